@@ -0,0 +1,384 @@
+/*
+    Audio captures (tape rips) for the host tools
+
+    The front end works in chunks of samples, with margins before and
+    after for the windows of each sample. The per sample steps (average,
+    block peaks) are simple loops over arrays that the compiler
+    vectorizes; only the comparator, with hysteresis, goes sample by
+    sample.
+
+    The signal is not rectified: after the AC coupling of a tape deck
+    the silence between the bits sits away from the average and the
+    ringing of a pulse can be larger than the pulse, so the comparator
+    follows a single polarity, the one of the first pulse after a long
+    silence, like the regenerator of PicoK7 (regen.c). The average is of
+    the samples before, so it does not move ahead of the first pulse.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio.h"
+
+#define READ_FRAMES   4096    // frames read from the file at a time
+
+#define CHUNK         65536   // samples processed at a time
+#define DC_WINDOW_MS  5.0     // window of the average removed from audio (before the sample)
+#define ENV_BLOCK_MS  1.0     // block of the envelope
+#define ENV_BLOCKS    10      // blocks before and after in the envelope
+#define FLOOR_MS      20.0    // block for the noise floor (longer than a bit)
+#define FLOOR_RANK    0.05    // fraction of the silent blocks below the noise floor
+#define FLOOR_SILENT  0.5     // silent blocks are below this fraction of the peak
+#define FLOOR_MAX     0.1     // noise floor used if there is no silence, fraction of the peak
+#define IDLE_MS       20.0    // silence that ends a program
+#define GLITCH_MS     0.075   // shorter pulses don't end the silence (half a pulse)
+#define MIN_LEVEL     2.0     // lowest threshold (2 LSB)
+
+static uint32_t get32 (const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void *alloc (size_t size) {
+    void *p = malloc(size);
+    if (p == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+// Open a capture and check the format
+bool audioOpen (AUDIO *a, const char *file) {
+    uint8_t hdr[12], chunk[8], fmt[16];
+    uint32_t size = 0;
+
+    memset(a, 0, sizeof(AUDIO));
+    a->f = fopen(file, "rb");
+    if (a->f == NULL) {
+        perror(file);
+        return false;
+    }
+    if ((fread(hdr, 1, 12, a->f) != 12) || (memcmp(hdr, "RIFF", 4) != 0) || (memcmp(hdr+8, "WAVE", 4) != 0)) {
+        fprintf(stderr, "%s: not a WAV file\n", file);
+        audioClose(a);
+        return false;
+    }
+    while (fread(chunk, 1, 8, a->f) == 8) {
+        uint32_t len = get32(chunk+4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if ((len < 16) || (fread(fmt, 1, 16, a->f) != 16)) {
+                break;
+            }
+            a->channels = fmt[2] | (fmt[3] << 8);
+            a->rate = get32(fmt+4);
+            a->bits = fmt[14] | (fmt[15] << 8);
+            fseek(a->f, len - 16 + (len & 1), SEEK_CUR);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            size = len;
+            break;
+        } else {
+            fseek(a->f, len + (len & 1), SEEK_CUR);
+        }
+    }
+    if ((size == 0) || (a->rate == 0) || (a->channels == 0) ||
+        ((a->bits != 8) && (a->bits != 16) && (a->bits != 24))) {
+        fprintf(stderr, "%s: unsupported WAV (PCM 8, 16 or 24 bits only)\n", file);
+        audioClose(a);
+        return false;
+    }
+    a->frames = size / (a->channels * a->bits / 8);
+    a->data = ftell(a->f);
+    a->buf = alloc(READ_FRAMES * a->channels * a->bits / 8);
+    return true;
+}
+
+// Read up to n samples of the first channel, in the scale of 16 bits
+// Returns the number of samples read
+size_t audioRead (AUDIO *a, float *x, size_t n) {
+    int frame = a->channels * a->bits / 8;
+    size_t total = 0;
+    while (total < n) {
+        size_t want = n - total;
+        if (want > READ_FRAMES) {
+            want = READ_FRAMES;
+        }
+        if (want > (a->frames - a->pos)) {
+            want = a->frames - a->pos;
+        }
+        size_t r = want ? fread(a->buf, frame, want, a->f) : 0;
+        if (r == 0) {
+            break;
+        }
+        for (size_t i = 0; i < r; i++) {
+            uint8_t *s = a->buf + i * frame;
+            if (a->bits == 8) {
+                x[total+i] = s[0] - 128.0f;
+            } else if (a->bits == 16) {
+                x[total+i] = (int16_t) (s[0] | (s[1] << 8));
+            } else {
+                x[total+i] = (int32_t) ((s[0] << 8) | (s[1] << 16) | ((uint32_t) s[2] << 24)) / 65536.0f;
+            }
+        }
+        total += r;
+        a->pos += r;
+    }
+    return total;
+}
+
+// Go back to the first sample
+bool audioRewind (AUDIO *a) {
+    a->pos = 0;
+    return fseek(a->f, a->data, SEEK_SET) == 0;
+}
+
+void audioClose (AUDIO *a) {
+    if (a->f != NULL) {
+        fclose(a->f);
+    }
+    free(a->buf);
+    memset(a, 0, sizeof(AUDIO));
+}
+
+
+// Front end
+//---------------------------
+
+void afeDefault (AFE_CONFIG *cfg) {
+    cfg->threshold = 0.3;
+    cfg->noise = 1.5;
+}
+
+static int cmpFloat (const void *a, const void *b) {
+    float x = *(const float *) a, y = *(const float *) b;
+    return (x > y) - (x < y);
+}
+
+// Read n samples to x, after the end repeat the last one (x[-1] if
+// there is nothing to read)
+static void afeFill (AFE *fe, float *x, size_t n) {
+    size_t r = audioRead(&fe->a, x, n);
+    float last = (r > 0) ? x[r-1] : x[-1];
+    for (size_t i = r; i < n; i++) {
+        x[i] = last;
+    }
+}
+
+// First pass: half of the peak to peak in FLOOR_MS blocks
+// The peak is the largest, the noise floor is a low rank of the silent
+// ones (a recording may have only a few seconds of silence)
+static bool afeFloor (AFE *fe) {
+    size_t nb = (size_t) (fe->a.rate * FLOOR_MS / 1000);
+    if (nb < 1) {
+        nb = 1;
+    }
+    size_t nblocks = fe->a.frames / nb;
+    if (nblocks == 0) {
+        return false;
+    }
+    float *x = alloc(nb * sizeof(float));
+    float *amp = alloc(nblocks * sizeof(float));
+    for (size_t b = 0; b < nblocks; b++) {
+        if (audioRead(&fe->a, x, nb) != nb) {
+            nblocks = b;
+            break;
+        }
+        float lo = x[0], hi = x[0];
+        for (size_t i = 1; i < nb; i++) {
+            lo = (x[i] < lo) ? x[i] : lo;
+            hi = (x[i] > hi) ? x[i] : hi;
+        }
+        amp[b] = (hi - lo) / 2;
+    }
+    free(x);
+    if (nblocks == 0) {
+        free(amp);
+        return false;
+    }
+    qsort(amp, nblocks, sizeof(float), cmpFloat);
+    fe->peak = amp[nblocks-1];
+    size_t silent = 0;
+    while ((silent < nblocks) && (amp[silent] < (FLOOR_SILENT * fe->peak))) {
+        silent++;
+    }
+    if (silent != 0) {
+        fe->noise = fe->floor = amp[(size_t) (silent * FLOOR_RANK)];
+    } else {
+        // all signal, the threshold cannot depend on the noise
+        fe->noise = amp[(size_t) (nblocks * FLOOR_RANK)];
+        fe->floor = FLOOR_MAX * fe->peak;
+    }
+    free(amp);
+    return audioRewind(&fe->a);
+}
+
+// Open a capture for the front end (does the first pass)
+bool afeOpen (AFE *fe, const char *file, const AFE_CONFIG *cfg) {
+    memset(fe, 0, sizeof(AFE));
+    fe->cfg = *cfg;
+    if (!audioOpen(&fe->a, file)) {
+        return false;
+    }
+    if (!afeFloor(fe)) {
+        fprintf(stderr, "%s: too short\n", file);
+        afeClose(fe);
+        return false;
+    }
+
+    // The margins cover the average and the envelope and, like the
+    // chunk, are whole blocks (x[margin] starts a block)
+    fe->block = (size_t) (fe->a.rate * ENV_BLOCK_MS / 1000);
+    if (fe->block < 1) {
+        fe->block = 1;
+    }
+    fe->dc = (size_t) (fe->a.rate * DC_WINDOW_MS / 1000);
+    if (fe->dc < 1) {
+        fe->dc = 1;
+    }
+    size_t nb = (fe->dc + fe->block - 1) / fe->block + ENV_BLOCKS + 1;
+    fe->margin = nb * fe->block;
+    size_t chunk = (CHUNK / fe->block) * fe->block;
+    fe->len = fe->margin + chunk + fe->margin;
+    fe->x = alloc(fe->len * sizeof(float));
+    fe->sum = alloc((fe->len + 1) * sizeof(double));
+    fe->amp = alloc(fe->len * sizeof(float));
+    fe->pk = alloc((fe->len / fe->block) * sizeof(float));
+    fe->pn = alloc((fe->len / fe->block) * sizeof(float));
+    fe->idle = (size_t) (fe->a.rate * IDLE_MS / 1000);
+    fe->glitch = (size_t) (fe->a.rate * GLITCH_MS / 1000);
+
+    // Before the start, repeat the first sample
+    fe->x[fe->margin-1] = 0.0f;
+    afeFill(fe, fe->x + fe->margin, fe->len - fe->margin);
+    for (size_t i = 0; i < fe->margin; i++) {
+        fe->x[i] = fe->x[fe->margin];
+    }
+    fe->base = 0;
+    fe->level = 0;
+    fe->pol = 0;
+    fe->quiet = fe->idle;
+    fe->width = 0;
+    return true;
+}
+
+// Process the next chunk, adding the level changes to w
+// now is the time at the end of the chunk (ns)
+// Returns false if there was nothing to process
+bool afeRun (AFE *fe, WAVE *w, uint64_t *now) {
+    size_t frames = fe->a.frames;
+    if (fe->base >= frames) {
+        return false;
+    }
+    size_t chunk = fe->len - 2*fe->margin;
+    size_t n = (frames - fe->base) < chunk ? frames - fe->base : chunk;
+    float *restrict x = fe->x;
+    float *restrict amp = fe->amp;
+    float *restrict pk = fe->pk;
+    float *restrict pn = fe->pn;
+    double *restrict sum = fe->sum;
+    size_t dc = fe->dc;
+    size_t len = fe->len;
+
+    // Remove the average (window ending at the sample)
+    sum[0] = 0.0;
+    for (size_t i = 0; i < len; i++) {
+        sum[i+1] = sum[i] + x[i];
+    }
+    double inv = 1.0 / dc;
+    for (size_t i = 0; i < (dc - 1); i++) {
+        amp[i] = 0.0f;
+    }
+    for (size_t i = dc - 1; i < len; i++) {
+        amp[i] = x[i] - (float) ((sum[i+1] - sum[i+1-dc]) * inv);
+    }
+
+    // Positive and negative peaks of each block
+    size_t nblocks = len / fe->block;
+    for (size_t b = 0; b < nblocks; b++) {
+        const float *a = amp + b * fe->block;
+        float hi = 0.0f, lo = 0.0f;
+        for (size_t i = 0; i < fe->block; i++) {
+            hi = (a[i] > hi) ? a[i] : hi;
+            lo = (a[i] < lo) ? a[i] : lo;
+        }
+        pk[b] = hi;
+        pn[b] = -lo;
+    }
+
+    // Compare with the thresholds of each block
+    float minimum = fe->cfg.noise * fe->floor;
+    if (minimum < MIN_LEVEL) {
+        minimum = MIN_LEVEL;
+    }
+    size_t first = fe->margin / fe->block;
+    size_t last = (fe->margin + n + fe->block - 1) / fe->block;
+    for (size_t b = first; b < last; b++) {
+        float on[2] = { 0.0f, 0.0f };
+        for (size_t k = b - ENV_BLOCKS; k <= (b + ENV_BLOCKS); k++) {
+            on[0] = (pk[k] > on[0]) ? pk[k] : on[0];
+            on[1] = (pn[k] > on[1]) ? pn[k] : on[1];
+        }
+        for (int p = 0; p < 2; p++) {
+            on[p] *= fe->cfg.threshold;
+            if (on[p] < minimum) {
+                on[p] = minimum;
+            }
+        }
+        size_t end = (b + 1) * fe->block;
+        if (end > (fe->margin + n)) {
+            end = fe->margin + n;
+        }
+        for (size_t i = b * fe->block; i < end; i++) {
+            // The polarity is kept while the signal goes on, after a
+            // long silence it is the one of the first pulse (a glitch
+            // in the silence could lock the wrong one)
+            if (!fe->level && (fe->quiet >= fe->idle)) {
+                if (amp[i] > on[0]) {
+                    fe->pol = 0;
+                } else if (-amp[i] > on[1]) {
+                    fe->pol = 1;
+                }
+            }
+            float s = fe->pol ? -amp[i] : amp[i];
+            float off = on[fe->pol] / 2;    // hysteresis, but above the noise
+            if (off < fe->floor) {
+                off = fe->floor;
+            }
+            int l = fe->level ? (s > off) : (s > on[fe->pol]);
+            if (l != fe->level) {
+                waveAdd(w, (uint64_t) ((fe->base + i - fe->margin) * 1e9 / fe->a.rate));
+                fe->level = l;
+                if (!l && (fe->width >= fe->glitch)) {
+                    fe->quiet = 0;
+                }
+                fe->width = 0;
+            }
+            if (l) {
+                fe->width++;
+            } else {
+                fe->quiet++;
+            }
+        }
+    }
+    fe->base += n;
+    *now = (uint64_t) (fe->base * 1e9 / fe->a.rate);
+
+    // The margins go to the start, read the next chunk
+    memmove(x, x + chunk, 2*fe->margin*sizeof(float));
+    afeFill(fe, x + 2*fe->margin, chunk);
+    return true;
+}
+
+void afeClose (AFE *fe) {
+    audioClose(&fe->a);
+    free(fe->x);
+    free(fe->sum);
+    free(fe->amp);
+    free(fe->pk);
+    free(fe->pn);
+    memset(fe, 0, sizeof(AFE));
+}
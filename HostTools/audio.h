@@ -0,0 +1,79 @@
+/*
+    Audio captures (tape rips) for the host tools
+
+    A capture is a PCM WAV file (8, 16 or 24 bits), the first channel
+    is used. It is read in blocks, so long captures don't need to fit
+    in memory.
+
+    The front end turns the audio into a digital waveform (signal
+    present or not), with an adaptive threshold: a fraction of the
+    local envelope of the polarity of the pulses, but never below a
+    multiple of the noise floor (the hiss between the programs), found
+    in a first pass.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#ifndef _AUDIO_H
+#define _AUDIO_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "waveform.h"
+
+typedef struct {
+    FILE *f;
+    uint32_t rate;      // samples/s
+    int channels;
+    int bits;
+    size_t frames;      // samples (of each channel) in the file
+    size_t pos;         // next sample
+    long data;          // offset of the first sample in the file
+    uint8_t *buf;
+} AUDIO;
+
+bool audioOpen (AUDIO *a, const char *file);
+size_t audioRead (AUDIO *a, float *x, size_t n);
+bool audioRewind (AUDIO *a);
+void audioClose (AUDIO *a);
+
+typedef struct {
+    double threshold;   // fraction of the envelope (default 0.3)
+    double noise;       // minimum threshold, multiple of the noise floor (default 1.5)
+} AFE_CONFIG;
+
+typedef struct {
+    AUDIO a;
+    AFE_CONFIG cfg;
+    float noise;        // noise floor found (half of the peak to peak in silence)
+    float floor;        // noise floor used (at most a fraction of the peak)
+    float peak;         // largest signal (half of the peak to peak)
+    size_t block;       // samples in an envelope block
+    size_t dc;          // samples in the DC window
+    size_t margin;      // samples before and after a chunk
+    size_t base;        // sample at x[0]
+    size_t len;         // samples in x
+    bool eof;
+    int level;          // signal present at the end of the last chunk
+    int pol;            // polarity of the pulses (1 = negative)
+    size_t quiet;       // samples without signal since the last pulse
+    size_t idle;        // silence that ends a program (samples)
+    size_t width;       // samples in the current pulse
+    size_t glitch;      // shorter pulses are glitches (samples)
+    float *x;           // chunk + margins
+    double *sum;        // prefix sums of x
+    float *amp;         // x - average
+    float *pk;          // positive peak of each block
+    float *pn;          // negative peak of each block
+} AFE;
+
+void afeDefault (AFE_CONFIG *cfg);
+bool afeOpen (AFE *fe, const char *file, const AFE_CONFIG *cfg);
+bool afeRun (AFE *fe, WAVE *w, uint64_t *now);
+void afeClose (AFE *fe);
+
+#endif
@@ -0,0 +1,348 @@
+/*
+    k7batch - recovers the ZX81 programs in audio captures of tapes
+
+    Usage: k7batch [-j jobs] [-d dir] [-t frac] [-n mult] [-z hz] [-q] file...
+        file is an audio capture (PCM WAV, 8, 16 or 24 bits); convert
+        other formats first (ex: flac -d rip.flac)
+        -j jobs files decoded at the same time (default: number of CPUs)
+        -d dir  where the programs are saved (default: current directory)
+        -t frac threshold, fraction of the local envelope (default 0.3)
+        -n mult minimum threshold, multiple of the noise floor (default 1.5)
+        -z hz   ZX81 clock (default 3250000)
+        -q      only the summary of each file
+
+    Each capture goes through the front end in audio.c and is split in
+    bursts of signal, separated by at least BURST_GAP_MS of silence.
+    Each burst is loaded like the ZX81 ROM does (zx81load.c); a program
+    that loads completely, with the same checks the firmware does in a
+    .P file (E_LINE and last byte 0x80), is saved as name-NN-TAPENAME.P
+    Bursts too small to be a program or where not a byte loads (the
+    hiss before and after the programs) are noise, not failures.
+
+    The confidence of a program is the smallest margin of its bits to
+    the limits of the ROM (counter loop and silence inside the bit), as
+    a fraction of the widest margin possible, lowered by the noise bits
+    (ignored by the ROM). The confidence of a file is the lowest of its
+    programs (0 if no program was recovered).
+
+    The exit code is 0 if all the files gave programs and all the
+    bursts loaded, 2 otherwise.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+#include <limits.h>
+
+#include "waveform.h"
+#include "audio.h"
+#include "zx81load.h"
+
+#define BURST_GAP_MS   500     // silence between bursts (bits are < 2ms apart)
+#define BURST_LEAD_US  1000    // silence before a burst, for the decoder
+#define BURST_MIN      128     // smaller bursts (in edges) are noise
+#define REPORT_SIZE    8192
+
+static const char *outdir = ".";
+static AFE_CONFIG afe_cfg;
+static ZXL_CONFIG zxl_cfg;
+static bool quiet;
+
+// Files to decode (each worker takes the next one)
+static char **files;
+static int nfiles, next_file;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Totals
+static int ok_files, programs, bad_bursts;
+static double audio_s;
+
+// Result of a file
+typedef struct {
+    const char *file;
+    char text[REPORT_SIZE];
+    size_t len;
+    int programs;       // saved
+    int bad;            // bursts that did not load
+    int noise;          // bursts where nothing loaded
+    double conf;        // lowest confidence
+} REPORT;
+
+static void usage (void) {
+    fprintf(stderr, "Usage: k7batch [-j jobs] [-d dir] [-t frac] [-n mult] [-z hz] [-q] file...\n");
+    exit(1);
+}
+
+static double now_s (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Add a line to a report
+static void say (REPORT *rp, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    if (rp->len < sizeof(rp->text)) {
+        int n = vsnprintf(rp->text + rp->len, sizeof(rp->text) - rp->len, fmt, ap);
+        if (n > 0) {
+            rp->len += n;
+        }
+    }
+    va_end(ap);
+}
+
+// Confidence of a loaded program (0 to 1)
+static double confidence (const ZXL_RESULT *r) {
+    double c0 = r->margin[0] == INT_MAX ? 1.0 : r->margin[0] / ((ZXL_BIT0_MAX - ZXL_BIT0_MIN) / 2.0);
+    double c1 = r->margin[1] == INT_MAX ? 1.0 : r->margin[1] / ((ZXL_BIT1_MAX - ZXL_BIT1_MIN) / 2.0);
+    double cg = r->gap_margin / (double) ZXL_SILENCE;
+    double c = c0 < c1 ? c0 : c1;
+    c = c < cg ? c : cg;
+    c = c < 0 ? 0 : c > 1 ? 1 : c;
+    return c * r->bits / (r->bits + r->noise);
+}
+
+// Save a program as base-NN-NAME.P
+static bool save (const char *file, int n, const ZXL_RESULT *r, char *out, size_t size) {
+    char name[ZXL_MAX_NAME+1], base[256];
+    const char *p = strrchr(file, '/');
+    snprintf(base, sizeof(base), "%s", p ? p+1 : file);
+    char *ext = strrchr(base, '.');
+    if (ext != NULL) {
+        *ext = 0;
+    }
+    zxlNameStr(r->name, r->name_len, name);
+    char *d = name;
+    for (char *s = name; *s; s++) {
+        if (((*s >= 'A') && (*s <= 'Z')) || ((*s >= '0') && (*s <= '9'))) {
+            *d++ = *s;
+        }
+    }
+    *d = 0;
+    snprintf(out, size, "%s/%s-%02d%s%s.P", outdir, base, n, name[0] ? "-" : "", name);
+    FILE *f = fopen(out, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fwrite(r->data, 1, r->prog_len, f) == (size_t) r->prog_len;
+    return (fclose(f) == 0) && ok;
+}
+
+// Load the programs in a burst (the edges in w, that start at a rising
+// edge); a burst may have more than one program, if the gap between
+// them is short
+static void decodeBurst (REPORT *rp, WAVE *w, uint64_t end, ZXL_RESULT *r) {
+    size_t first = 0;
+    while ((w->n - first) >= BURST_MIN) {
+        uint64_t t0 = w->t[first];
+        uint64_t shift = t0 > (BURST_LEAD_US * 1000ull) ? t0 - BURST_LEAD_US * 1000ull : 0;
+        WAVE b = { 0, w->t + first, w->n - first, w->n - first, end - shift };
+        for (size_t i = 0; i < b.n; i++) {
+            b.t[i] -= shift;
+        }
+        ZXL_STATUS st = zxlDecode(&b, &zxl_cfg, r);
+        for (size_t i = 0; i < b.n; i++) {
+            b.t[i] += shift;
+        }
+
+        char name[ZXL_MAX_NAME+1];
+        zxlNameStr(r->name, r->name_len, name);
+        if (st == ZXL_OK) {
+            char out[512];
+            double c = confidence(r);
+            rp->programs++;
+            if (c < rp->conf) {
+                rp->conf = c;
+            }
+            if (!save(rp->file, rp->programs, r, out, sizeof(out))) {
+                perror(out);
+                rp->bad++;
+            } else if (!quiet) {
+                say(rp, "  %9.3f s  %-12s %5d bytes  conf %3.0f%%  %s\n",
+                    t0 / 1e9, name, r->prog_len, 100 * c, out);
+            }
+        } else if ((r->name_len == 0) && (r->data_len == 0)) {
+            rp->noise++;
+        } else {
+            rp->bad++;
+            if (!quiet) {
+                say(rp, "  %9.3f s  %-12s %5d bytes  %s\n", t0 / 1e9, name, r->data_len, zxlStatusStr(st));
+            }
+        }
+        if ((st == ZXL_NO_SIGNAL) || (st == ZXL_TRUNCATED)) {
+            break;
+        }
+
+        // Go on after the end of the program (on a rising edge)
+        size_t last = first;
+        uint64_t t_end = r->t_end + shift;
+        while ((first < w->n) && (w->t[first] <= t_end)) {
+            first++;
+        }
+        first += first & 1;
+        if (first == last) {
+            break;
+        }
+    }
+}
+
+// Decode a capture
+static bool decodeFile (REPORT *rp, ZXL_RESULT *r) {
+    AFE fe;
+    WAVE w;
+    uint64_t now = 0;
+    double t = now_s();
+
+    rp->conf = 1.0;
+    if (!afeOpen(&fe, rp->file, &afe_cfg)) {
+        return false;
+    }
+    waveInit(&w, 0);
+    while (true) {
+        bool more = afeRun(&fe, &w, &now);
+        // a burst ends in silence (even number of edges)
+        bool gap = (w.n > 0) && ((w.n & 1) == 0) && ((now - w.t[w.n-1]) >= (BURST_GAP_MS * 1000000ull));
+        if (gap || (!more && (w.n > 0))) {
+            if (w.n >= BURST_MIN) {
+                decodeBurst(rp, &w, now, r);
+            } else {
+                rp->noise++;
+            }
+            w.n = 0;
+        }
+        if (!more) {
+            break;
+        }
+    }
+    double secs = fe.a.frames / (double) fe.a.rate;
+    double elapsed = now_s() - t;
+    float snr = fe.noise > 0 ? 20 * log10f(fe.peak / fe.noise) : 99.0f;
+    afeClose(&fe);
+    waveFree(&w);
+    if (rp->programs == 0) {
+        rp->conf = 0;
+    }
+
+    // The summary goes before the programs
+    char head[512];
+    int n = snprintf(head, sizeof(head), "%s: %.1f s, SNR %.0f dB, %d programs, %d failed, %d noise bursts, "
+                     "conf %.0f%%, %.2f s (%.0fx)\n", rp->file, secs, snr, rp->programs, rp->bad, rp->noise,
+                     100 * rp->conf, elapsed, elapsed > 0 ? secs / elapsed : 0.0);
+    if ((n > 0) && ((rp->len + n) < sizeof(rp->text))) {
+        memmove(rp->text + n, rp->text, rp->len + 1);
+        memcpy(rp->text, head, n);
+        rp->len += n;
+    }
+    pthread_mutex_lock(&lock);
+    audio_s += secs;
+    pthread_mutex_unlock(&lock);
+    return true;
+}
+
+// Worker thread: decodes files until there are no more
+static void *worker (void *arg) {
+    (void) arg;
+    ZXL_RESULT *r = malloc(sizeof(ZXL_RESULT));
+    REPORT *rp = malloc(sizeof(REPORT));
+    if ((r == NULL) || (rp == NULL)) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    while (true) {
+        pthread_mutex_lock(&lock);
+        int i = next_file++;
+        pthread_mutex_unlock(&lock);
+        if (i >= nfiles) {
+            break;
+        }
+        memset(rp, 0, sizeof(REPORT));
+        rp->file = files[i];
+        bool ok = decodeFile(rp, r);
+        pthread_mutex_lock(&lock);
+        fputs(rp->text, stdout);
+        fflush(stdout);
+        if (ok && (rp->programs > 0) && (rp->bad == 0)) {
+            ok_files++;
+        }
+        programs += rp->programs;
+        bad_bursts += rp->bad;
+        pthread_mutex_unlock(&lock);
+    }
+    free(r);
+    free(rp);
+    return NULL;
+}
+
+int main (int argc, char *argv[]) {
+    int jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    afeDefault(&afe_cfg);
+    zxlDefault(&zxl_cfg);
+    zxl_cfg.pulse_level = 1;    // the front end gives 1 when there is signal
+    while ((opt = getopt(argc, argv, "j:d:t:n:z:q")) != -1) {
+        switch (opt) {
+            case 'j':
+                jobs = atoi(optarg);
+                break;
+            case 'd':
+                outdir = optarg;
+                break;
+            case 't':
+                afe_cfg.threshold = atof(optarg);
+                break;
+            case 'n':
+                afe_cfg.noise = atof(optarg);
+                break;
+            case 'z':
+                zxl_cfg.clock_hz = atof(optarg);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                usage();
+        }
+    }
+    if ((optind >= argc) || (zxl_cfg.clock_hz <= 0) || (afe_cfg.threshold <= 0)) {
+        usage();
+    }
+    files = argv + optind;
+    nfiles = argc - optind;
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    if (jobs > nfiles) {
+        jobs = nfiles;
+    }
+
+    double t = now_s();
+    pthread_t *th = malloc(jobs * sizeof(pthread_t));
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&th[i], NULL, worker, NULL) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    for (int i = 0; i < jobs; i++) {
+        pthread_join(th[i], NULL);
+    }
+    free(th);
+    double elapsed = now_s() - t;
+
+    printf("\n%d files (%d without errors), %d programs, %d bursts failed\n",
+           nfiles, ok_files, programs, bad_bursts);
+    printf("%.1f s of audio in %.2f s with %d jobs (%.0fx real time)\n",
+           audio_s, elapsed, jobs, elapsed > 0 ? audio_s / elapsed : 0.0);
+    return ((ok_files == nfiles) && (bad_bursts == 0)) ? 0 : 2;
+}
@@ -0,0 +1,465 @@
+/*
+    k7bus - checks the timing of the RAM pack mode against the ZX81 bus
+
+    Usage: k7bus [-f MHz] [-d ns] [-m] [-v] [file.P...]
+        -f MHz  system clock of the Pico (default the one in rampack.h)
+        -d ns   delay of the bus buffers, each way (default 8)
+        -m      also find the slowest system clock that passes
+        -v      show the cycles that fail
+        file.P  run the display of the program and, if it can be
+                packed, its packed loader from the pack (besides the
+                built-in test)
+
+    The Z80 (z80.c) runs code from the pack and its bus cycles are put
+    on a time line with the delays of a Z80A at 3.25 MHz (the worst case
+    in the data sheet). The two state machines of rampack.pio are
+    followed on the same time line, with the cycle counts in rampack.h,
+    and these are checked:
+        read    the byte is on the bus before the Z80 samples it
+        rd      RD is low when the state machine tests it
+        free    the data bus is released before the next cycle
+        write   the byte is sampled while it is on the bus
+        raw     a write is in the memory before the next read
+        miss    the state machines are waiting when a cycle starts
+    The margins are in ns, a negative one is a violation.
+
+    The exit code is 0 if all the checks passed, 2 otherwise.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "rampack.h"
+#include "pack.h"
+#include "z80.h"
+
+#define MAX_SIZE        (16*1024)
+#define MAX_CYCLES      2000000
+#define MAX_STEPS       2000000
+
+// Z80A at 3.25 MHz (ns, max delays from the clock edges)
+#define T_NS            (1e9/3250000)
+#define MREQ_FALL       85      // from the falling edge of T1
+#define MREQ_RISE       85
+#define WR_FALL         80      // from the falling edge of T2
+#define WR_RISE         80
+#define DATA_OUT        150     // write data from the falling edge of T1
+#define SETUP_M1        35      // to the rising edge of T3
+#define SETUP_RD        50      // to the falling edge of T3
+
+#define RAMTOP          0x8000
+#define RET_ADDR        0x0001
+#define ROM_SLOW_FAST   0x0207
+#define ROM_SET_FAST    0x02E7
+#define DISPLAY_I       0x1E    // I register of the ZX81 (refresh addresses)
+
+typedef enum { C_M1, C_RFSH, C_RD, C_WR, C_IORD, C_IOWR } CYCLE_KIND;
+static const char *kind_name[] = { "M1", "RFSH", "RD", "WR", "IORD", "IOWR" };
+
+typedef struct {
+    uint64_t t;         // T-state of the start
+    uint16_t addr;
+    uint8_t kind;
+} CYCLE;
+
+typedef enum { K_READ, K_RD, K_FREE, K_WRITE, K_RAW, K_MISS, K_COUNT } CHECK;
+static const char *check_name[] = { "read", "rd", "free", "write", "raw", "miss" };
+
+typedef struct {
+    int n, fail;
+    double worst;
+    uint64_t worst_t;
+} RESULT;
+
+static double d_ns = 8;
+static bool verbose;
+
+static uint8_t mem[0x10000];
+static CYCLE *cycles;
+static int ncycles;
+
+// Built-in test (at 16514): block moves, read-modify-write, the stack
+// and a write followed by the fetch of the same byte
+static const uint8_t test_code[] = {
+    0x21, 0x00, 0x42,       // LD HL,4200h
+    0x11, 0x00, 0x44,       // LD DE,4400h
+    0x01, 0x00, 0x01,       // LD BC,0100h
+    0xED, 0xB0,             // LDIR
+    0x21, 0x00, 0x43,       // LD HL,4300h
+    0x06, 0x00,             // LD B,0
+    0x34,                   // INC (HL)
+    0x23,                   // INC HL
+    0x10, 0xFC,             // DJNZ -4
+    0x31, 0x00, 0x7F,       // LD SP,7F00h
+    0xE5,                   // PUSH HL
+    0xE3,                   // EX (SP),HL
+    0xE1,                   // POP HL
+    0x3A, 0x00, 0x44,       // LD A,(4400h)
+    0x32, 0x00, 0x45,       // LD (4500h),A
+    0x3E, 0x00,             // LD A,0
+    0x32, 0xA7, 0x40,       // LD (40A7h),A  (the next byte)
+    0x76,                   // HALT, changed to NOP
+    0x76                    // HALT
+};
+
+static void usage (void) {
+    fprintf(stderr, "Usage: k7bus [-f MHz] [-d ns] [-m] [-v] [file.P...]\n");
+    exit(1);
+}
+
+static void record (uint64_t t, uint16_t addr, CYCLE_KIND kind) {
+    if (ncycles < MAX_CYCLES) {
+        cycles[ncycles].t = t;
+        cycles[ncycles].addr = addr;
+        cycles[ncycles].kind = kind;
+        ncycles++;
+    }
+}
+
+// Memory of a 16K ZX81, the pack mirrored at 0xC000
+static uint8_t busRead (Z80 *z, uint16_t addr, Z80_CYCLE kind) {
+    if (kind == Z80_IO) {
+        record(z->t, addr, C_IORD);
+        return 0xFF;
+    }
+    if (kind == Z80_M1) {
+        record(z->t, addr, C_M1);
+        record(z->t+2, (z->i << 8) | z->refresh, C_RFSH);
+    } else {
+        record(z->t, addr, C_RD);
+    }
+    uint8_t v = mem[addr & 0x7FFF];
+    if ((kind == Z80_M1) && (addr & 0x8000)) {
+        v = (v & 0x40) ? v : 0;     // the display: the ULA forces NOPs
+    }
+    return v;
+}
+
+static void busWrite (Z80 *z, uint16_t addr, uint8_t val, Z80_CYCLE kind) {
+    if (kind == Z80_IO) {
+        record(z->t, addr, C_IOWR);
+        return;
+    }
+    record(z->t, addr, C_WR);
+    if (addr & 0x4000) {
+        mem[addr & 0x7FFF] = val;
+    }
+}
+
+static void setup (Z80 *z, uint16_t pc) {
+    z80Reset(z);
+    z->read = busRead;
+    z->write = busWrite;
+    z->i = DISPLAY_I;
+    z->iy = 0x4000;
+    z->sp = RAMTOP - 0x20;
+    mem[--z->sp] = RET_ADDR >> 8;
+    mem[--z->sp] = RET_ADDR & 0xFF;
+    z->pc = pc;
+    ncycles = 0;
+}
+
+// Run from pc to RET_ADDR or a HALT (ROM calls just return)
+static bool run (Z80 *z) {
+    for (int i = 0; (z->pc != RET_ADDR) && !z->halted; i++) {
+        if ((z->pc == ROM_SET_FAST) || (z->pc == ROM_SLOW_FAST)) {
+            z->pc = mem[z->sp] | (mem[z->sp+1] << 8);
+            z->sp += 2;
+            continue;
+        }
+        if ((i == MAX_STEPS) || (z->pc < 0x4000) || (z80Step(z) < 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Display of the 24 lines of D_FILE (M1 cycles at D_FILE+0x8000)
+static bool display (Z80 *z) {
+    uint16_t p = (mem[0x400C] | (mem[0x400D] << 8)) + 1;
+    setup(z, p | 0x8000);
+    for (int line = 0; line < 24; line++) {
+        for (int n = 0; !z->halted; n++) {
+            if ((n > 33) || (z80Step(z) < 0)) {
+                return false;
+            }
+        }
+        z->halted = false;
+        z->pc = (z->pc + 1) | 0x8000;
+        z->t += 4 * 10;     // back porch and the INT
+    }
+    return true;
+}
+
+static void check (RESULT *r, CHECK k, double margin, const CYCLE *c) {
+    RESULT *p = &r[k];
+    if ((p->n == 0) || (margin < p->worst)) {
+        p->worst = margin;
+        p->worst_t = c->t;
+    }
+    p->n++;
+    if (margin < 0) {
+        p->fail++;
+        if (verbose) {
+            printf("    T=%-9llu %-4s %04X %-5s %+.0f ns\n", (unsigned long long) c->t,
+                   kind_name[c->kind], c->addr, check_name[k], margin);
+        }
+    }
+}
+
+// Follow the state machines over the recorded cycles at f MHz
+static bool evaluate (double mhz, RESULT *r) {
+    const double cy = 1000.0 / mhz;
+    const double sync = RP_SYNC * cy;
+    double rd_ready = 0, wr_ready = 0;  // state machines waiting the next cycle
+    double commit = 0;                  // last write in the memory
+    bool written = false;
+    memset(r, 0, K_COUNT * sizeof(RESULT));
+
+    for (int i = 0; i < ncycles; i++) {
+        const CYCLE *c = &cycles[i];
+        double t0 = c->t * T_NS;
+        bool pack = (c->addr & 0x4000) != 0;
+
+        // Start of the next cycle that can drive the data bus
+        double next = 1e18;
+        for (int j = i+1; j < ncycles; j++) {
+            if (cycles[j].kind != C_RFSH) {
+                next = cycles[j].t * T_NS + T_NS/2;
+                break;
+            }
+        }
+
+        // Edges of the cycle (at the Pico, after the buffers)
+        double lo, hi, sample = 0, wr_lo = 0, wr_hi = 0, data = 0;
+        switch (c->kind) {
+            case C_M1:
+                lo = t0 + T_NS/2 + MREQ_FALL;
+                hi = t0 + 2*T_NS + MREQ_RISE;
+                sample = t0 + 2*T_NS - SETUP_M1;
+                break;
+            case C_RFSH:
+                lo = t0 + T_NS/2 + MREQ_FALL;
+                hi = t0 + 1.5*T_NS + MREQ_RISE;
+                break;
+            case C_RD:
+                lo = t0 + T_NS/2 + MREQ_FALL;
+                hi = t0 + 2.5*T_NS + MREQ_RISE;
+                sample = t0 + 2.5*T_NS - SETUP_RD;
+                break;
+            case C_WR:
+                lo = t0 + T_NS/2 + MREQ_FALL;
+                hi = t0 + 2.5*T_NS + MREQ_RISE;
+                data = t0 + T_NS/2 + DATA_OUT;
+                wr_lo = t0 + 1.5*T_NS + WR_FALL;
+                wr_hi = t0 + 2.5*T_NS;          // earliest
+                break;
+            case C_IOWR:
+                wr_lo = t0 + T_NS + WR_FALL;
+                wr_hi = t0 + 3.5*T_NS + WR_RISE;
+                // fall through
+            default:
+                lo = hi = 0;
+                break;
+        }
+
+        // rampack_read: every MREQ
+        if ((c->kind == C_M1) || (c->kind == C_RFSH) || (c->kind == C_RD) || (c->kind == C_WR)) {
+            double seen = lo + d_ns + sync;
+            double hi_seen = hi + d_ns + sync;
+            bool serve = pack && ((c->kind == C_M1) || (c->kind == C_RD));
+            if (serve || (c->kind == C_WR)) {
+                check(r, K_MISS, seen - rd_ready, c);
+            }
+            if (rd_ready > seen) {
+                seen = rd_ready;
+            }
+            double end = seen + 5*cy;   // A14 tested
+            if (pack) {
+                double push = seen + RP_READ_PUSH*cy;
+                double byte = push + RP_DMA*cy;
+                if (written) {
+                    check(r, K_RAW, push - commit, c);
+                }
+                if (serve) {
+                    double drive = byte + RP_READ_DRIVE*cy;
+                    check(r, K_RD, byte + RP_READ_TEST*cy - seen, c);   // RD falls with MREQ
+                    check(r, K_READ, sample - (drive + d_ns), c);
+                    double free = (drive > hi_seen ? drive : hi_seen) + RP_READ_FREE*cy;
+                    if (next < 1e18) {
+                        check(r, K_FREE, next - (free + d_ns), c);
+                    }
+                    end = free;
+                } else {
+                    end = byte + RP_READ_TEST*cy;
+                }
+            }
+            rd_ready = (end > hi_seen ? end : hi_seen) + RP_LOOP*cy;
+        }
+
+        // rampack_write: every WR
+        if ((c->kind == C_WR) || (c->kind == C_IOWR)) {
+            double seen = wr_lo + d_ns + sync;
+            double hi_seen = wr_hi + d_ns + sync;
+            check(r, K_MISS, seen - wr_ready, c);
+            if (wr_ready > seen) {
+                seen = wr_ready;
+            }
+            double end = seen + 2*cy;
+            if ((c->kind == C_WR) && pack) {
+                double s = seen + (RP_WRITE_DATA - RP_SYNC)*cy;   // pins as seen by the instruction
+                double m1 = s - (data + d_ns);
+                double m2 = (wr_hi + d_ns) - s;
+                check(r, K_WRITE, m1 < m2 ? m1 : m2, c);
+                end = seen + RP_WRITE_PUSH*cy;
+                commit = end + RP_DMA*cy;
+                written = true;
+            }
+            wr_ready = (end > hi_seen ? end : hi_seen) + RP_LOOP*cy;
+        }
+    }
+
+    for (int k = 0; k < K_COUNT; k++) {
+        if (r[k].fail) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check the recorded cycles, returns true if all passed
+static bool report (const char *name, double mhz, bool slowest) {
+    RESULT r[K_COUNT];
+    int npack = 0;
+    for (int i = 0; i < ncycles; i++) {
+        if ((cycles[i].addr & 0x4000) && (cycles[i].kind != C_RFSH) && (cycles[i].kind <= C_WR)) {
+            npack++;
+        }
+    }
+    printf("%s: %d bus cycles, %d of the pack\n", name, ncycles, npack);
+    bool ok = evaluate(mhz, r);
+    for (int k = 0; k < K_COUNT; k++) {
+        if (r[k].n == 0) {
+            continue;
+        }
+        printf("    %-5s %7d  worst %+6.0f ns at T=%llu", check_name[k], r[k].n,
+               r[k].worst, (unsigned long long) r[k].worst_t);
+        if (r[k].fail) {
+            printf("  %d FAILED", r[k].fail);
+        }
+        printf("\n");
+    }
+    if (slowest) {
+        bool save = verbose;
+        verbose = false;
+        int f;
+        for (f = 10; (f <= 400) && !evaluate(f, r); f++) {
+        }
+        verbose = save;
+        if (f <= 400) {
+            printf("    slowest clock that passes: %d MHz\n", f);
+        } else {
+            printf("    fails at any clock\n");
+        }
+    }
+    return ok;
+}
+
+// Read a .P file in the memory, returns the size (0 if invalid)
+static uint32_t readP (const char *file, uint8_t *p) {
+    FILE *f = fopen(file, "rb");
+    if (f == NULL) {
+        perror(file);
+        return 0;
+    }
+    size_t n = fread(p, 1, MAX_SIZE, f);
+    fclose(f);
+    if ((n <= 116) || (p[0] != 0)) {
+        return 0;
+    }
+    uint32_t size = (p[11] | (p[12] << 8)) - PACK_BASE;
+    if ((size > n) || (size <= 116) || (p[size-1] != 0x80)) {
+        return 0;
+    }
+    return size;
+}
+
+int main (int argc, char *argv[]) {
+    double mhz = RP_CLK_KHZ / 1000.0;
+    bool slowest = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:d:mv")) != -1) {
+        switch (opt) {
+            case 'f': mhz = atof(optarg); break;
+            case 'd': d_ns = atof(optarg); break;
+            case 'm': slowest = true; break;
+            case 'v': verbose = true; break;
+            default: usage();
+        }
+    }
+    if (mhz <= 0) {
+        usage();
+    }
+    cycles = malloc(MAX_CYCLES * sizeof(CYCLE));
+    if (cycles == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    printf("System clock %.1f MHz, buffers %.0f ns, Z80A at 3.25 MHz\n", mhz, d_ns);
+    bool ok = true;
+    Z80 z;
+
+    memset(mem, 0, sizeof(mem));
+    memcpy(mem + PACK_USR, test_code, sizeof(test_code));
+    setup(&z, PACK_USR);
+    if (!run(&z)) {
+        fprintf(stderr, "Built-in test did not end\n");
+        return 2;
+    }
+    ok &= report("built-in test", mhz, slowest);
+
+    static uint8_t img[MAX_SIZE], loader[MAX_SIZE];
+    for (int i = optind; i < argc; i++) {
+        const char *file = argv[i];
+        char name[600];
+        uint32_t size = readP(file, img);
+        if (size == 0) {
+            fprintf(stderr, "%s: not a valid .P file\n", file);
+            ok = false;
+            continue;
+        }
+        memset(mem, 0, sizeof(mem));
+        memcpy(mem + PACK_BASE, img, size);
+        if (!display(&z)) {
+            fprintf(stderr, "%s: invalid display file\n", file);
+            ok = false;
+            continue;
+        }
+        snprintf(name, sizeof(name), "%s (display)", file);
+        ok &= report(name, mhz, slowest);
+
+        uint32_t len = packImage(img, size, loader, sizeof(loader));
+        if (len != 0) {
+            memset(mem, 0, sizeof(mem));
+            memcpy(mem + PACK_BASE, loader, len);
+            mem[0x4004] = RAMTOP & 0xFF;
+            mem[0x4005] = RAMTOP >> 8;
+            setup(&z, PACK_USR);
+            if (!run(&z)) {
+                fprintf(stderr, "%s: loader did not return\n", file);
+                ok = false;
+                continue;
+            }
+            snprintf(name, sizeof(name), "%s (packed loader)", file);
+            ok &= report(name, mhz, slowest);
+        }
+    }
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,356 @@
+/*
+    k7cap - captures EAR and MIC with PicoK7 over USB (CDC)
+
+    Usage: k7cap [-r rate] [-n samples] [-t secs] [-w bytes] [-o file] port
+        -r  samples per second (default 250000)
+        -n  stop after the given number of samples
+        -t  stop after the given time (default: Ctrl-C stops)
+        -w  credit given to the device (default 16384); a small one
+            shows what happens when the host is slow
+        -o  output file (default capture.vcd):
+            .vcd  VCD, for PulseView, sigrok-cli, GTKWave or k7decode
+            .bin  one byte per sample, bit 0 EAR and bit 1 MIC, for
+                  sigrok-cli -I binary:numchannels=2:samplerate=rate
+        port is the serial port of the PicoK7 (ex: /dev/ttyACM0), in
+        the USB capture option, or the pty created by k7loop
+
+    The stream is described in PicoK7/capproto.h. The samples lost by
+    the device (if the host is too slow) are 'x' in the VCD and repeat
+    the last levels in the binary file.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+
+#include "upproto.h"
+#include "capproto.h"
+
+#define WINDOW        16384   // default credit given at the start
+#define MIN_CREDIT    4096    // don't send small credits...
+#define CREDIT_MS     1000    // ...but send something this often
+
+static int port;
+static UP_PARSER parser;
+static CAP_DEC dec;
+static volatile bool stop;
+
+static FILE *fout;
+static bool vcd;
+static uint32_t rate;
+static uint64_t t_sample;       // samples written
+static int levels = -1;         // last levels written
+static uint64_t n_runs, n_gaps;
+
+static const char *status_msg[] = {
+    "OK", "protocol error", "invalid file", "SD card error", "aborted", "timeout"
+};
+
+static void onSignal (int sig) {
+    (void) sig;
+    stop = true;
+}
+
+// Current time in seconds
+static double now (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Open the serial port in raw mode
+static int openPort (const char *path) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetspeed(&tio, B115200);  // ignored by USB CDC
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+// Send a frame
+static bool sendFrame (uint8_t type, const uint8_t *payload, int len) {
+    uint8_t frame[UP_MAX_FRAME];
+    int n = upFrame(frame, type, payload, len);
+    for (int i = 0; i < n; ) {
+        ssize_t w = write(port, frame+i, n-i);
+        if (w <= 0) {
+            perror("write");
+            return false;
+        }
+        i += w;
+    }
+    return true;
+}
+
+// Give credit to the device
+static bool sendCredit (uint32_t n) {
+    uint8_t aux[4];
+    upPut32(aux, n);
+    return sendFrame(CAP_CREDIT, aux, 4);
+}
+
+// Wait for a frame from the device
+// Text outside frames (debug messages) is ignored
+// Returns the frame type, UP_NONE on timeout or UP_BAD on error
+static int getFrame (int timeout_ms) {
+    static uint8_t buf[4096];
+    static int nbuf, pbuf;
+
+    while (true) {
+        while (pbuf < nbuf) {
+            uint8_t c = buf[pbuf++];
+            int type = upParse(&parser, c);
+            if (type != UP_NONE) {
+                return type;
+            }
+        }
+        struct pollfd pfd = { port, POLLIN, 0 };
+        int r = poll(&pfd, 1, timeout_ms);
+        if (r == 0) {
+            return UP_NONE;
+        }
+        if (r < 0) {
+            if (stop) {
+                return UP_NONE;
+            }
+            perror("poll");
+            return UP_BAD;
+        }
+        ssize_t n = read(port, buf, sizeof(buf));
+        if (n <= 0) {
+            fprintf(stderr, "Device disconnected\n");
+            return UP_BAD;
+        }
+        nbuf = n;
+        pbuf = 0;
+    }
+}
+
+// Time of sample s in the VCD (ns)
+static unsigned long long vcdTime (uint64_t s) {
+    return (unsigned long long) ((double) s * 1e9 / rate + 0.5);
+}
+
+// Start of the output file
+static void outStart (void) {
+    if (vcd) {
+        fprintf(fout, "$comment k7cap %u samples/s $end\n", rate);
+        fprintf(fout, "$timescale 1ns $end\n");
+        fprintf(fout, "$scope module picok7 $end\n$var wire 1 ! EAR $end\n$var wire 1 \" MIC $end\n$upscope $end\n");
+        fprintf(fout, "$enddefinitions $end\n");
+    }
+}
+
+// n samples with levels lv
+static void outRun (uint32_t n, int lv) {
+    if (vcd) {
+        if (lv != levels) {
+            fprintf(fout, "#%llu\n", vcdTime(t_sample));
+            if ((levels < 0) || ((lv ^ levels) & 1)) {
+                fprintf(fout, "%d!\n", lv & 1);
+            }
+            if ((levels < 0) || ((lv ^ levels) & 2)) {
+                fprintf(fout, "%d\"\n", (lv >> 1) & 1);
+            }
+        }
+    } else {
+        uint8_t buf[4096];
+        memset(buf, lv, sizeof(buf));
+        for (uint32_t left = n; left > 0; ) {
+            uint32_t k = left > sizeof(buf) ? sizeof(buf) : left;
+            fwrite(buf, 1, k, fout);
+            left -= k;
+        }
+    }
+    levels = lv;
+    t_sample += n;
+}
+
+// n samples lost
+static void outGap (uint32_t n) {
+    if (vcd) {
+        fprintf(fout, "#%llu\nx!\nx\"\n", vcdTime(t_sample));
+        t_sample += n;
+        levels = -1;    // both are written at the next run
+    } else {
+        outRun(n, levels < 0 ? 0 : levels);
+    }
+}
+
+// End of the output file
+static void outEnd (void) {
+    if (vcd) {
+        fprintf(fout, "#%llu\n", vcdTime(t_sample));
+    }
+    fclose(fout);
+}
+
+int main (int argc, char *argv[]) {
+    uint32_t req_rate = 250000;
+    double secs = 0;
+    uint32_t limit = 0;
+    const char *file = "capture.vcd";
+    uint32_t window = WINDOW;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:n:t:w:o:")) != -1) {
+        switch (opt) {
+            case 'r':
+                req_rate = atoi(optarg);
+                break;
+            case 'n':
+                limit = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                secs = atof(optarg);
+                break;
+            case 'w':
+                window = strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                file = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r rate] [-n samples] [-t secs] [-w bytes] [-o file] port\n", argv[0]);
+                return 1;
+        }
+    }
+    if ((argc - optind) != 1) {
+        fprintf(stderr, "Usage: %s [-r rate] [-n samples] [-t secs] [-w bytes] [-o file] port\n", argv[0]);
+        return 1;
+    }
+    const char *ext = strrchr(file, '.');
+    vcd = (ext == NULL) || (strcasecmp(ext, ".bin") != 0);
+    if ((secs > 0) && (limit == 0)) {
+        limit = (uint32_t) (secs * req_rate);
+    }
+
+    port = openPort(argv[optind]);
+    if (port < 0) {
+        return 1;
+    }
+    fout = fopen(file, vcd ? "w" : "wb");
+    if (fout == NULL) {
+        perror(file);
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    upInit(&parser);
+    capDecInit(&dec);
+
+    // Start the capture
+    uint8_t start[8];
+    upPut32(start, req_rate);
+    upPut32(start+4, limit);
+    if (!sendFrame(CAP_START, start, 8)) {
+        return 1;
+    }
+
+    double t0 = now();
+    double t_credit = t0;
+    double t_rx = t0;
+    uint64_t bytes = 0;
+    uint32_t consumed = 0;      // bytes processed and not given back
+    bool started = false, stopping = false;
+    while (true) {
+        if (stop && !stopping) {
+            sendFrame(CAP_STOP, NULL, 0);
+            stopping = true;
+        }
+        if (started && ((consumed >= MIN_CREDIT) || ((now() - t_credit) * 1000 >= CREDIT_MS))) {
+            sendCredit(consumed);
+            consumed = 0;
+            t_credit = now();
+        }
+
+        int type = getFrame(100);
+        if (type != UP_NONE) {
+            t_rx = now();
+        }
+        switch (type) {
+            case UP_NONE:
+                if ((now() - t_rx) > 10) {
+                    fprintf(stderr, "\nTimeout\n");
+                    sendFrame(UP_ABORT, NULL, 0);
+                    outEnd();
+                    return 1;
+                }
+                break;
+            case UP_BAD:
+                fprintf(stderr, "\nInvalid frame\n");
+                sendFrame(UP_ABORT, NULL, 0);
+                outEnd();
+                return 1;
+            case CAP_INFO:
+                rate = upGet32(parser.payload);
+                printf("%u samples/s, %d channels\n", rate, parser.payload[4]);
+                outStart();
+                sendCredit(window);
+                t_credit = now();
+                started = true;
+                break;
+            case CAP_DATA:
+                if (!started) {
+                    break;
+                }
+                for (int i = 0; i < parser.len; i++) {
+                    int r = capDecode(&dec, parser.payload[i]);
+                    if (r == CAP_RUN) {
+                        outRun(dec.n, dec.levels);
+                        n_runs++;
+                    } else if (r == CAP_GAP) {
+                        outGap(dec.n);
+                        n_gaps++;
+                    } else if (r == CAP_BAD) {
+                        fprintf(stderr, "\nInvalid run\n");
+                    }
+                }
+                bytes += parser.len;
+                consumed += parser.len;
+                if (rate) {
+                    printf("\r%.1f s, %llu KB", (double) t_sample / rate, (unsigned long long) bytes / 1024);
+                    fflush(stdout);
+                }
+                break;
+            case CAP_END: {
+                uint64_t total = upGet32(parser.payload) | ((uint64_t) upGet32(parser.payload+4) << 32);
+                uint32_t lost = upGet32(parser.payload+8);
+                uint8_t st = parser.payload[12];
+                double t = now() - t0;
+                outEnd();
+                printf("\nStatus: %s\n", st < (sizeof(status_msg)/sizeof(status_msg[0])) ?
+                        status_msg[st] : "unknown");
+                printf("%llu samples (%.3f s) in %.3f s, %llu runs, %llu bytes (%.2f bits/sample)\n",
+                       (unsigned long long) total, rate ? (double) total / rate : 0.0, t,
+                       (unsigned long long) n_runs, (unsigned long long) bytes,
+                       total ? bytes * 8.0 / total : 0.0);
+                if (lost || n_gaps) {
+                    printf("%u samples lost in %llu gaps\n", lost, (unsigned long long) n_gaps);
+                }
+                if (total != t_sample) {
+                    printf("Stream has %llu samples\n", (unsigned long long) t_sample);
+                    st = UPS_PROTOCOL;
+                }
+                return st == UPS_OK ? 0 : 2;
+            }
+        }
+    }
+}
@@ -0,0 +1,58 @@
+# Regression check of the front end: recordings made by k7wav must load
+# in k7batch, giving back the program
+# Usage: cmake -DK7WAV=k7wav -DK7BATCH=k7batch -DPFILE=file.P -DWORK=dir -P k7check.cmake
+#
+# Each case is a tape deck that k7wav simulates (name and options of k7wav);
+# k7batch must exit with 0 (all the files gave programs, no burst
+# failed) and each program saved must be the start of PFILE (the .P
+# may have padding after the program).
+
+cmake_minimum_required(VERSION 3.13)
+
+set(CASES
+    "clean -n 0 -f 20000 -c 1"
+    "default"
+    "inverted -i"
+    "fast -s 4"
+    "slow -s -5 -w 1"
+    "coupling -c 300"
+    "treble -f 3000"
+    "quiet -a 0.1 -n 0.005"
+    "rate -r 22050"
+)
+
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK})
+set(WAVS "")
+foreach(CASE IN LISTS CASES)
+    string(REPLACE " " ";" CASE "${CASE}")
+    list(GET CASE 0 NAME)
+    list(REMOVE_AT CASE 0)
+    execute_process(COMMAND ${K7WAV} ${CASE} ${PFILE} ${WORK}/${NAME}.wav
+                    RESULT_VARIABLE RC OUTPUT_QUIET)
+    if (NOT RC EQUAL 0)
+        message(FATAL_ERROR "k7wav failed for ${NAME}")
+    endif()
+    list(APPEND WAVS ${WORK}/${NAME}.wav)
+endforeach()
+
+execute_process(COMMAND ${K7BATCH} -q -d ${WORK} ${WAVS} RESULT_VARIABLE RC)
+if (NOT RC EQUAL 0)
+    message(FATAL_ERROR "k7batch did not load all the recordings")
+endif()
+
+file(READ ${PFILE} EXPECTED HEX)
+foreach(CASE IN LISTS CASES)
+    string(REGEX REPLACE " .*" "" NAME "${CASE}")
+    file(GLOB OUT ${WORK}/${NAME}-01-*.P)
+    if (NOT OUT)
+        message(FATAL_ERROR "${NAME}: no program")
+    endif()
+    file(READ ${OUT} GOT HEX)
+    string(LENGTH "${GOT}" LEN)
+    string(SUBSTRING "${EXPECTED}" 0 ${LEN} START)
+    if ((LEN EQUAL 0) OR NOT (GOT STREQUAL START))
+        message(FATAL_ERROR "${NAME}: the program is not ${PFILE}")
+    endif()
+endforeach()
+message(STATUS "${K7BATCH}: all the recordings of k7wav loaded")
@@ -0,0 +1,374 @@
+/*
+    k7decode - decodes an EAR signal like the ZX81 ROM LOAD routine
+
+    Usage: k7decode [options] file
+        file is a VCD (simulator, logic analyzer), a WAV (audio capture)
+        or a .P file (the signal is generated like PicoK7 does)
+        -o file.P   save the loaded program
+        -r file.P   compare with the original program (bit errors)
+        -c file.csv save the timing of each bit
+        -z hz       ZX81 clock (default 3250000)
+        -l 0|1      level of the pulses (default: the opposite of the silence)
+        -t frac     WAV threshold, fraction of the envelope (default 0.3)
+        -p on,off,gap  pulse timing in PIO cycles, for .P and -S (default 3,3,25)
+        -u us       PIO cycle (default 50)
+        -N name     tape name, for .P (default DQ)
+        -j us       random jitter added to each edge, for .P and -S
+        -k percent  clock error of the PicoK7, for .P
+
+    Usage: k7decode -S [-u us] [-j us] [-T percent] [-n trials] [-b bytes] [file.P]
+        Finds the fastest pulse timing that loads cleanly with the ZX81
+        clock off by -T..+T percent (default 2) and n (default 5) trials
+        of jitter for each clock. Uses the program in file.P or a random
+        program of the given size (default 512).
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "waveform.h"
+#include "zx81load.h"
+
+#define MAX_CYCLES  6       // pulse on/off limits for the sweep
+#define MIN_GAP     2
+#define MAX_GAP     30
+#define SHOW_FAILS  5       // faster combinations to show
+
+static uint8_t tape[ZXL_MAX_NAME + ZXL_MAX_DATA];
+static int tape_len;
+static uint8_t name[ZXL_MAX_NAME+1];
+static int name_len;
+
+static ZXL_RESULT res;
+
+static void usage (void) {
+    fprintf(stderr, "Usage: k7decode [-o out.P] [-r ref.P] [-c bits.csv] [-z hz] [-l 0|1] [-t frac]\n"
+                    "                [-p on,off,gap] [-u us] [-N name] [-j us] [-k percent] file\n"
+                    "       k7decode -S [-u us] [-j us] [-T percent] [-n trials] [-b bytes] [file.P]\n");
+    exit(1);
+}
+
+// Read a .P file, returns the program size (0 if invalid)
+static int readP (const char *file, uint8_t *buf) {
+    FILE *f = fopen(file, "rb");
+    if (f == NULL) {
+        perror(file);
+        return 0;
+    }
+    int size = fread(buf, 1, ZXL_MAX_DATA, f);
+    fclose(f);
+    if ((size <= 120) || (buf[0] != 0)) {
+        fprintf(stderr, "%s: not a valid .P file\n", file);
+        return 0;
+    }
+    int real_size = buf[11] + 256*buf[12] - 0x4009;
+    if ((real_size > size) || (real_size < 13) || (buf[real_size-1] != 0x80)) {
+        fprintf(stderr, "%s: not a valid .P file\n", file);
+        return 0;
+    }
+    return real_size;
+}
+
+// Put name + program in the tape buffer
+static void setTape (const uint8_t *prog, int size) {
+    memcpy(tape, name, name_len);
+    memcpy(tape+name_len, prog, size);
+    tape_len = name_len + size;
+}
+
+// Did the program load without errors?
+static bool clean (const ZXL_RESULT *r) {
+    return (r->status == ZXL_OK) && (r->noise == 0) &&
+           (r->name_len == name_len) && (memcmp(r->name, name, name_len) == 0) &&
+           ((r->name_len + r->data_len) == tape_len) &&
+           (memcmp(r->data, tape+name_len, r->data_len) == 0);
+}
+
+// Decode the synthesized tape
+static ZXL_STATUS decodeSynth (const K7_TIMING *tm, const ZXL_CONFIG *cfg, double scale,
+                               double jitter_us, unsigned *seed) {
+    WAVE w;
+    waveSynth(&w, tape, tape_len, tm, cfg->pulse_level, scale, jitter_us, seed);
+    zxlFree(&res);
+    ZXL_STATUS st = zxlDecode(&w, cfg, &res);
+    waveFree(&w);
+    return st;
+}
+
+// Show the margins of the last decode
+static void showMargins (const ZXL_CONFIG *cfg) {
+    double sample_us = 51.0 * 1e6 / cfg->clock_hz;
+    for (int b = 0; b < 2; b++) {
+        if (res.iter_max[b] > 0) {
+            printf("Bit %d: %d..%d iterations (valid %d..%d), margin %d\n", b,
+                   res.iter_min[b], res.iter_max[b],
+                   b ? ZXL_BIT1_MIN : ZXL_BIT0_MIN, b ? ZXL_BIT1_MAX : ZXL_BIT0_MAX,
+                   res.margin[b]);
+        }
+    }
+    if (res.bits) {
+        printf("Silence inside bits: %d samples (%.0f us) to spare\n",
+               res.gap_margin, res.gap_margin * sample_us);
+        printf("Shortest pulse: %d samples\n", res.min_pulse);
+        if (res.slack_us < 1e98) {
+            printf("Silence after bits: next pulse at least %.0f us after the end\n", res.slack_us);
+        }
+    }
+}
+
+// Find the fastest timing
+static int sweep (K7_TIMING tm, ZXL_CONFIG *cfg, double jitter_us, double tol, int trials) {
+    typedef struct { int on, off, gap; double us; } CAND;
+    CAND *cand = malloc(MAX_CYCLES * MAX_CYCLES * (MAX_GAP - MIN_GAP + 1) * sizeof(CAND));
+    int ncand = 0;
+
+    for (int on = 1; on <= MAX_CYCLES; on++) {
+        for (int off = 1; off <= MAX_CYCLES; off++) {
+            for (int gap = MIN_GAP; gap <= MAX_GAP; gap++) {
+                tm.on = on;
+                tm.off = off;
+                tm.gap = gap;
+                CAND c = { on, off, gap, waveDuration(tape, tape_len, &tm) };
+                // insertion sort by duration
+                int i = ncand++;
+                while ((i > 0) && (cand[i-1].us > c.us)) {
+                    cand[i] = cand[i-1];
+                    i--;
+                }
+                cand[i] = c;
+            }
+        }
+    }
+
+    double scale[3] = { 1.0, 1.0 / (1.0 - tol), 1.0 / (1.0 + tol) };
+    int fails = 0;
+    for (int i = 0; i < ncand; i++) {
+        tm.on = cand[i].on;
+        tm.off = cand[i].off;
+        tm.gap = cand[i].gap;
+        const char *why = NULL;
+        double why_scale = 1.0;
+        unsigned seed = 1;
+        for (int s = 0; (s < 3) && (why == NULL); s++) {
+            for (int n = 0; n < (jitter_us ? trials : 1); n++) {
+                decodeSynth(&tm, cfg, scale[s], jitter_us, &seed);
+                if (!clean(&res)) {
+                    why = res.status != ZXL_OK ? zxlStatusStr(res.status) :
+                          res.noise ? "noise" : "wrong data";
+                    why_scale = scale[s];
+                    break;
+                }
+            }
+        }
+        if (why != NULL) {
+            if (fails++ < SHOW_FAILS) {
+                printf("%d,%d,%d: %.0f bytes/s, fails (%s, ZX81 clock %+.1f%%)\n",
+                       tm.on, tm.off, tm.gap, tape_len / (cand[i].us / 1e6), why,
+                       100.0 * (1.0 / why_scale - 1.0));
+            }
+            continue;
+        }
+        if (fails > SHOW_FAILS) {
+            printf("(%d more faster combinations fail)\n", fails - SHOW_FAILS);
+        }
+        printf("\nFastest: on %d, off %d, gap %d cycles of %.0f us: %.0f bytes/s\n",
+               tm.on, tm.off, tm.gap, tm.cycle_us, tape_len / (cand[i].us / 1e6));
+        decodeSynth(&tm, cfg, 1.0, 0.0, &seed);
+        showMargins(cfg);
+
+        K7_TIMING def = K7_TIMING_DEFAULT;
+        def.cycle_us = tm.cycle_us;
+        printf("\nDefault: on %d, off %d, gap %d: %.0f bytes/s\n",
+               def.on, def.off, def.gap, tape_len / (waveDuration(tape, tape_len, &def) / 1e6));
+        decodeSynth(&def, cfg, 1.0, 0.0, &seed);
+        showMargins(cfg);
+        free(cand);
+        return 0;
+    }
+    printf("No combination loads cleanly\n");
+    free(cand);
+    return 2;
+}
+
+int main (int argc, char *argv[]) {
+    ZXL_CONFIG cfg;
+    K7_TIMING tm = K7_TIMING_DEFAULT;
+    const char *out = NULL, *ref = NULL, *csv = NULL;
+    const char *tname = "DQ";
+    double threshold = 0.3, jitter_us = 0.0, clock_err = 0.0, tol = 2.0;
+    int level = -1, trials = 5, bytes = 512;
+    bool do_sweep = false;
+    int opt;
+
+    zxlDefault(&cfg);
+    while ((opt = getopt(argc, argv, "o:r:c:z:l:t:p:u:N:j:k:ST:n:b:")) != -1) {
+        switch (opt) {
+            case 'o':
+                out = optarg;
+                break;
+            case 'r':
+                ref = optarg;
+                break;
+            case 'c':
+                csv = optarg;
+                break;
+            case 'z':
+                cfg.clock_hz = atof(optarg);
+                break;
+            case 'l':
+                level = atoi(optarg) ? 1 : 0;
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            case 'p':
+                if (sscanf(optarg, "%d,%d,%d", &tm.on, &tm.off, &tm.gap) != 3) {
+                    usage();
+                }
+                break;
+            case 'u':
+                tm.cycle_us = atof(optarg);
+                break;
+            case 'N':
+                tname = optarg;
+                break;
+            case 'j':
+                jitter_us = atof(optarg);
+                break;
+            case 'k':
+                clock_err = atof(optarg);
+                break;
+            case 'S':
+                do_sweep = true;
+                break;
+            case 'T':
+                tol = atof(optarg);
+                break;
+            case 'n':
+                trials = atoi(optarg);
+                break;
+            case 'b':
+                bytes = atoi(optarg);
+                break;
+            default:
+                usage();
+        }
+    }
+    if ((cfg.clock_hz <= 0) || (tm.cycle_us <= 0) || (trials < 1)) {
+        usage();
+    }
+    name_len = zxlName(tname, name);
+    static uint8_t prog[ZXL_MAX_DATA];
+    unsigned seed = 1;
+
+    if (do_sweep) {
+        int size;
+        if (optind < argc) {
+            size = readP(argv[optind], prog);
+            if (size == 0) {
+                return 1;
+            }
+        } else {
+            // Random program with a valid header
+            size = bytes < 121 ? 121 : bytes > ZXL_MAX_DATA ? ZXL_MAX_DATA : bytes;
+            for (int i = 0; i < size; i++) {
+                prog[i] = rand_r(&seed) & 0xFF;
+            }
+            prog[0] = 0;
+            prog[11] = (0x4009 + size) & 0xFF;
+            prog[12] = (0x4009 + size) >> 8;
+            prog[size-1] = 0x80;
+        }
+        cfg.pulse_level = level < 0 ? 0 : level;
+        setTape(prog, size);
+        printf("%d bytes, PIO cycle %.0f us, ZX81 clock %.0f Hz +/- %.1f%%, jitter %.1f us\n\n",
+               tape_len, tm.cycle_us, cfg.clock_hz, tol, jitter_us);
+        return sweep(tm, &cfg, jitter_us, tol / 100.0, trials);
+    }
+
+    if (optind >= argc) {
+        usage();
+    }
+    const char *file = argv[optind];
+    const char *ext = strrchr(file, '.');
+    WAVE w;
+    if ((ext != NULL) && (strcasecmp(ext, ".p") == 0)) {
+        int size = readP(file, prog);
+        if (size == 0) {
+            return 1;
+        }
+        setTape(prog, size);
+        waveSynth(&w, tape, tape_len, &tm, level < 0 ? 0 : level,
+                  1.0 / (1.0 + clock_err / 100.0), jitter_us, &seed);
+    } else if (!waveLoad(&w, file, threshold)) {
+        return 1;
+    }
+    cfg.pulse_level = level < 0 ? !waveIdleLevel(&w) : level;
+    cfg.keep_bits = csv != NULL;
+
+    ZXL_STATUS st = zxlDecode(&w, &cfg, &res);
+    char str[ZXL_MAX_NAME+1];
+    zxlNameStr(res.name, res.name_len, str);
+    printf("Pulses at level %d, %zu edges, %.3f s\n", cfg.pulse_level, w.n, w.end / 1e9);
+    printf("Name: \"%s\"\n", str);
+    printf("Loaded %d bytes of %d: %s\n", res.data_len, res.prog_len, zxlStatusStr(st));
+    printf("Bits: %d (noise %d), %.3f s\n", res.bits, res.noise, res.t_end / 1e9);
+    showMargins(&cfg);
+
+    if (ref != NULL) {
+        int size = readP(ref, prog);
+        if (size == 0) {
+            return 1;
+        }
+        int n = size < res.data_len ? size : res.data_len;
+        int errors = 0, bad = 0, first = -1;
+        for (int i = 0; i < n; i++) {
+            int x = prog[i] ^ res.data[i];
+            if (x) {
+                errors += __builtin_popcount(x);
+                if (bad++ == 0) {
+                    first = i;
+                }
+            }
+        }
+        printf("Compared %d bytes with %s: %d bit errors in %d bytes", n, ref, errors, bad);
+        if (first >= 0) {
+            printf(" (first at %d)", first);
+        }
+        printf("%s\n", n < size ? ", program incomplete" : "");
+    }
+
+    if (csv != NULL) {
+        FILE *f = fopen(csv, "w");
+        if (f == NULL) {
+            perror(csv);
+            return 1;
+        }
+        fprintf(f, "bit,t_us,value,iter,pulses,margin,max_gap,min_pulse,slack_us\n");
+        for (int i = 0; i < res.nbit; i++) {
+            ZXL_BIT *b = &res.bit[i];
+            fprintf(f, "%d,%.1f,%d,%d,%d,%d,%d,%d,%.1f\n", i, b->t / 1000.0, b->value,
+                    b->iter, b->pulses, b->margin, b->max_gap, b->min_pulse, b->slack_us);
+        }
+        fclose(f);
+    }
+
+    if ((out != NULL) && (res.data_len > 0)) {
+        FILE *f = fopen(out, "wb");
+        if ((f == NULL) || (fwrite(res.data, 1, res.data_len, f) != (size_t) res.data_len)) {
+            perror(out);
+            return 1;
+        }
+        fclose(f);
+    }
+    zxlFree(&res);
+    waveFree(&w);
+    return st == ZXL_OK ? 0 : 2;
+}
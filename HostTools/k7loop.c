@@ -0,0 +1,518 @@
+/*
+    k7loop - stand-in for the PicoK7 USB upload and capture, for
+    testing on the PC
+
+    Creates a pseudo terminal and answers the upload protocol like the
+    device does (same buffer size and credit rules). The tape is
+    simulated by consuming the data at a given rate.
+
+    The capture protocol (capproto.h) is also answered, with the rate,
+    buffers, credit and overrun rules of the device, in real time. EAR
+    is the signal in the file given by -w (repeated), MIC is low.
+
+    Usage: k7loop [-r bytes/s] [-d dir] [-w file] [-1]
+        -r  tape rate (default 0 = as fast as possible;
+            the ZX81 rate is around 40 bytes/s)
+        -d  directory where to store the files (default: current)
+        -w  signal for the captures (.vcd or .wav, default: EAR low)
+        -1  exit after one transfer (or capture)
+
+    The name of the pseudo terminal is printed at start, use it as
+    the port for k7upload.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+
+#include "upproto.h"
+#include "capproto.h"
+#include "waveform.h"
+
+#define RING_SIZE    2048
+#define MIN_CREDIT   256
+
+// Capture, as in capture.c
+#define CAP_SYS_HZ    125000000   // system clock (CLK_RUN_KHZ)
+#define CAP_RING      2048        // 16 sample words in the rings (CAP_RING_BITS)
+#define CAP_GUARD     128
+#define CAP_OUT       2048
+#define CAP_LOST_MAX  11
+#define CAP_FLUSH_MS  20
+#define CAP_TIMEOUT   5.0
+
+static int pty;
+static UP_PARSER parser;
+static double rate;
+static const char *dir = ".";
+
+static uint8_t ring[RING_SIZE];
+static uint32_t r_in, r_out;
+
+static uint8_t flags;
+static uint32_t total, granted, received, to_send, sent;
+static uint8_t hdr[13];
+static uint8_t last;
+static bool active, ended;
+static FILE *fout;
+static char path[1024];
+static double t_tape;
+static int transfers;
+
+static WAVE wave;
+static CAP_ENC enc;
+static bool capturing, draining;
+static uint32_t cap_rate, cap_limit, cap_credit, cap_lost, cap_pending;
+static uint64_t cap_samples, cap_words;
+static uint8_t cap_out[CAP_OUT];
+static uint32_t co_in, co_out;
+static double t_cap, t_flush, t_rx;
+static size_t w_idx;            // next change in the wave
+static int w_level;
+static uint64_t w_base;         // start of the current repetition (ns)
+
+// Current time in seconds
+static double now (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Send a frame
+static void sendFrame (uint8_t type, const uint8_t *payload, int len) {
+    uint8_t frame[UP_MAX_FRAME];
+    int n = upFrame(frame, type, payload, len);
+    if (write(pty, frame, n) != n) {
+        perror("write");
+    }
+}
+
+// Debug message, like prtdbg in the device
+static void debugMsg (const char *msg) {
+    if (write(pty, msg, strlen(msg)) < 0) {
+        perror("write");
+    }
+    printf("%s", msg);
+}
+
+// End of transfer
+static void finish (uint8_t st) {
+    char msg[64];
+    if (fout != NULL) {
+        fclose(fout);
+        fout = NULL;
+        if (st != UPS_OK) {
+            unlink(path);
+        }
+    }
+    snprintf(msg, sizeof(msg), "UPLOAD: status %d\n", st);
+    debugMsg(msg);
+    sendFrame(UP_STATUS, &st, 1);
+    active = false;
+    transfers++;
+}
+
+// Check the header like k7CheckHeader
+static uint32_t checkHeader (void) {
+    if ((total <= 120) || (hdr[0] != 0)) {
+        return 0;
+    }
+    uint32_t real_size = (hdr[11] + 256*hdr[12]) - 0x4009;
+    return real_size > total ? 0 : real_size;
+}
+
+// End of capture
+static void capFinish (uint8_t st) {
+    char msg[96];
+    uint8_t aux[13];
+    upPut32(aux, (uint32_t) cap_samples);
+    upPut32(aux+4, (uint32_t) (cap_samples >> 32));
+    upPut32(aux+8, cap_lost);
+    aux[12] = st;
+    snprintf(msg, sizeof(msg), "CAPTURE: status %d, %llu samples, %u lost\n",
+             st, (unsigned long long) cap_samples, cap_lost);
+    debugMsg(msg);
+    sendFrame(CAP_END, aux, 13);
+    capturing = false;
+    transfers++;
+}
+
+// Start a capture, with the rate the device would use
+static void capStart (const uint8_t *payload) {
+    char msg[64];
+    uint32_t req = upGet32(payload);
+    if (req < CAP_MIN_RATE) {
+        req = CAP_MIN_RATE;
+    } else if (req > CAP_MAX_RATE) {
+        req = CAP_MAX_RATE;
+    }
+    uint32_t div256 = (uint32_t) (((uint64_t) CAP_SYS_HZ * 256 + req/2) / req);
+    cap_rate = (uint32_t) (((uint64_t) CAP_SYS_HZ * 256 + div256/2) / div256);
+    cap_limit = upGet32(payload+4);
+    cap_credit = cap_lost = cap_pending = 0;
+    cap_samples = cap_words = 0;
+    co_in = co_out = 0;
+    capEncInit(&enc);
+    w_idx = 0;
+    w_level = wave.level0;
+    w_base = 0;
+    capturing = true;
+    draining = false;
+    t_cap = t_flush = now();
+    snprintf(msg, sizeof(msg), "CAPTURE: %u samples/s, limit %u\n", cap_rate, cap_limit);
+    debugMsg(msg);
+    uint8_t info[5];
+    upPut32(info, cap_rate);
+    info[4] = CAP_CHANNELS;
+    sendFrame(CAP_INFO, info, 5);
+}
+
+// Word k of the samples (EAR from the wave, MIC low)
+static uint32_t capWord (uint64_t k) {
+    uint32_t word = 0;
+    for (int i = 0; i < CAP_WORD_SAMPLES; i++) {
+        uint64_t t = (uint64_t) ((k * CAP_WORD_SAMPLES + i) * 1e9 / cap_rate);
+        if (wave.end > 0) {
+            while (t >= (w_base + wave.end)) {
+                w_base += wave.end;
+                w_idx = 0;
+                w_level = wave.level0;
+            }
+            while ((w_idx < wave.n) && ((w_base + wave.t[w_idx]) <= t)) {
+                w_level = !w_level;
+                w_idx++;
+            }
+        }
+        word |= (uint32_t) w_level << (i * CAP_CHANNELS);
+    }
+    return word;
+}
+
+// Put runs in the buffer
+static void capPut (const uint8_t *data, int len) {
+    for (int i = 0; i < len; i++) {
+        cap_out[co_in++ % CAP_OUT] = data[i];
+    }
+}
+
+// Stop the sampling, the runs in the buffer are still sent
+static void capStop (void) {
+    uint8_t aux[5];
+    capPut(aux, capFlush(&enc, aux));
+    draining = true;
+}
+
+// Sample, encode and send, like capture.c
+static void capPump (void) {
+    if (!capturing) {
+        return;
+    }
+    double t = now();
+    if (!draining) {
+        uint64_t written = (uint64_t) ((t - t_cap) * cap_rate) / CAP_WORD_SAMPLES;
+        if ((written - cap_words) > (CAP_RING - CAP_GUARD)) {
+            uint64_t skip = (written - cap_words) - CAP_RING/2;
+            uint64_t n = skip * CAP_WORD_SAMPLES;
+            if (cap_limit && ((cap_samples + n) > cap_limit)) {
+                n = cap_limit - cap_samples;
+            }
+            cap_words += skip;
+            cap_samples += n;
+            cap_lost += n;
+            cap_pending += n;
+        }
+        if (cap_pending && ((CAP_OUT - (co_in - co_out)) >= CAP_LOST_MAX)) {
+            uint8_t aux[CAP_LOST_MAX];
+            capPut(aux, capLost(&enc, cap_pending, aux));
+            cap_pending = 0;
+            if (cap_limit && (cap_samples == cap_limit)) {
+                capStop();
+            }
+        }
+        while (!draining && !cap_pending && (cap_words != written) &&
+               ((CAP_OUT - (co_in - co_out)) >= (CAP_ENC_MAX + CAP_LOST_MAX))) {
+            uint8_t aux[CAP_ENC_MAX];
+            int n = CAP_WORD_SAMPLES;
+            if (cap_limit && ((cap_samples + n) >= cap_limit)) {
+                n = cap_limit - cap_samples;
+            }
+            capPut(aux, capEncode(&enc, capWord(cap_words), n, aux));
+            cap_words++;
+            cap_samples += n;
+            if (cap_limit && (cap_samples == cap_limit)) {
+                capStop();
+            }
+        }
+    }
+
+    bool flush = (t - t_flush) * 1000 >= CAP_FLUSH_MS;
+    if (flush) {
+        t_flush = t;
+        if (!draining && !cap_pending && ((CAP_OUT - (co_in - co_out)) >= (5 + CAP_LOST_MAX))) {
+            uint8_t aux[5];
+            capPut(aux, capFlush(&enc, aux));
+        }
+    }
+    while (co_out != co_in) {
+        uint32_t n = co_in - co_out;
+        if (n > UP_MAX_PAYLOAD) {
+            n = UP_MAX_PAYLOAD;
+        }
+        if (n > cap_credit) {
+            n = cap_credit;
+        }
+        if ((n == 0) || ((n < UP_MAX_PAYLOAD) && !flush && !draining)) {
+            break;
+        }
+        uint8_t payload[UP_MAX_PAYLOAD];
+        for (uint32_t i = 0; i < n; i++) {
+            payload[i] = cap_out[co_out++ % CAP_OUT];
+        }
+        cap_credit -= n;
+        sendFrame(CAP_DATA, payload, n);
+    }
+
+    if (draining && (co_out == co_in)) {
+        capFinish(UPS_OK);
+    } else if ((t - t_rx) > CAP_TIMEOUT) {
+        capFinish(UPS_TIMEOUT);
+    }
+}
+
+// Treat a frame
+static void handleFrame (int type) {
+    char msg[128];
+    uint8_t *payload = parser.payload;
+    int len = parser.len;
+
+    switch (type) {
+        case UP_START:
+            if (active || (len < 6) || (len > (5+UP_MAX_NAME))) {
+                finish(UPS_PROTOCOL);
+                break;
+            }
+            flags = payload[0];
+            total = upGet32(payload+1);
+            r_in = r_out = granted = received = to_send = sent = 0;
+            last = 0;
+            active = true;
+            ended = false;
+            snprintf(msg, sizeof(msg), "UPLOAD: %.*s %u bytes flags %02X\n",
+                     len-5, payload+5, total, flags);
+            debugMsg(msg);
+            if (flags & UPF_STORE) {
+                snprintf(path, sizeof(path), "%s/%.*s", dir, len-5, payload+5);
+                fout = fopen(path, "wb");
+                if (fout == NULL) {
+                    finish(UPS_SD_ERROR);
+                }
+            }
+            break;
+        case UP_DATA:
+            if (!active || ended || ((received + len) > granted)) {
+                finish(UPS_PROTOCOL);
+                break;
+            }
+            if ((fout != NULL) && (fwrite(payload, 1, len, fout) != (size_t) len)) {
+                finish(UPS_SD_ERROR);
+                break;
+            }
+            for (int i = 0; i < len; i++) {
+                if ((received + i) < sizeof(hdr)) {
+                    hdr[received + i] = payload[i];
+                }
+                if (flags & UPF_SEND) {
+                    ring[r_in++ % RING_SIZE] = payload[i];
+                }
+            }
+            received += len;
+            break;
+        case UP_END:
+            if (!active || (received != total)) {
+                finish(UPS_PROTOCOL);
+            } else {
+                ended = true;
+            }
+            break;
+        case UP_ABORT:
+            if (active) {
+                finish(UPS_ABORTED);
+            }
+            if (capturing) {
+                capFinish(UPS_ABORTED);
+            }
+            break;
+        case CAP_START:
+            if (capturing || (len != 8)) {
+                capFinish(UPS_PROTOCOL);
+            } else {
+                capStart(payload);
+            }
+            break;
+        case CAP_CREDIT:
+            if (!capturing || (len != 4)) {
+                capFinish(UPS_PROTOCOL);
+            } else {
+                cap_credit += upGet32(payload);
+            }
+            break;
+        case CAP_STOP:
+            if (capturing && !draining) {
+                capStop();
+            }
+            break;
+    }
+}
+
+// Simulate the tape
+static void tape (void) {
+    if (!active || ((flags & UPF_SEND) == 0)) {
+        return;
+    }
+    if (to_send == 0) {
+        if ((received < sizeof(hdr)) && (received < total)) {
+            return;
+        }
+        to_send = checkHeader();
+        if (to_send == 0) {
+            finish(UPS_INVALID);
+            return;
+        }
+        t_tape = now();
+    }
+    uint32_t can = r_in - r_out;
+    if (rate > 0) {
+        uint32_t allowed = (uint32_t) ((now() - t_tape) * rate);
+        if ((allowed - sent) < can) {
+            can = allowed - sent;
+        }
+    }
+    while (can--) {
+        uint8_t b = ring[r_out++ % RING_SIZE];
+        if (sent < to_send) {
+            last = b;
+            if ((++sent & 0x7F) == 0 || (sent == to_send)) {
+                uint8_t aux[4];
+                upPut32(aux, sent);
+                sendFrame(UP_PROGRESS, aux, 4);
+            }
+        }
+    }
+}
+
+// Give credit
+static void giveCredit (void) {
+    if (!active || ended) {
+        return;
+    }
+    uint32_t room = RING_SIZE - (r_in - r_out) - (granted - received);
+    if ((granted + room) > total) {
+        room = total - granted;
+    }
+    if ((room >= MIN_CREDIT) || ((room > 0) && ((granted + room) == total))) {
+        uint8_t aux[2] = { room & 0xFF, room >> 8 };
+        granted += room;
+        sendFrame(UP_CREDIT, aux, 2);
+    }
+}
+
+int main (int argc, char *argv[]) {
+    bool once = false;
+    int opt;
+
+    waveInit(&wave, 0);
+    while ((opt = getopt(argc, argv, "r:d:w:1")) != -1) {
+        switch (opt) {
+            case 'r':
+                rate = atof(optarg);
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            case 'w':
+                waveFree(&wave);
+                if (!waveLoad(&wave, optarg, 0.3)) {
+                    return 1;
+                }
+                break;
+            case '1':
+                once = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r bytes/s] [-d dir] [-w file] [-1]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    pty = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((pty < 0) || (grantpt(pty) < 0) || (unlockpt(pty) < 0)) {
+        perror("pty");
+        return 1;
+    }
+    struct termios tio;
+    tcgetattr(pty, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(pty, TCSANOW, &tio);
+
+    // keep the slave open, so reads don't fail between clients
+    int slave = open(ptsname(pty), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        perror(ptsname(pty));
+        return 1;
+    }
+    printf("%s\n", ptsname(pty));
+    fflush(stdout);
+
+    upInit(&parser);
+    while (true) {
+        struct pollfd pfd = { pty, POLLIN, 0 };
+        int r = poll(&pfd, 1, (active || capturing) ? 1 : 100);
+        if (r > 0) {
+            uint8_t buf[4096];
+            ssize_t n = read(pty, buf, sizeof(buf));
+            t_rx = now();
+            for (ssize_t i = 0; i < n; i++) {
+                int type = upParse(&parser, buf[i]);
+                if (type == UP_BAD) {
+                    if (active) {
+                        finish(UPS_PROTOCOL);
+                    }
+                    if (capturing) {
+                        capFinish(UPS_PROTOCOL);
+                    }
+                } else if (type != UP_NONE) {
+                    handleFrame(type);
+                }
+            }
+        }
+        tape();
+        giveCredit();
+        capPump();
+        if (active && ended && (r_out == r_in)) {
+            if ((flags & UPF_SEND) && (last != 0x80)) {
+                finish(UPS_INVALID);
+            } else {
+                finish(UPS_OK);
+            }
+        }
+        if (once && (transfers > 0)) {
+            usleep(100000);
+            break;
+        }
+    }
+    close(slave);
+    close(pty);
+    return 0;
+}
@@ -0,0 +1,245 @@
+/*
+    k7pack - packed loaders for ZX81 programs
+
+    Usage: k7pack [-o dir] [-t] [-q] file...
+        file is a .P file
+        -o dir  save the packed loaders (same name) in dir
+        -t      run each loader (z80.c) and check that it rebuilds
+                the program
+        -q      only the totals
+
+    The loader is built by the same code the firmware uses (pack.c) when
+    the packed option is on. For each file, and for all of them, it
+    shows the bytes and the time to send them at the normal rate (the
+    name and the leader not included).
+
+    The test puts the loader in the memory of a 16K ZX81, calls it as
+    RAND USR 16514 would and compares the memory with the program, as
+    the ROM would leave it after LOAD. The ROM routines called by the
+    loader (SET-FAST and SLOW/FAST) just return.
+
+    The exit code is 0 if all the tests passed, 2 otherwise.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "pack.h"
+#include "z80.h"
+
+#define MAX_SIZE        (16*1024)   // as the firmware (tape.c)
+#define BIT0_MS         2.5         // time to send a bit (k7.pio)
+#define BIT1_MS         4.0
+
+#define RAMTOP          0x8000      // 16K
+#define RET_ADDR        0x0001      // return of USR (stops the test)
+#define ROM_ERROR       0x0008
+#define ROM_SLOW_FAST   0x0207
+#define ROM_SET_FAST    0x02E7
+#define MAX_STEPS       20000000
+
+static const char *outdir;
+static bool test, quiet;
+
+static uint8_t img[MAX_SIZE], loader[MAX_SIZE];
+static uint8_t mem[0x10000];
+
+static void usage (void) {
+    fprintf(stderr, "Usage: k7pack [-o dir] [-t] [-q] file...\n");
+    exit(1);
+}
+
+// Time to send the bytes (s)
+static double sendTime (const uint8_t *p, uint32_t n) {
+    double ms = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        int ones = __builtin_popcount(p[i]);
+        ms += ones*BIT1_MS + (8-ones)*BIT0_MS;
+    }
+    return ms / 1000;
+}
+
+// Read a .P file, returns the size up to E_LINE (0 if invalid)
+static uint32_t readP (const char *file, uint8_t *p) {
+    FILE *f = fopen(file, "rb");
+    if (f == NULL) {
+        perror(file);
+        return 0;
+    }
+    size_t n = fread(p, 1, MAX_SIZE, f);
+    fclose(f);
+    if ((n <= 116) || (p[0] != 0)) {
+        return 0;
+    }
+    uint32_t size = (p[11] | (p[12] << 8)) - PACK_BASE;
+    if ((size > n) || (size <= 116) || (p[size-1] != 0x80)) {
+        return 0;
+    }
+    return size;
+}
+
+static uint8_t memRead (Z80 *z, uint16_t addr, Z80_CYCLE kind) {
+    (void) z;
+    return (kind == Z80_IO) ? 0xFF : mem[addr];
+}
+
+static void memWrite (Z80 *z, uint16_t addr, uint8_t val, Z80_CYCLE kind) {
+    (void) z;
+    if ((kind == Z80_MEM) && (addr >= 0x4000)) {
+        mem[addr] = val;    // no writes to the ROM
+    }
+}
+
+// Run the loader and compare the memory with the program
+// Returns NULL if ok, else what went wrong
+static const char *runLoader (const uint8_t *p, uint32_t size, const uint8_t *ld, uint32_t len, uint64_t *t) {
+    Z80 z;
+    memset(mem, 0, sizeof(mem));
+    memcpy(mem + PACK_BASE, ld, len);
+    mem[0x4004] = RAMTOP & 0xFF;
+    mem[0x4005] = RAMTOP >> 8;
+    z80Reset(&z);
+    z.read = memRead;
+    z.write = memWrite;
+    z.sp = RAMTOP - 0x20;
+    mem[--z.sp] = RET_ADDR >> 8;
+    mem[--z.sp] = RET_ADDR & 0xFF;
+    z.pc = PACK_USR;
+    z.iy = 0x4000;
+
+    for (int i = 0; z.pc != RET_ADDR; i++) {
+        if ((z.pc == ROM_SET_FAST) || (z.pc == ROM_SLOW_FAST)) {
+            z.pc = mem[z.sp] | (mem[z.sp+1] << 8);
+            z.sp += 2;
+            continue;
+        }
+        if (z.pc == ROM_ERROR) {
+            return "error report";
+        }
+        if ((i == MAX_STEPS) || (z.pc < 0x4000) || (z80Step(&z) < 0)) {
+            return "did not return";
+        }
+    }
+    *t = z.t;
+
+    // As after LOAD, with CH_ADD at the end of the SAVE line
+    uint8_t expect[MAX_SIZE];
+    memcpy(expect, p, size);
+    uint16_t ch_add = (p[0x4029 - PACK_BASE] | (p[0x402A - PACK_BASE] << 8)) - 1;
+    expect[0x4016 - PACK_BASE] = ch_add & 0xFF;
+    expect[0x4017 - PACK_BASE] = ch_add >> 8;
+    expect[0x403B - PACK_BASE] &= 0x7F;
+    if (memcmp(mem + PACK_BASE, expect, size) != 0) {
+        return "wrong image";
+    }
+    if (z80Pair(&z, Z80_B) != (p[0x4032 - PACK_BASE] | (p[0x4033 - PACK_BASE] << 8))) {
+        return "SEED changed";
+    }
+    return NULL;
+}
+
+static bool save (const char *file, const uint8_t *p, uint32_t len) {
+    char out[512];
+    const char *base = strrchr(file, '/');
+    snprintf(out, sizeof(out), "%s/%s", outdir, base ? base+1 : file);
+    FILE *f = fopen(out, "wb");
+    if (f == NULL) {
+        perror(out);
+        return false;
+    }
+    bool ok = fwrite(p, 1, len, f) == len;
+    if ((fclose(f) != 0) || !ok) {
+        perror(out);
+        return false;
+    }
+    return true;
+}
+
+int main (int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "o:tq")) != -1) {
+        switch (opt) {
+            case 'o': outdir = optarg; break;
+            case 't': test = true; break;
+            case 'q': quiet = true; break;
+            default: usage();
+        }
+    }
+    if (optind >= argc) {
+        usage();
+    }
+
+    int nfiles = 0, npacked = 0, failed = 0;
+    uint32_t total_in = 0, total_out = 0;
+    double time_in = 0, time_out = 0;
+    for (int i = optind; i < argc; i++) {
+        const char *file = argv[i];
+        uint32_t size = readP(file, img);
+        if (size == 0) {
+            fprintf(stderr, "%s: not a valid .P file\n", file);
+            continue;
+        }
+        nfiles++;
+        uint32_t len = packImage(img, size, loader, sizeof(loader));
+        const char *why = NULL;
+        if (len == 0) {
+            why = ((img[0x4029 - PACK_BASE] | (img[0x402A - PACK_BASE] << 8)) <
+                   (img[0x400C - PACK_BASE] | (img[0x400D - PACK_BASE] << 8))) ? "no gain" : "not autorun";
+        }
+
+        // Files that are not packed are sent as they are
+        double t_in = sendTime(img, size);
+        double t_out = len ? sendTime(loader, len) : t_in;
+        total_in += size;
+        total_out += len ? len : size;
+        time_in += t_in;
+        time_out += t_out;
+        if (len == 0) {
+            if (!quiet) {
+                printf("%-24s %5u bytes %6.1f s  (%s)\n", file, size, t_in, why);
+            }
+            continue;
+        }
+        npacked++;
+
+        const char *result = NULL;
+        uint64_t t = 0;
+        if (test) {
+            result = runLoader(img, size, loader, len, &t);
+            if (result != NULL) {
+                failed++;
+            }
+        }
+        if (!quiet) {
+            printf("%-24s %5u -> %5u bytes %6.1f -> %6.1f s  %3.0f%%", file, size, len,
+                   t_in, t_out, 100.0 * (t_in - t_out) / t_in);
+            if (test) {
+                if (result == NULL) {
+                    printf("  ok (%.2f s at 3.25 MHz, FAST)", t / 3.25e6);
+                } else {
+                    printf("  FAILED: %s", result);
+                }
+            }
+            printf("\n");
+        }
+        if ((outdir != NULL) && (result == NULL)) {
+            save(file, loader, len);
+        }
+    }
+
+    if (nfiles) {
+        printf("%d files, %d packed: %u -> %u bytes, %.1f -> %.1f s (%.0f%% less)\n",
+               nfiles, npacked, total_in, total_out, time_in, time_out,
+               100.0 * (time_in - time_out) / time_in);
+    }
+    if (failed) {
+        printf("%d tests FAILED\n", failed);
+    }
+    return failed ? 2 : 0;
+}
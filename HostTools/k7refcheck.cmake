@@ -0,0 +1,35 @@
+# Regression check of the WAV input of k7decode: recordings made by
+# k7wav must load with no bit errors against the program
+# Usage: cmake -DK7WAV=k7wav -DK7DECODE=k7decode -DPFILE=file.P -DWORK=dir -P k7refcheck.cmake
+#
+# Each case is a tape deck that k7wav simulates (name and options of
+# k7wav), the recording is decoded by k7decode -r PFILE.
+
+cmake_minimum_required(VERSION 3.13)
+
+set(CASES
+    "clean -n 0 -f 20000 -c 1"
+    "default"
+    "inverted -i"
+)
+
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK})
+foreach(CASE IN LISTS CASES)
+    string(REPLACE " " ";" CASE "${CASE}")
+    list(GET CASE 0 NAME)
+    list(REMOVE_AT CASE 0)
+    execute_process(COMMAND ${K7WAV} ${CASE} ${PFILE} ${WORK}/${NAME}.wav
+                    RESULT_VARIABLE RC OUTPUT_QUIET)
+    if (NOT RC EQUAL 0)
+        message(FATAL_ERROR "k7wav failed for ${NAME}")
+    endif()
+    execute_process(COMMAND ${K7DECODE} -r ${PFILE} ${WORK}/${NAME}.wav
+                    RESULT_VARIABLE RC OUTPUT_VARIABLE OUT)
+    if ((NOT RC EQUAL 0) OR NOT (OUT MATCHES "Loaded ([0-9]+) bytes of ([0-9]+): OK")
+        OR NOT (CMAKE_MATCH_1 EQUAL CMAKE_MATCH_2)
+        OR NOT (OUT MATCHES ": 0 bit errors in 0 bytes\n"))
+        message(FATAL_ERROR "${NAME}: k7decode did not load ${PFILE}\n${OUT}")
+    endif()
+endforeach()
+message(STATUS "${K7DECODE}: all the recordings of k7wav loaded")
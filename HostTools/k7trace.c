@@ -0,0 +1,307 @@
+/*
+    k7trace - shows the binary trace sent by PicoK7 as a timeline
+
+    Usage: k7trace [-m] [-s] source
+        -m  also show the text outside frames (debug messages)
+        -s  only the summary
+        source is the serial port of the PicoK7 (ex: /dev/ttyACM0)
+        or a capture of its output (ex: picok7sim stdout); a port
+        is read until Ctrl-C
+
+    The events are described in PicoK7/trace.h
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+
+#include "upproto.h"
+#include "trace.h"
+
+static bool show_msgs;
+static bool show_events = true;
+static volatile bool stop;
+
+// Statistics
+static unsigned long count[256];
+static unsigned long lost;
+static unsigned long frames, bad_frames;
+static uint32_t sd_min = UINT32_MAX, sd_max;
+static uint64_t sd_total;
+static uint32_t stream_max;
+static unsigned long stream_late;
+static uint32_t record_max;
+static uint32_t mem_peak[TRMEM_COUNT], mem_size[TRMEM_COUNT];
+static uint32_t last_time[2];
+static bool has_time[2];
+
+static const char *event_name[] = {
+    "?", "SD read", "clock", "key", "LCD flush", "send", "TX FIFO",
+    "TX FIFO EMPTY", "ERROR", "PIO sm", "upload", "channel",
+    "stream", "record", "capture", "regenerator", "memory"
+};
+static const char *send_phase[] = {
+    "leader", "name", "data", "end", "pause", "resume", "seek", "abort"
+};
+static const char *error_name[] = {
+    "?", "invalid header", "file too short", "bad last byte", "f_open", "f_read", "PIO memory full",
+    "checksum mismatch", "too fragmented", "not contiguous", "f_write"
+};
+static const char *module_name[] = { "tape", "encoder", "ws2812", "scope", "capture" };
+static const char *key_name[] = { "ENTER", "UP", "DN" };
+static const char *channel_state[] = { "free", "leader", "sending", "done", "error" };
+static const char *region_name[] = { "stack core 0", "stack core 1", "heap" };
+static const char *status_name[] = {
+    "OK", "protocol error", "invalid file", "SD card error", "aborted", "timeout"
+};
+
+#define NAME(tbl, i) (((size_t) (i) < (sizeof(tbl)/sizeof(tbl[0]))) ? tbl[i] : "?")
+
+static void onSignal (int sig) {
+    (void) sig;
+    stop = true;
+}
+
+// Open the source, a serial port is put in raw mode
+static int openSource (const char *path) {
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct termios tio;
+    if (isatty(fd) && (tcgetattr(fd, &tio) == 0)) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+// Describe an event
+static void describe (const TR_EVENT *e, char *desc, size_t size) {
+    switch (e->id) {
+        case TR_SD_READ:
+            snprintf(desc, size, "SD read       %3u blocks %7u us", e->a, e->b);
+            break;
+        case TR_CLOCK:
+            snprintf(desc, size, "clock         %u kHz", e->b);
+            break;
+        case TR_KEY:
+            snprintf(desc, size, "key           %s", NAME(key_name, e->a));
+            break;
+        case TR_LCD_FLUSH:
+            snprintf(desc, size, "LCD flush     line %u page %u", e->a, e->b);
+            break;
+        case TR_SEND:
+            if (e->a == TRS_LEADER) {
+                snprintf(desc, size, "send %-8s %u bytes", send_phase[0], e->b);
+            } else {
+                snprintf(desc, size, "send %-8s %u sent", NAME(send_phase, e->a), e->b);
+            }
+            break;
+        case TR_FIFO:
+            snprintf(desc, size, "TX FIFO       level %u, %u sent", e->a, e->b);
+            break;
+        case TR_UNDERRUN:
+            snprintf(desc, size, "TX FIFO EMPTY %u sent", e->b);
+            break;
+        case TR_ERROR:
+            if (e->a == TRE_HEADER) {
+                snprintf(desc, size, "ERROR         %s: size %u code[0] %02X",
+                         error_name[TRE_HEADER], e->b & 0xFFFFFF, e->b >> 24);
+            } else if (e->a == TRE_PIO_MEMORY) {
+                snprintf(desc, size, "ERROR         %s (%s)",
+                         error_name[TRE_PIO_MEMORY], NAME(module_name, e->b));
+            } else {
+                snprintf(desc, size, "ERROR         %s %u", NAME(error_name, e->a), e->b);
+            }
+            break;
+        case TR_PIO_SM:
+            if (e->b & 0xF0) {
+                snprintf(desc, size, "PIO sm        %s pio%u sm %u", NAME(module_name, e->a), e->b >> 4, e->b & 0x0F);
+            } else {
+                snprintf(desc, size, "PIO sm        %s sm %u", NAME(module_name, e->a), e->b);
+            }
+            break;
+        case TR_UPLOAD:
+            snprintf(desc, size, "upload        %s, %u bytes", NAME(status_name, e->a), e->b);
+            break;
+        case TR_CAPTURE:
+            snprintf(desc, size, "capture       %s, %u samples lost", NAME(status_name, e->a), e->b);
+            break;
+        case TR_REGEN:
+            snprintf(desc, size, "regenerator   %u bits, %u%% exact", e->b, e->a);
+            break;
+        case TR_MEMORY:
+            snprintf(desc, size, "memory        %s %s %u bytes", NAME(region_name, e->a & ~TRMEM_SIZE),
+                     (e->a & TRMEM_SIZE) ? "size" : "peak", e->b);
+            break;
+        case TR_STREAM:
+            snprintf(desc, size, "stream        worst %u us%s%s", e->b,
+                     (e->a & TRF_FAST_SEEK) ? ", fast seek" : "", (e->a & TRF_LATE) ? ", LATE" : "");
+            break;
+        case TR_RECORD:
+            snprintf(desc, size, "record        %s, worst write %u us%s",
+                     (e->a & TRF_REC_ERROR) ? "ERROR" : "stored", e->b,
+                     (e->a & TRF_REC_CONTIGUOUS) ? ", contiguous" : "");
+            break;
+        case TR_CHANNEL:
+            snprintf(desc, size, "channel       output %u %s", e->a, NAME(channel_state, e->b));
+            break;
+        default:
+            snprintf(desc, size, "event %02X      a=%u b=%u", e->id, e->a, e->b);
+            break;
+    }
+}
+
+// Treat a trace frame
+static void traceFrame (const uint8_t *payload, int len) {
+    if ((len < 3) || (((len - 3) % TR_EVENT_SIZE) != 0) || (payload[0] > 1)) {
+        bad_frames++;
+        return;
+    }
+    frames++;
+    int core = payload[0];
+    unsigned n_lost = payload[1] | (payload[2] << 8);
+    if (n_lost) {
+        lost += n_lost;
+        if (show_events) {
+            printf("               core %d: %u events lost\n", core, n_lost);
+        }
+    }
+    for (const uint8_t *p = payload+3; p < (payload+len); p += TR_EVENT_SIZE) {
+        TR_EVENT e = { upGet32(p), p[4], p[5], upGet32(p+6) };
+        count[e.id]++;
+        if (e.id == TR_SD_READ) {
+            sd_total += e.b;
+            if (e.b < sd_min) {
+                sd_min = e.b;
+            }
+            if (e.b > sd_max) {
+                sd_max = e.b;
+            }
+        }
+        if ((e.id == TR_MEMORY) && ((e.a & ~TRMEM_SIZE) < TRMEM_COUNT)) {
+            int r = e.a & ~TRMEM_SIZE;
+            if (e.a & TRMEM_SIZE) {
+                mem_size[r] = e.b;
+            } else if (e.b > mem_peak[r]) {
+                mem_peak[r] = e.b;
+            }
+        }
+        if ((e.id == TR_RECORD) && (e.b > record_max)) {
+            record_max = e.b;
+        }
+        if (e.id == TR_STREAM) {
+            if (e.b > stream_max) {
+                stream_max = e.b;
+            }
+            if (e.a & TRF_LATE) {
+                stream_late++;
+            }
+        }
+        if (show_events) {
+            char desc[80];
+            describe(&e, desc, sizeof(desc));
+            uint32_t delta = has_time[core] ? e.time - last_time[core] : 0;
+            printf("%10.3f %+10.3f %d %s\n", e.time / 1000.0, delta / 1000.0, core, desc);
+        }
+        last_time[core] = e.time;
+        has_time[core] = true;
+    }
+}
+
+int main (int argc, char *argv[]) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ms")) != -1) {
+        switch (opt) {
+            case 'm':
+                show_msgs = true;
+                break;
+            case 's':
+                show_events = false;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-m] [-s] source\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind != (argc-1)) {
+        fprintf(stderr, "Usage: %s [-m] [-s] source\n", argv[0]);
+        return 1;
+    }
+    int fd = openSource(argv[optind]);
+    if (fd < 0) {
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+
+    if (show_events) {
+        printf("   time ms    delta ms core event\n");
+    }
+    UP_PARSER parser;
+    upInit(&parser);
+    int idle = parser.state;
+    char msg[256];
+    int nmsg = 0;
+    uint8_t buf[4096];
+    ssize_t n;
+    while (!stop && ((n = read(fd, buf, sizeof(buf))) > 0)) {
+        for (ssize_t i = 0; i < n; i++) {
+            int state = parser.state;
+            int type = upParse(&parser, buf[i]);
+            if (type == UP_TRACE) {
+                traceFrame(parser.payload, parser.len);
+            } else if (type == UP_BAD) {
+                bad_frames++;
+            } else if (show_msgs && (state == idle) && (parser.state == idle)) {
+                // outside a frame
+                if ((buf[i] == '\n') || (nmsg == (int) (sizeof(msg)-1))) {
+                    msg[nmsg] = 0;
+                    printf("               > %s\n", msg);
+                    nmsg = 0;
+                } else if (buf[i] != '\r') {
+                    msg[nmsg++] = buf[i];
+                }
+            }
+        }
+    }
+    close(fd);
+
+    printf("\n%lu trace frames, %lu invalid, %lu events lost\n", frames, bad_frames, lost);
+    for (int id = 0; id < 256; id++) {
+        if (count[id]) {
+            printf("  %-14s %lu\n", NAME(event_name, id), count[id]);
+        }
+    }
+    if (count[TR_SD_READ]) {
+        printf("SD read: min %u us, avg %llu us, max %u us\n", sd_min,
+               (unsigned long long) (sd_total / count[TR_SD_READ]), sd_max);
+    }
+    if (count[TR_STREAM]) {
+        printf("Files read: worst read %u us, %lu with late reads\n", stream_max, stream_late);
+    }
+    if (count[TR_RECORD]) {
+        printf("Files written: worst write %u us\n", record_max);
+    }
+    if (count[TR_MEMORY]) {
+        printf("Memory peaks:");
+        for (int r = 0; r < TRMEM_COUNT; r++) {
+            printf("%s %s %u/%u", r ? "," : "", region_name[r], mem_peak[r], mem_size[r]);
+        }
+        printf(" bytes\n");
+    }
+    if (count[TR_UNDERRUN]) {
+        printf("TX FIFO found empty %lu times\n", count[TR_UNDERRUN]);
+    }
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+    k7upload - sends a .P file to PicoK7 over USB (CDC)
+
+    Usage: k7upload [-s] [-n] port file.P [name]
+        -s  store the file in the ZX81 directory of the SD card
+        -n  don't send the file to the tape (only with -s)
+        port is the serial port of the PicoK7 (ex: /dev/ttyACM0)
+        or the pty created by k7loop
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+
+#include "upproto.h"
+
+static int port;
+static UP_PARSER parser;
+
+static const char *status_msg[] = {
+    "OK", "protocol error", "invalid file", "SD card error", "aborted", "timeout"
+};
+
+// Current time in seconds
+static double now (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Open the serial port in raw mode
+static int openPort (const char *path) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetspeed(&tio, B115200);  // ignored by USB CDC
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+// Send a frame
+static bool sendFrame (uint8_t type, const uint8_t *payload, int len) {
+    uint8_t frame[UP_MAX_FRAME];
+    int n = upFrame(frame, type, payload, len);
+    for (int i = 0; i < n; ) {
+        ssize_t w = write(port, frame+i, n-i);
+        if (w <= 0) {
+            perror("write");
+            return false;
+        }
+        i += w;
+    }
+    return true;
+}
+
+// Wait for a frame from the device
+// Text outside frames (debug messages) is ignored
+// Returns the frame type, UP_NONE on timeout or UP_BAD on error
+static int getFrame (int timeout_ms) {
+    static uint8_t buf[256];
+    static int nbuf, pbuf;
+
+    while (true) {
+        while (pbuf < nbuf) {
+            uint8_t c = buf[pbuf++];
+            int type = upParse(&parser, c);
+            if (type != UP_NONE) {
+                return type;
+            }
+        }
+        struct pollfd pfd = { port, POLLIN, 0 };
+        int r = poll(&pfd, 1, timeout_ms);
+        if (r == 0) {
+            return UP_NONE;
+        }
+        if (r < 0) {
+            perror("poll");
+            return UP_BAD;
+        }
+        ssize_t n = read(port, buf, sizeof(buf));
+        if (n <= 0) {
+            fprintf(stderr, "Device disconnected\n");
+            return UP_BAD;
+        }
+        nbuf = n;
+        pbuf = 0;
+    }
+}
+
+int main (int argc, char *argv[]) {
+    uint8_t flags = UPF_SEND;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "sn")) != -1) {
+        switch (opt) {
+            case 's':
+                flags |= UPF_STORE;
+                break;
+            case 'n':
+                flags &= ~UPF_SEND;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s] [-n] port file.P [name]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (((argc - optind) < 2) || (flags == 0)) {
+        fprintf(stderr, "Usage: %s [-s] [-n] port file.P [name]\n", argv[0]);
+        return 1;
+    }
+
+    // Read the file
+    FILE *f = fopen(argv[optind+1], "rb");
+    if (f == NULL) {
+        perror(argv[optind+1]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *image = malloc(size ? size : 1);
+    if ((image == NULL) || (fread(image, 1, size, f) != size)) {
+        fprintf(stderr, "Error reading %s\n", argv[optind+1]);
+        return 1;
+    }
+    fclose(f);
+
+    const char *name = (argc - optind) > 2 ? argv[optind+2] : argv[optind+1];
+    const char *slash = strrchr(name, '/');
+    if (slash != NULL) {
+        name = slash+1;
+    }
+    if (strlen(name) > UP_MAX_NAME) {
+        fprintf(stderr, "Name too long\n");
+        return 1;
+    }
+
+    port = openPort(argv[optind]);
+    if (port < 0) {
+        return 1;
+    }
+    upInit(&parser);
+
+    // Start transfer
+    uint8_t start[5+UP_MAX_NAME];
+    start[0] = flags;
+    upPut32(start+1, size);
+    memcpy(start+5, name, strlen(name));
+    if (!sendFrame(UP_START, start, 5+strlen(name))) {
+        return 1;
+    }
+
+    double t0 = now();
+    double t_data = 0;
+    size_t credit = 0, pos = 0;
+    uint32_t sent = 0;
+    bool ended = false;
+    while (true) {
+        // Send what the credit allows
+        while ((credit > 0) && (pos < size)) {
+            int n = credit > UP_MAX_PAYLOAD ? UP_MAX_PAYLOAD : credit;
+            if ((pos + n) > size) {
+                n = size - pos;
+            }
+            if (!sendFrame(UP_DATA, image+pos, n)) {
+                return 1;
+            }
+            pos += n;
+            credit -= n;
+        }
+        if ((pos == size) && !ended) {
+            t_data = now() - t0;
+            sendFrame(UP_END, NULL, 0);
+            ended = true;
+        }
+
+        int type = getFrame(30000);
+        switch (type) {
+            case UP_NONE:
+                fprintf(stderr, "\nTimeout\n");
+                sendFrame(UP_ABORT, NULL, 0);
+                return 1;
+            case UP_BAD:
+                fprintf(stderr, "\nInvalid frame\n");
+                sendFrame(UP_ABORT, NULL, 0);
+                return 1;
+            case UP_CREDIT:
+                credit += parser.payload[0] | (parser.payload[1] << 8);
+                break;
+            case UP_PROGRESS:
+                sent = upGet32(parser.payload);
+                printf("\rSent to tape: %u bytes", sent);
+                fflush(stdout);
+                break;
+            case UP_STATUS: {
+                uint8_t st = parser.payload[0];
+                double t = now() - t0;
+                if (sent) {
+                    printf("\n");
+                }
+                printf("Status: %s\n", st < (sizeof(status_msg)/sizeof(status_msg[0])) ?
+                        status_msg[st] : "unknown");
+                printf("%zu bytes, upload %.3f s (%.1f KB/s), total %.3f s\n",
+                        pos, t_data, t_data > 0 ? pos / t_data / 1024 : 0.0, t);
+                return st == UPS_OK ? 0 : 2;
+            }
+        }
+    }
+}
@@ -0,0 +1,207 @@
+/*
+    k7wav - makes a tape recording (WAV) of a ZX81 program, as played
+    by a tape deck, to test the regenerator of PicoK7
+
+    Usage: k7wav [options] file.P out.wav
+        -r hz       sample rate (default 44100)
+        -a frac     amplitude of the pulses, fraction of the full scale (default 0.5)
+        -n frac     noise (rms), fraction of the full scale (default 0.02)
+        -s percent  speed error of the tape deck (default 0)
+        -w percent  wow, slow variation of the speed (default 0)
+        -f hz       high frequency loss of the tape, low pass (default 6000)
+        -c hz       AC coupling, high pass (default 100)
+        -i          inverted polarity
+        -N name     tape name (default DQ)
+
+    The pulses are made like k7.pio does (waveform.c) and go through
+    the filters, so they come out round and with a droop, like in a
+    real recording.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "waveform.h"
+#include "zx81load.h"
+
+#define OVERSAMPLE  8       // levels averaged in each sample
+#define WOW_HZ      0.5     // frequency of the wow
+
+static uint8_t tape[ZXL_MAX_NAME + ZXL_MAX_DATA];
+
+static void usage (void) {
+    fprintf(stderr, "Usage: k7wav [-r hz] [-a frac] [-n frac] [-s percent] [-w percent]\n"
+                    "             [-f hz] [-c hz] [-i] [-N name] file.P out.wav\n");
+    exit(1);
+}
+
+// Read a .P file, returns the program size (0 if invalid)
+static int readP (const char *file, uint8_t *buf) {
+    FILE *f = fopen(file, "rb");
+    if (f == NULL) {
+        perror(file);
+        return 0;
+    }
+    int size = fread(buf, 1, ZXL_MAX_DATA, f);
+    fclose(f);
+    if ((size <= 120) || (buf[0] != 0)) {
+        fprintf(stderr, "%s: not a valid .P file\n", file);
+        return 0;
+    }
+    int real_size = buf[11] + 256*buf[12] - 0x4009;
+    if ((real_size > size) || (real_size < 13) || (buf[real_size-1] != 0x80)) {
+        fprintf(stderr, "%s: not a valid .P file\n", file);
+        return 0;
+    }
+    return real_size;
+}
+
+// Gaussian noise (Box-Muller)
+static double gauss (unsigned *seed) {
+    double u1 = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+    double u2 = rand_r(seed) / (RAND_MAX + 1.0);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static void put16 (FILE *f, uint16_t v) {
+    fputc(v & 0xFF, f);
+    fputc(v >> 8, f);
+}
+
+static void put32 (FILE *f, uint32_t v) {
+    put16(f, v & 0xFFFF);
+    put16(f, v >> 16);
+}
+
+// Header of a 16 bit mono PCM WAV
+static void wavHeader (FILE *f, uint32_t rate, uint32_t samples) {
+    fwrite("RIFF", 1, 4, f);
+    put32(f, 36 + 2*samples);
+    fwrite("WAVEfmt ", 1, 8, f);
+    put32(f, 16);
+    put16(f, 1);        // PCM
+    put16(f, 1);        // mono
+    put32(f, rate);
+    put32(f, 2*rate);
+    put16(f, 2);
+    put16(f, 16);
+    fwrite("data", 1, 4, f);
+    put32(f, 2*samples);
+}
+
+int main (int argc, char *argv[]) {
+    uint32_t rate = 44100;
+    double amplitude = 0.5;
+    double noise = 0.02;
+    double speed = 0;
+    double wow = 0;
+    double lp_hz = 6000;
+    double hp_hz = 100;
+    bool invert = false;
+    const char *tname = "DQ";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:a:n:s:w:f:c:iN:")) != -1) {
+        switch (opt) {
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 'a':
+                amplitude = atof(optarg);
+                break;
+            case 'n':
+                noise = atof(optarg);
+                break;
+            case 's':
+                speed = atof(optarg);
+                break;
+            case 'w':
+                wow = atof(optarg);
+                break;
+            case 'f':
+                lp_hz = atof(optarg);
+                break;
+            case 'c':
+                hp_hz = atof(optarg);
+                break;
+            case 'i':
+                invert = true;
+                break;
+            case 'N':
+                tname = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (((argc - optind) != 2) || (rate < 8000) || (lp_hz <= 0) || (hp_hz <= 0)) {
+        usage();
+    }
+
+    // Signal made by PicoK7 (pulses are 1)
+    int name_len = zxlName(tname, tape);
+    int size = readP(argv[optind], tape + name_len);
+    if (size == 0) {
+        return 1;
+    }
+    K7_TIMING tm = K7_TIMING_DEFAULT;
+    WAVE w;
+    waveSynth(&w, tape, name_len + size, &tm, 1, 1.0, 0, NULL);
+
+    FILE *f = fopen(argv[optind+1], "wb");
+    if (f == NULL) {
+        perror(argv[optind+1]);
+        return 1;
+    }
+
+    // The tape is read at 1 + speed, plus the wow
+    double dt = 1e9 / rate / OVERSAMPLE;
+    double a_lp = 1.0 - exp(-2.0 * M_PI * lp_hz / rate);
+    double a_hp = exp(-2.0 * M_PI * hp_hz / rate);
+    double tt = 0;              // tape time (ns)
+    size_t e = 0;               // next edge
+    int level = w.level0;
+    double lp = 0, hp = 0, last = 0;
+    unsigned seed = 1;
+    uint32_t samples = 0;
+
+    wavHeader(f, rate, 0);
+    for (uint32_t s = 0; tt < w.end; s++) {
+        double rs = (1.0 + speed / 100.0) * (1.0 + wow / 100.0 * sin(2.0 * M_PI * WOW_HZ * s / rate));
+        double sum = 0;
+        for (int i = 0; i < OVERSAMPLE; i++) {
+            tt += dt * rs;
+            while ((e < w.n) && (w.t[e] <= tt)) {
+                level = !level;
+                e++;
+            }
+            sum += level;
+        }
+        double x = sum / OVERSAMPLE;
+        lp += a_lp * (x - lp);
+        hp = a_hp * (hp + lp - last);
+        last = lp;
+        double y = (invert ? -hp : hp) * amplitude + noise * gauss(&seed);
+        if (y > 1.0) {
+            y = 1.0;
+        } else if (y < -1.0) {
+            y = -1.0;
+        }
+        put16(f, (uint16_t) (int16_t) lrint(y * 32767));
+        samples++;
+    }
+    fseek(f, 0, SEEK_SET);
+    wavHeader(f, rate, samples);
+    fclose(f);
+    waveFree(&w);
+
+    printf("%u samples, %.1f s\n", samples, (double) samples / rate);
+    return 0;
+}
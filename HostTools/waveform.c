@@ -0,0 +1,209 @@
+/*
+    Digital waveforms (EAR/MIC signals) for the host tools
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "waveform.h"
+#include "audio.h"
+
+void waveInit (WAVE *w, int level0) {
+    w->level0 = level0;
+    w->t = NULL;
+    w->n = w->size = 0;
+    w->end = 0;
+}
+
+void waveFree (WAVE *w) {
+    free(w->t);
+    waveInit(w, 0);
+}
+
+// Add a level change
+void waveAdd (WAVE *w, uint64_t t) {
+    if (w->n == w->size) {
+        w->size = w->size ? 2 * w->size : 4096;
+        w->t = realloc(w->t, w->size * sizeof(uint64_t));
+        if (w->t == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    if ((w->n > 0) && (t < w->t[w->n-1])) {
+        t = w->t[w->n-1];
+    }
+    w->t[w->n++] = t;
+    if (t > w->end) {
+        w->end = t;
+    }
+}
+
+// Load a waveform, the format is given by the extension
+bool waveLoad (WAVE *w, const char *file, double threshold) {
+    const char *ext = strrchr(file, '.');
+    if ((ext != NULL) && (strcasecmp(ext, ".wav") == 0)) {
+        return waveReadWAV(w, file, threshold);
+    }
+    if ((ext != NULL) && (strcasecmp(ext, ".vcd") == 0)) {
+        return waveReadVCD(w, file);
+    }
+    fprintf(stderr, "%s: unknown format (use .vcd or .wav)\n", file);
+    return false;
+}
+
+// Read the first signal in a VCD file
+bool waveReadVCD (WAVE *w, const char *file) {
+    FILE *f = fopen(file, "r");
+    if (f == NULL) {
+        perror(file);
+        return false;
+    }
+    char line[256];
+    char id[32] = "";
+    double scale = 1.0;     // ns per VCD time unit
+    bool in_timescale = false;
+    bool first = true;
+    int level = 0;
+    uint64_t t = 0;
+
+    waveInit(w, 0);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *p = line;
+        while (isspace((unsigned char) *p)) {
+            p++;
+        }
+        if ((strncmp(p, "$timescale", 10) == 0) || in_timescale) {
+            char *q = in_timescale ? p : p + 10;
+            double v;
+            char unit[8];
+            in_timescale = strstr(p, "$end") == NULL;
+            if (sscanf(q, "%lf %7[a-z]", &v, unit) == 2) {
+                scale = v * (strcmp(unit, "s") == 0 ? 1e9 : strcmp(unit, "ms") == 0 ? 1e6 :
+                             strcmp(unit, "us") == 0 ? 1e3 : strcmp(unit, "ps") == 0 ? 1e-3 :
+                             strcmp(unit, "fs") == 0 ? 1e-6 : 1.0);
+            }
+        } else if ((strncmp(p, "$var", 4) == 0) && (id[0] == 0)) {
+            char type[32], name[64];
+            int size;
+            sscanf(p, "$var %31s %d %31s %63s", type, &size, id, name);
+        } else if (*p == '#') {
+            t = (uint64_t) (strtod(p+1, NULL) * scale);
+            if (t > w->end) {
+                w->end = t;
+            }
+        } else if ((*p == '0') || (*p == '1') || (*p == 'x') || (*p == 'z') ||
+                   (*p == 'b') || (*p == 'B')) {
+            int v;
+            char *sig;
+            if ((*p == 'b') || (*p == 'B')) {
+                sig = strchr(p, ' ');
+                v = p[strlen(p) - (sig ? strlen(sig) : 0) - 1] == '1';
+                sig = sig ? sig + 1 : p;
+            } else {
+                v = *p == '1';
+                sig = p + 1;
+            }
+            sig[strcspn(sig, " \r\n")] = 0;
+            if (strcmp(sig, id) != 0) {
+                continue;
+            }
+            if (first) {
+                w->level0 = level = v;
+                first = false;
+            } else if (v != level) {
+                waveAdd(w, t);
+                level = v;
+            }
+        }
+    }
+    fclose(f);
+    if (first) {
+        fprintf(stderr, "%s: no signal found\n", file);
+        return false;
+    }
+    return true;
+}
+
+// Read an audio capture (see audio.h)
+// The signal is present (level 1) where the front end finds pulses;
+// threshold is the fraction of the envelope of the pulses
+bool waveReadWAV (WAVE *w, const char *file, double threshold) {
+    AFE fe;
+    AFE_CONFIG cfg;
+    uint64_t now = 0;
+
+    afeDefault(&cfg);
+    cfg.threshold = threshold;
+    if (!afeOpen(&fe, file, &cfg)) {
+        return false;
+    }
+    waveInit(w, 0);
+    while (afeRun(&fe, w, &now)) {
+        // all the chunks
+    }
+    w->end = now;
+    afeClose(&fe);
+    return true;
+}
+
+// The level where the waveform stays most of the time (silence)
+int waveIdleLevel (const WAVE *w) {
+    uint64_t time[2] = { 0, 0 };
+    uint64_t last = 0;
+    int level = w->level0;
+    for (size_t i = 0; i < w->n; i++) {
+        time[level] += w->t[i] - last;
+        last = w->t[i];
+        level ^= 1;
+    }
+    time[level] += w->end - last;
+    return time[1] > time[0] ? 1 : 0;
+}
+
+static double jitter (double j, unsigned *seed) {
+    return j ? (2.0 * rand_r(seed) / RAND_MAX - 1.0) * j : 0.0;
+}
+
+// Generate the waveform for the data (name + program), like k7.pio
+// scale multiplies all times (clock tolerance), jitter (us) is added
+// to each edge
+void waveSynth (WAVE *w, const uint8_t *data, int n, const K7_TIMING *tm,
+                int pulse_level, double scale, double jitter_us, unsigned *seed) {
+    double cycle = tm->cycle_us * 1000.0 * scale;
+    double t = tm->leader_ms * 1e6 * scale;
+    double j = jitter_us * 1000.0;
+
+    waveInit(w, !pulse_level);
+    for (int i = 0; i < n; i++) {
+        for (int b = 7; b >= 0; b--) {
+            int bit = (data[i] >> b) & 1;
+            t += (tm->gap + bit) * cycle;
+            for (int p = bit ? tm->pulses1 : tm->pulses0; p > 0; p--) {
+                waveAdd(w, (uint64_t) (t + jitter(j, seed)));
+                t += tm->on * cycle;
+                waveAdd(w, (uint64_t) (t + jitter(j, seed)));
+                t += tm->off * cycle;
+            }
+        }
+    }
+    w->end = (uint64_t) (t + tm->leader_ms * 1e6 * scale);
+}
+
+// Time to send the data (us), without the leader
+double waveDuration (const uint8_t *data, int n, const K7_TIMING *tm) {
+    double cycles = 0;
+    for (int i = 0; i < n; i++) {
+        for (int b = 7; b >= 0; b--) {
+            int bit = (data[i] >> b) & 1;
+            cycles += tm->gap + bit + (bit ? tm->pulses1 : tm->pulses0) * (tm->on + tm->off);
+        }
+    }
+    return cycles * tm->cycle_us;
+}
@@ -0,0 +1,49 @@
+/*
+    Digital waveforms (EAR/MIC signals) for the host tools
+
+    A waveform is the level at time 0 and the times of the
+    level changes (in ns). It can be read from a VCD file (the
+    simulator or a logic analyzer), from a WAV file (an audio
+    capture) or synthesized from a program, like k7.pio does.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#ifndef _WAVEFORM_H
+#define _WAVEFORM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    int level0;         // level at time 0
+    uint64_t *t;        // time of each level change (ns)
+    size_t n, size;
+    uint64_t end;       // end of the waveform (ns)
+} WAVE;
+
+// Timing of the generated signal, in PIO cycles (see k7.pio)
+typedef struct {
+    double cycle_us;    // PIO cycle
+    int on, off;        // pulse high and low
+    int gap;            // silence before a bit 0 (bit 1 has one more cycle)
+    int pulses0, pulses1;
+    double leader_ms;   // silence before the name
+} K7_TIMING;
+
+#define K7_TIMING_DEFAULT { 50.0, 3, 3, 25, 4, 9, 1000.0 }
+
+void waveInit (WAVE *w, int level0);
+void waveFree (WAVE *w);
+void waveAdd (WAVE *w, uint64_t t);
+bool waveLoad (WAVE *w, const char *file, double threshold);
+bool waveReadVCD (WAVE *w, const char *file);
+bool waveReadWAV (WAVE *w, const char *file, double threshold);
+int waveIdleLevel (const WAVE *w);
+void waveSynth (WAVE *w, const uint8_t *data, int n, const K7_TIMING *tm,
+                int pulse_level, double scale, double jitter_us, unsigned *seed);
+double waveDuration (const uint8_t *data, int n, const K7_TIMING *tm);
+
+#endif
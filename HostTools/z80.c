@@ -0,0 +1,740 @@
+/*
+    Z80 interpreter for the host tools
+
+    The opcodes are decoded by their fields (x = bits 7-6, y = bits 5-3,
+    z = bits 2-0, p = y/2, q = y%2). The DD and FD prefixes make HL,
+    H and L refer to IX or IY; (HL) becomes (IX+d).
+
+    Timing: an opcode fetch is 4 T-states, a memory access 3 and an I/O
+    access 4; the extra internal states are added where the instruction
+    has them.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <string.h>
+
+#include "z80.h"
+
+#define FC  0x01
+#define FN  0x02
+#define FP  0x04
+#define FH  0x10
+#define FZ  0x40
+#define FS  0x80
+
+#define A   r[Z80_A]
+#define F   r[Z80_F]
+
+static const uint8_t cc_mask[4] = { FZ, FC, FP, FS };
+
+// Bus cycles
+static uint8_t m1 (Z80 *z) {
+    uint8_t op = z->read(z, z->pc++, Z80_M1);
+    z->refresh = (z->refresh & 0x80) | ((z->refresh + 1) & 0x7F);
+    z->t += 4;
+    return op;
+}
+
+static uint8_t rd8 (Z80 *z, uint16_t addr) {
+    uint8_t v = z->read(z, addr, Z80_MEM);
+    z->t += 3;
+    return v;
+}
+
+static void wr8 (Z80 *z, uint16_t addr, uint8_t v) {
+    z->write(z, addr, v, Z80_MEM);
+    z->t += 3;
+}
+
+static uint8_t in8 (Z80 *z, uint16_t port) {
+    uint8_t v = z->read(z, port, Z80_IO);
+    z->t += 4;
+    return v;
+}
+
+static void out8 (Z80 *z, uint16_t port, uint8_t v) {
+    z->write(z, port, v, Z80_IO);
+    z->t += 4;
+}
+
+static uint8_t imm8 (Z80 *z) {
+    return rd8(z, z->pc++);
+}
+
+static uint16_t imm16 (Z80 *z) {
+    uint16_t v = imm8(z);
+    return v | (imm8(z) << 8);
+}
+
+static uint16_t rd16 (Z80 *z, uint16_t addr) {
+    uint16_t v = rd8(z, addr);
+    return v | (rd8(z, addr+1) << 8);
+}
+
+static void wr16 (Z80 *z, uint16_t addr, uint16_t v) {
+    wr8(z, addr, v & 0xFF);
+    wr8(z, addr+1, v >> 8);
+}
+
+static void push (Z80 *z, uint16_t v) {
+    wr8(z, --z->sp, v >> 8);
+    wr8(z, --z->sp, v & 0xFF);
+}
+
+static uint16_t pop (Z80 *z) {
+    uint16_t v = rd8(z, z->sp++);
+    return v | (rd8(z, z->sp++) << 8);
+}
+
+// Registers
+static void setPair (Z80 *z, int hi, uint16_t v) {
+    z->r[hi] = v >> 8;
+    z->r[hi+1] = v & 0xFF;
+}
+
+// HL, IX or IY (by the prefix)
+static uint16_t getHL (Z80 *z, int pfx) {
+    return (pfx == 0xDD) ? z->ix : (pfx == 0xFD) ? z->iy : z80Pair(z, Z80_H);
+}
+
+static void setHL (Z80 *z, int pfx, uint16_t v) {
+    if (pfx == 0xDD) {
+        z->ix = v;
+    } else if (pfx == 0xFD) {
+        z->iy = v;
+    } else {
+        setPair(z, Z80_H, v);
+    }
+}
+
+// Register pair p of the table with SP (BC, DE, HL, SP)
+static uint16_t getRP (Z80 *z, int pfx, int p) {
+    return (p == 3) ? z->sp : (p == 2) ? getHL(z, pfx) : z80Pair(z, 2*p);
+}
+
+static void setRP (Z80 *z, int pfx, int p, uint16_t v) {
+    if (p == 3) {
+        z->sp = v;
+    } else if (p == 2) {
+        setHL(z, pfx, v);
+    } else {
+        setPair(z, 2*p, v);
+    }
+}
+
+// Register n (not 6), H and L are the halves of IX and IY with a prefix
+static uint8_t getR (Z80 *z, int pfx, int n) {
+    if (pfx && ((n == Z80_H) || (n == Z80_L))) {
+        uint16_t v = getHL(z, pfx);
+        return (n == Z80_H) ? v >> 8 : v & 0xFF;
+    }
+    return z->r[n];
+}
+
+static void setR (Z80 *z, int pfx, int n, uint8_t v) {
+    if (pfx && ((n == Z80_H) || (n == Z80_L))) {
+        uint16_t hl = getHL(z, pfx);
+        setHL(z, pfx, (n == Z80_H) ? (hl & 0x00FF) | (v << 8) : (hl & 0xFF00) | v);
+    } else {
+        z->r[n] = v;
+    }
+}
+
+// Address of (HL) or (IX+d)
+static uint16_t addrHL (Z80 *z, int pfx) {
+    if (pfx == 0) {
+        return z80Pair(z, Z80_H);
+    }
+    int8_t d = imm8(z);
+    z->t += 5;
+    return getHL(z, pfx) + d;
+}
+
+// Flags
+static uint8_t parity (uint8_t v) {
+    v ^= v >> 4;
+    v ^= v >> 2;
+    v ^= v >> 1;
+    return (v & 1) ? 0 : FP;
+}
+
+static uint8_t flagsSZ (uint8_t v) {
+    return (v & FS) | (v ? 0 : FZ);
+}
+
+static uint8_t flagsSZP (uint8_t v) {
+    return flagsSZ(v) | parity(v);
+}
+
+static bool cond (Z80 *z, int y) {
+    bool set = (z->F & cc_mask[y >> 1]) != 0;
+    return (y & 1) ? set : !set;
+}
+
+// ALU operation y (ADD ADC SUB SBC AND XOR OR CP) on A
+static void alu (Z80 *z, int y, uint8_t v) {
+    uint8_t a = z->A;
+    int c = ((y == 1) || (y == 3)) ? (z->F & FC) : 0;
+    int res;
+    switch (y) {
+        case 0:
+        case 1:
+            res = a + v + c;
+            z->F = flagsSZ(res) | ((a ^ v ^ res) & FH) |
+                   ((~(a ^ v) & (a ^ res) & 0x80) ? FP : 0) | ((res & 0x100) ? FC : 0);
+            z->A = res;
+            break;
+        case 2:
+        case 3:
+        case 7:
+            res = a - v - c;
+            z->F = flagsSZ(res) | ((a ^ v ^ res) & FH) | FN |
+                   (((a ^ v) & (a ^ res) & 0x80) ? FP : 0) | ((res & 0x100) ? FC : 0);
+            if (y != 7) {
+                z->A = res;
+            }
+            break;
+        case 4:
+            z->A &= v;
+            z->F = flagsSZP(z->A) | FH;
+            break;
+        case 5:
+            z->A ^= v;
+            z->F = flagsSZP(z->A);
+            break;
+        case 6:
+            z->A |= v;
+            z->F = flagsSZP(z->A);
+            break;
+    }
+}
+
+static uint8_t inc8 (Z80 *z, uint8_t v) {
+    uint8_t res = v + 1;
+    z->F = (z->F & FC) | flagsSZ(res) | (((v & 0x0F) == 0x0F) ? FH : 0) | ((v == 0x7F) ? FP : 0);
+    return res;
+}
+
+static uint8_t dec8 (Z80 *z, uint8_t v) {
+    uint8_t res = v - 1;
+    z->F = (z->F & FC) | flagsSZ(res) | FN | (((v & 0x0F) == 0) ? FH : 0) | ((v == 0x80) ? FP : 0);
+    return res;
+}
+
+// Rotation or shift y (RLC RRC RL RR SLA SRA SLL SRL)
+static uint8_t rot (Z80 *z, int y, uint8_t v) {
+    int c;
+    uint8_t res;
+    switch (y) {
+        case 0:  c = v >> 7; res = (v << 1) | c; break;
+        case 1:  c = v & 1; res = (v >> 1) | (c << 7); break;
+        case 2:  c = v >> 7; res = (v << 1) | (z->F & FC); break;
+        case 3:  c = v & 1; res = (v >> 1) | ((z->F & FC) << 7); break;
+        case 4:  c = v >> 7; res = v << 1; break;
+        case 5:  c = v & 1; res = (v >> 1) | (v & 0x80); break;
+        case 6:  c = v >> 7; res = (v << 1) | 1; break;
+        default: c = v & 1; res = v >> 1; break;
+    }
+    z->F = flagsSZP(res) | (c ? FC : 0);
+    return res;
+}
+
+static uint16_t add16 (Z80 *z, uint16_t a, uint16_t b) {
+    uint32_t res = a + b;
+    z->F = (z->F & (FS | FZ | FP)) | (((a ^ b ^ res) >> 8) & FH) | ((res >> 16) ? FC : 0);
+    return res;
+}
+
+static uint16_t adc16 (Z80 *z, uint16_t a, uint16_t b, bool sub) {
+    int c = z->F & FC;
+    uint32_t res = sub ? a - b - c : a + b + c;
+    uint16_t r16 = res;
+    bool ov = sub ? ((a ^ b) & (a ^ r16) & 0x8000) : (~(a ^ b) & (a ^ r16) & 0x8000);
+    z->F = ((r16 >> 8) & FS) | (r16 ? 0 : FZ) | (((a ^ b ^ res) >> 8) & FH) |
+           (ov ? FP : 0) | (sub ? FN : 0) | ((res & 0x10000) ? FC : 0);
+    return r16;
+}
+
+void z80Reset (Z80 *z) {
+    memset(z->r, 0xFF, sizeof(z->r));
+    memset(z->alt, 0xFF, sizeof(z->alt));
+    z->ix = z->iy = z->sp = 0xFFFF;
+    z->pc = 0;
+    z->i = z->refresh = 0;
+    z->iff1 = z->iff2 = false;
+    z->im = 0;
+    z->halted = false;
+    z->t = 0;
+}
+
+// CB prefix, addr is (IX+d) if pfx
+static void opCB (Z80 *z, int pfx, uint16_t addr) {
+    uint8_t op = pfx ? rd8(z, z->pc++) : m1(z);
+    int x = op >> 6, y = (op >> 3) & 7, n = op & 7;
+    bool mem = pfx || (n == 6);
+    uint8_t v;
+
+    if (mem) {
+        if (pfx) {
+            z->t += 2;      // DD CB d op
+        } else {
+            addr = z80Pair(z, Z80_H);
+        }
+        v = rd8(z, addr);
+        z->t += 1;
+    } else {
+        v = z->r[n];
+    }
+    switch (x) {
+        case 0:
+            v = rot(z, y, v);
+            break;
+        case 1:
+            z->F = (z->F & FC) | FH | ((v & (1 << y)) ? (y == 7 ? FS : 0) : (FZ | FP));
+            return;
+        case 2:
+            v &= ~(1 << y);
+            break;
+        case 3:
+            v |= 1 << y;
+            break;
+    }
+    if (mem) {
+        wr8(z, addr, v);
+        if (pfx && (n != 6)) {
+            z->r[n] = v;    // undocumented copy to a register
+        }
+    } else {
+        z->r[n] = v;
+    }
+}
+
+// Block transfers and searches (LDI CPI INI OUTI and the repeats)
+static void opBlock (Z80 *z, int y, int n) {
+    uint16_t hl = z80Pair(z, Z80_H), de = z80Pair(z, Z80_D), bc = z80Pair(z, Z80_B);
+    int step = (y & 1) ? -1 : 1;
+    bool repeat = y >= 6;
+    bool again = false;
+
+    if (n == 0) {           // LD
+        wr8(z, de, rd8(z, hl));
+        z->t += 2;
+        setPair(z, Z80_H, hl + step);
+        setPair(z, Z80_D, de + step);
+        setPair(z, Z80_B, --bc);
+        z->F = (z->F & (FS | FZ | FC)) | (bc ? FP : 0);
+        again = bc != 0;
+    } else if (n == 1) {    // CP
+        uint8_t v = rd8(z, hl);
+        uint8_t res = z->A - v;
+        z->t += 5;
+        setPair(z, Z80_H, hl + step);
+        setPair(z, Z80_B, --bc);
+        z->F = (z->F & FC) | flagsSZ(res) | ((z->A ^ v ^ res) & FH) | FN | (bc ? FP : 0);
+        again = bc && res;
+    } else if (n == 2) {    // IN
+        z->t += 1;
+        uint8_t v = in8(z, bc);
+        wr8(z, hl, v);
+        setPair(z, Z80_H, hl + step);
+        z->r[Z80_B]--;
+        z->F = (z->F & FC) | FN | (z->r[Z80_B] ? 0 : FZ);
+        again = z->r[Z80_B] != 0;
+    } else {                // OUT
+        z->t += 1;
+        uint8_t v = rd8(z, hl);
+        z->r[Z80_B]--;
+        out8(z, z80Pair(z, Z80_B), v);
+        setPair(z, Z80_H, hl + step);
+        z->F = (z->F & FC) | FN | (z->r[Z80_B] ? 0 : FZ);
+        again = z->r[Z80_B] != 0;
+    }
+    if (repeat && again) {
+        z->pc -= 2;
+        z->t += 5;
+    }
+}
+
+// ED prefix
+// Returns false if invalid
+static bool opED (Z80 *z) {
+    uint8_t op = m1(z);
+    int x = op >> 6, y = (op >> 3) & 7, n = op & 7, p = y >> 1, q = y & 1;
+
+    if ((x == 2) && (n <= 3) && (y >= 4)) {
+        opBlock(z, y, n);
+        return true;
+    }
+    if (x != 1) {
+        return false;
+    }
+    switch (n) {
+        case 0: {       // IN r,(C)
+            uint8_t v = in8(z, z80Pair(z, Z80_B));
+            if (y != 6) {
+                z->r[y] = v;
+            }
+            z->F = (z->F & FC) | flagsSZP(v);
+            break;
+        }
+        case 1:         // OUT (C),r
+            out8(z, z80Pair(z, Z80_B), (y == 6) ? 0 : z->r[y]);
+            break;
+        case 2:         // SBC/ADC HL,rr
+            z->t += 7;
+            setPair(z, Z80_H, adc16(z, z80Pair(z, Z80_H), getRP(z, 0, p), q == 0));
+            break;
+        case 3: {       // LD (nn),rr / LD rr,(nn)
+            uint16_t addr = imm16(z);
+            if (q == 0) {
+                wr16(z, addr, getRP(z, 0, p));
+            } else {
+                setRP(z, 0, p, rd16(z, addr));
+            }
+            break;
+        }
+        case 4: {       // NEG
+            uint8_t v = z->A;
+            z->A = 0;
+            alu(z, 2, v);
+            break;
+        }
+        case 5:         // RETN / RETI
+            z->pc = pop(z);
+            z->iff1 = z->iff2;
+            break;
+        case 6:         // IM
+            z->im = (y & 3) == 0 ? 0 : (y & 3) - 1;
+            break;
+        case 7:
+            switch (y) {
+                case 0: z->t += 1; z->i = z->A; break;
+                case 1: z->t += 1; z->refresh = z->A; break;
+                case 2:
+                case 3:
+                    z->t += 1;
+                    z->A = (y == 2) ? z->i : z->refresh;
+                    z->F = (z->F & FC) | flagsSZ(z->A) | (z->iff2 ? FP : 0);
+                    break;
+                case 4:
+                case 5: {   // RRD / RLD
+                    uint16_t hl = z80Pair(z, Z80_H);
+                    uint8_t v = rd8(z, hl);
+                    z->t += 4;
+                    uint8_t a = z->A;
+                    if (y == 4) {
+                        z->A = (a & 0xF0) | (v & 0x0F);
+                        v = (v >> 4) | (a << 4);
+                    } else {
+                        z->A = (a & 0xF0) | (v >> 4);
+                        v = (v << 4) | (a & 0x0F);
+                    }
+                    wr8(z, hl, v);
+                    z->F = (z->F & FC) | flagsSZP(z->A);
+                    break;
+                }
+                default:
+                    return false;
+            }
+            break;
+    }
+    return true;
+}
+
+// Execute one instruction
+// Returns the T-states, -1 if the opcode is invalid
+int z80Step (Z80 *z) {
+    uint64_t t0 = z->t;
+    int pfx = 0;
+    uint8_t op;
+
+    if (z->halted) {
+        m1(z);          // HALT executes NOPs
+        z->pc--;
+        return z->t - t0;
+    }
+    op = m1(z);
+    while ((op == 0xDD) || (op == 0xFD)) {
+        pfx = op;
+        op = m1(z);
+    }
+    if (op == 0xED) {
+        return opED(z) ? (int) (z->t - t0) : -1;
+    }
+    if (op == 0xCB) {
+        uint16_t addr = 0;
+        if (pfx) {
+            addr = getHL(z, pfx) + (int8_t) imm8(z);
+        }
+        opCB(z, pfx, addr);
+        return z->t - t0;
+    }
+
+    int x = op >> 6, y = (op >> 3) & 7, n = op & 7, p = y >> 1, q = y & 1;
+    switch (x) {
+        case 0:
+            switch (n) {
+                case 0:
+                    if (y == 1) {           // EX AF,AF'
+                        uint8_t a = z->A, f = z->F;
+                        z->A = z->alt[Z80_A];
+                        z->F = z->alt[Z80_F];
+                        z->alt[Z80_A] = a;
+                        z->alt[Z80_F] = f;
+                    } else if (y >= 2) {    // DJNZ, JR, JR cc
+                        if (y == 2) {
+                            z->t += 1;
+                        }
+                        int8_t d = imm8(z);
+                        bool jump = (y == 2) ? --z->r[Z80_B] != 0 : (y == 3) ? true : cond(z, y - 4);
+                        if (jump) {
+                            z->pc += d;
+                            z->t += 5;
+                        }
+                    }
+                    break;
+                case 1:
+                    if (q == 0) {           // LD rr,nn
+                        setRP(z, pfx, p, imm16(z));
+                    } else {                // ADD HL,rr
+                        z->t += 7;
+                        setHL(z, pfx, add16(z, getHL(z, pfx), getRP(z, pfx, p)));
+                    }
+                    break;
+                case 2: {
+                    uint16_t addr;
+                    switch (y) {
+                        case 0: wr8(z, z80Pair(z, Z80_B), z->A); break;
+                        case 1: z->A = rd8(z, z80Pair(z, Z80_B)); break;
+                        case 2: wr8(z, z80Pair(z, Z80_D), z->A); break;
+                        case 3: z->A = rd8(z, z80Pair(z, Z80_D)); break;
+                        case 4: addr = imm16(z); wr16(z, addr, getHL(z, pfx)); break;
+                        case 5: addr = imm16(z); setHL(z, pfx, rd16(z, addr)); break;
+                        case 6: addr = imm16(z); wr8(z, addr, z->A); break;
+                        case 7: addr = imm16(z); z->A = rd8(z, addr); break;
+                    }
+                    break;
+                }
+                case 3:                     // INC/DEC rr
+                    z->t += 2;
+                    setRP(z, pfx, p, getRP(z, pfx, p) + (q ? -1 : 1));
+                    break;
+                case 4:
+                case 5:                     // INC/DEC r
+                    if (y == 6) {
+                        uint16_t addr = addrHL(z, pfx);
+                        uint8_t v = rd8(z, addr);
+                        z->t += 1;
+                        wr8(z, addr, (n == 4) ? inc8(z, v) : dec8(z, v));
+                    } else {
+                        uint8_t v = getR(z, pfx, y);
+                        setR(z, pfx, y, (n == 4) ? inc8(z, v) : dec8(z, v));
+                    }
+                    break;
+                case 6:                     // LD r,n
+                    if (y == 6) {
+                        uint16_t addr = addrHL(z, pfx);
+                        if (pfx) {
+                            z->t -= 3;      // n is read while adding d
+                        }
+                        wr8(z, addr, imm8(z));
+                    } else {
+                        setR(z, pfx, y, imm8(z));
+                    }
+                    break;
+                case 7: {
+                    uint8_t a = z->A, c = z->F & FC, f = z->F & (FS | FZ | FP);
+                    switch (y) {
+                        case 0: c = a >> 7; a = (a << 1) | c; break;             // RLCA
+                        case 1: c = a & 1; a = (a >> 1) | (c << 7); break;       // RRCA
+                        case 2: { int o = a >> 7; a = (a << 1) | c; c = o; break; }     // RLA
+                        case 3: { int o = a & 1; a = (a >> 1) | (c << 7); c = o; break; } // RRA
+                        case 4: {                                               // DAA
+                            uint8_t fix = 0;
+                            bool h = z->F & FH, sub = z->F & FN;
+                            if (h || ((a & 0x0F) > 9)) {
+                                fix = 0x06;
+                            }
+                            if (c || (a > 0x99)) {
+                                fix |= 0x60;
+                                c = 1;
+                            }
+                            uint8_t res = sub ? a - fix : a + fix;
+                            z->F = flagsSZP(res) | (sub ? FN : 0) | (c ? FC : 0) | ((a ^ res) & FH);
+                            z->A = res;
+                            return z->t - t0;
+                        }
+                        case 5: z->A = ~a; z->F |= FH | FN; return z->t - t0;   // CPL
+                        case 6: z->F = f | FC; return z->t - t0;                 // SCF
+                        case 7: z->F = f | ((z->F & FC) ? FH : FC); return z->t - t0;   // CCF
+                    }
+                    z->A = a;
+                    z->F = f | c;
+                    break;
+                }
+            }
+            break;
+
+        case 1:
+            if ((y == 6) && (n == 6)) {     // HALT
+                z->halted = true;
+                z->pc--;
+            } else if (y == 6) {            // LD (HL),r
+                wr8(z, addrHL(z, pfx), z->r[n]);
+            } else if (n == 6) {            // LD r,(HL)
+                z->r[y] = rd8(z, addrHL(z, pfx));
+            } else {
+                setR(z, pfx, y, getR(z, pfx, n));
+            }
+            break;
+
+        case 2:                             // ALU r
+            if (n == 6) {
+                alu(z, y, rd8(z, addrHL(z, pfx)));
+            } else {
+                alu(z, y, getR(z, pfx, n));
+            }
+            break;
+
+        case 3:
+            switch (n) {
+                case 0:                     // RET cc
+                    z->t += 1;
+                    if (cond(z, y)) {
+                        z->pc = pop(z);
+                    }
+                    break;
+                case 1:
+                    if (q == 0) {           // POP
+                        uint16_t v = pop(z);
+                        if (p == 3) {
+                            z->A = v >> 8;
+                            z->F = v & 0xFF;
+                        } else {
+                            setRP(z, pfx, p, v);
+                        }
+                    } else if (p == 0) {    // RET
+                        z->pc = pop(z);
+                    } else if (p == 1) {    // EXX
+                        for (int i = Z80_B; i <= Z80_L; i++) {
+                            uint8_t v = z->r[i];
+                            z->r[i] = z->alt[i];
+                            z->alt[i] = v;
+                        }
+                    } else if (p == 2) {    // JP (HL)
+                        z->pc = getHL(z, pfx);
+                    } else {                // LD SP,HL
+                        z->t += 2;
+                        z->sp = getHL(z, pfx);
+                    }
+                    break;
+                case 2: {                   // JP cc,nn
+                    uint16_t addr = imm16(z);
+                    if (cond(z, y)) {
+                        z->pc = addr;
+                    }
+                    break;
+                }
+                case 3:
+                    switch (y) {
+                        case 0: z->pc = imm16(z); break;                    // JP nn
+                        case 2: out8(z, (z->A << 8) | imm8(z), z->A); break; // OUT (n),A
+                        case 3: {                                           // IN A,(n)
+                            uint8_t port = imm8(z);
+                            z->A = in8(z, (z->A << 8) | port);
+                            break;
+                        }
+                        case 4: {                                           // EX (SP),HL
+                            uint16_t v = rd16(z, z->sp);
+                            z->t += 1;
+                            wr8(z, z->sp + 1, getHL(z, pfx) >> 8);
+                            wr8(z, z->sp, getHL(z, pfx) & 0xFF);
+                            z->t += 2;
+                            setHL(z, pfx, v);
+                            break;
+                        }
+                        case 5: {                                           // EX DE,HL
+                            uint16_t v = z80Pair(z, Z80_D);
+                            setPair(z, Z80_D, z80Pair(z, Z80_H));
+                            setPair(z, Z80_H, v);
+                            break;
+                        }
+                        case 6: z->iff1 = z->iff2 = false; break;           // DI
+                        case 7: z->iff1 = z->iff2 = true; break;            // EI
+                    }
+                    break;
+                case 4: {                   // CALL cc,nn
+                    uint16_t addr = imm16(z);
+                    if (cond(z, y)) {
+                        z->t += 1;
+                        push(z, z->pc);
+                        z->pc = addr;
+                    }
+                    break;
+                }
+                case 5:
+                    if (q == 0) {           // PUSH
+                        z->t += 1;
+                        push(z, (p == 3) ? (z->A << 8) | z->F : getRP(z, pfx, p));
+                    } else if (p == 0) {    // CALL nn
+                        uint16_t addr = imm16(z);
+                        z->t += 1;
+                        push(z, z->pc);
+                        z->pc = addr;
+                    } else {
+                        return -1;          // prefixes handled above
+                    }
+                    break;
+                case 6:                     // ALU n
+                    alu(z, y, imm8(z));
+                    break;
+                case 7:                     // RST
+                    z->t += 1;
+                    push(z, z->pc);
+                    z->pc = y * 8;
+                    break;
+            }
+            break;
+    }
+    return z->t - t0;
+}
+
+// Non maskable interrupt
+// Returns the T-states
+int z80Nmi (Z80 *z) {
+    uint64_t t0 = z->t;
+    if (z->halted) {
+        z->halted = false;
+        z->pc++;
+    }
+    z->iff2 = z->iff1;
+    z->iff1 = false;
+    z->t += 5;
+    push(z, z->pc);
+    z->pc = 0x0066;
+    return z->t - t0;
+}
+
+// Maskable interrupt, bus is the value on the data bus (IM 0 and 2)
+// Returns the T-states (0 if disabled)
+int z80Int (Z80 *z, uint8_t bus) {
+    uint64_t t0 = z->t;
+    if (!z->iff1) {
+        return 0;
+    }
+    if (z->halted) {
+        z->halted = false;
+        z->pc++;
+    }
+    z->iff1 = z->iff2 = false;
+    z->t += 7;      // acknowledge cycle
+    push(z, z->pc);
+    if (z->im == 2) {
+        z->pc = rd16(z, (z->i << 8) | bus);
+    } else {
+        z->pc = (z->im == 0) ? bus & 0x38 : 0x0038;     // IM 0 with an RST on the bus
+    }
+    return z->t - t0;
+}
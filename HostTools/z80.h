@@ -0,0 +1,52 @@
+/*
+    Z80 interpreter for the host tools
+
+    Runs Z80 code against memory and I/O callbacks, counting T-states.
+    Each access is reported with its kind (opcode fetch, memory, I/O)
+    at the T-state where its machine cycle starts, so the callbacks can
+    follow the bus.
+
+    The documented instructions are implemented (plus SLL and the halves
+    of IX and IY), with the documented timing; the undocumented flags
+    (bits 3 and 5) are not.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#ifndef _Z80_H
+#define _Z80_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum { Z80_M1, Z80_MEM, Z80_IO } Z80_CYCLE;
+
+// Register order in r[] (as in the opcodes, 6 is F)
+enum { Z80_B, Z80_C, Z80_D, Z80_E, Z80_H, Z80_L, Z80_F, Z80_A };
+
+typedef struct Z80 Z80;
+struct Z80 {
+    uint8_t r[8];
+    uint8_t alt[8];     // alternate set (EX AF,AF' and EXX)
+    uint16_t ix, iy, sp, pc;
+    uint8_t i, refresh;
+    bool iff1, iff2;
+    int im;
+    bool halted;
+    uint64_t t;         // T-states since reset
+    void *ctx;
+    uint8_t (*read) (Z80 *z, uint16_t addr, Z80_CYCLE kind);
+    void (*write) (Z80 *z, uint16_t addr, uint8_t val, Z80_CYCLE kind);
+};
+
+void z80Reset (Z80 *z);
+int  z80Step (Z80 *z);
+int  z80Nmi (Z80 *z);
+int  z80Int (Z80 *z, uint8_t bus);
+
+static inline uint16_t z80Pair (const Z80 *z, int hi) {
+    return (z->r[hi] << 8) | z->r[hi+1];
+}
+
+#endif
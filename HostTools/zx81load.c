@@ -0,0 +1,287 @@
+/*
+    Reference decoder - a model of the ZX81 ROM LOAD routine
+
+    For each bit the ROM waits for the signal (a loop that times out
+    after 256 samples), then counts loop iterations in D while the
+    signal keeps coming back before 26 silent samples. The count
+    (0x94 - D) tells the bit value: 1 if D ends negative, 0 if D ends
+    below 0x56 and noise (ignored) otherwise. The timings below are the
+    T states of these loops, with the Z80 at 3.25MHz (FAST mode).
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include "zx81load.h"
+
+// Timing of the ROM loops (T states)
+#define WAIT_LOOP      68      // wait for signal loop
+#define WAIT_SAMPLE    17      // input read in the wait loop
+#define WAIT_TIMEOUT   256     // wait loop iterations before giving up
+#define GET_BIT        50      // from signal detected to the counter loop
+#define COUNT_SIGNAL   50      // counter loop with signal (back to TRAILER)
+#define COUNT_SILENT   51      // counter loop without signal (DJNZ)
+#define BIT_END        30      // store the bit
+#define BYTE_END       120     // store the byte, check for the end
+
+// ZX81 char codes 0x0B to 0x3F (0x0C is the pound sign)
+static const char zx81chars[] = "\"\x7F$:?()><=+-*/;,.0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+static const char *status_str[] = {
+    "OK", "no signal", "signal lost", "waveform ended", "invalid program"
+};
+
+// Position in the waveform (time only goes forward)
+typedef struct {
+    const WAVE *w;
+    size_t i;
+    int pulse_level;
+} CURSOR;
+
+// Is there signal at time t (ns)?
+static bool present (CURSOR *c, double t) {
+    while ((c->i < c->w->n) && (c->w->t[c->i] <= t)) {
+        c->i++;
+    }
+    return (c->w->level0 ^ (int) (c->i & 1)) == c->pulse_level;
+}
+
+void zxlDefault (ZXL_CONFIG *cfg) {
+    cfg->clock_hz = 3250000.0;
+    cfg->pulse_level = 0;
+    cfg->keep_bits = false;
+}
+
+const char *zxlStatusStr (ZXL_STATUS st) {
+    return st <= ZXL_INVALID ? status_str[st] : "?";
+}
+
+void zxlFree (ZXL_RESULT *r) {
+    free(r->bit);
+    r->bit = NULL;
+    r->nbit = 0;
+}
+
+// Margin of a count (iterations) to the limits of its bit value
+static int bitMargin (int value, int n) {
+    int lo = value ? ZXL_BIT1_MIN : ZXL_BIT0_MIN;
+    int hi = value ? ZXL_BIT1_MAX : ZXL_BIT0_MAX;
+    if (n > hi) {
+        n -= 256;   // D wrapped around
+    }
+    return (n - lo) < (hi - n) ? n - lo : hi - n;
+}
+
+// Check the loaded program, like the firmware does with .P files
+static ZXL_STATUS checkProgram (ZXL_RESULT *r) {
+    if ((r->prog_len <= 120) || (r->data[0] != 0) || (r->data[r->prog_len-1] != 0x80)) {
+        return ZXL_INVALID;
+    }
+    return ZXL_OK;
+}
+
+// Store a loaded byte
+// Returns true when the load is over
+static bool storeByte (ZXL_RESULT *r, uint8_t b, bool *in_name) {
+    if (*in_name) {
+        r->name[r->name_len++] = b;
+        if (b & 0x80) {
+            *in_name = false;
+        } else if (r->name_len == ZXL_MAX_NAME) {
+            r->status = ZXL_INVALID;
+            return true;
+        }
+        return false;
+    }
+    r->data[r->data_len++] = b;
+    if (r->data_len == 13) {
+        // E_LINE is loaded, now we know where to stop
+        r->prog_len = r->data[11] + 256*r->data[12] - 0x4009;
+        if ((r->prog_len <= 13) || (r->prog_len > ZXL_MAX_DATA)) {
+            r->prog_len = 0;
+            r->status = ZXL_INVALID;
+            return true;
+        }
+    }
+    if ((r->prog_len != 0) && (r->data_len == r->prog_len)) {
+        r->status = checkProgram(r);
+        return true;
+    }
+    return false;
+}
+
+// Decode a waveform
+ZXL_STATUS zxlDecode (const WAVE *w, const ZXL_CONFIG *cfg, ZXL_RESULT *r) {
+    const double T = 1e9 / cfg->clock_hz;   // ns per T state
+    CURSOR cur = { w, 0, cfg->pulse_level };
+    double t = 0;
+    double t_ready = 0;     // when the ROM starts waiting for the next bit
+    bool started = false;   // a valid bit was loaded
+    bool in_name = true;
+    int c = 1;              // byte being assembled (C register)
+    size_t size_bit = 0;
+
+    memset(r, 0, sizeof(ZXL_RESULT));
+    r->iter_min[0] = r->iter_min[1] = INT_MAX;
+    r->margin[0] = r->margin[1] = INT_MAX;
+    r->gap_margin = INT_MAX;
+    r->min_pulse = INT_MAX;
+    r->slack_us = 1e99;
+
+    while (true) {
+        // Wait for the signal
+        int wait = 0;
+        while (!present(&cur, t + WAIT_SAMPLE*T)) {
+            t += WAIT_LOOP*T;
+            if (t > w->end) {
+                r->status = started ? ZXL_TRUNCATED : ZXL_NO_SIGNAL;
+                goto done;
+            }
+            if (++wait == WAIT_TIMEOUT) {
+                if (started) {
+                    r->status = ZXL_DROPOUT;
+                    goto done;
+                }
+                wait = 0;
+            }
+        }
+        double t_start = t + WAIT_SAMPLE*T;
+        if (started) {
+            // Was the pulse in time?
+            double rise = cur.i > 0 ? w->t[cur.i-1] : 0;
+            double slack = (rise - t_ready) / 1000.0;
+            if (slack < r->slack_us) {
+                r->slack_us = slack;
+            }
+            if (cfg->keep_bits && r->nbit) {
+                r->bit[r->nbit-1].slack_us = slack;
+            }
+        }
+
+        // Counter loop
+        ZXL_BIT bit = { (uint64_t) t_start, 0, 0, 1, 0, 0, INT_MAX, 0.0 };
+        int silent = 0, run = 1;
+        t = t_start + GET_BIT*T;
+        while (silent < ZXL_SILENCE) {
+            bit.iter++;
+            if (present(&cur, t)) {
+                if (t > w->end) {
+                    r->status = started ? ZXL_TRUNCATED : ZXL_NO_SIGNAL;
+                    goto done;
+                }
+                if (silent) {
+                    if (silent > bit.max_gap) {
+                        bit.max_gap = silent;
+                    }
+                    if (run < bit.min_pulse) {
+                        bit.min_pulse = run;
+                    }
+                    bit.pulses++;
+                    run = silent = 0;
+                }
+                run++;
+                t += COUNT_SIGNAL*T;
+            } else {
+                silent++;
+                t += COUNT_SILENT*T;
+            }
+        }
+        if (run < bit.min_pulse) {
+            bit.min_pulse = run;
+        }
+        t += BIT_END*T;
+
+        uint8_t d = (0x94 - bit.iter) & 0xFF;
+        bit.value = (d & 0x80) ? 1 : (d < 0x56) ? 0 : -1;
+        if (bit.value < 0) {
+            r->noise++;     // the ROM goes for the next bit
+        } else {
+            bit.margin = bitMargin(bit.value, bit.iter);
+            if (bit.iter < r->iter_min[bit.value]) {
+                r->iter_min[bit.value] = bit.iter;
+            }
+            if (bit.iter > r->iter_max[bit.value]) {
+                r->iter_max[bit.value] = bit.iter;
+            }
+            if (bit.margin < r->margin[bit.value]) {
+                r->margin[bit.value] = bit.margin;
+            }
+            if ((ZXL_SILENCE - bit.max_gap) < r->gap_margin) {
+                r->gap_margin = ZXL_SILENCE - bit.max_gap;
+            }
+            if (bit.min_pulse < r->min_pulse) {
+                r->min_pulse = bit.min_pulse;
+            }
+            r->bits++;
+            r->t_end = (uint64_t) t;
+            started = true;
+        }
+        if (cfg->keep_bits) {
+            if (r->nbit == (int) size_bit) {
+                size_bit = size_bit ? 2*size_bit : 4096;
+                r->bit = realloc(r->bit, size_bit * sizeof(ZXL_BIT));
+                if (r->bit == NULL) {
+                    fprintf(stderr, "Out of memory\n");
+                    exit(1);
+                }
+            }
+            r->bit[r->nbit++] = bit;
+        }
+        if (bit.value >= 0) {
+            c = (c << 1) | bit.value;
+            if (c & 0x100) {
+                t += BYTE_END*T;
+                if (storeByte(r, c & 0xFF, &in_name)) {
+                    goto done;
+                }
+                c = 1;
+            }
+        }
+        t_ready = t;
+    }
+
+done:
+    return r->status;
+}
+
+// Convert a name to ZX81 tape format (bit7 set in last char)
+// Returns the name size
+int zxlName (const char *src, uint8_t *dst) {
+    int n = 0;
+    for (; *src && (n < ZXL_MAX_NAME); src++) {
+        char c = toupper((unsigned char) *src);
+        const char *p = strchr(zx81chars, c);
+        if (c == ' ') {
+            dst[n++] = 0x00;
+        } else if (p != NULL) {
+            dst[n++] = 0x0B + (p - zx81chars);
+        } else {
+            dst[n++] = 0x0F;    // '?'
+        }
+    }
+    if (n > 0) {
+        dst[n-1] |= 0x80;
+    }
+    return n;
+}
+
+// Convert a tape name to ASCII
+void zxlNameStr (const uint8_t *name, int len, char *dst) {
+    for (int i = 0; i < len; i++) {
+        uint8_t c = name[i] & 0x7F;
+        if (c == 0) {
+            *dst++ = ' ';
+        } else if ((c >= 0x0B) && (c < 0x40)) {
+            *dst++ = zx81chars[c - 0x0B];
+        } else {
+            *dst++ = '?';
+        }
+    }
+    *dst = 0;
+}
@@ -0,0 +1,84 @@
+/*
+    Reference decoder - a model of the ZX81 ROM LOAD routine
+
+    The ROM is not executed: the loops that wait for the signal,
+    count the pulses of a bit and detect the silence between bits
+    are modelled with their timing in T states, sampling the EAR
+    waveform where the ROM would read it.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#ifndef _ZX81LOAD_H
+#define _ZX81LOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "waveform.h"
+
+#define ZXL_MAX_NAME   127
+#define ZXL_MAX_DATA   (16*1024)
+
+// Counter loop limits (iterations) for each bit value
+#define ZXL_BIT0_MIN   63
+#define ZXL_BIT0_MAX   148
+#define ZXL_BIT1_MIN   149
+#define ZXL_BIT1_MAX   276
+#define ZXL_SILENCE    26      // silent samples that end a bit
+
+typedef enum {
+    ZXL_OK,
+    ZXL_NO_SIGNAL,      // nothing decoded
+    ZXL_DROPOUT,        // signal lost in the middle of the program
+    ZXL_TRUNCATED,      // waveform ended before the end of the program
+    ZXL_INVALID         // loaded, but not a valid program
+} ZXL_STATUS;
+
+typedef struct {
+    double clock_hz;    // Z80 clock (3.25MHz)
+    int pulse_level;    // level of the waveform when there is signal
+    bool keep_bits;     // record each bit in the result
+} ZXL_CONFIG;
+
+// A decoded bit
+typedef struct {
+    uint64_t t;         // start (ns)
+    int value;          // 0, 1 or -1 (noise, ignored by the ROM)
+    int iter;           // counter loop iterations
+    int pulses;         // pulses seen
+    int margin;         // iterations to the nearest limit
+    int max_gap;        // longest silence inside the bit (samples)
+    int min_pulse;      // shortest pulse (samples)
+    double slack_us;    // from the end of the bit to the next pulse
+} ZXL_BIT;
+
+typedef struct {
+    ZXL_STATUS status;
+    uint8_t name[ZXL_MAX_NAME+1];
+    int name_len;
+    uint8_t data[ZXL_MAX_DATA];
+    int data_len;       // bytes loaded after the name
+    int prog_len;       // program size (from E_LINE), 0 if unknown
+    int bits;           // valid bits
+    int noise;          // "bits" ignored by the ROM
+    ZXL_BIT *bit;       // each bit (if keep_bits)
+    int nbit;
+    // Worst cases
+    int iter_min[2], iter_max[2];
+    int margin[2];      // iterations to the limits of each bit value
+    int gap_margin;     // samples to spare in the silences inside a bit
+    int min_pulse;      // shortest pulse (samples)
+    double slack_us;    // shortest time from a bit end to the next pulse
+    uint64_t t_end;     // time of the last bit (ns)
+} ZXL_RESULT;
+
+void zxlDefault (ZXL_CONFIG *cfg);
+ZXL_STATUS zxlDecode (const WAVE *w, const ZXL_CONFIG *cfg, ZXL_RESULT *r);
+void zxlFree (ZXL_RESULT *r);
+const char *zxlStatusStr (ZXL_STATUS st);
+int zxlName (const char *src, uint8_t *dst);
+void zxlNameStr (const uint8_t *name, int len, char *dst);
+
+#endif
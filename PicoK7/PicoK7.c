@@ -11,10 +11,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
 #include "hardware/clocks.h"
 #include "hardware/pio.h"
+#include "hardware/spi.h"
 
 #include "ff.h"
 #include "f_util.h"
@@ -22,29 +24,77 @@
 #include "hw_config.h"
 
 #include "picok7.h"
+#include "stream.h"
 
-#define MAX_PFILES   50
-static char *pfiles[MAX_PFILES];
-static int npfiles;
+static char fname[CAT_MAX_NAME+1];     // selected file
+static char optname[CAT_MAX_NAME+1];   // menu option
+static const uint ear_extra[] = PINS_EAR_EXTRA;
+static char title[] = "==File to Send==";
+static bool hint;                      // title replaced by the file hint
+
+#ifdef LIB_PICO_STDIO_USB
+static char usbopt[] = "<USB upload>";
+static char capopt[] = "<USB capture>";
+#endif
+static char packopt[] = "<Packed: off>";
+static int pack_opt;                   // index of packopt in the menu
+static char scopeopt[] = "<Scope>";
+static int scope_opt;                  // index of scopeopt in the menu
+#ifdef PICOK7_REGEN
+static char regenopt[] = "<Regenerate>";
+static int regen_opt;                  // index of regenopt in the menu
+#endif
+static bool packed;
+
+// Boot phases (time since power on)
+#define MAX_PHASES   8
+#define BOOT_SHOW_MS 1500   // time the boot time stays in the title
+static struct {
+    const char *name;
+    uint32_t us;
+} phases[MAX_PHASES];
+static int nphases;
+static uint32_t boot_ms;    // power on to menu (less the wait for USB), shown until a key
 
 static bool findPFiles(void);
+static bool findFiles(const char *dir, const char *pattern, bool list);
+static const char *menuOption(int i);
+static const uint8_t *menuPreview(int i);
+static void menuIdle(int i, uint32_t ms);
+static int chooseOutput(void);
+static const char *outputOption(int i);
+static void bootMark(const char *name);
+static void bootReport(int l);
 
 int main()
 {
+    memInit();
     stdio_init_all();
+    bootMark("start");
 
-    #ifdef LIB_PICO_STDIO_USB
-    while (!stdio_usb_connected()) {
-        sleep_ms(100);
-    }
-    #endif
-
+    // The display reset and power up go on (by an alarm) while
+    // the SD card is mounted and the files are found
+    clockInit();
+    crcInit();
     ws282Init(WS2812_PIO, PIN_WS2812);
-    ws2812Update(urgb_u32(0,0,128));
+    ws2812Pattern(LED_SOLID, urgb_u32(0,0,128));
     k7Init(K7_PIO, PIN_EAR);
+    tapInit(PIN_EAR);
+    chInit(ear_extra, count_of(ear_extra));
     encoderInit(ENC_PIO, PIN_ENC_CLK, PIN_ENC_DT, PIN_ENC_SW);
     displayInit();
     displayStr((char *)"PicoK7 v1.00    ", 0, 0, true);
+    bootMark("init");
+
+    uint32_t usb_ms = 0;    // waiting for the host, not part of the boot
+    #ifdef LIB_PICO_STDIO_USB
+    uint32_t wait_us = time_us_32();
+    while (!stdio_usb_connected()) {
+        sleep_ms(100);
+    }
+    usb_ms = (time_us_32() - wait_us) / 1000;
+    bootMark("usb");
+    #endif
 
     bool sd_ok = false;
     sd_card_t *sd_card_p = sd_get_by_num(0);
@@ -52,11 +102,14 @@ int main()
     FRESULT fr = f_mount(fs_p, "0:", 1);
     if (fr == FR_OK) {
         prtdbg("SD card mounted\n");
+        bootMark("mount");
         sd_card_p->state.mounted = true;
+        clockAddSpi(SD_SPI, spi_get_baudrate(SD_SPI));
         FRESULT fr = f_chdir("/ZX81");
         if (fr == FR_OK) {
             sd_ok = true;
             prtdbg("ZX81 directory found\n");
+            recCleanup();
             displayStr((char *) "SD card OK", 1, 0, false);
         } else {
             prtdbg("f_chdir error: %s (%d)\n", FRESULT_str(fr), fr);
@@ -72,76 +125,290 @@ int main()
             displayStr((char *) "No P file!", 2, 0, false);
             sd_ok = false;
         }
+        bootMark("files");
     }
 
+    displayWait();
+    bootMark("lcd");
+    bootReport(sd_ok ? 8 : 3);    // with no error only the total, in the menu
+
     if (sd_ok) {
+        clockSet(CLK_IDLE_KHZ);
+        boot_ms = time_us_32() / 1000 - usb_ms;
         while (true) {
+            memCheck();
             displayClear();
-            ws2812Update(urgb_u32(0,127,0));
-            displayStr((char *)"==File to Send==", 0, 0, false);
-            int sel = displayMenu(2, 5, npfiles, pfiles);
-            if (k7Send(pfiles[sel])) {
-                ws2812Update(urgb_u32(0,127,0));
+            ws2812Pattern(LED_SOLID, urgb_u32(0,127,0));
+            displayStr(title, 0, 0, false);
+            hint = false;
+            int nopc = catCount();
+            #ifdef LIB_PICO_STDIO_USB
+            nopc += 2;  // USB upload and capture
+            #endif
+            pack_opt = nopc++;
+            scope_opt = nopc++;
+            #ifdef PICOK7_REGEN
+            regen_opt = nopc++;
+            #endif
+            clockSet(CLK_IDLE_KHZ);
+            int sel = displayMenu(1, 7, nopc, menuOption, menuPreview, menuIdle);
+            boot_ms = 0;
+            clockSet(CLK_RUN_KHZ);
+            #ifdef LIB_PICO_STDIO_USB
+            if (sel == catCount()) {
+                if (usbUpload()) {
+                    findPFiles();   // a new file was stored
+                }
+                continue;
+            }
+            if (sel == (catCount()+1)) {
+                usbCapture();
+                continue;
+            }
+            #endif
+            if (sel == pack_opt) {
+                packed = !packed;
+                strcpy(packopt, packed ? "<Packed: on>" : "<Packed: off>");
+                k7Pack(packed);
+                continue;
+            }
+            if (sel == scope_opt) {
+                scopeRun();
+                continue;
+            }
+            #ifdef PICOK7_REGEN
+            if (sel == regen_opt) {
+                regenRun();
+                continue;
+            }
+            #endif
+            catName(sel, fname);
+            bool ok;
+            int out = catIsList(sel) ? -1 : (machineFind(fname) == &machines[MACH_ZX81]) ? chooseOutput() : 0;
+            if (out > 0) {
+                // independent channel, runs in the background
+                CH_STATE st = chStatus(out, NULL);
+                if ((st == CH_LEADER) || (st == CH_SENDING)) {
+                    chAbort(out);
+                    continue;
+                }
+                if (chSend(out, fname)) {
+                    continue;
+                }
+                ok = false;
+            } else {
+                k7Broadcast(out < 0 ? chFreeMask() : 1);
+                ok = catIsList(sel) ? k7Playlist(fname) : k7Send(fname);
+                k7Broadcast(1);
+            }
+            if (ok) {
+                ws2812Pattern(LED_SOLID, urgb_u32(0,127,0));
             }
             else {
                 displayStr((char *)"Invalid file", 6, 0, false);
-                ws2812Update(urgb_u32(128,0,0));
+                ws2812Pattern(LED_FLASH, urgb_u32(128,0,0));
             }
             displayStr((char *)"Press Enter", 7, 0, false);
+            clockReport();
+            memReport();
             while (getKey() != KEY_ENTER) {
-                sleep_ms(100);        
+                traceDrain();
+                chPoll();
+                sleep_ms(10);
             }
         }
     } else {
-        ws2812Update(urgb_u32(128,0,0));
+        ws2812Pattern(LED_FLASH, urgb_u32(128,0,0));
     }
 
+    clockSet(CLK_IDLE_KHZ);
     while (true) {
-        sleep_ms(100);
+        traceDrain();
+        chPoll();
+        sleep_ms(10);
     }
 }
 
 
-// Find all .P files in current directory
+// Find all tape (.P, .O, .TAP) and playlist files in current directory
 // Returns false if error
 bool findPFiles() {
+    clockSet(CLK_FAST_KHZ);     // catalog scan
     char cwdbuf[FF_LFN_BUF] = {0};
     FRESULT fr;
 
-    npfiles = 0;
-
+    catReset();
     fr = f_getcwd(cwdbuf, sizeof cwdbuf);
     if (FR_OK != fr) {
         prtdbg("f_getcwd error: %s (%d)\n", FRESULT_str(fr), fr);
         return false;
     }
-    char const *p_dir = cwdbuf;
+    for (int i = 0; i < MACH_COUNT; i++) {
+        if ((i == 0) || strcmp(machines[i].ext, machines[i-1].ext)) {
+            char pattern[8] = "*";
+            strcat(pattern, machines[i].ext);
+            if (!findFiles(cwdbuf, pattern, false)) {
+                return false;
+            }
+        }
+    }
+    if (!findFiles(cwdbuf, "*.LST", true)) {
+        return false;
+    }
+    prtdbg("Found %d files, catalog uses %lu bytes\n", catCount(), (unsigned long) catUsed());
+    return catCount() > 0;
+}
 
+// Add to the catalog the files in p_dir that match pattern
+// Returns false if error
+static bool findFiles(const char *p_dir, const char *pattern, bool list) {
+    FRESULT fr;
     DIR dj = {};      /* Directory object */
     FILINFO fno = {}; /* File information */
-    fr = f_findfirst(&dj, &fno, p_dir, "*.P");
+    fr = f_findfirst(&dj, &fno, p_dir, pattern);
     if (FR_OK != fr) {
         prtdbg("f_findfirst error: %s (%d)\n", FRESULT_str(fr), fr);
         return false;
     }
     while (fr == FR_OK && fno.fname[0]) {
         if ((fno.fattrib & AM_DIR) == 0) {
-            char *name = (char *) malloc(strlen(fno.fname)+1);
-            if (name == NULL) {
-                prtdbg("Out of memory\n");
-                return false;
-            }
-            strcpy (name, fno.fname);
-            if (npfiles < MAX_PFILES) {
-                pfiles[npfiles++] = name;
-            } else {
-                prtdbg("Too many files\n");
+            if (!catAdd(fno.fname, fno.fsize, list)) {
+                prtdbg("Catalog full\n");
                 break;
             }
         }
         fr = f_findnext(&dj, &fno); /* Search for next item */
     }
     f_closedir(&dj);
-    prtdbg("Found %d files\n", npfiles);
     return true;
 }
+
+// Record the time of a boot phase
+static void bootMark(const char *name) {
+    if (nphases < MAX_PHASES) {
+        phases[nphases].name = name;
+        phases[nphases++].us = time_us_32();
+    }
+}
+
+// Show the boot phases, starting at line l (8: not shown), and send them to USB
+static void bootReport(int l) {
+    char aux[17];
+    prtdbg("BOOT:");
+    for (int i = 0; i < nphases; i++) {
+        prtdbg(" %s %lu.%03lu", phases[i].name,
+            (unsigned long) phases[i].us/1000, (unsigned long) phases[i].us%1000);
+        if (l < 8) {
+            snprintf(aux, sizeof(aux), "%-7s%6lums", phases[i].name,
+                (unsigned long) phases[i].us/1000);
+            displayStr(aux, l++, 0, false);
+        }
+    }
+    prtdbg(" ms\n");
+    memReport();
+    traceDrain();
+}
+
+// Option i of the file menu
+static const char *menuOption(int i) {
+    #ifdef LIB_PICO_STDIO_USB
+    if (i == catCount()) {
+        return usbopt;
+    }
+    if (i == (catCount()+1)) {
+        return capopt;
+    }
+    #endif
+    if (i == pack_opt) {
+        return packopt;
+    }
+    if (i == scope_opt) {
+        return scopeopt;
+    }
+    #ifdef PICOK7_REGEN
+    if (i == regen_opt) {
+        return regenopt;
+    }
+    #endif
+    return catName(i, optname);
+}
+
+// Preview of the screen in option i of the file menu
+static const uint8_t *menuPreview(int i) {
+    if ((i >= catCount()) || catIsList(i)) {
+        return NULL;    // USB options, packed option, scope, regenerator or playlist
+    }
+    catName(i, optname);
+    if (machineFind(optname) != &machines[MACH_ZX81]) {
+        return NULL;    // only the ZX81 screen
+    }
+    return previewImage(optname);
+}
+
+// Background work while the file menu waits for a key
+// A .P file selected for K7_PREFETCH_MS is read and checked, so it is
+// sent at once; its size (or that it is invalid) goes in the title
+static void menuIdle(int i, uint32_t ms) {
+    int size = -1;
+    if (boot_ms != 0) {
+        // the boot time replaces the title until a key is pressed
+        if ((i == 0) && (ms < BOOT_SHOW_MS)) {
+            if (!hint) {
+                char aux[17];
+                uint32_t shown = (boot_ms > 99999) ? 99999 : boot_ms;
+                snprintf(aux, sizeof(aux), "==Boot %5lums==", (unsigned long) shown);
+                displayStr(aux, 0, 0, false);
+                hint = true;
+            }
+            return;
+        }
+        boot_ms = 0;
+        displayStr(title, 0, 0, false);
+        hint = false;
+    }
+    if ((ms < K7_PREFETCH_MS) || (i >= catCount()) || catIsList(i)) {
+        k7Prefetch(NULL);
+    } else {
+        size = k7Prefetch(catName(i, optname));
+    }
+    if ((size < 0) && hint) {
+        displayStr(title, 0, 0, false);
+        hint = false;
+    } else if ((size >= 0) && !hint) {
+        char aux[17];
+        if (size) {
+            snprintf(aux, sizeof(aux), "==%5u bytes===", (uint16_t) size);  // up to 16K
+        } else {
+            strcpy(aux, "==Invalid file==");
+        }
+        displayStr(aux, 0, 0, false);
+        hint = true;
+    }
+}
+
+// Choose where to send a program (when there are extra outputs)
+// Returns -1 for all the free outputs, 0 for the main output or
+// the number of an extra output (if it is busy, it will be aborted)
+static int chooseOutput() {
+    if (k7Outputs() == 1) {
+        return 0;
+    }
+    displayClear();
+    displayStr((char *)"====Send to=====", 0, 0, false);
+    clockSet(CLK_IDLE_KHZ);
+    int sel = displayMenu(1, 7, k7Outputs()+1, outputOption, NULL, NULL);
+    clockSet(CLK_RUN_KHZ);
+    return sel - 1;
+}
+
+// Option i of the output menu
+static const char *outputOption(int i) {
+    if (i == 0) {
+        return "All free";
+    }
+    if (i == 1) {
+        return "Main";
+    }
+    chStatus(i-1, optname);
+    return optname;
+}
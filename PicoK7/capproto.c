@@ -0,0 +1,117 @@
+/**
+ * @file capproto.c
+ * @author Daniel Quadros
+ * @brief USB capture protocol - runs (also used by the host tools)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include "capproto.h"
+
+#define LEVELS_MASK   ((1 << CAP_CHANNELS) - 1)
+
+// Decoder states
+enum { ST_RUN, ST_GAP };
+
+// Write v in LEB128, returns the number of bytes
+static int putNumber (uint8_t *out, uint32_t v) {
+    int n = 0;
+    while (v >= 0x80) {
+        out[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+// Init encoder
+void capEncInit (CAP_ENC *e) {
+    e->run = 0;
+    e->levels = 0;
+}
+
+// Encode the first n samples of a word from the PIO
+// (sample i is in bits i*CAP_CHANNELS and up)
+// Returns the number of bytes written in out (max CAP_ENC_MAX)
+int capEncode (CAP_ENC *e, uint32_t word, int n, uint8_t *out) {
+    int len = 0;
+
+    // fast path: the whole word continues the current run
+    if ((n == CAP_WORD_SAMPLES) && (e->run != 0) && (e->run < CAP_MAX_RUN) &&
+        (word == e->levels * (0xFFFFFFFFu / LEVELS_MASK))) {
+        e->run += CAP_WORD_SAMPLES;
+        return 0;
+    }
+    for (int i = 0; i < n; i++) {
+        uint8_t lv = word & LEVELS_MASK;
+        word >>= CAP_CHANNELS;
+        if (e->run == 0) {
+            e->levels = lv;
+        } else if ((lv != e->levels) || (e->run >= CAP_MAX_RUN)) {
+            len += putNumber(out+len, (e->run << CAP_CHANNELS) | e->levels);
+            e->levels = lv;
+            e->run = 0;
+        }
+        e->run++;
+    }
+    return len;
+}
+
+// Write the current run (so the host is up to date)
+// Returns the number of bytes written in out (max 5)
+int capFlush (CAP_ENC *e, uint8_t *out) {
+    if (e->run == 0) {
+        return 0;
+    }
+    int len = putNumber(out, (e->run << CAP_CHANNELS) | e->levels);
+    e->run = 0;
+    return len;
+}
+
+// Write the current run and the mark of n samples lost
+// Returns the number of bytes written in out (max 11)
+int capLost (CAP_ENC *e, uint32_t n, uint8_t *out) {
+    int len = capFlush(e, out);
+    out[len++] = 0;
+    return len + putNumber(out+len, n);
+}
+
+// Init decoder
+void capDecInit (CAP_DEC *d) {
+    d->state = ST_RUN;
+    d->shift = 0;
+    d->value = 0;
+}
+
+// Decode a byte
+// Returns CAP_RUN or CAP_GAP when complete (result in d->n and d->levels),
+// CAP_NONE if more bytes are needed or CAP_BAD
+int capDecode (CAP_DEC *d, uint8_t c) {
+    if (d->shift > 28) {
+        capDecInit(d);
+        return CAP_BAD;     // too long for 32 bits
+    }
+    d->value |= (uint32_t) (c & 0x7F) << d->shift;
+    if (c & 0x80) {
+        d->shift += 7;
+        return CAP_NONE;
+    }
+    uint32_t v = d->value;
+    d->shift = 0;
+    d->value = 0;
+    if (d->state == ST_GAP) {
+        d->state = ST_RUN;
+        d->n = v;
+        return CAP_GAP;
+    }
+    if (v == 0) {
+        d->state = ST_GAP;
+        return CAP_NONE;
+    }
+    d->n = v >> CAP_CHANNELS;
+    d->levels = v & LEVELS_MASK;
+    return d->n ? CAP_RUN : CAP_BAD;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file capproto.h
+ * @author Daniel Quadros
+ * @brief USB capture protocol - definitions shared with the host tools
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * In the capture mode the PicoK7 is a two channel logic analyzer: EAR
+ * (channel 0) and MIC (channel 1) are sampled at the rate asked by the
+ * host and the samples are sent as runs, in the frames of upproto.h.
+ *
+ * Host to device:
+ *   CAP_START  rate(4) samples(4)  start, samples = 0: until CAP_STOP
+ *   CAP_CREDIT credit(4)           more bytes of run data the host takes
+ *   CAP_STOP                       end the capture
+ * Device to host:
+ *   CAP_INFO   rate(4) channels(1) the real rate (Hz), at the start
+ *   CAP_DATA   runs
+ *   CAP_END    samples(8) lost(4) status(1), status as in upproto.h
+ *
+ * A run is a number in LEB128 (7 bits in each byte, the least
+ * significant first, bit 7 set in all but the last byte):
+ *   (length << CAP_CHANNELS) | levels   (bit n of levels = channel n)
+ * A run with length 0 and levels 0 is followed by the number of
+ * samples lost (the ring buffer was full), the runs go on after them.
+ * Consecutive runs can have the same levels.
+ *
+ * Flow control is credit based, like the upload, but the other way:
+ * the device only sends as many bytes of runs as the host has granted.
+ * The samples wait in a ring buffer while there is no credit.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef __CAPPROTO_H__
+
+#define __CAPPROTO_H__
+
+#include <stdint.h>
+
+// Host to device
+#define CAP_START     0x11    // rate(4) samples(4)
+#define CAP_CREDIT    0x12    // credit(4)
+#define CAP_STOP      0x13    // no payload
+
+// Device to host
+#define CAP_INFO      0x91    // rate(4) channels(1)
+#define CAP_DATA      0x92    // runs
+#define CAP_END       0x93    // samples(8) lost(4) status(1)
+
+#define CAP_CHANNELS      2
+#define CAP_WORD_SAMPLES  (32/CAP_CHANNELS)     // samples in a word given to capEncode
+#define CAP_MIN_RATE      2000                  // max PIO divider at 125 MHz
+#define CAP_MAX_RATE      4000000
+#define CAP_MAX_RUN       (1u << 28)            // longer runs are split
+#define CAP_ENC_MAX       (5 + CAP_WORD_SAMPLES + 5)  // max bytes from capEncode
+
+// capDecode() return
+#define CAP_NONE      0       // run not complete
+#define CAP_RUN       1       // n samples with levels
+#define CAP_GAP       2       // n samples lost
+#define CAP_BAD       (-1)    // invalid data
+
+// Run encoder
+typedef struct {
+    uint32_t run;       // samples in the current run
+    uint8_t levels;     // levels in the current run
+} CAP_ENC;
+
+// Run decoder
+typedef struct {
+    int state;
+    int shift;
+    uint32_t value;
+    uint32_t n;         // result: samples
+    uint8_t levels;     // result: levels (CAP_RUN)
+} CAP_DEC;
+
+void capEncInit (CAP_ENC *e);
+int capEncode (CAP_ENC *e, uint32_t word, int n, uint8_t *out);
+int capFlush (CAP_ENC *e, uint8_t *out);
+int capLost (CAP_ENC *e, uint32_t n, uint8_t *out);
+void capDecInit (CAP_DEC *d);
+int capDecode (CAP_DEC *d, uint8_t c);
+
+#endif
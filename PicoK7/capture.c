@@ -0,0 +1,463 @@
+/**
+ * @file capture.c
+ * @author Daniel Quadros
+ * @brief USB capture: EAR and MIC sampled and sent to the host
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * The protocol is described in capproto.h.
+ * Two state machines, started together, sample EAR and MIC at the rate
+ * asked by the host and DMA channels write the samples in a ring buffer
+ * for each pin. They run the program of the scope (a single IN), as the
+ * PIO memory left by the encoder and the outputs has no room for more.
+ * The words of the two rings are interleaved and read as runs
+ * (capproto.c) into a third buffer, that is sent to the host as the
+ * credit allows. A tape signal has few edges, so the runs are much
+ * smaller than the samples.
+ *
+ * If the host doesn't give credit, the runs fill their buffer and then
+ * the samples fill the ring; the samples that don't fit are dropped and
+ * a mark with their number is sent in their place.
+ *
+ * The state machines and the DMA channels are claimed when the option is
+ * entered and released at the exit, the scope uses the same PIO.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+
+#include "picok7.h"
+#include "capproto.h"
+#include "upproto.h"
+#include "trace.h"
+
+#include "scope.pio.h"
+
+#ifdef LIB_PICO_STDIO_USB
+
+#define RING_WORDS   ((1 << CAP_RING_BITS) / 4)   // in each ring
+#define RING_SAMPLES 32     // samples in a word of a ring
+#define RING_GUARD   64     // words that may be written while the ring is read
+#define OUT_SIZE     2048   // runs waiting for credit (power of 2)
+#define TIMEOUT_MS   5000   // max time without frames from host
+#define FLUSH_MS     20     // max time a run waits to be sent
+#define SHOW_MS      500    // progress update
+#define LOST_MAX     11     // max bytes from capLost
+
+static uint32_t ring[CAP_CHANNELS][RING_WORDS] __attribute__((aligned(1 << CAP_RING_BITS)));
+static uint8_t out[OUT_SIZE];
+static uint32_t o_in, o_out;    // bytes put in/taken from out
+
+static const uint cap_pin[CAP_CHANNELS] = { PIN_EAR, PIN_MIC };
+static PIO cap_pio;
+static int cap_sm[CAP_CHANNELS];
+static uint cap_offset;
+static int cap_dma[CAP_CHANNELS];
+
+static UP_PARSER parser;
+static CAP_ENC enc;
+
+// Capture state
+static enum { CPS_WAIT, CPS_RUN, CPS_DRAIN, CPS_DONE } state;
+static uint32_t rate;       // real rate (samples/s)
+static uint32_t limit;      // samples to capture (0 = until stopped)
+static uint64_t samples;    // samples encoded (or lost)
+static uint32_t lost;       // samples dropped
+static uint32_t pending;    // samples dropped, mark not in out yet
+static uint32_t credit;     // bytes the host can take
+static uint32_t words;      // words taken from each ring
+static uint8_t status;
+
+static void capSend (uint8_t type, const uint8_t *payload, int len);
+static void handleFrame (int type, uint8_t *payload, int len);
+static bool capClaim (void);
+static void capRelease (void);
+static void startCapture (uint8_t *payload, int len);
+static void stopSampling (void);
+static uint32_t ringWritten (void);
+static uint32_t interleave (uint32_t ear, uint32_t mic);
+static void pump (void);
+static void sendRuns (bool flush);
+static void showProgress (void);
+static void finish (uint8_t st);
+static void outPut (const uint8_t *data, int len);
+
+// USB capture mode
+void usbCapture () {
+    displayClear();
+    displayStr("USB capture", 0, 0, true);
+    if (!capClaim()) {
+        displayStr("No PIO", 1, 0, false);
+        sleep_ms(2000);
+        return;
+    }
+    displayStr("Waiting...", 1, 0, false);
+    displayStr("Enter to cancel", 7, 0, false);
+    ws2812Pattern(LED_BLINK, urgb_u32(0,0,128));
+    gpio_init(PIN_MIC);
+
+    upInit(&parser);
+    state = CPS_WAIT;
+    uint32_t last_rx = to_ms_since_boot(get_absolute_time());
+    uint32_t last_flush = last_rx;
+    uint32_t last_show = last_rx;
+
+    while (state != CPS_DONE) {
+        // Process received bytes
+        for (int i = 0; i < 64; i++) {
+            int c = getchar_timeout_us(0);
+            if (c < 0) {
+                break;
+            }
+            last_rx = to_ms_since_boot(get_absolute_time());
+            int type = upParse(&parser, (uint8_t) c);
+            if (type == UP_BAD) {
+                prtdbg("CAPTURE: bad frame\n");
+                if (state != CPS_WAIT) {
+                    finish(UPS_PROTOCOL);
+                }
+            } else if (type != UP_NONE) {
+                handleFrame(type, parser.payload, parser.len);
+            }
+            if (state == CPS_DONE) {
+                break;
+            }
+        }
+        if (state == CPS_WAIT) {
+            chPoll();
+            if (getKey() == KEY_ENTER) {
+                capRelease();
+                return;
+            }
+            continue;
+        }
+        if (state == CPS_DONE) {
+            break;
+        }
+
+        uint32_t now = to_ms_since_boot(get_absolute_time());
+        if (state == CPS_RUN) {
+            pump();
+        }
+        bool flush = (now - last_flush) >= FLUSH_MS;
+        if (flush) {
+            last_flush = now;
+        }
+        sendRuns(flush);
+        if ((now - last_show) >= SHOW_MS) {
+            last_show = now;
+            showProgress();
+        }
+        chPoll();
+
+        if (getKey() == KEY_ENTER) {
+            finish(UPS_ABORTED);
+        } else if ((state == CPS_DRAIN) && (o_out == o_in)) {
+            finish(UPS_OK);
+        } else if ((now - last_rx) > TIMEOUT_MS) {
+            finish(UPS_TIMEOUT);
+        }
+    }
+
+    capRelease();
+    showProgress();
+    displayStr(status == UPS_OK ? "Capture OK" : "Capture failed", 6, 0, false);
+    if (status != UPS_OK) {
+        ws2812Pattern(LED_FLASH, urgb_u32(128,0,0));
+    }
+    displayStr("Press Enter    ", 7, 0, false);
+    while (getKey() != KEY_ENTER) {
+        chPoll();
+        sleep_ms(10);
+    }
+}
+
+// Send a frame to the host
+static void capSend (uint8_t type, const uint8_t *payload, int len) {
+    uint8_t frame[UP_MAX_FRAME];
+    int n = upFrame(frame, type, payload, len);
+    for (int i = 0; i < n; i++) {
+        putchar_raw(frame[i]);  // no CR/LF translation
+    }
+    stdio_flush();
+}
+
+// Treat a frame from the host
+static void handleFrame (int type, uint8_t *payload, int len) {
+    switch (type) {
+        case CAP_START:
+            if ((state == CPS_WAIT) && (len == 8)) {
+                startCapture(payload, len);
+            } else {
+                finish(UPS_PROTOCOL);
+            }
+            break;
+        case CAP_CREDIT:
+            if ((state == CPS_WAIT) || (len != 4)) {
+                finish(UPS_PROTOCOL);
+                break;
+            }
+            credit += upGet32(payload);
+            break;
+        case CAP_STOP:
+            if (state == CPS_RUN) {
+                stopSampling();
+            }
+            break;
+        case UP_ABORT:
+            if (state != CPS_WAIT) {
+                finish(UPS_ABORTED);
+            }
+            break;
+    }
+}
+
+// Claims a state machine for each channel (in the same PIO) and the DMA channels
+static bool capClaim () {
+    for (uint p = NUM_PIOS; p-- > 0; ) {
+        PIO pio = p ? pio1 : pio0;
+        int n = 0;
+        while (n < CAP_CHANNELS) {
+            int sm = pio_claim_unused_sm(pio, false);
+            if (sm < 0) {
+                break;
+            }
+            cap_sm[n++] = sm;
+        }
+        if ((n < CAP_CHANNELS) || !pio_can_add_program(pio, &scope_program)) {
+            while (n > 0) {
+                pio_sm_unclaim(pio, cap_sm[--n]);
+            }
+            continue;
+        }
+        cap_offset = pio_add_program(pio, &scope_program);
+        cap_pio = pio;
+        for (n = 0; n < CAP_CHANNELS; n++) {
+            traceEvent(TR_PIO_SM, TRM_CAPTURE, (p << 4) | cap_sm[n]);
+            cap_dma[n] = dma_claim_unused_channel(true);
+        }
+        return true;
+    }
+    traceEvent(TR_ERROR, TRE_PIO_MEMORY, TRM_CAPTURE);
+    return false;
+}
+
+// Releases the state machines and the DMA channels
+static void capRelease () {
+    for (int n = 0; n < CAP_CHANNELS; n++) {
+        pio_sm_set_enabled(cap_pio, cap_sm[n], false);
+        pio_sm_unclaim(cap_pio, cap_sm[n]);
+        dma_channel_abort(cap_dma[n]);
+        dma_channel_unclaim(cap_dma[n]);
+    }
+    pio_remove_program(cap_pio, &scope_program, cap_offset);
+}
+
+// Start the sampling
+static void startCapture (uint8_t *payload, int len) {
+    uint32_t req = upGet32(payload);
+    if (req < CAP_MIN_RATE) {
+        req = CAP_MIN_RATE;
+    } else if (req > CAP_MAX_RATE) {
+        req = CAP_MAX_RATE;
+    }
+    limit = upGet32(payload+4);
+
+    // the divider has 8 bits of fraction, the real rate is reported
+    uint32_t sys = clock_get_hz(clk_sys);
+    uint32_t div256 = (uint32_t) (((uint64_t) sys * 256 + req/2) / req);
+    rate = (uint32_t) (((uint64_t) sys * 256 + div256/2) / div256);
+    prtdbg("CAPTURE: %lu samples/s, limit %lu\n", (unsigned long) rate, (unsigned long) limit);
+
+    o_in = o_out = 0;
+    credit = 0;
+    words = 0;
+    samples = 0;
+    lost = pending = 0;
+    capEncInit(&enc);
+    uint8_t info[5];
+    upPut32(info, rate);
+    info[4] = CAP_CHANNELS;
+    capSend(CAP_INFO, info, 5);
+
+    uint32_t mask = 0;
+    for (int n = 0; n < CAP_CHANNELS; n++) {
+        pio_sm_config c = scope_program_get_default_config(cap_offset);
+        sm_config_set_in_pins(&c, cap_pin[n]);
+        sm_config_set_in_shift(&c, true, true, 32);
+        sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+        sm_config_set_clkdiv_int_frac(&c, div256 >> 8, div256 & 0xFF);
+        pio_sm_init(cap_pio, cap_sm[n], cap_offset, &c);
+        clockAddPio(cap_pio, cap_sm[n], rate);
+
+        dma_channel_config dc = dma_channel_get_default_config(cap_dma[n]);
+        channel_config_set_transfer_data_size(&dc, DMA_SIZE_32);
+        channel_config_set_read_increment(&dc, false);
+        channel_config_set_write_increment(&dc, true);
+        channel_config_set_ring(&dc, true, CAP_RING_BITS);
+        channel_config_set_dreq(&dc, pio_get_dreq(cap_pio, cap_sm[n], false));
+        dma_channel_configure(cap_dma[n], &dc, ring[n], &cap_pio->rxf[cap_sm[n]], 0xFFFFFFFF, true);
+        mask |= 1u << cap_sm[n];
+    }
+    pio_enable_sm_mask_in_sync(cap_pio, mask);   // same clock phase
+
+    displayStr("Capturing ", 1, 0, false);
+    state = CPS_RUN;
+}
+
+// Stop the sampling, the runs in the buffer are still sent
+static void stopSampling () {
+    for (int n = 0; n < CAP_CHANNELS; n++) {
+        pio_sm_set_enabled(cap_pio, cap_sm[n], false);
+        dma_channel_abort(cap_dma[n]);
+    }
+    uint8_t aux[5];
+    outPut(aux, capFlush(&enc, aux));
+    state = CPS_DRAIN;
+}
+
+// Words written in both rings
+static uint32_t ringWritten () {
+    uint32_t written = 0xFFFFFFFFu - dma_hw->ch[cap_dma[0]].transfer_count;
+    for (int n = 1; n < CAP_CHANNELS; n++) {
+        uint32_t w = 0xFFFFFFFFu - dma_hw->ch[cap_dma[n]].transfer_count;
+        if ((w - words) < (written - words)) {
+            written = w;
+        }
+    }
+    return written;
+}
+
+// Interleave 16 samples of EAR (bits 0-15 of ear) and MIC, in the
+// order of capEncode (sample i in bits 2i and 2i+1)
+static uint32_t interleave (uint32_t ear, uint32_t mic) {
+    uint32_t x = (ear & 0xFFFF) | (mic << 16);
+    x = (x & 0xFF0000FF) | ((x & 0x00FF0000) >> 8) | ((x & 0x0000FF00) << 8);
+    x = (x & 0xF00FF00F) | ((x & 0x0F000F00) >> 4) | ((x & 0x00F000F0) << 4);
+    x = (x & 0xC3C3C3C3) | ((x & 0x30303030) >> 2) | ((x & 0x0C0C0C0C) << 2);
+    x = (x & 0x99999999) | ((x & 0x44444444) >> 1) | ((x & 0x22222222) << 1);
+    return x;
+}
+
+// Turn the samples in the rings into runs
+static void pump () {
+    uint32_t written = ringWritten();
+    if ((written - words) > (RING_WORDS - RING_GUARD)) {
+        // overrun: skip to the newest half of the ring
+        uint32_t skip = (written - words) - RING_WORDS/2;
+        uint32_t n = skip * RING_SAMPLES;
+        if (limit && ((samples + n) > limit)) {
+            n = limit - samples;
+        }
+        words += skip;
+        samples += n;
+        lost += n;
+        pending += n;
+    }
+    if (pending) {
+        // the mark goes before the next runs
+        if ((OUT_SIZE - (o_in - o_out)) < LOST_MAX) {
+            return;
+        }
+        uint8_t aux[LOST_MAX];
+        outPut(aux, capLost(&enc, pending, aux));
+        pending = 0;
+        if (limit && (samples == limit)) {
+            stopSampling();
+            return;
+        }
+    }
+    while ((words != written) && ((OUT_SIZE - (o_in - o_out)) >= (2*CAP_ENC_MAX + LOST_MAX))) {
+        uint32_t ear = ring[0][words & (RING_WORDS-1)];
+        uint32_t mic = ring[1][words & (RING_WORDS-1)];
+        words++;
+        for (int half = 0; half < 2; half++) {
+            uint8_t aux[CAP_ENC_MAX];
+            int n = CAP_WORD_SAMPLES;
+            if (limit && ((samples + n) >= limit)) {
+                n = limit - samples;
+            }
+            outPut(aux, capEncode(&enc, interleave(ear, mic), n, aux));
+            samples += n;
+            if (limit && (samples == limit)) {
+                stopSampling();
+                return;
+            }
+            ear >>= CAP_WORD_SAMPLES;
+            mic >>= CAP_WORD_SAMPLES;
+        }
+    }
+}
+
+// Send the runs the credit allows
+// Less than a full frame only if flush
+static void sendRuns (bool flush) {
+    if (flush && (state == CPS_RUN) && (pending == 0) && ((OUT_SIZE - (o_in - o_out)) >= (5 + LOST_MAX))) {
+        uint8_t aux[5];
+        outPut(aux, capFlush(&enc, aux));
+    }
+    while (o_out != o_in) {
+        uint32_t n = o_in - o_out;
+        if (n > UP_MAX_PAYLOAD) {
+            n = UP_MAX_PAYLOAD;
+        }
+        if (n > credit) {
+            n = credit;
+        }
+        if ((n == 0) || ((n < UP_MAX_PAYLOAD) && !flush && (state == CPS_RUN))) {
+            break;
+        }
+        uint8_t payload[UP_MAX_PAYLOAD];
+        for (uint32_t i = 0; i < n; i++) {
+            payload[i] = out[o_out++ & (OUT_SIZE-1)];
+        }
+        credit -= n;
+        capSend(CAP_DATA, payload, n);
+    }
+}
+
+// Show the time captured and the samples lost
+static void showProgress () {
+    char aux[17];
+    snprintf(aux, sizeof(aux), "%lu Hz", (unsigned long) rate);
+    displayStr(aux, 2, 0, false);
+    snprintf(aux, sizeof(aux), "%8lu s", (unsigned long) (rate ? samples / rate : 0));
+    displayStr(aux, 3, 0, false);
+    snprintf(aux, sizeof(aux), "Lost %lu", (unsigned long) lost);
+    displayStr(aux, 4, 0, false);
+}
+
+// End of capture
+static void finish (uint8_t st) {
+    if (state == CPS_RUN) {
+        for (int n = 0; n < CAP_CHANNELS; n++) {
+            pio_sm_set_enabled(cap_pio, cap_sm[n], false);
+            dma_channel_abort(cap_dma[n]);
+        }
+    }
+    traceEvent(TR_CAPTURE, st, lost);
+    status = st;
+    uint8_t aux[13];
+    upPut32(aux, (uint32_t) samples);
+    upPut32(aux+4, (uint32_t) (samples >> 32));
+    upPut32(aux+8, lost);
+    aux[12] = st;
+    capSend(CAP_END, aux, 13);
+    state = CPS_DONE;
+}
+
+// Put runs in the buffer (the room was checked)
+static void outPut (const uint8_t *data, int len) {
+    for (int i = 0; i < len; i++) {
+        out[o_in++ & (OUT_SIZE-1)] = data[i];
+    }
+}
+
+#endif
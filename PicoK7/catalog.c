@@ -0,0 +1,234 @@
+/**
+ * @file catalog.c
+ * @author Daniel Quadros
+ * @brief File catalog - compact list of the files in the ZX81 directory
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * All the catalog is in a single static arena of CAT_BUDGET bytes:
+ * the names grow from the start and the index (offset and information
+ * of each file) grows from the end. There is no malloc and a reset
+ * only zeroes the counters.
+ *
+ * The names are kept sorted and front coded: each one is stored as
+ * (n, suffix, 0), where n is the number of chars shared with the
+ * previous name. A name with n = 0 is complete; catBalance keeps at
+ * most 2*CAT_RESTART names between complete ones, so decoding a name
+ * walks back a few entries only.
+ *
+ * The CRC32 of a file is recorded in its entry the first time it is
+ * read (zero means unknown); it is checked in the next reads and is
+ * also the key of the file contents for caches.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+#include "picok7.h"
+
+#define CAT_RESTART  16
+
+// Index entry
+typedef struct {
+    uint16_t off;       // offset of the name in the arena
+    uint16_t info;      // size (up to CAT_SIZE_MAX) | CAT_LIST
+    uint32_t crc;       // CRC32 of the contents, 0 if not known
+} CAT_ENTRY;
+
+#define CAT_LIST      0x8000
+#define CAT_SIZE_MAX  0x7FFF
+
+static uint8_t arena[CAT_BUDGET] __attribute__((aligned(4)));
+static int ncat;        // number of files
+static uint32_t used;   // bytes used by the names
+
+// Work buffers (static to save stack)
+static char aux[CAT_MAX_NAME+1];
+static uint8_t code[2*(CAT_MAX_NAME+2)];
+
+static int catSearch (const char *name);
+static int catShared (const char *a, const char *b);
+static int catCode (uint8_t *dst, const char *name, int n);
+static bool catReplace (int i, int oldlen, const uint8_t *data, int len, bool entry);
+static void catBalance (int i);
+
+// Entry i of the index (the index grows down from the end of the arena)
+static inline CAT_ENTRY *catEntry (int i) {
+    return ((CAT_ENTRY *) (arena + CAT_BUDGET)) - 1 - i;
+}
+
+// Size of the coded name i
+static inline int catCodeLen (int i) {
+    return 2 + strlen((char *) arena + catEntry(i)->off + 1);
+}
+
+// Empty the catalog
+void catReset () {
+    ncat = 0;
+    used = 0;
+}
+
+// Add a file
+// Returns false if there is no room
+bool catAdd (const char *name, uint32_t size, bool list) {
+    int len = strlen(name);
+    if (len > CAT_MAX_NAME) {
+        return false;
+    }
+
+    int lo = catSearch(name);
+
+    // Code the name and, if it was not complete, the next one
+    int n = (lo > 0) ? catShared(catName(lo-1, aux), name) : 0;
+    int clen = catCode(code, name, n);
+    int oldlen = 0;
+    if ((lo < ncat) && (arena[catEntry(lo)->off] != 0)) {
+        catName(lo, aux);
+        oldlen = catCodeLen(lo);
+        clen += catCode(code + clen, aux, catShared(name, aux));
+    }
+    if (!catReplace(lo, oldlen, code, clen, true)) {
+        return false;
+    }
+    catEntry(lo)->info = (size > CAT_SIZE_MAX ? CAT_SIZE_MAX : size) | (list ? CAT_LIST : 0);
+    catEntry(lo)->crc = 0;
+    catBalance(lo);
+    return true;
+}
+
+// Number of files in the catalog
+int catCount () {
+    return ncat;
+}
+
+// Bytes used by the catalog
+uint32_t catUsed () {
+    return used + ncat*sizeof(CAT_ENTRY);
+}
+
+// Get the name of file i
+// buf must have room for CAT_MAX_NAME+1 chars
+char *catName (int i, char *buf) {
+    int j = i;
+    while (arena[catEntry(j)->off] != 0) {
+        j--;    // find the complete name
+    }
+    for ( ; j <= i; j++) {
+        uint8_t *e = arena + catEntry(j)->off;
+        strcpy(buf + e[0], (char *) e + 1);
+    }
+    return buf;
+}
+
+// Get the size of file i (limited to 32K)
+uint32_t catSize (int i) {
+    return catEntry(i)->info & CAT_SIZE_MAX;
+}
+
+// Check if file i is a playlist
+bool catIsList (int i) {
+    return (catEntry(i)->info & CAT_LIST) != 0;
+}
+
+// Find a file, returns its index or -1 if not in the catalog
+int catFind (const char *name) {
+    int i = catSearch(name);
+    return ((i < ncat) && (strcmp(catName(i, aux), name) == 0)) ? i : -1;
+}
+
+// Get the CRC32 of file i (0 if not known)
+uint32_t catCrc (int i) {
+    return catEntry(i)->crc;
+}
+
+// Record the CRC32 of file i
+void catSetCrc (int i, uint32_t crc) {
+    catEntry(i)->crc = crc;
+}
+
+// Position of name in the catalog (binary search)
+static int catSearch (const char *name) {
+    int lo = 0;
+    int hi = ncat;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(catName(mid, aux), name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Number of chars at the start of a that are equal in b
+static int catShared (const char *a, const char *b) {
+    int n = 0;
+    while ((a[n] != 0) && (a[n] == b[n])) {
+        n++;
+    }
+    return n;
+}
+
+// Code name, sharing n chars with the previous one
+// Returns the size of the code
+static int catCode (uint8_t *dst, const char *name, int n) {
+    int len = strlen(name + n);
+    dst[0] = n;
+    memcpy(dst + 1, name + n, len + 1);
+    return len + 2;
+}
+
+// Replace the oldlen bytes of the coded name i with len bytes from data
+// If entry is true a new entry is inserted before i (data has its code
+// followed by the new code of name i, if oldlen is not zero)
+// Returns false if there is no room
+static bool catReplace (int i, int oldlen, const uint8_t *data, int len, bool entry) {
+    int delta = len - oldlen;
+    int nent = ncat + (entry ? 1 : 0);
+    if ((used + delta + nent*sizeof(CAT_ENTRY)) > CAT_BUDGET) {
+        return false;
+    }
+    uint32_t off = (i < ncat) ? catEntry(i)->off : used;
+    memmove(arena + off + len, arena + off + oldlen, used - off - oldlen);
+    memcpy(arena + off, data, len);
+    used += delta;
+
+    int first = i + 1;
+    if (entry) {
+        if (i < ncat) {
+            memmove(catEntry(ncat), catEntry(ncat-1), (ncat-i)*sizeof(CAT_ENTRY));
+            catEntry(i+1)->off = off + 2 + strlen((char *) arena + off + 1);
+            first = i + 2;
+        }
+        catEntry(i)->off = off;
+        ncat++;
+    }
+    for (int j = first; j < ncat; j++) {
+        catEntry(j)->off += delta;
+    }
+    return true;
+}
+
+// Limit the names between complete ones, around entry i
+// If there is no room the catalog is only slower
+static void catBalance (int i) {
+    int start = i;
+    while (arena[catEntry(start)->off] != 0) {
+        start--;
+    }
+    int end = i + 1;
+    while ((end < ncat) && (arena[catEntry(end)->off] != 0)) {
+        end++;
+    }
+    if ((end - start) > 2*CAT_RESTART) {
+        int m = start + CAT_RESTART;
+        int len = catCode(code, catName(m, aux), 0);
+        catReplace(m, catCodeLen(m), code, len, false);
+    }
+}
@@ -0,0 +1,300 @@
+/**
+ * @file channel.c
+ * @author Daniel Quadros
+ * @brief Independent channels - send programs on the extra outputs
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * Each extra output (see k7AddOutput) can send its own program while
+ * the main output is used for something else. A channel has its own
+ * file and ring buffer: chPoll (called from the main loops) reads the
+ * file into the ring and the PIO TX not full interrupt moves the ring
+ * into the FIFO. The leader silence is timed by chPoll.
+ * During the leader the program is read once and its CRC32 compared to
+ * the one in the catalog, so a bad read stops the channel (CH_ERROR)
+ * before the first pulse, like on the main output; the CRC32 is checked
+ * again as the program is read to be sent.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/irq.h"
+
+#include "ff.h"
+#include "f_util.h"
+
+#include "picok7.h"
+#include "stream.h"
+#include "trace.h"
+
+#define CH_RING_SIZE  1024  // must be a power of 2
+#define CH_CHUNK      256   // bytes read from the SD card at a time
+
+typedef struct {
+    volatile CH_STATE state;
+    PIO pio;
+    uint sm;
+    K7_STREAM st;
+    uint8_t ring[CH_RING_SIZE];
+    volatile uint32_t r_in, r_out;  // bytes put in/taken from ring
+    int nlen;               // name size
+    uint32_t size;          // code size
+    uint32_t to_read;       // code not read yet
+    uint32_t to_check;      // code not checked yet (read in the leader)
+    uint32_t crc;           // CRC32 of the code read
+    int cat;                // index in the catalog (-1 if not there)
+    absolute_time_t leader_end;
+    char file[17];          // for the status (may be truncated)
+} CHANNEL;
+
+static CHANNEL ch[K7_CHANNELS];    // ch[0] is not used (main output)
+static uint8_t chunk[CH_CHUNK];
+
+static void chRingPut (CHANNEL *c, const uint8_t *data, int n);
+static bool chCheck (int n);
+static void chStop (int n, CH_STATE state);
+static void chIrqEnable (CHANNEL *c, bool enable);
+static void chIrqHandler (void);
+
+// Create the extra outputs
+// pins are the pins of outputs 1 to npins
+void chInit (const uint *pins, int npins) {
+    for (int i = 0; i < npins; i++) {
+        int n = k7AddOutput(pins[i]);
+        if (n < 0) {
+            break;
+        }
+        k7Output(n, &ch[n].pio, &ch[n].sm);
+        ch[n].state = CH_FREE;
+    }
+    if (k7Outputs() > 1) {
+        irq_add_shared_handler(PIO0_IRQ_0, chIrqHandler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(PIO0_IRQ_0, true);
+        irq_add_shared_handler(PIO1_IRQ_0, chIrqHandler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(PIO1_IRQ_0, true);
+    }
+}
+
+// Start sending pfile on output n
+// Returns false if invalid file
+bool chSend (int n, const char *pfile) {
+    CHANNEL *c = &ch[n];
+    uint8_t hdr[13];
+    UINT nr;
+
+    chStop(n, CH_FREE);
+    FRESULT fr = streamOpen(&c->st, pfile, K7_TAPE_BPS);
+    if (fr != FR_OK) {
+        return false;
+    }
+
+    // Check header and last byte
+    uint32_t size = 0;
+    uint8_t last = 0;
+    fr = streamRead(&c->st, hdr, sizeof(hdr), &nr);
+    if ((fr == FR_OK) && (nr == sizeof(hdr))) {
+        size = k7CheckHeader(hdr, streamSize(&c->st));
+    }
+    if (size) {
+        fr = streamSeek(&c->st, size - 1);
+        if (fr == FR_OK) {
+            fr = streamRead(&c->st, &last, 1, &nr);
+        }
+        if (last != 0x80) {
+            traceEvent(TR_ERROR, TRE_LAST_BYTE, last);
+            size = 0;
+        }
+    }
+    if ((size == 0) || (streamSeek(&c->st, 0) != FR_OK)) {
+        streamClose(&c->st);
+        return false;
+    }
+
+    // The name goes in the ring, the code is read by chPoll
+    static const uint8_t name[] = K7_DEFAULT_NAME;
+    c->r_in = c->r_out = 0;
+    c->nlen = sizeof(name) - 1;
+    chRingPut(c, name, c->nlen);
+    c->size = c->to_read = c->to_check = size;
+    c->crc = 0;
+    c->cat = catFind(pfile);
+    snprintf(c->file, sizeof(c->file), "%s", pfile);
+    c->leader_end = make_timeout_time_ms(K7_LEADER_MS);
+    c->state = CH_LEADER;
+    traceEvent(TR_CHANNEL, n, CH_LEADER);
+    return true;
+}
+
+// Abort the sending on output n
+void chAbort (int n) {
+    if ((ch[n].state == CH_LEADER) || (ch[n].state == CH_SENDING)) {
+        chStop(n, CH_FREE);
+    }
+}
+
+// Do the background work of the channels
+// Must be called often (at least every few ms) while a channel is sending
+void chPoll () {
+    for (int n = 1; n < k7Outputs(); n++) {
+        CHANNEL *c = &ch[n];
+        switch (c->state) {
+            case CH_LEADER:
+                if (c->to_check != 0) {
+                    // a chunk of the check at each call
+                    UINT nr = (c->to_check > CH_CHUNK) ? CH_CHUNK : c->to_check;
+                    FRESULT fr = streamRead(&c->st, chunk, nr, &nr);
+                    if ((fr != FR_OK) || (nr == 0)) {
+                        chStop(n, CH_ERROR);
+                        break;
+                    }
+                    c->to_check -= nr;
+                    c->crc = crcCalc(c->crc, chunk, nr);
+                    if (c->to_check == 0) {
+                        if (chCheck(n)) {
+                            c->crc = 0;
+                            if (streamSeek(&c->st, 0) != FR_OK) {
+                                chStop(n, CH_ERROR);
+                            }
+                        }
+                    }
+                    break;
+                }
+                if (absolute_time_diff_us(get_absolute_time(), c->leader_end) > 0) {
+                    break;
+                }
+                c->state = CH_SENDING;
+                traceEvent(TR_CHANNEL, n, CH_SENDING);
+                // fall through
+            case CH_SENDING:
+                if ((c->to_read != 0) && ((CH_RING_SIZE - (c->r_in - c->r_out)) >= CH_CHUNK)) {
+                    UINT nr = (c->to_read > CH_CHUNK) ? CH_CHUNK : c->to_read;
+                    FRESULT fr = streamRead(&c->st, chunk, nr, &nr);
+                    if ((fr != FR_OK) || (nr == 0)) {
+                        chStop(n, CH_ERROR);
+                        break;
+                    }
+                    chRingPut(c, chunk, nr);
+                    c->to_read -= nr;
+                    c->crc = crcCalc(c->crc, chunk, nr);
+                    if ((c->to_read == 0) && !chCheck(n)) {
+                        break;
+                    }
+                }
+                if (c->r_in != c->r_out) {
+                    chIrqEnable(c, true);
+                } else if ((c->to_read == 0) && pio_sm_is_tx_fifo_empty(c->pio, c->sm)) {
+                    chStop(n, CH_DONE);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Compare the CRC32 of the code of output n with the catalog (it is
+// recorded there the first time)
+// Returns false, with the channel stopped, if it is different
+static bool chCheck (int n) {
+    CHANNEL *c = &ch[n];
+    if (c->cat >= 0) {
+        if (catCrc(c->cat) == 0) {
+            catSetCrc(c->cat, c->crc);
+        } else if (catCrc(c->cat) != c->crc) {
+            traceEvent(TR_ERROR, TRE_CRC, c->crc);
+            chStop(n, CH_ERROR);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bit mask of the outputs that are not sending
+uint32_t chFreeMask () {
+    uint32_t mask = 1;
+    for (int n = 1; n < k7Outputs(); n++) {
+        if ((ch[n].state != CH_LEADER) && (ch[n].state != CH_SENDING)) {
+            mask |= 1u << n;
+        }
+    }
+    return mask;
+}
+
+// Get the state of output n and, if not NULL, a status text (16 chars)
+CH_STATE chStatus (int n, char *text) {
+    CHANNEL *c = &ch[n];
+    CH_STATE state = c->state;
+    if (text != NULL) {
+        uint32_t sent = c->r_out;
+        sent = (sent > (uint32_t) c->nlen) ? sent - c->nlen : 0;
+        switch (state) {
+            case CH_LEADER:
+            case CH_SENDING:
+                snprintf(text, 17, "Ch%c %3u%% %.7s", '0' + n, (uint8_t) (100*sent/c->size), c->file);
+                break;
+            case CH_DONE:
+                snprintf(text, 17, "Ch%d done %.7s", n, c->file);
+                break;
+            case CH_ERROR:
+                snprintf(text, 17, "Ch%d error", n);
+                break;
+            default:
+                snprintf(text, 17, "Ch%d free", n);
+                break;
+        }
+    }
+    return state;
+}
+
+// Put data in the ring (there must be room)
+static void chRingPut (CHANNEL *c, const uint8_t *data, int n) {
+    uint32_t in = c->r_in;
+    for (int i = 0; i < n; i++) {
+        c->ring[in++ & (CH_RING_SIZE-1)] = data[i];
+    }
+    c->r_in = in;     // the interrupt sees the data only now
+}
+
+// Stop output n, what is in the FIFO is still sent
+static void chStop (int n, CH_STATE state) {
+    CHANNEL *c = &ch[n];
+    if ((c->state == CH_LEADER) || (c->state == CH_SENDING)) {
+        chIrqEnable(c, false);
+        streamClose(&c->st);
+        traceEvent(TR_CHANNEL, n, state);
+    }
+    c->state = state;
+}
+
+// Enable/disable the TX not full interrupt of a channel
+static void chIrqEnable (CHANNEL *c, bool enable) {
+    if (enable) {
+        hw_set_bits(&c->pio->inte0, PIO_IRQ0_INTE_SM0_TXNFULL_BITS << c->sm);
+    } else {
+        hw_clear_bits(&c->pio->inte0, PIO_IRQ0_INTE_SM0_TXNFULL_BITS << c->sm);
+    }
+}
+
+// Move data from the rings to the FIFOs
+// The interrupt is disabled when a ring is empty (chPoll enables it again)
+static void __not_in_flash_func(chIrqHandler) (void) {
+    for (int n = 1; n < K7_CHANNELS; n++) {
+        CHANNEL *c = &ch[n];
+        if ((c->pio == NULL) || ((c->pio->ints0 & (PIO_IRQ0_INTS_SM0_TXNFULL_BITS << c->sm)) == 0)) {
+            continue;
+        }
+        uint32_t out = c->r_out;
+        while ((out != c->r_in) && !pio_sm_is_tx_fifo_full(c->pio, c->sm)) {
+            pio_sm_put(c->pio, c->sm, c->ring[out++ & (CH_RING_SIZE-1)] << 24);
+        }
+        c->r_out = out;
+        if (out == c->r_in) {
+            chIrqEnable(c, false);
+        }
+    }
+}
@@ -0,0 +1,180 @@
+/**
+ * @file clock.c
+ * @author Daniel Quadros
+ * @brief System clock manager - changes clk_sys keeping the PIO and SPI timing
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * The modules register their state machines (with the frequency they
+ * need), SPI ports (with the baud rate) and anything else that depends
+ * on clk_sys. When the clock changes, the dividers are recalculated and
+ * written right after each switch, with the interrupts disabled.
+ * While the system PLL is being reprogrammed clk_sys runs from the
+ * USB PLL (48MHz), with the dividers set for it.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/sync.h"
+#include "hardware/pio.h"
+#include "hardware/spi.h"
+
+#include "picok7.h"
+#include "trace.h"
+
+#define MAX_PIO   8
+#define MAX_SPI   2
+#define MAX_CB    4
+#define MAX_FREQ  8
+
+static struct {
+    PIO pio;
+    uint sm;
+    float hz;
+} pios[MAX_PIO];
+static int npios;
+
+static struct {
+    spi_inst_t *spi;
+    uint baud;
+} spis[MAX_SPI];
+static int nspis;
+
+static void (*callbacks[MAX_CB])(void);
+static int ncallbacks;
+
+// Time at each frequency
+static struct {
+    uint32_t khz;
+    uint64_t us;
+} stats[MAX_FREQ];
+static int nstats;
+
+static uint32_t cur_khz;
+static absolute_time_t since;
+
+static void setDividers (uint32_t hz);
+static void account (void);
+
+// Init the clock manager (with the current clock)
+void clockInit () {
+    cur_khz = clock_get_hz(clk_sys) / 1000;
+    since = get_absolute_time();
+}
+
+// Keep a state machine running at hz
+// Calling it again for the same state machine changes the rate
+void clockAddPio (PIO pio, uint sm, float hz) {
+    for (int i = 0; i < npios; i++) {
+        if ((pios[i].pio == pio) && (pios[i].sm == sm)) {
+            pios[i].hz = hz;
+            return;
+        }
+    }
+    if (npios < MAX_PIO) {
+        pios[npios].pio = pio;
+        pios[npios].sm = sm;
+        pios[npios].hz = hz;
+        npios++;
+    }
+}
+
+// Keep a SPI port at baud
+void clockAddSpi (spi_inst_t *spi, uint baud) {
+    if (nspis < MAX_SPI) {
+        spis[nspis].spi = spi;
+        spis[nspis].baud = baud;
+        nspis++;
+    }
+}
+
+// Function to call when the clock changes (with interrupts disabled)
+void clockAddCallback (void (*fn)(void)) {
+    if (ncallbacks < MAX_CB) {
+        callbacks[ncallbacks++] = fn;
+    }
+}
+
+// Change clk_sys
+// Returns false if the frequency cannot be generated
+bool clockSet (uint32_t khz) {
+    uint vco, pd1, pd2;
+
+    if (khz == cur_khz) {
+        return true;
+    }
+    if (!check_sys_clock_khz(khz, &vco, &pd1, &pd2)) {
+        prtdbg("CLOCK: cannot generate %lu kHz\n", (unsigned long) khz);
+        return false;
+    }
+    account();
+    traceEvent(TR_CLOCK, 0, khz);
+
+    uint32_t irq = save_and_disable_interrupts();
+
+    // Run from the USB PLL while the system PLL changes
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                    CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
+                    USB_CLK_KHZ * 1000, USB_CLK_KHZ * 1000);
+    setDividers(USB_CLK_KHZ * 1000);
+    pll_init(pll_sys, 1, vco, pd1, pd2);
+
+    // Back to the system PLL at the new frequency
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                    CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS,
+                    khz * 1000, khz * 1000);
+    setDividers(khz * 1000);
+
+    // clk_peri comes from clk_sys
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS,
+                    khz * 1000, khz * 1000);
+    for (int i = 0; i < nspis; i++) {
+        spi_set_baudrate(spis[i].spi, spis[i].baud);
+    }
+    for (int i = 0; i < ncallbacks; i++) {
+        callbacks[i]();
+    }
+
+    restore_interrupts(irq);
+    cur_khz = khz;
+    return true;
+}
+
+// Show the time spent at each frequency
+void clockReport () {
+    account();
+    for (int i = 0; i < nstats; i++) {
+        prtdbg("CLOCK: %6lu kHz %8llu ms\n", (unsigned long) stats[i].khz,
+               (unsigned long long) (stats[i].us / 1000));
+    }
+}
+
+// Set the PIO dividers for clk_sys = hz
+static void setDividers (uint32_t hz) {
+    for (int i = 0; i < npios; i++) {
+        pio_sm_set_clkdiv(pios[i].pio, pios[i].sm, hz / pios[i].hz);
+    }
+}
+
+// Add the time since the last change to the current frequency
+static void account () {
+    absolute_time_t now = get_absolute_time();
+    uint64_t us = absolute_time_diff_us(since, now);
+    since = now;
+    int i;
+    for (i = 0; (i < nstats) && (stats[i].khz != cur_khz); i++) {
+    }
+    if (i == nstats) {
+        if (nstats == MAX_FREQ) {
+            return;
+        }
+        stats[nstats].khz = cur_khz;
+        stats[nstats++].us = 0;
+    }
+    stats[i].us += us;
+}
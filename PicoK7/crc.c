@@ -0,0 +1,62 @@
+/**
+ * @file crc.c
+ * @author Daniel Quadros
+ * @brief CRC32 of the data read from the SD card, by the DMA sniffer
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * The data is moved by a DMA channel (to a dummy byte) with the sniffer
+ * calculating the standard CRC32 (the same as zlib), so the CPU only
+ * waits for the DMA (one byte per clock). The sniffer is configured at
+ * each call, as the SD driver may also use it.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+
+#include "picok7.h"
+
+static int crc_ch;
+static uint8_t crc_sink;
+
+static uint32_t crcReverse (uint32_t x);
+
+// Claim and configure the DMA channel
+void crcInit () {
+    crc_ch = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(crc_ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_sniff_enable(&c, true);
+    dma_channel_configure(crc_ch, &c, &crc_sink, NULL, 0, false);
+}
+
+// Update crc (0 at the start) with n bytes from buf
+uint32_t crcCalc (uint32_t crc, const void *buf, uint n) {
+    if (n == 0) {
+        return crc;
+    }
+    // The accumulator is kept bit reversed and inverted
+    dma_sniffer_enable(crc_ch, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+    dma_sniffer_set_output_reverse_enabled(true);
+    dma_sniffer_set_output_invert_enabled(true);
+    dma_sniffer_set_data_accumulator(crcReverse(~crc));
+    dma_channel_transfer_from_buffer_now(crc_ch, buf, n);
+    dma_channel_wait_for_finish_blocking(crc_ch);
+    return dma_sniffer_get_data_accumulator();
+}
+
+// Reverse the bits in x
+static uint32_t crcReverse (uint32_t x) {
+    x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+    x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
+    x = ((x >> 8) & 0x00FF00FF) | ((x & 0x00FF00FF) << 8);
+    return (x >> 16) | (x << 16);
+}
@@ -7,6 +7,7 @@
 #include "hardware/pio.h"
 
 #include "picok7.h"
+#include "trace.h"
 
 #include "font.h"
 
@@ -57,10 +58,16 @@
 // Screen size
 #define LCD_WIDTH    128
 #define LCD_HEIGHT   64
+#define LCD_LINES    (LCD_HEIGHT/8)
+#define LCD_COLS     (LCD_WIDTH/8)
+
+// Reset timing (ms)
+#define RES_LOW_MS   500
+#define RES_HIGH_MS  100
 
 // Display initialization commands
 static uint8_t cmdInit[] = {
-  // cmd                              // sleep_ms
+  // cmd                              // delay (ms)
   ST7565R_SET_BIAS_7,                 0, 
   ST7565R_SET_ADC_NORMAL,             0,
   ST7565R_SET_COM_NORMAL,             0,
@@ -78,6 +85,19 @@ static uint8_t cmdInit[] = {
 // Buffer for a screen page (128x8 pixels)
 static uint8_t linBuf[LCD_WIDTH];
 
+// Text on the screen, so lines can be redrawn after a scroll
+static char scrText[LCD_LINES][LCD_COLS];
+static uint16_t scrInv[LCD_LINES];  // inverse chars (bit c = column c)
+
+// The whole display RAM is rotated by the start line,
+// line l is in page (7 - l + startPage) & 7
+static int startPage;
+
+// Initialization runs from an alarm, so the boot can go on meanwhile
+// Until the controller is ready the text goes only to scrText
+static enum { LCD_RESET, LCD_CONFIG, LCD_CONFIGURED, LCD_READY } volatile lcdState;
+static int lcdStep;   // next command in cmdInit
+
 // Local routines
 static inline void pinInit(int pin, int value) {
   gpio_init(pin);
@@ -86,10 +106,18 @@ static inline void pinInit(int pin, int value) {
 }
 void Display_chr(char chr, int l, int c);
 void Display_invchr(char chr, int l, int c);
-static void Display_sendcmds (uint8_t *cmd, int nCmds);
 static void Display_sendcmd (uint8_t cmd);
+static int64_t Display_initStep (alarm_id_t id, void *user_data);
+static void Display_sync (void);
+static void Display_line (int l);
+static void Display_text (int l, const char *text, uint16_t inv);
+static void Display_page (int l, const uint8_t *data);
+static void Display_preview (int lt, int nl, const uint8_t *img, const char *str);
+static void Display_option (int l, const char *str, bool inverse);
+static void Display_scroll (int lt, int nl, int dir);
 
 // Initialize the display
+// Only starts the reset, the rest is done by Display_initStep
 void displayInit()
 {
   // Setup SPI
@@ -97,27 +125,45 @@ void displayInit()
   spi_set_format (LCD_SPI, DATA_BITS, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
   gpio_set_function(LCD_pinSCL, GPIO_FUNC_SPI);
   gpio_set_function(LCD_pinSI, GPIO_FUNC_SPI);
+  clockAddSpi(LCD_SPI, BAUD_RATE);
 
   // Setup other pins
   pinInit(LCD_pinCS, HIGH);
   pinInit(LCD_pinRES, LOW);
   pinInit(LCD_pinRS, DATA);
 
-  // Reset controller
+  // Reset controller, cmdInit will be sent by the alarm
+  memset(scrText, ' ', sizeof(scrText));
+  memset(scrInv, 0, sizeof(scrInv));
+  startPage = 0;
+  lcdState = LCD_RESET;
+  lcdStep = 0;
   gpio_put(LCD_pinRES, LOW);
-  sleep_ms (500);
-  gpio_put(LCD_pinRES, HIGH);
-  sleep_ms (100);
-  
-  // Configure controller and clean the screen
-  Display_sendcmds (cmdInit, sizeof(cmdInit)/2);
-  displayClear();
+  add_alarm_in_ms(RES_LOW_MS, Display_initStep, NULL, true);
+}
+
+// Wait for the end of the initialization
+void displayWait()
+{
+  Display_sync();
+  while (lcdState != LCD_READY) {
+    sleep_ms(1);
+    Display_sync();
+  }
 }
 
 // Clear display
 void displayClear()
 {
   memset(linBuf, 0x00, LCD_WIDTH);
+  memset(scrText, ' ', sizeof(scrText));
+  memset(scrInv, 0, sizeof(scrInv));
+  startPage = 0;
+  Display_sync();
+  if (lcdState != LCD_READY) {
+    return;     // screen will be drawn from scrText
+  }
+  Display_sendcmd(ST7565R_SET_DISP_START_LINE | 0);
 
   // write zeroes in all columns in all pages
   for (uint8_t p = 0; p < LCD_HEIGHT/8; p++) {
@@ -133,8 +179,16 @@ void displayClear()
 
 // Write string s starting at line l (0-7) collumn c (0-16)
 void displayStr(char *str, int l, int c, bool inverse) {
+  Display_sync();
   while (*str) {
-    if (inverse) {
+    if (lcdState != LCD_READY) {
+      scrText[l][c] = *str;
+      if (inverse) {
+        scrInv[l] |= 1 << c;
+      } else {
+        scrInv[l] &= ~(1 << c);
+      }
+    } else if (inverse) {
       Display_invchr(*str, l, c);  
     } else {
       Display_chr(*str, l, c);
@@ -149,49 +203,112 @@ void displayStr(char *str, int l, int c, bool inverse) {
   }
 }
 
+// Draw np pages (128 bytes each, bit 7 is the top) of an image from
+// line lt; the text buffer is not changed
+void displayImage (int lt, int np, const uint8_t *img) {
+  Display_sync();
+  if (lcdState != LCD_READY) {
+    return;
+  }
+  for (int l = 0; l < np; l++) {
+    Display_page(lt+l, img + l*LCD_WIDTH);
+  }
+}
+
 // Implements a simple menu
-int displayMenu (int lt, int nl, int nopc, char *opc[]) {
-  char aux[LCD_WIDTH/8+1];
+// Moving past the window scrolls the display (changing the start line),
+// only the new option and the lines outside the window are redrawn
+// opc(i) returns option i (the string is used before the next call)
+// pvw(i), if not NULL, returns the preview image of option i (or NULL);
+// it is shown when the selection stays PVW_DWELL_MS on the option and
+// the window has room for it, until the next key
+// idle(i, ms), if not NULL, is called while there are no keys, with the
+// selected option and the time (ms) since it was selected; it must
+// return quickly, so the keys are not delayed
+int displayMenu (int lt, int nl, int nopc, const char *(*opc)(int i),
+                 const uint8_t *(*pvw)(int i), void (*idle)(int i, uint32_t ms)) {
   int sel = 0;
   int top = 0;
+  bool use_pvw = (pvw != NULL) && (nl > PVW_PAGES);
+  bool tried = !use_pvw;   // preview of sel already tried
+  bool shown = false;
+  uint32_t moved = time_us_32();
 
+  displayWait();
+  for (int i = 0; i < nl; i++) {
+    Display_option(lt+i, (top+i) < nopc ? opc(top+i) : "", (top+i) == sel);
+  }
   while (true) {
-    for (int i = 0, j = top; (i < nl) && (j < nopc); i++, j++) {
-      memset(aux, ' ', LCD_WIDTH/8);
-      aux[LCD_WIDTH/8] = 0;
-      int s = strlen(opc[j]);
-      memcpy (aux, opc[j], s < (LCD_WIDTH/8) ? s : (LCD_WIDTH/8));
-      displayStr(aux, lt+i, 0, j == sel);
+    int old = sel;
+    int key = getKey();
+    if (shown && (key != -1)) {
+      for (int l = lt; l < (lt+nl); l++) {
+        Display_line(l);    // back to the options
+      }
+      shown = false;
     }
-    switch (getKey()) {
+    switch (key) {
       case KEY_ENTER:
         return sel;
       case KEY_DN:
         if (sel > 0) {
           sel--;
-          if (sel < top) {
-            top--;
-          }
         }
         break;
       case KEY_UP:
         if (sel < (nopc-1)) {
           sel++;
-          if (sel >= (top+nl)) {
-            top++;
-          }
         }
         break;
     }
+    if (sel == old) {
+      if (!tried && ((time_us_32() - moved) >= PVW_DWELL_MS*1000)) {
+        const uint8_t *img = pvw(sel);
+        if (img != NULL) {
+          Display_preview(lt, nl, img, opc(sel));
+          shown = true;
+        }
+        tried = true;
+      }
+      if (idle != NULL) {
+        idle(sel, (time_us_32() - moved) / 1000);
+      }
+      traceDrain();   // nothing to redraw
+      chPoll();
+      sleep_ms(1);
+      continue;
+    }
+    tried = !use_pvw;
+    moved = time_us_32();
+    if (sel < top) {
+      top--;
+      Display_scroll(lt, nl, -1);
+      Display_option(lt, opc(sel), true);
+      if (nl > 1) {
+        Display_option(lt+1, opc(old), false);
+      }
+    } else if (sel >= (top+nl)) {
+      top++;
+      Display_scroll(lt, nl, 1);
+      Display_option(lt+nl-1, opc(sel), true);
+      if (nl > 1) {
+        Display_option(lt+nl-2, opc(old), false);
+      }
+    } else {
+      Display_option(lt+old-top, opc(old), false);
+      Display_option(lt+sel-top, opc(sel), true);
+    }
   }
 }
 
 // Write char chr at line l (0-7) collumn c (0-16)
 void Display_chr(char chr, int l, int c) {
   uint8_t *pgc = (uint8_t *) (font + ((chr - 0x20) << 3));
+  scrText[l][c] = chr;
+  scrInv[l] &= ~(1 << c);
   c = c << 3;
 
-  Display_sendcmd(ST7565R_SET_PAGE | (7-l));  // page numbered from bottom to top
+  Display_sendcmd(ST7565R_SET_PAGE | ((7-l+startPage) & 7));  // page numbered from bottom to top
   Display_sendcmd(ST7565R_SET_COLUMN_UPPER | (c >> 4));
   Display_sendcmd(ST7565R_SET_COLUMN_LOWER | (c & 0x0F));
   gpio_put(LCD_pinCS, LOW);
@@ -207,9 +324,11 @@ void Display_invchr(char chr, int l, int c) {
   for (int i = 0; i < 8; i++) {
     aux[i] = pgc[i] ^0xFF;
   }
+  scrText[l][c] = chr;
+  scrInv[l] |= 1 << c;
   c = c << 3;
 
-  Display_sendcmd(ST7565R_SET_PAGE | (7-l));  // page numbered from bottom to top
+  Display_sendcmd(ST7565R_SET_PAGE | ((7-l+startPage) & 7));  // page numbered from bottom to top
   Display_sendcmd(ST7565R_SET_COLUMN_UPPER | (c >> 4));
   Display_sendcmd(ST7565R_SET_COLUMN_LOWER | (c & 0x0F));
   gpio_put(LCD_pinCS, LOW);
@@ -218,21 +337,117 @@ void Display_invchr(char chr, int l, int c) {
   gpio_put(LCD_pinCS, HIGH);
 }
 
-// Send a sequence of commands to the display, with sleep_mss
-static void Display_sendcmds (uint8_t *cmd, int nCmds)
-{
-  gpio_put(LCD_pinCS, LOW);
-  gpio_put(LCD_pinRS, CMD);
-  for (int i = 0; i < nCmds*2; i+=2)
-  {
-    spi_write_blocking(LCD_SPI, &cmd[i], 1);
-    if (cmd[i+1] != 0) {
-      sleep_ms(cmd[i+1]);
+// Redraw line l (0-7) from the text buffer, as a single page
+static void Display_line (int l) {
+  Display_text(l, scrText[l], scrInv[l]);
+}
+
+// Draw LCD_COLS chars of text (bit c of inv set for inverse) at line l,
+// without changing the text buffer
+static void Display_text (int l, const char *text, uint16_t inv) {
+  for (int c = 0; c < LCD_COLS; c++) {
+    const uint8_t *pgc = font + ((text[c] - 0x20) << 3);
+    uint8_t x = (inv & (1 << c)) ? 0xFF : 0x00;
+    for (int i = 0; i < 8; i++) {
+      linBuf[(c << 3) + i] = pgc[i] ^ x;
     }
   }
+  Display_page(l, linBuf);
+}
+
+// Send the 128 columns of line l (0-7)
+static void Display_page (int l, const uint8_t *data) {
+  traceEvent(TR_LCD_FLUSH, l, (7-l+startPage) & 7);
+  Display_sendcmd(ST7565R_SET_PAGE | ((7-l+startPage) & 7));
+  Display_sendcmd(ST7565R_SET_COLUMN_UPPER | 0);
+  Display_sendcmd(ST7565R_SET_COLUMN_LOWER | 0);
+  gpio_put(LCD_pinCS, LOW);
+  gpio_put(LCD_pinRS, DATA);
+  spi_write_blocking(LCD_SPI, data, LCD_WIDTH);
   gpio_put(LCD_pinCS, HIGH);
 }
 
+// Show a preview image in the menu window (lines lt to lt+nl-1),
+// followed by the selected option; the text buffer is not changed
+// so the menu is restored by redrawing the window
+static void Display_preview (int lt, int nl, const uint8_t *img, const char *str) {
+  char text[LCD_COLS];
+  for (int l = 0; l < PVW_PAGES; l++) {
+    Display_page(lt+l, img + l*LCD_WIDTH);
+  }
+  int s = strlen(str);
+  memset(text, ' ', LCD_COLS);
+  memcpy(text, str, s < LCD_COLS ? s : LCD_COLS);
+  Display_text(lt+PVW_PAGES, text, 0xFFFF);
+  memset(text, ' ', LCD_COLS);
+  for (int l = lt+PVW_PAGES+1; l < (lt+nl); l++) {
+    Display_text(l, text, 0);
+  }
+}
+
+// Write a menu option (padded with spaces) at line l
+static void Display_option (int l, const char *str, bool inverse) {
+  int s = strlen(str);
+  memset(scrText[l], ' ', LCD_COLS);
+  memcpy(scrText[l], str, s < LCD_COLS ? s : LCD_COLS);
+  scrInv[l] = inverse ? 0xFFFF : 0;
+  Display_line(l);
+}
+
+// Scroll the lines lt to lt+nl-1 one line up (dir = 1) or down (dir = -1)
+// The controller rotates the whole screen, the lines outside
+// the window are redrawn in their place
+// The line that enters the window must be written by the caller
+static void Display_scroll (int lt, int nl, int dir) {
+  startPage = (startPage - dir) & 7;
+  Display_sendcmd(ST7565R_SET_DISP_START_LINE | (startPage << 3));
+  if (dir > 0) {
+    memmove(scrText[lt], scrText[lt+1], (nl-1)*LCD_COLS);
+    memmove(&scrInv[lt], &scrInv[lt+1], (nl-1)*sizeof(uint16_t));
+  } else {
+    memmove(scrText[lt+1], scrText[lt], (nl-1)*LCD_COLS);
+    memmove(&scrInv[lt+1], &scrInv[lt], (nl-1)*sizeof(uint16_t));
+  }
+  for (int l = 0; l < LCD_LINES; l++) {
+    if ((l < lt) || (l >= (lt+nl))) {
+      Display_line(l);
+    }
+  }
+}
+
+// Initialization sequence (alarm callback)
+// Sends the commands in cmdInit, returning to wait the delays
+static int64_t Display_initStep (alarm_id_t id, void *user_data)
+{
+  if (lcdState == LCD_RESET) {
+    gpio_put(LCD_pinRES, HIGH);
+    lcdState = LCD_CONFIG;
+    return RES_HIGH_MS*1000;
+  }
+  while (lcdStep < (int) sizeof(cmdInit)) {
+    uint8_t delay = cmdInit[lcdStep+1];
+    Display_sendcmd(cmdInit[lcdStep]);
+    lcdStep += 2;
+    if (delay != 0) {
+      return delay*1000;
+    }
+  }
+  lcdState = LCD_CONFIGURED;
+  return 0;
+}
+
+// After the initialization, draw what was written meanwhile
+// Called only from the main loop, so it does not race with displayStr
+static void Display_sync (void)
+{
+  if (lcdState == LCD_CONFIGURED) {
+    for (int l = 0; l < LCD_LINES; l++) {
+      Display_line(l);
+    }
+    lcdState = LCD_READY;
+  }
+}
+
 // Send a command uint8_t to the display
 static void Display_sendcmd (uint8_t cmd)
 {
@@ -28,6 +28,7 @@
 #include "encoder.pio.h"
 
 #include "picok7.h"
+#include "trace.h"
 
 #define DEBOUNCE_MS 100
 #define T_QUEUE 32
@@ -80,6 +81,7 @@ static volatile int q_input, q_output;
 // store key in queue
 static inline void storeKey(int key) {
     int prox = (q_input + 1) % T_QUEUE;
+    traceEvent(TR_KEY, key, 0);
     if (prox != q_output) {
         key_queue[q_input] = key;
         q_input = prox;
@@ -165,12 +167,12 @@ void encoderInit (PIO pio, uint pin_a, uint pin_b, uint pin_sw) {
 
     // Alocate a state machine
     enc_sm = pio_claim_unused_sm(pio, true);
-    prtdbg("ENCODER: sm %d\n", enc_sm);
+    traceEvent(TR_PIO_SM, TRM_ENCODER, enc_sm);
 
     // Load PIO program
     int offset = pio_add_program(pio, &encoder_program);
     if (offset < 0) {
-        prtdbg("ENCODER: PIO memory full\n");
+        traceEvent(TR_ERROR, TRE_PIO_MEMORY, TRM_ENCODER);
     }
 
     // Init encoder pins
@@ -189,6 +191,7 @@ void encoderInit (PIO pio, uint pin_a, uint pin_b, uint pin_sw) {
     sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
     sm_config_set_clkdiv_int_frac(&c, 250, 0);
     pio_sm_init(pio, enc_sm, offset, &c);
+    clockAddPio(pio, enc_sm, clock_get_hz(clk_sys) / 250.0f);
 
     // Setup interrupt
     hw_set_bits(&pio->inte1, PIO_IRQ1_INTE_SM0_RXNEMPTY_BITS << enc_sm);
@@ -0,0 +1,109 @@
+/**
+ * @file machine.c
+ * @author Daniel Quadros
+ * @brief Machines - the tape format of each computer, as data
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * Each machine is an entry in a table: how the bits are sent (the
+ * PIO program), the timing, how the blocks are framed and how the
+ * header of a file is checked. The times are given in T-states of the
+ * machine and converted to PIO cycles by the compiler.
+ *
+ * ZX81 (.P) and ZX80 (.O) files are memory images, sent as trains of
+ * pulses by k7.pio; the ZX80 does not save a name. ZX Spectrum and
+ * Jupiter Ace files (.TAP) are blocks, each one with a 16 bit length,
+ * sent as a pilot tone, two sync half periods and the bits (two half
+ * periods each) by k7edge.pio. The Ace TAP files don't have the flag
+ * byte that starts each block on tape, it is added when sending.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+#include "ff.h"
+
+#include "picok7.h"
+#include "trace.h"
+
+#define SPECTRUM_KHZ  3500
+#define ACE_KHZ       3250
+
+const K7_MACHINE machines[MACH_COUNT] = {
+    {
+        .id = MACH_ZX81, .name = "ZX81", .ext = ".P", .coding = K7_PULSES,
+        .base = 0x4009, .eline = 11, .version = 0, .min_size = 120, .named = true
+    },
+    {
+        .id = MACH_ZX80, .name = "ZX80", .ext = ".O", .coding = K7_PULSES,
+        .base = 0x4000, .eline = 10, .version = -1, .min_size = 40, .named = false
+    },
+    {
+        .id = MACH_SPECTRUM, .name = "Spectrum", .ext = ".TAP", .coding = K7_EDGES,
+        .pilot = TAP_CYCLES(2168, SPECTRUM_KHZ),
+        .sync1 = TAP_CYCLES(667, SPECTRUM_KHZ), .sync2 = TAP_CYCLES(735, SPECTRUM_KHZ),
+        .bit0 = TAP_CYCLES(855, SPECTRUM_KHZ), .bit1 = TAP_CYCLES(1710, SPECTRUM_KHZ),
+        .pilot_hdr = 8063, .pilot_data = 3223,
+        .flag_hdr = -1, .flag_data = -1, .hdr_len = 19, .pause_ms = 1000
+    },
+    {
+        .id = MACH_ACE, .name = "Ace", .ext = ".TAP", .coding = K7_EDGES,
+        .pilot = TAP_CYCLES(2011, ACE_KHZ),
+        .sync1 = TAP_CYCLES(601, ACE_KHZ), .sync2 = TAP_CYCLES(791, ACE_KHZ),
+        .bit0 = TAP_CYCLES(801, ACE_KHZ), .bit1 = TAP_CYCLES(1591, ACE_KHZ),
+        .pilot_hdr = 8192, .pilot_data = 1024,
+        .flag_hdr = 0x00, .flag_data = 0xFF, .hdr_len = 26, .pause_ms = 1000
+    }
+};
+
+// Find the machine of a file
+// By the extension; a TAP file is from an Ace if its first block
+// has the length of an Ace header
+// Returns NULL if it is not a tape file
+const K7_MACHINE *machineFind (const char *file) {
+    const char *ext = strrchr(file, '.');
+    if (ext == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < MACH_COUNT; i++) {
+        if (strcasecmp(ext, machines[i].ext) != 0) {
+            continue;
+        }
+        if (machines[i].coding == K7_EDGES) {
+            FIL fp;
+            uint8_t len[2] = { 0, 0 };
+            UINT nr;
+            if (f_open(&fp, file, FA_OPEN_EXISTING | FA_READ) == FR_OK) {
+                f_read(&fp, len, sizeof(len), &nr);
+                f_close(&fp);
+            }
+            if ((len[0] + 256*len[1]) == machines[MACH_ACE].hdr_len) {
+                return &machines[MACH_ACE];
+            }
+        }
+        return &machines[i];
+    }
+    return NULL;
+}
+
+// Check the start of a memory image and get the size to send
+// hdr must have at least eline+2 bytes, size is the file size
+// E_LINE is the end of the saved memory; some files have garbage
+// added at the end
+uint machineSize (const K7_MACHINE *m, const uint8_t *hdr, uint size) {
+    if ((size <= m->min_size) || ((m->version >= 0) && (hdr[0] != m->version))) {
+        traceEvent(TR_ERROR, TRE_HEADER, (size & 0xFFFFFF) | (hdr[0] << 24));
+        return 0;   // too short or invalid version
+    }
+    uint real_size = (hdr[m->eline] + 256*hdr[m->eline+1]) - m->base;
+    if (real_size > size) {
+        traceEvent(TR_ERROR, TRE_SIZE, real_size);
+        return 0;   // something is missing in the file
+    }
+    return real_size;
+}
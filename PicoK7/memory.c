@@ -0,0 +1,116 @@
+/**
+ * @file memory.c
+ * @author Daniel Quadros
+ * @brief Memory monitor - stack and heap high-water marks
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * The regions come from the symbols of the SDK linker script: the stack
+ * of core 0 is in scratch Y, the one of core 1 in scratch X (it has a
+ * size only if pico_multicore is linked) and the heap goes from the end
+ * of the static data to the start of the stacks.
+ * memInit, at the start of main, paints the stacks with a pattern; the
+ * deepest word that is no longer the pattern is the high-water mark.
+ * The heap of newlib never shrinks, so its top is the peak (FatFs takes
+ * its long file name buffers from it).
+ * memCheck records a TR_MEMORY event when a mark goes up, memReport
+ * also sends the marks as a debug message.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+#include "picok7.h"
+#include "trace.h"
+
+#define PAINT         0xDEADBEEFu   // pattern in the unused stack
+#define PAINT_MARGIN  16            // words kept below the stack pointer
+
+// Linker script symbols
+extern uint32_t __StackBottom[], __StackTop[];          // core 0
+extern uint32_t __StackOneBottom[], __StackOneTop[];    // core 1
+extern char __end__[], __StackLimit[];                  // heap
+
+static uint32_t peak[TRMEM_COUNT];     // marks already reported
+static bool sizes_sent;
+
+static uint32_t stackUsed (const uint32_t *bottom, const uint32_t *top);
+static uint32_t regionUsed (int r);
+static uint32_t regionSize (int r);
+
+// Paint the stacks (call first in main)
+void memInit () {
+    uint32_t *sp;
+    __asm volatile ("mov %0, sp" : "=r" (sp));
+    for (uint32_t *p = __StackBottom; p < (sp - PAINT_MARGIN); p++) {
+        *p = PAINT;
+    }
+    for (uint32_t *p = __StackOneBottom; p < __StackOneTop; p++) {
+        *p = PAINT;
+    }
+}
+
+// Record the marks that went up
+void memCheck () {
+    if (!sizes_sent) {
+        for (int r = 0; r < TRMEM_COUNT; r++) {
+            traceEvent(TR_MEMORY, r | TRMEM_SIZE, regionSize(r));
+        }
+        sizes_sent = true;
+    }
+    for (int r = 0; r < TRMEM_COUNT; r++) {
+        uint32_t used = regionUsed(r);
+        if (used > peak[r]) {
+            peak[r] = used;
+            traceEvent(TR_MEMORY, r, used);
+        }
+    }
+}
+
+// Show the marks
+void memReport () {
+    memCheck();
+    prtdbg("MEMORY: stack core 0 %lu/%lu, stack core 1 %lu/%lu, heap %lu/%lu bytes\n",
+           (unsigned long) peak[TRMEM_STACK0], (unsigned long) regionSize(TRMEM_STACK0),
+           (unsigned long) peak[TRMEM_STACK1], (unsigned long) regionSize(TRMEM_STACK1),
+           (unsigned long) peak[TRMEM_HEAP], (unsigned long) regionSize(TRMEM_HEAP));
+}
+
+// Bytes of a stack that were used
+// (all of them if it overflowed below bottom)
+static uint32_t stackUsed (const uint32_t *bottom, const uint32_t *top) {
+    const uint32_t *p = bottom;
+    while ((p < top) && (*p == PAINT)) {
+        p++;
+    }
+    return (top - p) * sizeof(uint32_t);
+}
+
+// Bytes used in a region
+static uint32_t regionUsed (int r) {
+    switch (r) {
+        case TRMEM_STACK0:
+            return stackUsed(__StackBottom, __StackTop);
+        case TRMEM_STACK1:
+            return stackUsed(__StackOneBottom, __StackOneTop);
+        default:
+            return (char *) sbrk(0) - __end__;
+    }
+}
+
+// Size of a region
+static uint32_t regionSize (int r) {
+    switch (r) {
+        case TRMEM_STACK0:
+            return (__StackTop - __StackBottom) * sizeof(uint32_t);
+        case TRMEM_STACK1:
+            return (__StackOneTop - __StackOneBottom) * sizeof(uint32_t);
+        default:
+            return __StackLimit - __end__;
+    }
+}
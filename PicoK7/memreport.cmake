@@ -0,0 +1,163 @@
+# RAM and flash used by each module, from the linker map
+# Usage: cmake -DMAP=PicoK7.elf.map [-DOUT=report.txt] [-DTOP=n] -P memreport.cmake
+#
+# Each input section in the memory map counts for the module (the
+# source file or the library) it came from: in RAM if it is linked
+# at 0x2xxxxxxx, in flash if it is linked (or loaded, for initialized
+# data and code copied to RAM) at 0x1xxxxxxx. The full table goes to
+# OUT (if given), the TOP modules (default 10) and the totals are shown.
+
+cmake_minimum_required(VERSION 3.13)
+
+set(RAM_SIZE 270336)    # 256K + scratch X and Y (4K each)
+
+if (NOT DEFINED TOP)
+    set(TOP 10)
+endif()
+
+file(STRINGS ${MAP} LINES)
+
+set(MODULES "")
+set(IN_MAP FALSE)
+set(SECTION "")         # wrapped section name
+set(OUT_RAM FALSE)      # current output section is in RAM
+set(OUT_FLASH FALSE)    # current output section is in (or loaded from) flash
+foreach(LINE IN LISTS LINES)
+    if (NOT IN_MAP)
+        if (LINE MATCHES "^Linker script and memory map")
+            set(IN_MAP TRUE)
+        endif()
+        continue()
+    endif()
+
+    # long names are alone in their line, the addresses are in the next
+    if (LINE MATCHES "^(\\.[^ ]+|  ?[.A-Za-z_][^ ]*)$")
+        set(SECTION "${LINE}")
+        continue()
+    endif()
+    if (NOT SECTION STREQUAL "")
+        set(LINE "${SECTION}${LINE}")
+        set(SECTION "")
+    endif()
+
+    # output section
+    if (LINE MATCHES "^\\.[^ ]+ +0x([0-9a-f]+) +0x[0-9a-f]+( +load address 0x([0-9a-f]+))?")
+        set(VMA "${CMAKE_MATCH_1}")
+        set(LMA "${CMAKE_MATCH_3}")
+        set(OUT_RAM FALSE)
+        set(OUT_FLASH FALSE)
+        if (VMA MATCHES "^0*2[0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f]$")
+            set(OUT_RAM TRUE)
+            if (LMA MATCHES "^0*1[0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f]$")
+                set(OUT_FLASH TRUE)
+            endif()
+        elseif (VMA MATCHES "^0*1[0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f]$")
+            set(OUT_FLASH TRUE)
+        endif()
+        continue()
+    endif()
+
+    # input section: name address size file
+    if (NOT (OUT_RAM OR OUT_FLASH))
+        continue()
+    endif()
+    if (NOT LINE MATCHES "^ [.A-Za-z_][^ ]* +0x[0-9a-f]+ +0x([0-9a-f]+) +(.+)$")
+        continue()
+    endif()
+    math(EXPR SIZE "0x${CMAKE_MATCH_1}")
+    set(FILE "${CMAKE_MATCH_2}")
+    if (SIZE EQUAL 0)
+        continue()
+    endif()
+    if (FILE MATCHES "([^/\\\\]+\\.a)\\(")
+        set(MOD "${CMAKE_MATCH_1}")
+    else()
+        get_filename_component(MOD "${FILE}" NAME)
+        string(REGEX REPLACE "\\.(obj|o)$" "" MOD "${MOD}")
+    endif()
+    string(MAKE_C_IDENTIFIER "${MOD}" KEY)
+    if (NOT DEFINED RAM_${KEY})
+        list(APPEND MODULES "${MOD}")
+        set(RAM_${KEY} 0)
+        set(FLASH_${KEY} 0)
+    endif()
+    if (OUT_RAM)
+        math(EXPR RAM_${KEY} "${RAM_${KEY}} + ${SIZE}")
+    endif()
+    if (OUT_FLASH)
+        math(EXPR FLASH_${KEY} "${FLASH_${KEY}} + ${SIZE}")
+    endif()
+endforeach()
+
+if (NOT IN_MAP)
+    message(FATAL_ERROR "${MAP}: not a linker map")
+endif()
+
+# Sort by RAM, then flash (the numbers are padded to sort as text)
+set(ROWS "")
+set(RAM_TOTAL 0)
+set(FLASH_TOTAL 0)
+foreach(MOD IN LISTS MODULES)
+    string(MAKE_C_IDENTIFIER "${MOD}" KEY)
+    math(EXPR RAM_TOTAL "${RAM_TOTAL} + ${RAM_${KEY}}")
+    math(EXPR FLASH_TOTAL "${FLASH_TOTAL} + ${FLASH_${KEY}}")
+    set(SORT_KEY "")
+    foreach(N ${RAM_${KEY}} ${FLASH_${KEY}})
+        string(LENGTH "${N}" LEN)
+        while (LEN LESS 10)
+            set(N "0${N}")
+            math(EXPR LEN "${LEN} + 1")
+        endwhile()
+        string(APPEND SORT_KEY "${N}")
+    endforeach()
+    list(APPEND ROWS "${SORT_KEY}|${MOD}")
+endforeach()
+list(SORT ROWS)
+list(REVERSE ROWS)
+
+# Columns
+function(row VAR NAME RAM FLASH)
+    set(LINE "${NAME}")
+    string(LENGTH "${LINE}" LEN)
+    while (LEN LESS 32)
+        string(APPEND LINE " ")
+        math(EXPR LEN "${LEN} + 1")
+    endwhile()
+    foreach(N ${RAM} ${FLASH})
+        string(LENGTH "${N}" LEN)
+        while (LEN LESS 10)
+            string(APPEND LINE " ")
+            math(EXPR LEN "${LEN} + 1")
+        endwhile()
+        string(APPEND LINE "${N}")
+    endforeach()
+    set(${VAR} "${LINE}" PARENT_SCOPE)
+endfunction()
+
+row(HEADER "Module" "RAM" "Flash")
+set(REPORT "${HEADER}\n")
+set(SHORT "${HEADER}\n")
+set(I 0)
+foreach(R IN LISTS ROWS)
+    string(REGEX REPLACE "^[0-9]+\\|" "" MOD "${R}")
+    string(MAKE_C_IDENTIFIER "${MOD}" KEY)
+    row(LINE "${MOD}" "${RAM_${KEY}}" "${FLASH_${KEY}}")
+    string(APPEND REPORT "${LINE}\n")
+    if (I LESS TOP)
+        string(APPEND SHORT "${LINE}\n")
+    endif()
+    math(EXPR I "${I} + 1")
+endforeach()
+row(LINE "Total" "${RAM_TOTAL}" "${FLASH_TOTAL}")
+string(APPEND REPORT "${LINE}\n")
+string(APPEND SHORT "...\n${LINE}\n")
+
+math(EXPR RAM_LEFT "${RAM_SIZE} - ${RAM_TOTAL}")
+math(EXPR RAM_PCT "${RAM_TOTAL} * 100 / ${RAM_SIZE}")
+set(SUMMARY "RAM: ${RAM_TOTAL} of ${RAM_SIZE} bytes (${RAM_PCT}%), ${RAM_LEFT} left for the heap\nFlash: ${FLASH_TOTAL} bytes\n")
+string(APPEND REPORT "\n${SUMMARY}")
+
+if (DEFINED OUT)
+    file(WRITE ${OUT} "${REPORT}")
+endif()
+message("${SHORT}\n${SUMMARY}")
@@ -0,0 +1,313 @@
+/**
+ * @file pack.c
+ * @author Daniel Quadros
+ * @brief Packed loading - compressor and ZX81 loader (also used by the host tools)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * The compressor is a greedy LZ77: each position is looked up in a
+ * hash of its first three bytes, with a chain of the previous positions
+ * in the window. It needs no memory besides the tables below.
+ *
+ * The decompressor works in place: the compressed image is moved up
+ * far enough that the output never reaches the bytes not read yet. The
+ * distance is the largest difference between the position of a token
+ * in the output and in the compressed image (the slack).
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <string.h>
+
+#include "pack.h"
+
+#define HASH_SIZE   (1 << PACK_HASH_BITS)
+#define NIL         0xFFFF
+
+// System variables, as offsets in the image
+#define SV_E_PPC    (0x400A - PACK_BASE)
+#define SV_D_FILE   (0x400C - PACK_BASE)
+#define SV_DF_CC    (0x400E - PACK_BASE)
+#define SV_VARS     (0x4010 - PACK_BASE)
+#define SV_DEST     (0x4012 - PACK_BASE)
+#define SV_E_LINE   (0x4014 - PACK_BASE)
+#define SV_CH_ADD   (0x4016 - PACK_BASE)
+#define SV_X_PTR    (0x4018 - PACK_BASE)
+#define SV_STKBOT   (0x401A - PACK_BASE)
+#define SV_STKEND   (0x401C - PACK_BASE)
+#define SV_NXTLIN   (0x4029 - PACK_BASE)
+
+#define ZX_NEWLINE  0x76
+#define ZX_REM      0xEA
+#define DFILE_LEN   25      // collapsed display file (1K style)
+
+static uint16_t head[HASH_SIZE];        // last position with each hash
+static uint16_t chain[PACK_WINDOW];     // previous position with the same hash
+
+// Stub, at PACK_USR (RAND USR 16514)
+// The zero fields are filled by packImage
+static const uint8_t stub[] = {
+    0x2A, 0x04, 0x40,       //       LD   HL,(RAMTOP)
+    0x11, 0x00, 0x00,       //       LD   DE,top+PACK_STACK
+    0xA7,                   //       AND  A
+    0xED, 0x52,             //       SBC  HL,DE
+    0x30, 0x02,             //       JR   NC,ROOM
+    0xCF, 0x03,             //       RST  08h       ; report 4 (no room)
+    0xCD, 0xE7, 0x02,       // ROOM: CALL SET-FAST
+    0x21, 0x00, 0x00,       //       LD   HL,last byte to move
+    0x11, 0x00, 0x00,       //       LD   DE,its place at the top
+    0x01, 0x00, 0x00,       //       LD   BC,bytes to move
+    0xED, 0xB8,             //       LDDR
+    0x21, 0x00, 0x00,       //       LD   HL,compressed image
+    0x11, 0x09, 0x40,       //       LD   DE,4009h
+    0xC3, 0x00, 0x00        //       JP   UNPACK
+};
+#define ST_NEED     4
+#define ST_LAST     17
+#define ST_TOP      20
+#define ST_LEN      23
+#define ST_PACKED   28
+#define ST_UNPACK   34
+
+// Decompressor, goes after the compressed image (relocatable)
+// HL = compressed image, DE = output
+static const uint8_t unpack[] = {
+    0x7E,                   // UNPACK: LD   A,(HL)
+    0x23,                   //         INC  HL
+    0xA7,                   //         AND  A
+    0x28, 0x20,             //         JR   Z,DONE
+    0xCB, 0x7F,             //         BIT  7,A
+    0x20, 0x07,             //         JR   NZ,COPY
+    0x4F,                   //         LD   C,A         ; literals
+    0x06, 0x00,             //         LD   B,0
+    0xED, 0xB0,             //         LDIR
+    0x18, 0xF0,             //         JR   UNPACK
+    0xE6, 0x7F,             // COPY:   AND  7Fh
+    0xC6, PACK_MIN_MATCH,   //         ADD  A,PACK_MIN_MATCH  ; CY = 0
+    0x4E,                   //         LD   C,(HL)
+    0x23,                   //         INC  HL
+    0x46,                   //         LD   B,(HL)
+    0x23,                   //         INC  HL
+    0xE5,                   //         PUSH HL
+    0x62,                   //         LD   H,D
+    0x6B,                   //         LD   L,E
+    0xED, 0x42,             //         SBC  HL,BC
+    0x4F,                   //         LD   C,A
+    0x06, 0x00,             //         LD   B,0
+    0xED, 0xB0,             //         LDIR
+    0xE1,                   //         POP  HL
+    0x18, 0xDB,             //         JR   UNPACK
+    0x2A, 0x29, 0x40,       // DONE:   LD   HL,(NXTLIN)
+    0x2B,                   //         DEC  HL
+    0x22, 0x16, 0x40,       //         LD   (CH_ADD),HL ; end of the SAVE line
+    0x21, 0x3B, 0x40,       //         LD   HL,CDFLAG
+    0xCB, 0xBE,             //         RES  7,(HL)      ; we are in FAST
+    0xCD, 0x07, 0x02,       //         CALL SLOW/FAST   ; mode of the program
+    0xED, 0x4B, 0x32, 0x40, //         LD   BC,(SEED)   ; RAND keeps it
+    0xC9                    //         RET
+};
+
+// Line 2: RAND USR 16514
+static const uint8_t line2[] = {
+    0x00, 0x02, 0x0E, 0x00,
+    0xF9, 0xD4, 0x1D, 0x22, 0x21, 0x1D, 0x20,   // RAND USR 16514
+    0x7E, 0x8F, 0x01, 0x04, 0x00, 0x00,         // 16514 as a number
+    ZX_NEWLINE
+};
+
+static inline uint32_t get16 (const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline void put16 (uint8_t *p, uint32_t val) {
+    p[0] = val & 0xFF;
+    p[1] = val >> 8;
+}
+
+static inline uint32_t hash (const uint8_t *p) {
+    return ((p[0] << 8) ^ (p[1] << 4) ^ p[2] ^ (p[0] >> 4)) & (HASH_SIZE - 1);
+}
+
+// Longest previous copy of the bytes at pos
+// Returns the length (0 if none) and the offset in *off
+static uint32_t packFind (const uint8_t *src, uint32_t size, uint32_t pos, uint32_t *off) {
+    uint32_t best = 0;
+    uint32_t lim = size - pos;
+    if (lim < PACK_MIN_MATCH) {
+        return 0;
+    }
+    if (lim > PACK_MAX_MATCH) {
+        lim = PACK_MAX_MATCH;
+    }
+    uint32_t q = head[hash(src + pos)];
+    for (int d = 0; (q != NIL) && ((pos - q) < PACK_WINDOW) && (d < PACK_DEPTH); d++) {
+        uint32_t n = 0;
+        while ((n < lim) && (src[q+n] == src[pos+n])) {
+            n++;
+        }
+        if (n > best) {
+            best = n;
+            *off = pos - q;
+            if (n == lim) {
+                break;
+            }
+        }
+        q = chain[q % PACK_WINDOW];
+    }
+    return best;
+}
+
+// Put the position in the hash
+static inline void packInsert (const uint8_t *src, uint32_t size, uint32_t pos) {
+    if ((pos + 2) < size) {
+        uint32_t h = hash(src + pos);
+        chain[pos % PACK_WINDOW] = head[h];
+        head[h] = pos;
+    }
+}
+
+// Compress size bytes from src to dst (up to max bytes)
+// *slack gets the distance needed to decompress in place
+// Returns the compressed size (0 if it does not fit)
+uint32_t packData (const uint8_t *src, uint32_t size, uint8_t *dst, uint32_t max, int32_t *slack) {
+    uint32_t in = 0, out = 0, lit = 0;
+    int32_t sl = 0;
+
+    memset(head, 0xFF, sizeof(head));
+    while (lit < size) {
+        uint32_t off = 0;
+        uint32_t len = (in < size) ? packFind(src, size, in, &off) : 0;
+        if ((len < PACK_MIN_MATCH) && (in < size) && ((in - lit) < PACK_MAX_LIT)) {
+            packInsert(src, size, in++);
+            continue;
+        }
+
+        // Literals before this point
+        if (in > lit) {
+            uint32_t n = in - lit;
+            if ((out + 1 + n) > max) {
+                return 0;
+            }
+            if (((int32_t) lit - (int32_t) out) > sl) {
+                sl = lit - out;
+            }
+            dst[out++] = n;
+            memcpy(dst + out, src + lit, n);
+            out += n;
+            lit = in;
+        }
+
+        // Copy
+        if (len >= PACK_MIN_MATCH) {
+            if ((out + 3) > max) {
+                return 0;
+            }
+            if (((int32_t) in - (int32_t) out) > sl) {
+                sl = in - out;
+            }
+            dst[out++] = 0x80 | (len - PACK_MIN_MATCH);
+            put16(dst + out, off);
+            out += 2;
+            for (uint32_t i = 0; i < len; i++) {
+                packInsert(src, size, in++);
+            }
+            lit = in;
+        }
+    }
+    if (out >= max) {
+        return 0;
+    }
+    if (((int32_t) size - (int32_t) out) > sl) {
+        sl = size - out;
+    }
+    dst[out++] = 0;
+    *slack = sl;
+    return out;
+}
+
+// Build the packed loader of a .P image (size bytes, up to E_LINE)
+// out must have room for max bytes
+// Returns the size of the loader, 0 if the program is not autorun or
+// packing does not make it smaller
+uint32_t packImage (const uint8_t *img, uint32_t size, uint8_t *out, uint32_t max) {
+    uint32_t sv = PACK_PROG - PACK_BASE;
+    if (size <= sv) {
+        return 0;
+    }
+    if (max >= size) {
+        max = size - 1;     // the loader has to be smaller
+    }
+
+    // Autorun: NXTLIN is a line of the program, after a SAVE
+    uint32_t nxtlin = get16(img + SV_NXTLIN);
+    uint32_t dfile = get16(img + SV_D_FILE);
+    if ((nxtlin <= PACK_PROG) || (nxtlin >= dfile) || ((dfile - PACK_BASE) >= size) ||
+        (img[nxtlin - 1 - PACK_BASE] != ZX_NEWLINE)) {
+        return 0;
+    }
+
+    // REM line with the stub, the compressed image and the decompressor
+    uint32_t rem = sv;
+    uint32_t packed = rem + 5 + sizeof(stub);
+    uint32_t tail = sizeof(unpack) + 1 + sizeof(line2) + DFILE_LEN + 1;
+    if (max <= (packed + tail)) {
+        return 0;
+    }
+    int32_t slack;
+    uint32_t plen = packData(img, size, out + packed, max - packed - tail, &slack);
+    if (plen == 0) {
+        return 0;
+    }
+    uint32_t dec = packed + plen;
+    uint32_t eol = dec + sizeof(unpack);
+    memcpy(out + dec, unpack, sizeof(unpack));
+    out[eol] = ZX_NEWLINE;
+    out[rem] = 0x00;
+    out[rem+1] = 0x01;
+    put16(out + rem + 2, eol - (rem + 4) + 1);
+    out[rem+4] = ZX_REM;
+
+    // Where the compressed image and the decompressor go
+    uint32_t from = PACK_BASE + packed;
+    uint32_t len = plen + sizeof(unpack);
+    uint32_t to = PACK_BASE + slack;
+    if (to < from) {
+        to = from;
+    }
+    uint32_t need = to + len + PACK_STACK;
+    if (need > 0xFFFF) {
+        return 0;
+    }
+    memcpy(out + rem + 5, stub, sizeof(stub));
+    put16(out + rem + 5 + ST_NEED, need);
+    put16(out + rem + 5 + ST_LAST, from + len - 1);
+    put16(out + rem + 5 + ST_TOP, to + len - 1);
+    put16(out + rem + 5 + ST_LEN, len);
+    put16(out + rem + 5 + ST_PACKED, to);
+    put16(out + rem + 5 + ST_UNPACK, to + plen);
+
+    // RAND USR line, display file and variables
+    uint32_t l2 = eol + 1;
+    memcpy(out + l2, line2, sizeof(line2));
+    uint32_t df = l2 + sizeof(line2);
+    memset(out + df, ZX_NEWLINE, DFILE_LEN);
+    uint32_t vars = df + DFILE_LEN;
+    out[vars] = 0x80;
+    uint32_t eline = vars + 1;
+
+    // System variables of the original, pointing to the loader
+    memcpy(out, img, sv);
+    put16(out + SV_E_PPC, 2);
+    put16(out + SV_D_FILE, PACK_BASE + df);
+    put16(out + SV_DF_CC, PACK_BASE + df + 1);
+    put16(out + SV_VARS, PACK_BASE + vars);
+    put16(out + SV_DEST, 0);
+    put16(out + SV_E_LINE, PACK_BASE + eline);
+    put16(out + SV_CH_ADD, PACK_BASE + eol);
+    put16(out + SV_X_PTR, 0);
+    put16(out + SV_STKBOT, PACK_BASE + eline);
+    put16(out + SV_STKEND, PACK_BASE + eline);
+    put16(out + SV_NXTLIN, PACK_BASE + l2);
+    return eline;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file pack.h
+ * @author Daniel Quadros
+ * @brief Packed loading - definitions shared with the host tools
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * A packed program is a small .P file (the loader) that the ZX81 loads
+ * at the normal rate. It has a REM line with a Z80 stub, a decompressor
+ * and the compressed image of the original program, and a line with
+ * RAND USR 16514 that is run at once (autorun).
+ *
+ * The stub moves the compressed image and the decompressor to the top
+ * of the memory used by the program and the decompressor rebuilds the
+ * original image from 0x4009 up, over the loader. At the end, the ZX81
+ * is in the state it would be after loading the original program and
+ * goes on running it (from its NXTLIN).
+ *
+ * Compressed format (a sequence of tokens):
+ *   0x00                 end
+ *   0x01 to 0x7F         n literal bytes follow
+ *   0x80+n offset(2)     copy n+PACK_MIN_MATCH bytes from offset bytes
+ *                        back in the output (may overlap)
+ *
+ * Only autorun programs are packed (the loader has to know where to go
+ * on) and only if the loader is smaller than the program.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef __PACK_H__
+
+#define __PACK_H__
+
+#include <stdint.h>
+
+#define PACK_BASE       0x4009  // start of a .P image (VERSN)
+#define PACK_PROG       0x407D  // first line of BASIC
+#define PACK_USR        0x4082  // first byte after the first REM
+#define PACK_STACK      256     // bytes kept free below RAMTOP
+
+#define PACK_MIN_MATCH  4
+#define PACK_MAX_MATCH  (0x7F+PACK_MIN_MATCH)
+#define PACK_MAX_LIT    0x7F
+#define PACK_WINDOW     4096    // max offset of a copy
+#define PACK_HASH_BITS  12
+#define PACK_DEPTH      32      // positions tried for each copy
+
+uint32_t packData (const uint8_t *src, uint32_t size, uint8_t *dst, uint32_t max, int32_t *slack);
+uint32_t packImage (const uint8_t *img, uint32_t size, uint8_t *out, uint32_t max);
+
+#endif
@@ -21,11 +21,17 @@
 
 #define LCD_pinCS   28
 #define LCD_pinRES  27
+#ifdef PICOK7_REGEN
+#define LCD_pinRS   9       // GPIO 26 is the tape input (ADC)
+#else
 #define LCD_pinRS   26
+#endif
 #define LCD_pinSCL  14
 #define LCD_pinSI   15
 #define LCD_SPI     spi1
 
+#define SD_SPI      spi0    // see sdhw_config.c
+
 #define PIN_WS2812  16
 
 #define WS2812_PIO  pio0
@@ -33,6 +39,20 @@
 #define PIN_EAR     29
 #define K7_PIO      pio0
 
+#define PINS_EAR_EXTRA  { 10, 11, 12 }   // extra outputs (other ZX81s)
+
+#define PIN_MIC     13      // MIC of the ZX81 (scope input, see README)
+
+#ifdef PICOK7_REGEN
+#define PIN_TAPE    26      // tape deck (regenerator input, ADC 0, see README)
+#endif
+
+
+// System clock (kHz)
+//---------------------------
+#define CLK_IDLE_KHZ   48000    // waiting in the menu
+#define CLK_RUN_KHZ    125000   // sending (the clock at boot)
+#define CLK_FAST_KHZ   133000   // CPU heavy phases
 
 // "Keys" (generated by encoder)
 //---------------------------
@@ -40,26 +60,210 @@
 #define KEY_UP    1
 #define KEY_DN    2
 
+// Tape
+//---------------------------
+#define K7_LEADER_MS  3000  // silence before a program
+#define K7_MAX_FNAME  64    // max file name length in a playlist
+#define K7_MAX_TNAME  16    // max name length on tape
+#define K7_MAX_PARTS  16    // max parts in a playlist
+#define K7_CHANNELS   4     // max outputs, including PIN_EAR
+#define K7_TAPE_BPS   50    // fastest tape rate (bytes/s), for the SD reads
+#define K7_DEFAULT_NAME "\x29\xB6"    // DQ
+#define K7_PREFETCH_MS  150 // time on a file in the menu before it is read
+
+// Machines (tape formats, see machine.c)
+//---------------------------
+#define TAP_PIO_FREQ  1000000.0 // k7edge.pio cycle (1us)
+#define TAP_RING      4096      // bytes read ahead of a TAP file
+
+// T-states of a machine to k7edge.pio cycles (constant, for the tables)
+#define TAP_CYCLES(t,khz)   ((uint32_t) (((t) * (TAP_PIO_FREQ/1000) + (khz)/2) / (khz)))
+
+typedef enum { MACH_ZX81, MACH_ZX80, MACH_SPECTRUM, MACH_ACE, MACH_COUNT } K7_MACH_ID;
+
+// How the bits are sent
+//   K7_PULSES: program image, bits are trains of pulses (k7.pio)
+//   K7_EDGES: TAP blocks, each bit is two half periods (k7edge.pio)
+typedef enum { K7_PULSES, K7_EDGES } K7_CODING;
+
+typedef struct {
+    K7_MACH_ID id;
+    const char *name;
+    const char *ext;        // file extension
+    K7_CODING coding;
+    // K7_PULSES: the file is the memory from base to E_LINE
+    uint16_t base;          // address of the first byte
+    uint8_t eline;          // offset of E_LINE
+    int16_t version;        // first byte (-1 = any)
+    uint16_t min_size;      // files must be larger (system variables)
+    bool named;             // the name is sent before the program
+    // K7_EDGES: half periods (k7edge.pio cycles) and block framing
+    uint32_t pilot, sync1, sync2, bit0, bit1;
+    uint16_t pilot_hdr;     // half periods of pilot before a header
+    uint16_t pilot_data;    // and before the other blocks
+    int16_t flag_hdr;       // flag sent before a header block (-1 = in the file)
+    int16_t flag_data;      // and before the other blocks
+    uint16_t hdr_len;       // length of a header block (with no flag in the file)
+    uint16_t pause_ms;      // silence after a block
+} K7_MACHINE;
+
+// Screen preview (file menu)
+//---------------------------
+#define PVW_PAGES     6     // LCD pages (8 lines of pixels) in the preview
+#define PVW_SIZE      (PVW_PAGES*128)
+#define PVW_DWELL_MS  400   // time on an option before its preview
+
+// Scope (menu option)
+//---------------------------
+#define SCOPE_FREQ      1000000.0   // samples per second
+#define SCOPE_RING_BITS 13          // ring buffer of 8K bytes (65536 samples)
+#define SCOPE_FPS       25          // screen updates per second
+#define SCOPE_PRE       8           // columns before the trigger
+
+// USB capture (menu option)
+//---------------------------
+#define CAP_RING_BITS   12          // ring buffer of 4K bytes per channel (32768 samples)
+
+// Regenerator (menu option)
+//---------------------------
+#define REGEN_RATE      50000       // ADC samples per second
+#define REGEN_RING_BITS 10          // ring buffer of 1K bytes (20 ms)
+
+// File catalog
+//---------------------------
+#define CAT_BUDGET    12288 // bytes for the names and the index
+#define CAT_MAX_NAME  255   // max file name length
+
+// Part of a playlist
+typedef struct {
+    char file[K7_MAX_FNAME+1];
+    uint8_t name[K7_MAX_TNAME];   // ZX81 char codes, bit 7 set in last char
+    int gap;                      // silence before the part, in ms
+} K7_PART;
+
 // Public functions
 //---------------------------
 
+// Clock manager
+struct spi_inst;
+void clockInit (void);
+void clockAddPio (PIO pio, uint sm, float hz);
+void clockAddSpi (struct spi_inst *spi, uint baud);
+void clockAddCallback (void (*fn)(void));
+bool clockSet (uint32_t khz);
+void clockReport (void);
+
+// File catalog
+void catReset (void);
+bool catAdd (const char *name, uint32_t size, bool list);
+int  catCount (void);
+uint32_t catUsed (void);
+char *catName (int i, char *buf);
+uint32_t catSize (int i);
+bool catIsList (int i);
+int  catFind (const char *name);
+uint32_t catCrc (int i);
+void catSetCrc (int i, uint32_t crc);
+
+// CRC32 (DMA sniffer)
+void crcInit (void);
+uint32_t crcCalc (uint32_t crc, const void *buf, uint n);
+
+// Trace (events in trace.h)
+void traceEvent (uint8_t id, uint8_t a, uint32_t b);
+void traceDrain (void);
+
+// Memory monitor
+void memInit (void);
+void memCheck (void);
+void memReport (void);
+
 // Encoder
 void encoderInit (PIO pio, uint pin_a, uint pin_b, uint pin_sw);
 int  getKey (void);
 
+// Machines
+extern const K7_MACHINE machines[MACH_COUNT];
+const K7_MACHINE *machineFind (const char *file);
+uint machineSize (const K7_MACHINE *m, const uint8_t *hdr, uint size);
+
+// TAP files
+void tapInit (uint pin);
+bool tapSend (const K7_MACHINE *m, const char *file);
+
 // Tape
 void k7Init (PIO pio, uint pin);
 bool k7Send (char *pfile);
+bool k7SendList (K7_PART *parts, int nparts);
+uint k7CheckHeader (const uint8_t *hdr, uint size);
+int  k7Prefetch (const char *pfile);
+void k7Pack (bool on);
+void k7StreamStart (const uint8_t *name, int size, int leader);
+bool k7StreamPut (uint8_t b);
+void k7StreamEnd (void);
+int  k7AddOutput (uint pin);
+int  k7Outputs (void);
+void k7Output (int n, PIO *pio, uint *sm);
+void k7Broadcast (uint32_t mask);
+void k7Lend (uint offset, const pio_sm_config *c);
+void k7Bits (bool on);
+void k7Speed (float scale);
+
+// Tape transport
+typedef enum { K7_IDLE, K7_LEADER, K7_PLAYING, K7_PAUSING, K7_PAUSED, K7_DONE, K7_ABORTED } K7_STATE;
+typedef void (*K7_NOTIFY)(K7_STATE state);
+void k7Play (const uint8_t *name, const uint8_t *code, int size, int leader);
+K7_STATE k7Poll (void);
+void k7Pause (void);
+void k7Resume (void);
+void k7Abort (void);
+void k7Seek (uint32_t ms);
+uint32_t k7Time (void);
+uint32_t k7Length (void);
+void k7Notify (K7_NOTIFY fn);
+
+// Independent channels (extra outputs)
+typedef enum { CH_FREE, CH_LEADER, CH_SENDING, CH_DONE, CH_ERROR } CH_STATE;
+void chInit (const uint *pins, int npins);
+bool chSend (int n, const char *pfile);
+void chAbort (int n);
+void chPoll (void);
+uint32_t chFreeMask (void);
+CH_STATE chStatus (int n, char *text);
+
+// Screen preview
+const uint8_t *previewImage (const char *file);
+
+// USB upload
+bool usbUpload (void);
+
+// USB capture
+void usbCapture (void);
+
+// Scope
+void scopeRun (void);
+
+// Regenerator
+void regenRun (void);
+
+// Playlist
+bool isPlaylist (char *file);
+bool k7Playlist (char *lstfile);
 
 // Display
 void displayInit (void);
+void displayWait (void);
 void displayClear (void);
 void displayStr (char *str, int l, int c, bool inverse);
-int displayMenu (int lt, int nl, int nopc, char *opc[]);
+void displayImage (int lt, int np, const uint8_t *img);
+int displayMenu (int lt, int nl, int nopc, const char *(*opc)(int i),
+                 const uint8_t *(*pvw)(int i), void (*idle)(int i, uint32_t ms));
 
 // WS2812 RGB LED
+typedef enum { LED_SOLID, LED_BLINK, LED_BREATHE, LED_FLASH } LED_PATTERN;
 void ws282Init (PIO pio, uint pin);
-void ws2812Update(uint32_t pixel);
+void ws2812Pattern (LED_PATTERN pattern, uint32_t color);
+void ws2812Track (PIO pio, uint sm);
 static inline uint32_t urgb_u32(uint8_t r, uint8_t g, uint8_t b) {
     return
             ((uint32_t) (r) << 16) |
@@ -0,0 +1,162 @@
+/**
+ * @file playlist.c
+ * @author Daniel Quadros
+ * @brief Playlists - send several .P files in sequence
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * A playlist is a text file (extension .LST) in the ZX81 directory.
+ * Each line describes a part:
+ *
+ *   file[,gap[,name]]
+ *
+ *   file: .P file in the same directory
+ *   gap:  silence before the part, in ms (default K7_LEADER_MS)
+ *   name: name on tape, for programs that do LOAD "name"
+ *         (default is the file name without the extension)
+ *
+ * Empty lines and lines starting with '#' are ignored.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+#include "ff.h"
+#include "f_util.h"
+
+#include "picok7.h"
+
+#define MAX_LST_SIZE 2048
+
+static char lst[MAX_LST_SIZE+1];
+static K7_PART parts[K7_MAX_PARTS];
+
+// ZX81 char codes 0x0B to 0x3F (0x0C is the pound sign)
+static const char zx81chars[] = "\"\x7F$:?()><=+-*/;,.0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+static char *trim (char *s);
+static bool parseLine (char *line, K7_PART *part);
+static int zx81Name (const char *src, int len, uint8_t *dst);
+
+// Check if file is a playlist (by the extension)
+bool isPlaylist (char *file) {
+    char *ext = strrchr(file, '.');
+    return (ext != NULL) && (strcasecmp(ext, ".LST") == 0);
+}
+
+// Send the files in a playlist
+// Returns false if the playlist or one of its files is invalid
+bool k7Playlist (char *lstfile) {
+    FIL fp;
+    UINT size = 0;
+    FRESULT fr = f_open(&fp, lstfile, FA_OPEN_EXISTING | FA_READ);
+    if (fr != FR_OK) {
+        prtdbg("f_open error: %s (%d)\n", FRESULT_str(fr), fr);
+        return false;
+    }
+    fr = f_read(&fp, lst, MAX_LST_SIZE, &size);
+    f_close(&fp);
+    if (fr != FR_OK) {
+        prtdbg("f_read error: %s (%d)\n", FRESULT_str(fr), fr);
+        return false;
+    }
+    lst[size] = 0;
+
+    int nparts = 0;
+    char *line = lst;
+    while (line != NULL) {
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = 0;
+        }
+        line = trim(line);
+        if ((*line != 0) && (*line != '#')) {
+            if (nparts == K7_MAX_PARTS) {
+                prtdbg("Too many parts\n");
+                return false;
+            }
+            if (!parseLine(line, &parts[nparts])) {
+                prtdbg("Invalid line: %s\n", line);
+                return false;
+            }
+            nparts++;
+        }
+        line = next;
+    }
+    prtdbg("Playlist with %d parts\n", nparts);
+    return (nparts > 0) && k7SendList(parts, nparts);
+}
+
+// Removes spaces (and CR) from start and end of s
+static char *trim (char *s) {
+    while (isspace((unsigned char) *s)) {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while ((end > s) && isspace((unsigned char) end[-1])) {
+        *--end = 0;
+    }
+    return s;
+}
+
+// Parse a line: file[,gap[,name]]
+// Returns false if invalid
+static bool parseLine (char *line, K7_PART *part) {
+    char *gap = strchr(line, ',');
+    char *name = NULL;
+    if (gap != NULL) {
+        *gap++ = 0;
+        name = strchr(gap, ',');
+        if (name != NULL) {
+            *name++ = 0;
+        }
+    }
+
+    line = trim(line);
+    if ((*line == 0) || (strlen(line) > K7_MAX_FNAME)) {
+        return false;
+    }
+    strcpy(part->file, line);
+
+    part->gap = K7_LEADER_MS;
+    if ((gap != NULL) && (*(gap = trim(gap)) != 0)) {
+        part->gap = atoi(gap);
+        if (part->gap <= 0) {
+            return false;
+        }
+    }
+
+    if ((name != NULL) && (*(name = trim(name)) != 0)) {
+        return zx81Name(name, strlen(name), part->name) > 0;
+    }
+    char *ext = strrchr(line, '.');
+    return zx81Name(line, ext ? ext-line : strlen(line), part->name) > 0;
+}
+
+// Convert len chars from src to a ZX81 tape name in dst
+// Returns the name size
+static int zx81Name (const char *src, int len, uint8_t *dst) {
+    int n = 0;
+    for (int i = 0; (i < len) && (n < K7_MAX_TNAME); i++) {
+        char c = toupper((unsigned char) src[i]);
+        const char *p = strchr(zx81chars, c);
+        if (c == ' ') {
+            dst[n++] = 0x00;
+        } else if ((c != 0) && (p != NULL)) {
+            dst[n++] = 0x0B + (p - zx81chars);
+        } else {
+            dst[n++] = 0x0F;    // '?'
+        }
+    }
+    if (n > 0) {
+        dst[n-1] |= 0x80;
+    }
+    return n;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file preview.c
+ * @author Daniel Quadros
+ * @brief Preview of the ZX81 screen saved in a .P file
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * A .P file is the ZX81 memory from 0x4009 (VERSN) to E_LINE, so
+ * it includes the display file. D_FILE (at 0x400C) points to it: a
+ * HALT (0x76) followed by 24 lines, each one with up to 32 chars and
+ * ended by a HALT. With less than 3.25K of RAM the lines are collapsed
+ * (only the chars up to the last non space, maybe none).
+ *
+ * Only the header and the display file are read from the SD card.
+ * Each char is drawn with 4x2 pixels, from zxglyph.h (made at build
+ * time by zxglyph.cmake), so the screen fits in 128x48 pixels.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+#include "ff.h"
+
+#include "picok7.h"
+#include "stream.h"
+
+#include "zxglyph.h"
+
+#define ZX_BASE      0x4009     // address of the first byte in the file
+#define ZX_SYSVARS   116        // system variables in the file (to 0x407C)
+#define ZX_HALT      0x76       // line end in the display file
+#define ZX_ROWS      24
+#define ZX_COLS      32
+#define DFILE_MAX    (1 + ZX_ROWS*(ZX_COLS+1))  // expanded display file
+
+// Work areas (static to save stack)
+static K7_STREAM st;
+static uint8_t dfile[DFILE_MAX];
+static uint8_t img[PVW_SIZE];
+
+static bool previewDraw (uint n);
+
+// Get the preview of the screen in file
+// Returns an image of PVW_PAGES pages (128 bytes each, from top to
+// bottom) or NULL if the file has no valid display file
+// The image is valid until the next call
+const uint8_t *previewImage (const char *file) {
+    uint8_t hdr[13];
+    UINT nr = 0;
+
+    if (streamOpen(&st, file, 0) != FR_OK) {
+        return NULL;
+    }
+    FRESULT fr = streamRead(&st, hdr, sizeof(hdr), &nr);
+    bool ok = (fr == FR_OK) && (nr == sizeof(hdr)) && (hdr[0] == 0);
+    if (ok) {
+        // D_FILE must be after the system variables and before E_LINE
+        uint32_t end = (hdr[11] + 256*hdr[12]) - ZX_BASE;
+        uint32_t d = (hdr[3] + 256*hdr[4]) - ZX_BASE;
+        ok = (end <= streamSize(&st)) && (d >= ZX_SYSVARS) && (d < end);
+        if (ok) {
+            uint32_t n = end - d;
+            fr = streamSeek(&st, d);
+            if (fr == FR_OK) {
+                fr = streamRead(&st, dfile, (n > DFILE_MAX) ? DFILE_MAX : n, &nr);
+            }
+            ok = (fr == FR_OK) && previewDraw(nr);
+        }
+    }
+    streamClose(&st);
+    return ok ? img : NULL;
+}
+
+// Draw in img the n bytes of the display file in dfile
+// Returns false if it is not a valid display file
+static bool previewDraw (uint n) {
+    memset(img, 0, sizeof(img));
+    if ((n == 0) || (dfile[0] != ZX_HALT)) {
+        return false;
+    }
+    uint i = 1;
+    for (int row = 0; row < ZX_ROWS; row++) {
+        uint8_t *page = img + (row >> 2)*(PVW_SIZE/PVW_PAGES);
+        int shift = 6 - 2*(row & 3);    // 4 rows in a page, bit 7 is the top
+        for (int col = 0; ; col++) {
+            if (i == n) {
+                return false;   // missing lines
+            }
+            uint8_t c = dfile[i++];
+            if (c == ZX_HALT) {
+                break;
+            }
+            if (col == ZX_COLS) {
+                return false;   // line too long
+            }
+            uint8_t g = 0;      // tokens are not expected in the screen
+            if ((c & 0x40) == 0) {
+                g = zxglyph[c & 0x3F];
+                if (c & 0x80) {
+                    g ^= 0xFF;  // inverse
+                }
+            }
+            for (int k = 0; k < 4; k++) {
+                page[4*col + k] |= ((g >> (6 - 2*k)) & 3) << shift;
+            }
+        }
+    }
+    return true;
+}
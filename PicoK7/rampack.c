@@ -0,0 +1,332 @@
+/**
+ * @file rampack.c
+ * @author Daniel Quadros
+ * @brief RAM pack mode (PicoK7Pack firmware)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * The Pico is a 16K RAM pack of the ZX81 (see rampack.h). All the
+ * GPIOs go to the bus, so there is no display, encoder or SD card in
+ * this mode: the program comes over USB, with k7upload (the protocol
+ * in upproto.h, the flags are ignored).
+ *
+ * The ROM fills the memory at reset (and NEW), so a program put there
+ * before would be lost. Instead it is kept aside and injected when the
+ * ZX81 is found with no program (D_FILE right after the system
+ * variables) in the first frames after a reset. It is done when FRAMES
+ * changes, in the vertical retrace, away from the display routine:
+ * the program lines and variables, the edit line of the ROM moved to
+ * the new E_LINE and, last, the system variables of the program (but
+ * the ones that belong to the ROM state). The ZX81 is then as after
+ * LOAD and the program can be RUN. A NEW, or a reset, brings it back.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/structs/bus_ctrl.h"
+
+#include "picok7.h"
+#include "rampack.h"
+#include "pack.h"
+#include "upproto.h"
+
+#include "rampack.pio.h"
+
+#define RP_PIO       pio0
+#define TIMEOUT_MS   5000   // max time without data from host
+
+#define SV_STKEND    0x401C
+#define SV_RAMTOP    0x4004
+
+// The memory of the pack (the DMA takes the high bits of the address
+// from the state machines) and the program to inject, in the same place
+static uint8_t mem[RP_SIZE] __attribute__((aligned(RP_SIZE)));
+static uint8_t image[RP_SIZE];
+static bool armed;
+static uint16_t last_frames;
+
+// System variables of the ROM state, kept when injecting
+static const struct { uint16_t addr; uint8_t len; } rom_vars[] = {
+    { 0x401F, 2 },      // MEM
+    { 0x4022, 1 },      // DF_SZ
+    { 0x4025, 4 },      // LAST_K, DB_ST, MARGIN
+    { 0x402D, 1 },      // FLAGX
+    { 0x4034, 2 },      // FRAMES
+    { 0x403B, 1 }       // CDFLAG
+};
+
+// Pointers to the workspace (after E_LINE), moved with it
+static const uint16_t ws_vars[] = { 0x4016, 0x4018, 0x401A, SV_STKEND };  // CH_ADD, X_PTR, STKBOT, STKEND
+
+// USB transfer
+static UP_PARSER parser;
+static enum { UPL_WAIT, UPL_DATA } state;
+static uint32_t total;
+static uint32_t received;
+
+static void rpInit (void);
+static void rpDmaInit (uint sm_rd, uint sm_wr);
+static void rpSmInit (uint sm, uint offset, pio_sm_config *c);
+static void rpPoll (void);
+static void rpInject (void);
+static uint16_t rpGet (const uint8_t *p, uint16_t addr);
+static void rpPut (uint8_t *p, uint16_t addr, uint16_t val);
+static void upSend (uint8_t type, const uint8_t *payload, int len);
+static void handleFrame (int type, uint8_t *payload, int len);
+static void finish (uint8_t st);
+
+int main () {
+    set_sys_clock_khz(RP_CLK_KHZ, true);
+    stdio_init_all();
+    rpInit();
+    upInit(&parser);
+    state = UPL_WAIT;
+
+    uint32_t last_rx = to_ms_since_boot(get_absolute_time());
+    while (true) {
+        int c = getchar_timeout_us(0);
+        if (c >= 0) {
+            last_rx = to_ms_since_boot(get_absolute_time());
+            int type = upParse(&parser, (uint8_t) c);
+            if (type == UP_BAD) {
+                prtdbg("RAMPACK: bad frame\n");
+                if (state != UPL_WAIT) {
+                    finish(UPS_PROTOCOL);
+                }
+            } else if (type != UP_NONE) {
+                handleFrame(type, parser.payload, parser.len);
+            }
+        } else if ((state == UPL_DATA) &&
+                   ((to_ms_since_boot(get_absolute_time()) - last_rx) > TIMEOUT_MS)) {
+            finish(UPS_TIMEOUT);
+        }
+        rpPoll();
+    }
+}
+
+// Start serving the bus
+static void rpInit () {
+    memset(mem, 0, sizeof(mem));
+
+    // The DMA must not wait for the CPU (USB and injection)
+    bus_ctrl_hw->priority = BUSCTRL_BUS_PRIORITY_DMA_W_BITS | BUSCTRL_BUS_PRIORITY_DMA_R_BITS;
+
+    uint sm_rd = pio_claim_unused_sm(RP_PIO, true);
+    uint sm_wr = pio_claim_unused_sm(RP_PIO, true);
+    for (uint pin = RP_PIN_A0; pin < (RP_PIN_D0+8); pin++) {
+        pio_gpio_init(RP_PIO, pin);
+    }
+    const uint ctl[] = { RP_PIN_MREQ, RP_PIN_RD, RP_PIN_WR };
+    for (int i = 0; i < count_of(ctl); i++) {
+        pio_gpio_init(RP_PIO, ctl[i]);
+        gpio_pull_up(ctl[i]);   // ZX81 off
+    }
+    pio_sm_set_consecutive_pindirs(RP_PIO, sm_rd, RP_PIN_A0, RP_PIN_D0+8, false);
+    rpDmaInit(sm_rd, sm_wr);
+
+    uint offset = pio_add_program(RP_PIO, &rampack_read_program);
+    pio_sm_config c = rampack_read_program_get_default_config(offset);
+    sm_config_set_out_pins(&c, RP_PIN_D0, 8);
+    sm_config_set_jmp_pin(&c, RP_PIN_RD);
+    sm_config_set_in_shift(&c, false, true, 32);
+    rpSmInit(sm_rd, offset, &c);
+
+    offset = pio_add_program(RP_PIO, &rampack_write_program);
+    c = rampack_write_program_get_default_config(offset);
+    sm_config_set_jmp_pin(&c, RP_PIN_MREQ);
+    sm_config_set_in_shift(&c, false, false, 32);
+    rpSmInit(sm_wr, offset, &c);
+
+    pio_set_sm_mask_enabled(RP_PIO, (1u << sm_rd) | (1u << sm_wr), true);
+    prtdbg("RAMPACK: memory at %08lX\n", (unsigned long) mem);
+}
+
+// Two channels for reads (address to the second channel, byte from
+// the memory to the state machine) and two for writes (address to the
+// second channel, byte from the state machine to the memory)
+static void rpDmaInit (uint sm_rd, uint sm_wr) {
+    int ch_raddr = dma_claim_unused_channel(true);
+    int ch_rdata = dma_claim_unused_channel(true);
+    int ch_waddr = dma_claim_unused_channel(true);
+    int ch_wdata = dma_claim_unused_channel(true);
+
+    dma_channel_config c = dma_channel_get_default_config(ch_raddr);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(RP_PIO, sm_rd, false));
+    dma_channel_configure(ch_raddr, &c, &dma_hw->ch[ch_rdata].al3_read_addr_trig,
+                          &RP_PIO->rxf[sm_rd], 1, false);
+
+    c = dma_channel_get_default_config(ch_rdata);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_chain_to(&c, ch_raddr);
+    dma_channel_configure(ch_rdata, &c, &RP_PIO->txf[sm_rd], mem, 1, false);
+
+    c = dma_channel_get_default_config(ch_waddr);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(RP_PIO, sm_wr, false));
+    dma_channel_configure(ch_waddr, &c, &dma_hw->ch[ch_wdata].al2_write_addr_trig,
+                          &RP_PIO->rxf[sm_wr], 1, false);
+
+    c = dma_channel_get_default_config(ch_wdata);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(RP_PIO, sm_wr, false));
+    channel_config_set_chain_to(&c, ch_waddr);
+    dma_channel_configure(ch_wdata, &c, mem, &RP_PIO->rxf[sm_wr], 1, false);
+
+    dma_start_channel_mask((1u << ch_raddr) | (1u << ch_waddr));
+}
+
+// Common configuration of the state machines
+static void rpSmInit (uint sm, uint offset, pio_sm_config *c) {
+    sm_config_set_in_pins(c, RP_PIN_A0);
+    sm_config_set_out_shift(c, true, false, 32);
+    pio_sm_init(RP_PIO, sm, offset, c);
+
+    // X = address of the memory, without the bits from the bus
+    pio_sm_put(RP_PIO, sm, ((uintptr_t) mem) >> RP_ADDR_BITS);
+    pio_sm_exec(RP_PIO, sm, pio_encode_pull(false, true));
+    pio_sm_exec(RP_PIO, sm, pio_encode_mov(pio_x, pio_osr));
+}
+
+// Watch for the moment to inject the program
+static void rpPoll () {
+    if (!armed) {
+        return;
+    }
+    uint16_t frames = rpGet(mem, RP_FRAMES);
+    if (frames == last_frames) {
+        return;
+    }
+    last_frames = frames;
+    if ((rpGet(mem, RP_D_FILE) == PACK_PROG) &&
+        ((uint16_t) (~frames & 0x7FFF) < RP_INJECT_FRAMES)) {
+        rpInject();
+    }
+}
+
+// Put the program in the memory of the ZX81
+static void rpInject () {
+    uint16_t e_line = rpGet(mem, RP_E_LINE);
+    uint16_t ws = rpGet(mem, SV_STKEND) - e_line;
+    uint16_t new_eline = rpGet(image, RP_E_LINE);
+    if ((e_line < PACK_PROG) || (ws > 256) ||
+        ((new_eline + ws) > (rpGet(mem, SV_RAMTOP) - PACK_STACK))) {
+        prtdbg("RAMPACK: no room (E_LINE %04X, %u bytes)\n", e_line, ws);
+        return;
+    }
+
+    // System variables, with the ROM state and the workspace moved
+    uint8_t sv[PACK_PROG - RP_BASE];
+    memcpy(sv, image, PACK_PROG - RP_BASE);
+    for (int i = 0; i < count_of(rom_vars); i++) {
+        memcpy(sv + rom_vars[i].addr - RP_BASE, mem + rom_vars[i].addr - RP_BASE, rom_vars[i].len);
+    }
+    for (int i = 0; i < count_of(ws_vars); i++) {
+        uint16_t p = rpGet(mem, ws_vars[i]);
+        if ((p >= e_line) && (p <= (e_line + ws))) {
+            p = p - e_line + new_eline;
+        }
+        rpPut(sv, ws_vars[i], p);
+    }
+
+    uint8_t work[256];
+    memcpy(work, mem + e_line - RP_BASE, ws);
+    memcpy(mem + PACK_PROG - RP_BASE, image + PACK_PROG - RP_BASE, new_eline - PACK_PROG);
+    memcpy(mem + new_eline - RP_BASE, work, ws);
+    memcpy(mem + PACK_BASE - RP_BASE, sv + PACK_BASE - RP_BASE, PACK_PROG - PACK_BASE);
+    prtdbg("RAMPACK: program injected (frame %04X)\n", last_frames);
+}
+
+static uint16_t rpGet (const uint8_t *p, uint16_t addr) {
+    return p[addr - RP_BASE] | (p[addr - RP_BASE + 1] << 8);
+}
+
+static void rpPut (uint8_t *p, uint16_t addr, uint16_t val) {
+    p[addr - RP_BASE] = val & 0xFF;
+    p[addr - RP_BASE + 1] = val >> 8;
+}
+
+// Send a frame to the host
+static void upSend (uint8_t type, const uint8_t *payload, int len) {
+    uint8_t frame[UP_MAX_FRAME];
+    int n = upFrame(frame, type, payload, len);
+    for (int i = 0; i < n; i++) {
+        putchar_raw(frame[i]);  // no CR/LF translation
+    }
+    stdio_flush();
+}
+
+// Treat a frame from the host
+// The program goes straight to image, all the credit is given at once
+static void handleFrame (int type, uint8_t *payload, int len) {
+    uint8_t *p = image + PACK_BASE - RP_BASE;
+    uint32_t size;
+    switch (type) {
+        case UP_START:
+            if ((state != UPL_WAIT) || (len < 5)) {
+                finish(UPS_PROTOCOL);
+                break;
+            }
+            total = upGet32(payload+1);
+            received = 0;
+            if ((total <= (PACK_PROG - PACK_BASE)) || (total > (RP_SIZE - (PACK_BASE - RP_BASE) - PACK_STACK))) {
+                finish(UPS_INVALID);
+                break;
+            }
+            armed = false;
+            state = UPL_DATA;
+            upSend(UP_CREDIT, (uint8_t []) { total & 0xFF, total >> 8 }, 2);
+            break;
+        case UP_DATA:
+            if ((state != UPL_DATA) || ((received + len) > total)) {
+                finish(UPS_PROTOCOL);
+                break;
+            }
+            memcpy(p + received, payload, len);
+            received += len;
+            break;
+        case UP_END:
+            // the file may have padding after the program (E_LINE)
+            size = rpGet(image, RP_E_LINE) - PACK_BASE;
+            if ((state != UPL_DATA) || (received != total)) {
+                finish(UPS_PROTOCOL);
+            } else if ((p[0] != 0) || (size > total) || (size <= (PACK_PROG - PACK_BASE)) ||
+                       (rpGet(image, RP_D_FILE) <= PACK_PROG) || (p[size-1] != 0x80)) {
+                finish(UPS_INVALID);    // not a ZX81 program (or no lines)
+            } else {
+                memset(p + size, 0, total - size);
+                total = size;
+                armed = true;
+                last_frames = rpGet(mem, RP_FRAMES);
+                finish(UPS_OK);
+            }
+            break;
+        case UP_ABORT:
+            if (state != UPL_WAIT) {
+                finish(UPS_ABORTED);
+            }
+            break;
+    }
+}
+
+// End of transfer
+static void finish (uint8_t st) {
+    prtdbg("RAMPACK: upload status %d, %lu bytes\n", st, (unsigned long) received);
+    upSend(UP_STATUS, &st, 1);
+    state = UPL_WAIT;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file rampack.h
+ * @author Daniel Quadros
+ * @brief RAM pack mode - definitions shared with the host tools
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * In this mode (a different board, see README) the Pico is a 16K RAM
+ * pack on the expansion bus of the ZX81. Two PIO state machines follow
+ * the bus (rampack.pio) and four DMA channels move the bytes between
+ * them and an image of the memory in the SRAM of the RP2040, without
+ * the CPU.
+ *
+ * The pack answers when A14 is set (0x4000-0x7FFF, and the mirror at
+ * 0xC000-0xFFFF used by the display). Refresh cycles and I/O writes
+ * are ignored.
+ *
+ * The timing of the state machines is below, in system clock cycles.
+ * HostTools/k7bus checks it against the read and write windows of the
+ * ZX81, change both if rampack.pio is changed.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef __RAMPACK_H__
+
+#define __RAMPACK_H__
+
+// Bus connections (all inputs go through 5V tolerant buffers)
+#define RP_PIN_A0       0       // A0 to A14 on GPIO 0 to 14
+#define RP_PIN_D0       15      // D0 to D7 on GPIO 15 to 22
+#define RP_PIN_MREQ     26
+#define RP_PIN_RD       27
+#define RP_PIN_WR       28
+#define RP_ADDR_BITS    14      // bits of the address in the image (A14 selects the pack)
+
+#define RP_BASE         0x4000
+#define RP_SIZE         0x4000  // 16K
+#define RP_CLK_KHZ      133000  // system clock
+
+// ZX81 system variables used to inject a program
+#define RP_D_FILE       0x400C
+#define RP_E_LINE       0x4014
+#define RP_FRAMES       0x4034
+#define RP_INJECT_FRAMES  250   // max frames after a reset (or NEW) to inject
+
+// Timing of rampack.pio (system clock cycles, worst case)
+#define RP_SYNC         3       // input synchronizer (2) and phase (1)
+#define RP_READ_PUSH    7       // MREQ seen low to the address in the FIFO
+#define RP_READ_TEST    2       // byte from the DMA to RD tested
+#define RP_READ_DRIVE   5       // byte from the DMA to the data bus driven
+#define RP_READ_FREE    3       // RD seen high to the data bus released
+#define RP_WRITE_DATA   10      // WR seen low to the data bus sampled
+#define RP_WRITE_PUSH   13      // WR seen low to the data in the FIFO
+#define RP_LOOP         2       // MREQ (or WR) seen high to waiting the next cycle
+#define RP_DMA          10      // the two transfers of a read or a write
+
+#endif
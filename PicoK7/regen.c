@@ -0,0 +1,444 @@
+/**
+ * @file regen.c
+ * @author Daniel Quadros
+ * @brief Regenerator: tape deck in, clean pulses out
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * The signal of a tape deck (PIN_TAPE, through the circuit in the README)
+ * is sampled by the ADC at REGEN_RATE and a DMA channel writes the
+ * samples in a ring buffer. The pulses are found as they arrive, with a
+ * Schmitt trigger that follows the signal like the one in the host tools
+ * (HostTools/audio.c): 30% of the envelope, but never below 1.5 times the
+ * noise floor (the peaks of the silence), and the release at half of it.
+ * The polarity is taken from the first pulse after a long silence and
+ * kept while the program goes on.
+ *
+ * Pulses closer than 1ms are a burst, that is a bit: 0 if it has less
+ * than 7 pulses, 1 if more (4 and 9 are expected); a pulse with no other
+ * one near it and bursts of a single pulse are noise. The bit is decided
+ * a fixed time after the start of its burst and given to the main
+ * output, that runs k7.pio taking a bit at a time from the FIFO, so it
+ * comes out with the original timing and a constant delay. The clock of the output follows
+ * the time between the bursts, a little faster, so a tape deck a little
+ * fast or slow doesn't make the bits pile up or the delay grow.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+
+#include "picok7.h"
+#include "trace.h"
+
+// Times in samples (REGEN_RATE is a multiple of 1000)
+#define US(t)         ((uint32_t) ((t) * (REGEN_RATE / 1000) / 1000))
+
+#define RING_SIZE     (1 << REGEN_RING_BITS)
+#define RING_GUARD    64        // samples that may be written while the ring is read
+#define ADC_CLOCK     48000000.0f   // clk_adc comes from the USB PLL
+
+// Tape signal (k7.pio)
+#define BIT0_US       2500      // a bit 0 takes 50 cycles
+#define BIT1_US       4050      // a bit 1 takes 81 cycles
+#define SILENCE_US    1300      // silence before the pulses of a bit
+#define PULSES_0      4         // pulses in a bit 0
+#define PULSES_1      9         // pulses in a bit 1
+
+// Detection
+#define RINGING_US    150       // closer crossings are ringing, not pulses
+#define PAIR_US       500       // a pulse with no other this close is a glitch
+#define GAP_US        1000      // silence that ends a burst
+#define IDLE_US       20000     // silence that ends a program
+#define DECIDE_US     3300      // a bit goes out this long after the start of its burst
+#define BIT1_PULSES   7         // bursts with less pulses are 0
+#define MIN_PULSES    2         // a single pulse is noise
+#define THRESHOLD     30        // % of the envelope
+#define NOISE_X2      3         // threshold at least 1.5 times the noise floor
+#define MIN_LEVEL     (2 << 8)  // lowest threshold (2 LSB)
+#define FULL_SCALE    (128 << 8)
+#define DC_SHIFT      9         // average of the signal: 512 samples (10ms)
+#define ENV_SHIFT     9         // decay of the envelope: 10ms
+#define FLOOR_DROP    1         // noise floor falls half way to a lower block...
+#define FLOOR_SHIFT   4         // ...and rises 1/16 to a higher one
+#define BLOCK         US(20000) // noise floor: peak in blocks longer than a bit
+#define PACE_SHIFT    4         // speed of the tape deck: average of 16 bits
+#define SPEED_MAX     15        // max error in the speed of the tape deck (%)
+#define SPEED_STEP    0.002f    // smaller changes are not applied
+#define SPEED_MARGIN  1.02f     // the output runs a little faster, so it waits
+                                // for the next bit instead of falling behind
+
+#define MAX_BURSTS    4         // bursts waiting for the decision
+#define SHOW_MS       500       // statistics update
+
+static uint8_t ring[RING_SIZE] __attribute__((aligned(RING_SIZE)));
+static int adc_dma;
+static uint32_t pos;            // samples taken from the ring
+static PIO out_pio;
+static uint out_sm;
+
+// Detector state
+static int32_t dc;              // average of the signal (8.8)
+static int32_t env[2];          // envelope of each polarity (8.8)
+static int32_t noise;           // noise floor (8.8)
+static int32_t noise_acc;       // noise floor with 8 more bits
+static int32_t blk_peak;        // peak in the current block
+static uint32_t blk_left;       // samples left in the block
+static bool blk_pulse;          // a pulse was found in the block
+static int pol;                 // polarity of the pulses (1 = negative)
+static bool high;               // inside a pulse
+static uint32_t last_pulse;     // sample of the last pulse
+static bool last_counted;       // the last pulse is in a burst
+static uint32_t last_count;     // sample of the last pulse in a burst
+static uint32_t run_start;      // first pulse of the current burst
+static int run_pulses;          // pulses in the current burst
+static int32_t pace;            // speed of the tape deck (16.16)
+static float deck;              // speed of the tape deck
+static float speed;             // applied to the output
+
+// Bursts waiting for the decision
+static struct {
+    uint32_t start;             // sample of the first pulse
+    int pulses;
+} burst[MAX_BURSTS];
+static int b_first, b_count;
+static bool b_open;             // the last burst in the queue is not complete
+
+// Statistics
+static struct {
+    uint32_t bits;              // bits sent
+    uint32_t exact;             // bits with the expected number of pulses
+    uint32_t fixed;             // bits with missing or extra pulses
+    uint32_t noise;             // bursts discarded
+    uint32_t late;              // bits that waited for the previous one
+    uint32_t lost;              // samples lost (ring overrun)
+} st;
+
+static bool regenStart (void);
+static void regenStop (void);
+static void pump (void);
+static void sample (uint32_t n, uint8_t x);
+static void pulse (uint32_t n);
+static void count (uint32_t n);
+static void decide (void);
+static void showStats (void);
+static unsigned sat (uint64_t v, unsigned max);
+
+// Regenerator mode, until Enter is pressed
+void regenRun () {
+    displayClear();
+    displayStr("Regenerator", 0, 0, true);
+    if (!regenStart()) {
+        displayStr("No DMA", 1, 0, false);
+        sleep_ms(2000);
+        return;
+    }
+    displayStr("Enter to exit", 7, 0, false);
+    ws2812Pattern(LED_BREATHE, urgb_u32(0,0,120));
+    ws2812Track(out_pio, out_sm);
+
+    uint32_t last_show = to_ms_since_boot(get_absolute_time());
+    showStats();
+    while (true) {
+        pump();
+        uint32_t now = to_ms_since_boot(get_absolute_time());
+        if ((now - last_show) >= SHOW_MS) {
+            last_show = now;
+            showStats();
+        }
+        chPoll();
+        // no traceDrain here: writing to a host that doesn't read blocks
+        // for longer than the ring of samples lasts (the events wait in
+        // the trace ring until the menu)
+        if (getKey() == KEY_ENTER) {
+            break;
+        }
+    }
+
+    regenStop();
+    traceEvent(TR_REGEN, st.bits ? (uint16_t) (st.exact * 100 / st.bits) : 0, st.bits);
+}
+
+// Claim the DMA channel, switch the main output to bits and start the ADC
+static bool regenStart () {
+    adc_dma = dma_claim_unused_channel(false);
+    if (adc_dma < 0) {
+        return false;
+    }
+
+    // Detector
+    dc = 128 << 8;
+    env[0] = env[1] = 0;
+    noise_acc = FULL_SCALE << 8;    // goes down at the first block
+    noise = FULL_SCALE;
+    blk_peak = 0;
+    blk_left = BLOCK;
+    blk_pulse = false;
+    pol = 0;
+    high = false;
+    last_pulse = last_count = 0 - US(GAP_US) - 1;
+    last_counted = true;
+    run_start = 0;
+    run_pulses = 0;
+    pace = 1 << 16;
+    deck = 1.0f;
+    speed = SPEED_MARGIN;
+    b_first = b_count = 0;
+    b_open = false;
+    st.bits = st.exact = st.fixed = st.noise = st.late = st.lost = 0;
+
+    // Output
+    k7Output(0, &out_pio, &out_sm);
+    k7Bits(true);
+    k7Speed(speed);
+
+    // ADC, 8 bit samples in the FIFO, taken by the DMA
+    adc_init();
+    adc_gpio_init(PIN_TAPE);
+    adc_select_input(PIN_TAPE - 26);
+    adc_fifo_setup(true, true, 1, false, true);
+    adc_set_clkdiv(ADC_CLOCK / REGEN_RATE - 1);
+
+    dma_channel_config c = dma_channel_get_default_config(adc_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, REGEN_RING_BITS);
+    channel_config_set_dreq(&c, DREQ_ADC);
+    dma_channel_configure(adc_dma, &c, ring, &adc_hw->fifo, 0xFFFFFFFF, true);
+    pos = 0;
+    adc_run(true);
+    return true;
+}
+
+// Stop the ADC, release the DMA channel and restore the main output
+static void regenStop () {
+    adc_run(false);
+    dma_channel_abort(adc_dma);
+    dma_channel_unclaim(adc_dma);
+    adc_fifo_drain();
+    ws2812Track(NULL, 0);
+    k7Speed(1.0f);
+    k7Bits(false);
+}
+
+// Process the samples written by the DMA
+static void pump () {
+    uint32_t written = 0xFFFFFFFF - dma_hw->ch[adc_dma].transfer_count;
+    if ((written - pos) > (RING_SIZE - RING_GUARD)) {
+        uint32_t skip = (written - pos) - RING_SIZE/2;
+        st.lost += skip;
+        pos += skip;
+    }
+    while (pos != written) {
+        sample(pos, ring[pos & (RING_SIZE-1)]);
+        pos++;
+    }
+}
+
+// Process sample n
+static void sample (uint32_t n, uint8_t x) {
+    // Remove the DC level
+    int32_t v = ((int32_t) x << 8) - dc;
+    dc += v >> DC_SHIFT;
+    int32_t mag = v < 0 ? -v : v;
+
+    // Envelopes: instant attack, slow decay
+    for (int p = 0; p < 2; p++) {
+        int32_t e = p ? -v : v;
+        if (e > env[p]) {
+            env[p] = e;
+        } else {
+            env[p] -= env[p] >> ENV_SHIFT;
+        }
+    }
+
+    // Noise floor: peak of the blocks without pulses, goes down fast
+    // and up slowly
+    if (mag > blk_peak) {
+        blk_peak = mag;
+    }
+    if (--blk_left == 0) {
+        if (!blk_pulse) {
+            int32_t d = (blk_peak << 8) - noise_acc;
+            noise_acc += d >> ((d < 0) ? FLOOR_DROP : FLOOR_SHIFT);
+            noise = noise_acc >> 8;
+        }
+        blk_peak = 0;
+        blk_pulse = false;
+        blk_left = BLOCK;
+    }
+
+    // Schmitt trigger, thresholds for each polarity
+    int32_t minimum = noise * NOISE_X2 / 2;
+    if (minimum < MIN_LEVEL) {
+        minimum = MIN_LEVEL;
+    }
+    int32_t on[2];
+    for (int p = 0; p < 2; p++) {
+        on[p] = env[p] * THRESHOLD / 100;
+        if (on[p] < minimum) {
+            on[p] = minimum;
+        }
+    }
+    int32_t off = on[pol] / 2;
+    if (off < noise) {
+        off = noise;
+    }
+
+    // The polarity is kept while the signal goes on (the ringing of a
+    // pulse can be larger than the pulse), after a long silence it is
+    // the one of the first pulse
+    if (!high && ((n - last_pulse) > US(IDLE_US))) {
+        if (v > on[0]) {
+            pol = 0;
+        } else if (-v > on[1]) {
+            pol = 1;
+        }
+    }
+    int32_t s = pol ? -v : v;
+    if (!high) {
+        if (s > on[pol]) {
+            high = true;
+            pulse(n);
+        }
+    } else if (s < off) {
+        high = false;
+    }
+
+    // Bits due
+    if ((b_count != 0) && ((n - burst[b_first].start) >= US(DECIDE_US))) {
+        decide();
+    }
+}
+
+// A pulse started at sample n
+// It goes in a burst only if there is another pulse close to it, so
+// the ringing in the silence between the bits is discarded
+static void pulse (uint32_t n) {
+    uint32_t dt = n - last_pulse;
+    if (dt < US(RINGING_US)) {
+        return;
+    }
+    if (dt <= US(PAIR_US)) {
+        if (!last_counted) {
+            count(last_pulse);
+        }
+        count(n);
+        last_counted = true;
+    } else {
+        if (!last_counted) {
+            st.noise++;
+        }
+        last_counted = false;
+    }
+    last_pulse = n;
+    blk_pulse = true;
+}
+
+// Put the pulse at sample n in a burst
+static void count (uint32_t n) {
+    uint32_t dt = n - last_count;
+    last_count = n;
+    if (dt > US(GAP_US)) {
+        // new burst, the time since the previous one gives the speed
+        if (run_pulses >= MIN_PULSES) {
+            uint32_t nominal = (run_pulses >= BIT1_PULSES) ? US(BIT1_US) : US(BIT0_US);
+            uint32_t t = n - run_start;
+            if (((t * 100) > (nominal * (100 - SPEED_MAX))) && ((t * 100) < (nominal * (100 + SPEED_MAX)))) {
+                pace += ((int32_t) (((uint64_t) nominal << 16) / t) - pace) >> PACE_SHIFT;
+            }
+        }
+        run_start = n;
+        run_pulses = 1;
+        if (b_count == MAX_BURSTS) {
+            st.noise++;
+            b_open = false;
+            return;
+        }
+        int i = (b_first + b_count) % MAX_BURSTS;
+        burst[i].start = n;
+        burst[i].pulses = 1;
+        b_count++;
+        b_open = true;
+    } else {
+        run_pulses++;
+        if (b_open) {
+            burst[(b_first + b_count - 1) % MAX_BURSTS].pulses++;
+        }
+    }
+}
+
+// Send the bit of the first burst in the queue
+static void decide () {
+    int pulses = burst[b_first].pulses;
+    b_first = (b_first + 1) % MAX_BURSTS;
+    if (--b_count == 0) {
+        b_open = false;
+    }
+    if (pulses < MIN_PULSES) {
+        st.noise++;
+        return;
+    }
+    uint32_t bit = pulses >= BIT1_PULSES;
+    st.bits++;
+    if (pulses == (bit ? PULSES_1 : PULSES_0)) {
+        st.exact++;
+    } else {
+        st.fixed++;
+    }
+
+    // Follow the speed of the tape deck
+    deck = pace / 65536.0f;
+    if (fabsf(deck * SPEED_MARGIN - speed) > SPEED_STEP) {
+        speed = deck * SPEED_MARGIN;
+        k7Speed(speed);
+    }
+
+    // The FIFO is empty if the output is sending the previous bit
+    if (!pio_sm_is_tx_fifo_empty(out_pio, out_sm)) {
+        st.late++;
+    }
+    pio_sm_put_blocking(out_pio, out_sm, bit << 31);
+}
+
+// Show the statistics
+// The values are clamped to their fields, so each line fits 16 columns
+// (single digits go as chars, so the compiler can bound them too)
+static void showStats () {
+    char aux[17];
+    int32_t e = env[0] > env[1] ? env[0] : env[1];
+
+    snprintf(aux, sizeof(aux), "Level%3u%% N%3u%%", sat(e * 100 / FULL_SCALE, 100),
+             sat(noise * 100 / FULL_SCALE, 100));
+    displayStr(aux, 1, 0, false);
+    unsigned spd = sat((uint32_t) (deck * 1000.0f + 0.5f), 1999);                 // 0.1%
+    unsigned delay = sat((uint32_t) (DECIDE_US + SILENCE_US / speed) / 100, 99);  // 0.1ms
+    snprintf(aux, sizeof(aux), "Spd %3u.%c%% %c.%cms", (uint8_t) (spd / 10), '0' + spd % 10,
+             '0' + delay / 10, '0' + delay % 10);
+    displayStr(aux, 2, 0, false);
+    snprintf(aux, sizeof(aux), "Bits %-11u", (unsigned) st.bits);
+    displayStr(aux, 3, 0, false);
+    if (st.bits) {
+        unsigned pm = sat((uint64_t) st.exact * 1000 / st.bits, 1000);
+        snprintf(aux, sizeof(aux), "Exact %3u.%c%%    ", (uint8_t) (pm / 10), '0' + pm % 10);
+    } else {
+        snprintf(aux, sizeof(aux), "Exact   --      ");
+    }
+    displayStr(aux, 4, 0, false);
+    snprintf(aux, sizeof(aux), "Fix%4u Noise%3u", sat(st.fixed, 9999), sat(st.noise, 999));
+    displayStr(aux, 5, 0, false);
+    snprintf(aux, sizeof(aux), "Late%3u Lost%4u", sat(st.late, 999), sat(st.lost, 9999));
+    displayStr(aux, 6, 0, false);
+}
+
+// v limited to max
+static unsigned sat (uint64_t v, unsigned max) {
+    return (v > max) ? max : (unsigned) v;
+}
@@ -0,0 +1,369 @@
+/**
+ * @file scope.c
+ * @author Daniel Quadros
+ * @brief Oscilloscope of the tape signals (menu option)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * A state machine (scope.pio) samples one input every microsecond and
+ * a DMA channel writes the samples in a ring buffer, with no work for
+ * the CPU. At each screen update the ring is searched back for the last
+ * trigger edge with a full screen after it, the signal is drawn from
+ * there and the mean pulse (high) and the longest gap (low) in the
+ * screen are shown in the last line.
+ *
+ * The first line has the fields: time per column, trigger (/ rising
+ * edge, \ falling edge, A auto), input and Exit. Enter goes to the next
+ * field and the encoder changes the selected one.
+ *
+ * The inputs are the outputs (EAR and the extra ones) and PIN_MIC; the
+ * pins are only read, so the outputs go on working (chPoll is called).
+ * The state machine and the DMA channel are claimed when the scope is
+ * entered and released at the exit (the USB capture uses the same PIO).
+ * The samples are counted from the start of the capture in 32 bits, so
+ * the capture is restarted (skipping a screen update) every MAX_WORDS.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+
+#include "picok7.h"
+#include "trace.h"
+
+#include "scope.pio.h"
+
+#define RING_WORDS      ((1 << SCOPE_RING_BITS) / 4)
+#define RING_SAMPLES    (RING_WORDS * 32)
+#define RING_GUARD      4096    // samples that may be overwritten while drawing
+#define MAX_WORDS       (1u << 26)  // the capture restarts before the samples
+                                    // (words * 32) overflow 32 bits (35 minutes)
+#define SCOPE_WIDTH     128
+#define SCOPE_HIGH      4       // pixel rows of the levels in the image
+#define SCOPE_LOW       43
+
+static uint32_t ring[RING_WORDS] __attribute__((aligned(1 << SCOPE_RING_BITS)));
+static uint8_t img[PVW_SIZE];
+
+static PIO scope_pio;
+static int scope_sm;
+static uint scope_offset;
+static int scope_dma;
+
+// Fields in the first line
+enum { F_TIME, F_TRIGGER, F_INPUT, F_EXIT };
+
+// Time per column (us)
+static const uint16_t timebase[] = { 1, 2, 5, 10, 20, 50, 100, 200 };
+#define TB_DEFAULT  4
+
+// Trigger
+typedef enum { TRIG_RISE, TRIG_FALL, TRIG_AUTO } TRIGGER;
+static const char trig_char[] = "/\\A";
+
+// Inputs
+static const uint ear_extra[] = PINS_EAR_EXTRA;
+#define NINPUTS   (count_of(ear_extra) + 2)
+static uint inputPin (int n);
+static void inputName (int n, char *name);
+
+// Local routines
+static bool scopeClaim (void);
+static void scopeRelease (void);
+static void scopeStart (uint pin);
+static void scopeStop (void);
+static void scopeStatus (int tb, TRIGGER trig, int input, int field);
+static bool scopeFrame (int tb, TRIGGER trig);
+static uint32_t scopeWords (void);
+static void scopeMeasure (uint32_t start, uint32_t n);
+static uint32_t scopeTrigger (uint32_t from, uint32_t to, int level);
+static void scopePixel (int x, int y);
+
+// Sample s (counted from the start of the capture)
+static inline int sample (uint32_t s) {
+    return (ring[(s >> 5) & (RING_WORDS - 1)] >> (s & 31)) & 1;
+}
+
+// Runs the oscilloscope until Exit is selected
+void scopeRun () {
+    if (!scopeClaim()) {
+        displayClear();
+        displayStr((char *) "No PIO for scope", 3, 0, false);
+        sleep_ms(2000);
+        return;
+    }
+    int tb = TB_DEFAULT;
+    TRIGGER trig = TRIG_RISE;
+    int input = 0;
+    int field = F_TIME;
+    uint32_t last = time_us_32();
+    bool waiting = false;
+
+    displayClear();
+    scopeStatus(tb, trig, input, field);
+    gpio_init(PIN_MIC);
+    scopeStart(inputPin(input));
+    while (true) {
+        int key = getKey();
+        if (key == KEY_ENTER) {
+            if (field == F_EXIT) {
+                break;
+            }
+            field++;
+        } else if (key >= 0) {
+            int d = (key == KEY_UP) ? 1 : -1;
+            switch (field) {
+                case F_TIME:
+                    tb += d;
+                    if (tb < 0) {
+                        tb = 0;
+                    } else if (tb == count_of(timebase)) {
+                        tb = count_of(timebase)-1;
+                    }
+                    break;
+                case F_TRIGGER:
+                    trig = (TRIGGER) ((trig + 3 + d) % 3);
+                    break;
+                case F_INPUT:
+                    input = (input + NINPUTS + d) % NINPUTS;
+                    scopeStart(inputPin(input));
+                    break;
+                default:
+                    field = F_TIME;
+                    break;
+            }
+        }
+        if (key >= 0) {
+            scopeStatus(tb, trig, input, field);
+        }
+        if ((time_us_32() - last) >= (1000000 / SCOPE_FPS)) {
+            last = time_us_32();
+            if (scopeWords() >= MAX_WORDS) {
+                scopeStart(inputPin(input));    // the screen is kept
+            } else {
+                bool drawn = scopeFrame(tb, trig);
+                if (!drawn && !waiting) {
+                    displayStr((char *) "Waiting trigger ", 7, 0, false);
+                }
+                waiting = !drawn;
+            }
+        } else {
+            traceDrain();
+            chPoll();
+            sleep_ms(1);
+        }
+    }
+    scopeRelease();
+}
+
+// Claims a state machine (in any PIO) and a DMA channel
+static bool scopeClaim () {
+    for (uint p = NUM_PIOS; p-- > 0; ) {
+        PIO pio = p ? pio1 : pio0;
+        int sm = pio_claim_unused_sm(pio, false);
+        if (sm < 0) {
+            continue;
+        }
+        if (!pio_can_add_program(pio, &scope_program)) {
+            pio_sm_unclaim(pio, sm);
+            continue;
+        }
+        traceEvent(TR_PIO_SM, TRM_SCOPE, (p << 4) | sm);
+        scope_offset = pio_add_program(pio, &scope_program);
+        scope_pio = pio;
+        scope_sm = sm;
+        scope_dma = dma_claim_unused_channel(true);
+        clockAddPio(pio, sm, SCOPE_FREQ);
+        return true;
+    }
+    traceEvent(TR_ERROR, TRE_PIO_MEMORY, TRM_SCOPE);
+    return false;
+}
+
+// Releases the state machine and the DMA channel
+static void scopeRelease () {
+    scopeStop();
+    pio_sm_unclaim(scope_pio, scope_sm);
+    pio_remove_program(scope_pio, &scope_program, scope_offset);
+    dma_channel_unclaim(scope_dma);
+}
+
+// (Re)starts the capture of a pin
+// The pin is not given to the PIO, it may be in use by another one
+static void scopeStart (uint pin) {
+    scopeStop();
+    pio_sm_config c = scope_program_get_default_config(scope_offset);
+    sm_config_set_in_pins(&c, pin);
+    sm_config_set_in_shift(&c, true, true, 32);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    sm_config_set_clkdiv(&c, clock_get_hz(clk_sys) / SCOPE_FREQ);
+    pio_sm_init(scope_pio, scope_sm, scope_offset, &c);
+
+    dma_channel_config dc = dma_channel_get_default_config(scope_dma);
+    channel_config_set_transfer_data_size(&dc, DMA_SIZE_32);
+    channel_config_set_read_increment(&dc, false);
+    channel_config_set_write_increment(&dc, true);
+    channel_config_set_ring(&dc, true, SCOPE_RING_BITS);
+    channel_config_set_dreq(&dc, pio_get_dreq(scope_pio, scope_sm, false));
+    dma_channel_configure(scope_dma, &dc, ring, &scope_pio->rxf[scope_sm], 0xFFFFFFFF, true);
+    pio_sm_set_enabled(scope_pio, scope_sm, true);
+}
+
+// Stops the capture
+static void scopeStop () {
+    pio_sm_set_enabled(scope_pio, scope_sm, false);
+    dma_channel_abort(scope_dma);
+}
+
+// Pin of input n: EAR, the extra outputs and MIC
+static uint inputPin (int n) {
+    if (n == 0) {
+        return PIN_EAR;
+    }
+    if (n <= count_of(ear_extra)) {
+        return ear_extra[n-1];
+    }
+    return PIN_MIC;
+}
+
+// Name of input n (4 chars)
+static void inputName (int n, char *name) {
+    if (n == 0) {
+        strcpy(name, "EAR ");
+    } else if (n <= count_of(ear_extra)) {
+        sprintf(name, "EAR%d", n+1);
+    } else {
+        strcpy(name, "MIC ");
+    }
+}
+
+// Draws the first line: "nnnu T INPT Exit", the selected field in inverse
+static void scopeStatus (int tb, TRIGGER trig, int input, int field) {
+    char aux[8];
+    sprintf(aux, "%3uu", timebase[tb]);
+    displayStr(aux, 0, 0, field == F_TIME);
+    aux[0] = trig_char[trig];
+    aux[1] = 0;
+    displayStr(aux, 0, 5, field == F_TRIGGER);
+    inputName(input, aux);
+    displayStr(aux, 0, 7, field == F_INPUT);
+    displayStr((char *) "Exit", 0, 12, field == F_EXIT);
+}
+
+// Draws the signal from the last trigger (or the last screen, in auto)
+// Returns false (and keeps the screen) if there is no trigger
+static bool scopeFrame (int tb, TRIGGER trig) {
+    // samples ready (the last word may be in transit)
+    uint32_t words = scopeWords();
+    uint32_t end = (words > 1) ? (words - 1) * 32 : 0;
+    uint32_t first = (end > (RING_SAMPLES - RING_GUARD)) ? end - (RING_SAMPLES - RING_GUARD) : 0;
+    uint32_t span = SCOPE_WIDTH * timebase[tb];
+    uint32_t pre = SCOPE_PRE * timebase[tb];
+    if ((end - first) < (span + 1)) {
+        return false;
+    }
+
+    uint32_t start = end - span;
+    if (trig != TRIG_AUTO) {
+        uint32_t t = scopeTrigger(first + pre + 1, start + pre, trig == TRIG_RISE);
+        if (t == 0) {
+            return false;
+        }
+        start = t - pre;
+    }
+
+    // each column is high, low or (if both) an edge
+    memset(img, 0, sizeof(img));
+    uint32_t s = start;
+    for (int x = 0; x < SCOPE_WIDTH; x++) {
+        int ones = 0;
+        for (int i = 0; i < timebase[tb]; i++) {
+            ones += sample(s++);
+        }
+        if (ones == 0) {
+            scopePixel(x, SCOPE_LOW);
+        } else if (ones == timebase[tb]) {
+            scopePixel(x, SCOPE_HIGH);
+        } else {
+            for (int y = SCOPE_HIGH; y <= SCOPE_LOW; y++) {
+                scopePixel(x, y);
+            }
+        }
+        if ((trig != TRIG_AUTO) && (x == SCOPE_PRE)) {
+            for (int y = 0; y < PVW_PAGES*8; y += 4) {
+                scopePixel(x, y);     // trigger mark (dotted)
+            }
+        }
+    }
+    displayImage(1, PVW_PAGES, img);
+    scopeMeasure(start, span);
+    return true;
+}
+
+// Words written by the DMA since the capture started
+static uint32_t scopeWords () {
+    return 0xFFFFFFFFu - dma_hw->ch[scope_dma].transfer_count;
+}
+
+// Last edge to level (the sample before is the opposite) in from to to
+// Returns 0 if not found
+static uint32_t scopeTrigger (uint32_t from, uint32_t to, int level) {
+    uint32_t fill = level ? 0xFFFFFFFFu : 0;
+    for (uint32_t t = to; t >= from; t--) {
+        if (((t & 31) == 31) && (t >= (from + 31)) &&
+            ((ring[(t >> 5) & (RING_WORDS - 1)] == fill) || (ring[(t >> 5) & (RING_WORDS - 1)] == ~fill))) {
+            t -= 31;    // no edge inside this word, test its first sample
+        }
+        if ((sample(t) == level) && (sample(t-1) != level)) {
+            return t;
+        }
+    }
+    return 0;
+}
+
+// Mean pulse and longest gap (only the ones entirely in the screen)
+static void scopeMeasure (uint32_t start, uint32_t n) {
+    char aux[17];
+    uint32_t pulses = 0, ptime = 0, gap = 0;
+    uint32_t run = 0;
+    int level = sample(start);
+    bool complete = false;   // the first run started before the screen
+    for (uint32_t s = start+1; s < (start + n); s++) {
+        run++;
+        if (sample(s) != level) {
+            if (complete) {
+                if (level) {
+                    pulses++;
+                    ptime += run;
+                } else if (run > gap) {
+                    gap = run;
+                }
+            }
+            complete = true;
+            level = !level;
+            run = 0;
+        }
+    }
+    char ptxt[6] = "   --";
+    char gtxt[6] = "   --";
+    if (pulses) {
+        uint32_t width = (ptime + pulses/2) / pulses;
+        sprintf(ptxt, "%5lu", (unsigned long) (width > 99999 ? 99999 : width));
+    }
+    if (gap) {
+        sprintf(gtxt, "%5lu", (unsigned long) (gap > 99999 ? 99999 : gap));
+    }
+    snprintf(aux, sizeof(aux), "P%s G%s us", ptxt, gtxt);
+    displayStr(aux, 7, 0, false);
+}
+
+// Sets a pixel in the image (y = 0 is the top)
+static void scopePixel (int x, int y) {
+    img[(y >> 3)*SCOPE_WIDTH + x] |= 0x80 >> (y & 7);
+}
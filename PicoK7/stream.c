@@ -0,0 +1,223 @@
+/**
+ * @file stream.c
+ * @author Daniel Quadros
+ * @brief Streamed files - reads with bounded seek time and recordings
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * All the reads of programs from the SD card go through here, so
+ * the read times are traced in a single place (see stream.h).
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+#include "ff.h"
+
+#include "picok7.h"
+#include "stream.h"
+#include "trace.h"
+
+static FRESULT recBlock (K7_REC *r, int b, UINT n);
+
+// Open a file for reading
+// min_bps is the throughput the reader needs (0 if none)
+FRESULT streamOpen (K7_STREAM *s, const char *path, uint32_t min_bps) {
+    s->fast = false;
+    s->min_bps = min_bps;
+    s->reads = s->late = s->max_us = 0;
+    s->bytes = s->us = 0;
+    FRESULT fr = f_open(&s->fp, path, FA_OPEN_EXISTING | FA_READ);
+    if (fr != FR_OK) {
+        traceEvent(TR_ERROR, TRE_OPEN, fr);
+        return fr;
+    }
+    #if FF_USE_FASTSEEK
+    if (f_size(&s->fp) >= STREAM_FASTSEEK_MIN) {
+        s->clmt[0] = STREAM_CLMT_SIZE;
+        s->fp.cltbl = s->clmt;
+        if (f_lseek(&s->fp, CREATE_LINKMAP) == FR_OK) {
+            s->fast = true;
+        } else {
+            // too fragmented (clmt[0] has the size needed)
+            traceEvent(TR_ERROR, TRE_FRAGMENTED, s->clmt[0]);
+            s->fp.cltbl = NULL;
+        }
+    }
+    #endif
+    return FR_OK;
+}
+
+// Read from the file, measuring the time
+FRESULT streamRead (K7_STREAM *s, void *buf, UINT n, UINT *nr) {
+    uint32_t t = time_us_32();
+    FRESULT fr = f_read(&s->fp, buf, n, nr);
+    t = time_us_32() - t;
+    if (fr != FR_OK) {
+        traceEvent(TR_ERROR, TRE_READ, fr);
+        return fr;
+    }
+    traceEvent(TR_SD_READ, (*nr + 511) / 512, t);
+    s->reads++;
+    s->bytes += *nr;
+    s->us += t;
+    if (t > s->max_us) {
+        s->max_us = t;
+    }
+    if (s->min_bps && (((uint64_t) t * s->min_bps) > ((uint64_t) *nr * 1000000))) {
+        s->late++;
+    }
+    return FR_OK;
+}
+
+// Move to ofs (uses the CLMT, if there is one)
+FRESULT streamSeek (K7_STREAM *s, FSIZE_t ofs) {
+    uint32_t t = time_us_32();
+    FRESULT fr = f_lseek(&s->fp, ofs);
+    t = time_us_32() - t;
+    if (t > s->max_us) {
+        s->max_us = t;
+    }
+    return fr;
+}
+
+// Close the file, tracing the statistics
+void streamClose (K7_STREAM *s) {
+    f_close(&s->fp);
+    if (s->reads) {
+        traceEvent(TR_STREAM, (s->fast ? TRF_FAST_SEEK : 0) | (s->late ? TRF_LATE : 0), s->max_us);
+    }
+}
+
+// Start a recording of at most max bytes in path
+FRESULT recOpen (K7_REC *r, const char *path, FSIZE_t max) {
+    snprintf(r->path, sizeof(r->path), "%s", path);
+    r->cur = 0;
+    r->fill = 0;
+    r->full[0] = r->full[1] = false;
+    r->max_us = 0;
+    r->contiguous = false;
+    max = (max + REC_BLOCK - 1) & ~(FSIZE_t) (REC_BLOCK - 1);
+    FRESULT fr = f_open(&r->fp, REC_TEMP, FA_CREATE_ALWAYS | FA_WRITE);
+    if (fr != FR_OK) {
+        traceEvent(TR_ERROR, TRE_OPEN, fr);
+        return r->error = fr;
+    }
+    #if FF_USE_EXPAND
+    fr = f_expand(&r->fp, max, 1);
+    r->contiguous = fr == FR_OK;
+    #else
+    fr = FR_DENIED;
+    #endif
+    if (fr != FR_OK) {
+        // no contiguous area, allocate the clusters anyway
+        traceEvent(TR_ERROR, TRE_EXPAND, fr);
+        fr = f_lseek(&r->fp, max);
+        if ((fr == FR_OK) && (f_tell(&r->fp) != max)) {
+            fr = FR_DENIED;     // card full
+        }
+        if (fr == FR_OK) {
+            fr = f_lseek(&r->fp, 0);
+        }
+    }
+    if (fr == FR_OK) {
+        fr = f_sync(&r->fp);    // the allocation is on the card
+    }
+    if (fr != FR_OK) {
+        f_close(&r->fp);
+        f_unlink(REC_TEMP);
+    }
+    return r->error = fr;
+}
+
+// Add data to the recording
+// A full buffer is written by recPoll, or here if the other one is full
+FRESULT recWrite (K7_REC *r, const void *data, UINT n) {
+    const uint8_t *p = data;
+    while ((n > 0) && (r->error == FR_OK)) {
+        UINT len = REC_BLOCK - r->fill;
+        if (len > n) {
+            len = n;
+        }
+        memcpy(r->buf[r->cur] + r->fill, p, len);
+        r->fill += len;
+        p += len;
+        n -= len;
+        if (r->fill == REC_BLOCK) {
+            r->full[r->cur] = true;
+            r->cur ^= 1;
+            r->fill = 0;
+            if (r->full[r->cur]) {
+                recBlock(r, r->cur, REC_BLOCK);
+            }
+        }
+    }
+    return r->error;
+}
+
+// Write a full buffer (call often while recording)
+void recPoll (K7_REC *r) {
+    int b = r->cur ^ 1;
+    if (r->full[b] && (r->error == FR_OK)) {
+        recBlock(r, b, REC_BLOCK);
+    }
+}
+
+// End the recording
+// If keep is true, the data is stored in the file given to recOpen,
+// otherwise it is discarded
+FRESULT recClose (K7_REC *r, bool keep) {
+    if (keep && (r->error == FR_OK)) {
+        recPoll(r);
+        if (r->fill) {
+            recBlock(r, r->cur, r->fill);
+        }
+    }
+    FRESULT fr = r->error;
+    if (keep && (fr == FR_OK)) {
+        fr = f_truncate(&r->fp);
+    }
+    FRESULT frc = f_close(&r->fp);
+    if (fr == FR_OK) {
+        fr = frc;
+    }
+    if (keep && (fr == FR_OK)) {
+        f_unlink(r->path);      // may not exist
+        fr = f_rename(REC_TEMP, r->path);
+    } else {
+        f_unlink(REC_TEMP);
+    }
+    traceEvent(TR_RECORD, (fr == FR_OK ? 0 : TRF_REC_ERROR) | (r->contiguous ? TRF_REC_CONTIGUOUS : 0),
+               r->max_us);
+    return fr;
+}
+
+// Delete a recording interrupted by a power loss
+void recCleanup () {
+    f_unlink(REC_TEMP);
+}
+
+// Write buffer b (n bytes), measuring the time
+static FRESULT recBlock (K7_REC *r, int b, UINT n) {
+    UINT bw;
+    uint32_t t = time_us_32();
+    FRESULT fr = f_write(&r->fp, r->buf[b], n, &bw);
+    t = time_us_32() - t;
+    if ((fr == FR_OK) && (bw != n)) {
+        fr = FR_DENIED;     // card full
+    }
+    if (fr != FR_OK) {
+        traceEvent(TR_ERROR, TRE_WRITE, fr);
+        r->error = fr;
+    }
+    r->full[b] = false;
+    if (t > r->max_us) {
+        r->max_us = t;
+    }
+    return fr;
+}
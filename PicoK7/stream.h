@@ -0,0 +1,80 @@
+/**
+ * @file stream.h
+ * @author Daniel Quadros
+ * @brief Streamed files - reads with bounded seek time and recordings
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * Large files are opened in FatFs fast seek mode: a cluster link map
+ * (CLMT) is built at the open, so the seeks (and the reads that cross
+ * a cluster) don't walk the FAT. The map has a fixed size; a file
+ * too fragmented for it is read the normal way.
+ *
+ * The time of each read is measured. A read is late if it took more
+ * time than the data it brought takes to be sent at min_bps.
+ *
+ * A recording goes to REC_TEMP, allocated (contiguous, if possible) for
+ * the worst case size when it is opened, so the writes don't change the
+ * FAT or the directory. The data is written in aligned blocks of whole
+ * sectors, from a double buffer. At the end the file is truncated and
+ * renamed; a power loss leaves only REC_TEMP, deleted at the next boot.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef __STREAM_H__
+
+#define __STREAM_H__
+
+#include "ff.h"
+
+#define STREAM_CLMT_SIZE    64          // CLMT words per file (31 fragments)
+#define STREAM_FASTSEEK_MIN (32*1024)   // smaller files don't use fast seek
+
+#define REC_BLOCK           2048        // bytes written at a time (4 sectors)
+#define REC_MAX_NAME        64
+#define REC_TEMP            "RECORD.TMP"
+
+typedef struct {
+    FIL fp;
+    #if FF_USE_FASTSEEK
+    DWORD clmt[STREAM_CLMT_SIZE];
+    #endif
+    bool fast;              // using the CLMT
+    uint32_t min_bps;       // throughput needed (0 = none)
+    uint32_t reads;         // read requests
+    uint32_t late;          // reads slower than min_bps
+    uint32_t max_us;        // worst read time
+    uint32_t bytes;         // bytes read
+    uint32_t us;            // total read time
+} K7_STREAM;
+
+FRESULT streamOpen (K7_STREAM *s, const char *path, uint32_t min_bps);
+FRESULT streamRead (K7_STREAM *s, void *buf, UINT n, UINT *nr);
+FRESULT streamSeek (K7_STREAM *s, FSIZE_t ofs);
+void streamClose (K7_STREAM *s);
+
+static inline FSIZE_t streamSize (K7_STREAM *s) {
+    return f_size(&s->fp);
+}
+
+typedef struct {
+    FIL fp;
+    char path[REC_MAX_NAME+1];
+    uint8_t buf[2][REC_BLOCK];
+    int cur;                // buffer being filled
+    UINT fill;              // bytes in it
+    bool full[2];           // waiting to be written
+    FRESULT error;
+    bool contiguous;        // allocated with f_expand
+    uint32_t max_us;        // worst write time
+} K7_REC;
+
+FRESULT recOpen (K7_REC *r, const char *path, FSIZE_t max);
+FRESULT recWrite (K7_REC *r, const void *data, UINT n);
+void recPoll (K7_REC *r);
+FRESULT recClose (K7_REC *r, bool keep);
+void recCleanup (void);
+
+#endif
@@ -0,0 +1,276 @@
+/**
+ * @file tap.c
+ * @author Daniel Quadros
+ * @brief TAP files - ZX Spectrum and Jupiter Ace tapes
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * A TAP file is a sequence of blocks, each one preceded by its length
+ * (16 bits, little endian). Each block is sent as a pilot tone, two
+ * sync half periods, the flag byte (if the machine needs it and it is
+ * not in the file), the bytes in the block (msb first, each bit is two
+ * half periods) and a pause. The timing comes from the machine table
+ * (machine.c).
+ *
+ * The main output state machine is lent to k7edge.pio while sending.
+ * The CPU puts one word in the FIFO for each half period, the file is
+ * read in TAP_RING bytes ahead, in SD sectors, while the FIFO is full.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
+
+#include "k7edge.pio.h"
+
+#include "ff.h"
+
+#include "picok7.h"
+#include "stream.h"
+#include "trace.h"
+
+#define TAP_IDLE    1       // level of the silence (as in k7.pio)
+#define TAP_CHUNK   512     // bytes read at a time
+#define TAP_OVERHEAD 4      // cycles of k7edge.pio for each word
+
+static int tap_offset = -1;
+static PIO tap_pio;
+static uint tap_sm;
+static uint tap_pin;
+
+// Sending
+static struct {
+    const K7_MACHINE *m;
+    K7_STREAM st;
+    uint8_t ring[TAP_RING];
+    uint32_t r_in;          // bytes read from the file
+    uint32_t r_out;         // bytes taken from the ring
+    uint32_t size;
+    bool error;
+    bool abort;
+    uint level;
+} tp;
+
+static bool tapBlock (int n, uint32_t len);
+static bool tapGet (uint8_t *b);
+static bool tapFill (void);
+static void tapPut (uint level, uint32_t cycles);
+static void tapHalf (uint32_t cycles);
+static void tapByte (uint8_t b);
+static void tapProgress (int n);
+
+// Load k7edge.pio in the PIO of the main output (on pin)
+void tapInit (uint pin) {
+    tap_pin = pin;
+    k7Output(0, &tap_pio, &tap_sm);
+    if (!pio_can_add_program(tap_pio, &k7edge_program)) {
+        traceEvent(TR_ERROR, TRE_PIO_MEMORY, TRM_TAPE);
+        return;
+    }
+    tap_offset = pio_add_program(tap_pio, &k7edge_program);
+}
+
+// Send a TAP file, on the main output
+// Enter aborts
+// Returns false if invalid file
+bool tapSend (const K7_MACHINE *m, const char *file) {
+    char aux[17];
+    displayClear();
+    snprintf(aux, sizeof(aux), "Sending %.8s", m->name);
+    displayStr(aux, 0, 0, false);
+    displayStr((char *) file, 1, 0, false);
+    if (tap_offset < 0) {
+        return false;
+    }
+
+    // Slowest rate is all bits 1
+    uint32_t bps = TAP_PIO_FREQ / (16 * m->bit1);
+    if (streamOpen(&tp.st, file, bps) != FR_OK) {
+        return false;
+    }
+    tp.m = m;
+    tp.r_in = tp.r_out = 0;
+    tp.size = streamSize(&tp.st);
+    tp.error = tp.abort = false;
+    tp.level = TAP_IDLE;
+
+    // Lend the state machine to k7edge.pio (the TX FIFO has 8 words)
+    pio_sm_config c = k7edge_program_get_default_config(tap_offset);
+    sm_config_set_out_pins(&c, tap_pin, 1);
+    sm_config_set_out_shift(&c, false, false, 32);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+    sm_config_set_clkdiv(&c, clock_get_hz(clk_sys) / TAP_PIO_FREQ);
+    k7Lend(tap_offset, &c);
+
+    traceEvent(TR_SEND, TRS_LEADER, tp.size);
+    displayStr("Sent 0%", 3, 0, false);
+    displayStr("Enter=abort", 7, 0, false);
+    ws2812Pattern(LED_BREATHE, urgb_u32(0,0,120));
+    tapPut(TAP_IDLE, K7_LEADER_MS * (TAP_PIO_FREQ/1000));
+
+    int n = 0;
+    while (!tp.abort && !tp.error && (tp.r_out < tp.size)) {
+        uint8_t lb[2];
+        if (!tapGet(&lb[0]) || !tapGet(&lb[1])) {
+            break;
+        }
+        uint32_t len = lb[0] + 256*lb[1];
+        if ((len == 0) || ((tp.r_out + len) > tp.size)) {
+            traceEvent(TR_ERROR, TRE_SIZE, len);
+            tp.error = true;    // last block is incomplete
+            break;
+        }
+        tapBlock(n++, len);
+    }
+
+    // Wait for the end and give the state machine back
+    while (!tp.abort && !pio_sm_is_tx_fifo_empty(tap_pio, tap_sm)) {
+        tapFill();
+        chPoll();
+        tp.abort = getKey() == KEY_ENTER;
+    }
+    if (tp.abort) {
+        traceEvent(TR_SEND, TRS_ABORT, tp.r_out);
+        displayStr("Aborted         ", 4, 0, false);
+    } else if (!tp.error) {
+        traceEvent(TR_SEND, TRS_END, tp.r_out);
+        displayStr("Sent 100%", 3, 0, false);
+    }
+    k7Lend(0, NULL);    // the pause is silence for k7.pio too
+    streamClose(&tp.st);
+    displayStr("                ", 7, 0, false);
+    return !tp.error;
+}
+
+// Send block n, of len bytes
+// Returns false if aborted or error
+static bool tapBlock (int n, uint32_t len) {
+    const K7_MACHINE *m = tp.m;
+    uint8_t b;
+    bool hdr;
+    int flag;
+
+    // The first byte (or the length) tells if it is a header
+    if (m->flag_hdr < 0) {
+        while ((tp.r_in == tp.r_out) && tapFill()) {
+        }
+        if (tp.r_in == tp.r_out) {
+            tp.error = true;
+            return false;
+        }
+        hdr = tp.ring[tp.r_out % TAP_RING] < 0x80;
+        flag = -1;
+    } else {
+        hdr = len == m->hdr_len;
+        flag = hdr ? m->flag_hdr : m->flag_data;
+    }
+    traceEvent(TR_SEND, TRS_DATA, n);
+    tapProgress(n);
+
+    for (int i = hdr ? m->pilot_hdr : m->pilot_data; !tp.abort && (i > 0); i--) {
+        tapHalf(m->pilot);
+    }
+    tapHalf(m->sync1);
+    tapHalf(m->sync2);
+    if (flag >= 0) {
+        tapByte(flag);
+    }
+    for (uint32_t i = 0; (i < len) && !tp.abort; i++) {
+        if (!tapGet(&b)) {
+            return false;
+        }
+        tapByte(b);
+        if ((i & 0x7F) == 0x7F) {
+            tapProgress(n);
+        }
+    }
+    tapHalf(m->bit1);     // an edge ends the last bit
+    tapPut(TAP_IDLE, m->pause_ms * (TAP_PIO_FREQ/1000));
+    return !tp.abort;
+}
+
+// Take the next byte of the file
+// Returns false at the end of the file or error
+static bool tapGet (uint8_t *b) {
+    while ((tp.r_in == tp.r_out) && tapFill()) {
+    }
+    if (tp.r_in == tp.r_out) {
+        return false;
+    }
+    *b = tp.ring[tp.r_out++ % TAP_RING];
+    return true;
+}
+
+// Read a chunk of the file, if there is room in the ring
+// Returns false if nothing was read
+static bool tapFill () {
+    if (tp.error || (tp.r_in == tp.size) || ((tp.r_in - tp.r_out) > (TAP_RING - TAP_CHUNK))) {
+        return false;
+    }
+    UINT n = tp.size - tp.r_in;
+    if (n > TAP_CHUNK) {
+        n = TAP_CHUNK;
+    }
+    if (streamRead(&tp.st, tp.ring + (tp.r_in % TAP_RING), n, &n) != FR_OK) {
+        tp.error = true;
+        return false;
+    }
+    if (n == 0) {
+        tp.size = tp.r_in;      // file is shorter than expected
+        return false;
+    }
+    tp.r_in += n;
+    return true;
+}
+
+// Put a half period at level in the FIFO
+// While it is full the ring is filled and the keys are checked
+static void tapPut (uint level, uint32_t cycles) {
+    if (tp.abort) {
+        return;
+    }
+    while (pio_sm_is_tx_fifo_full(tap_pio, tap_sm)) {
+        chPoll();
+        if (getKey() == KEY_ENTER) {
+            tp.abort = true;
+            pio_sm_clear_fifos(tap_pio, tap_sm);
+            return;
+        }
+        if (!tapFill()) {
+            busy_wait_us(100);
+        }
+    }
+    if ((tp.r_out != 0) && pio_sm_is_tx_fifo_empty(tap_pio, tap_sm)) {
+        traceEvent(TR_UNDERRUN, 0, tp.r_out);
+    }
+    tp.level = level;
+    pio_sm_put(tap_pio, tap_sm, (level << 31) | (cycles - TAP_OVERHEAD));
+}
+
+// Next half period (the level changes)
+static void tapHalf (uint32_t cycles) {
+    tapPut(tp.level ^ 1, cycles);
+}
+
+// A byte, msb first
+static void tapByte (uint8_t b) {
+    for (int i = 0; i < 8; i++, b <<= 1) {
+        uint32_t c = (b & 0x80) ? tp.m->bit1 : tp.m->bit0;
+        tapHalf(c);
+        tapHalf(c);
+    }
+}
+
+// Show the block and the bytes sent
+static void tapProgress (int n) {
+    char aux[17];
+    snprintf(aux, sizeof(aux), "Block %u", (unsigned) (n+1));
+    displayStr(aux, 2, 0, false);
+    snprintf(aux, sizeof(aux), "Sent %u%%", (uint8_t) (100ull*tp.r_out/tp.size));
+    displayStr(aux, 3, 0, false);
+}
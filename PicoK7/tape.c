@@ -10,6 +10,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
 #include "hardware/clocks.h"
@@ -23,22 +24,109 @@
 #include "hw_config.h"
 
 #include "picok7.h"
+#include "stream.h"
+#include "trace.h"
+#include "pack.h"
 
-static uint8_t pgmname[] = "\x29\xB6"; // DQ
+#define PIO_FREQ 20000.0    // 50us cycle
 
-static uint8_t code[16*1024];
+// Bit time in PIO cycles (see k7.pio)
+#define K7_BIT0_CYCLES  50
+#define K7_BIT1_CYCLES  80
+#define K7_CYCLES_MS    20
 
-static int8_t led_int;
-static int8_t led_delta;
+#define K7_SEEK_MS      5000    // seek step (encoder)
+#define K7_INDEX_STEP   64      // bytes between time index entries
+#define K7_READ_TRIES   2       // reads of a file with a wrong checksum
+
+static uint8_t pgmname[] = K7_DEFAULT_NAME;
+
+// Machine of the program being sent (a memory image, see machine.c)
+static const K7_MACHINE *mach = &machines[MACH_ZX81];
+
+// Two buffers, so the next part of a playlist can be read
+// while the current one is being sent
+#define K7_MAX_SIZE (16*1024)
+static uint8_t code[2][K7_MAX_SIZE];
+
+// Prefetch of the next part of a playlist
+// It is done in small steps, while the PIO FIFO is full
+#define PF_CHUNK 512
+
+typedef enum { PF_IDLE, PF_OPEN, PF_READ, PF_DONE, PF_ERROR, PF_SKIP } PF_STATE;
+
+static struct {
+    PF_STATE state;
+    const K7_MACHINE *mach;
+    char *file;
+    uint8_t *buf;
+    K7_STREAM st;
+    UINT size;
+    int tries;
+} pf;
+
+// File being prefetched from the menu (to code[0])
+static char pf_name[CAT_MAX_NAME+1];
+
+// Send ZX81 programs as packed loaders (see pack.c)
+static bool packed;
+
+// Progress of the program being sent
+static int st_size;
+static int st_sent;
+
+// Transport (non-blocking send of a program in memory)
+// The stream is the name followed by the code, pos is the next byte
+// to put in the FIFO; time is counted from the start of the name
+static struct {
+    K7_STATE state;
+    const uint8_t *name;
+    const uint8_t *code;
+    int nlen;
+    int len;            // name + code
+    int pos;
+    int leader;
+    absolute_time_t leader_end;
+    K7_NOTIFY notify;
+    uint32_t index[(K7_MAX_TNAME+K7_MAX_SIZE)/K7_INDEX_STEP+2];   // PIO cycles at each step
+} tp;
 
 static PIO k7_pio;
 static uint k7_sm;
 static uint k7_pin;
 
-static UINT check_code (UINT code);
-static bool send_pgm (uint8_t *name, const uint8_t *code, int size);
-static void updateLED(void);
+// Outputs (output 0 is the main one, k7_pio/k7_sm)
+// The outputs in out_mask receive the main stream, in lock-step
+static struct {
+    PIO pio;
+    uint sm;
+} out[K7_CHANNELS];
+static int nout;
+static uint32_t out_mask = 1;
+static int k7_offset[NUM_PIOS] = { -1, -1 };    // program in each PIO
+
+static UINT k7Load (const K7_MACHINE *m, char *pfile, uint8_t *buf);
+static UINT check_code (const K7_MACHINE *m, uint8_t *code, UINT size);
+static bool k7Verify (const char *pfile, const uint8_t *buf, UINT size);
+static void prefetchStart (const K7_MACHINE *m, char *pfile, uint8_t *buf);
+static bool prefetchStep (void);
+static UINT prefetchWait (void);
+static void prefetchCancel (void);
+static void k7Put (uint8_t b);
+static void k7Drain (void);
+static void k7Silence (int ms);
+static bool send_pgm (const uint8_t *name, const uint8_t *code, int size, int leader);
 static void displayPercent(int perc);
+static inline uint8_t tpByte (int p);
+static uint32_t byteCycles (uint8_t b);
+static void tpState (K7_STATE state);
+static void showState (K7_STATE state);
+static void showTarget (int ms);
+static void k7SmInit (PIO pio, uint sm, uint pin, uint offset);
+static pio_sm_config k7SmConfig (uint pin, uint offset);
+static bool outFull (void);
+static bool outEmpty (void);
+static void outPut (uint8_t b);
 
 // Inits the K7 emulation
 void k7Init (PIO pio, uint pin) {
@@ -48,120 +136,764 @@ void k7Init (PIO pio, uint pin) {
 
     // Get a state machine
     k7_sm = pio_claim_unused_sm(pio, true);
-    prtdbg("TAPE: sm %d\n", k7_sm);
+    traceEvent(TR_PIO_SM, TRM_TAPE, k7_sm);
 
     // Loads the program
     uint offset = pio_add_program(pio, &k7_program);
     if (offset < 0) {
-        prtdbg("TAPE: PIO memory full\n");
+        traceEvent(TR_ERROR, TRE_PIO_MEMORY, TRM_TAPE);
     }
+    k7_offset[pio_get_index(pio)] = offset;
+
+    k7SmInit(pio, k7_sm, k7_pin, offset);
+    out[0].pio = pio;
+    out[0].sm = k7_sm;
+    nout = 1;
+}
+
+// Add an output (another ZX81) on pin
+// Uses a free state machine in any PIO, loading the program if needed
+// Returns the number of the output or -1 if there are no resources
+int k7AddOutput (uint pin) {
+    if (nout == K7_CHANNELS) {
+        return -1;
+    }
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        PIO pio = p ? pio1 : pio0;
+        int sm = pio_claim_unused_sm(pio, false);
+        if (sm < 0) {
+            continue;
+        }
+        if (k7_offset[p] < 0) {
+            if (!pio_can_add_program(pio, &k7_program)) {
+                pio_sm_unclaim(pio, sm);
+                continue;
+            }
+            k7_offset[p] = pio_add_program(pio, &k7_program);
+        }
+        traceEvent(TR_PIO_SM, TRM_TAPE, (p << 4) | sm);
+        k7SmInit(pio, sm, pin, k7_offset[p]);
+        out[nout].pio = pio;
+        out[nout].sm = sm;
+        return nout++;
+    }
+    traceEvent(TR_ERROR, TRE_PIO_MEMORY, TRM_TAPE);
+    return -1;
+}
+
+// Number of outputs
+int k7Outputs () {
+    return nout;
+}
+
+// PIO and state machine of output n
+void k7Output (int n, PIO *pio, uint *sm) {
+    *pio = out[n].pio;
+    *sm = out[n].sm;
+}
+
+// Choose the outputs that receive the main stream (bit n = output n)
+// The main output is always included
+void k7Broadcast (uint32_t mask) {
+    out_mask = (mask | 1) & ((1u << nout) - 1);
+}
 
+// Init pin and state machine and start it
+static void k7SmInit (PIO pio, uint sm, uint pin, uint offset) {
     // Init output pin
-    pio_gpio_init(pio, k7_pin);
-    pio_sm_set_consecutive_pindirs(pio, k7_sm, k7_pin, 1, true);
+    pio_gpio_init(pio, pin);
+    pio_sm_set_consecutive_pindirs(pio, sm, pin, 1, true);
 
     // Configure the state machine
+    pio_sm_config c = k7SmConfig(pin, offset);
+    pio_sm_init(pio, sm, offset, &c);
+    clockAddPio(pio, sm, PIO_FREQ);
+
+    // Starts the state machine
+    pio_sm_set_enabled(pio, sm, true);
+}
+
+// Configuration of a state machine running k7.pio
+static pio_sm_config k7SmConfig (uint pin, uint offset) {
     pio_sm_config c = k7_program_get_default_config(offset);
-    sm_config_set_sideset_pins(&c, k7_pin);
+    sm_config_set_sideset_pins(&c, pin);
     sm_config_set_out_shift(&c, false, true, 8);
-    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
-    float div = clock_get_hz(clk_sys)*0.00005;
+    float div = clock_get_hz(clk_sys) / PIO_FREQ;
     sm_config_set_clkdiv(&c, div);
-    pio_sm_init(pio, k7_sm, offset, &c);
+    return c;
+}
 
-    // Starts the state machine
-    pio_sm_set_enabled(pio, k7_sm, true);    
+// Run another program (at offset in the same PIO, configured by c)
+// in the state machine of the main output or, if c is NULL, go back
+// to k7.pio; the clock must not change while it is lent
+void k7Lend (uint offset, const pio_sm_config *c) {
+    pio_sm_config k7c;
+    pio_sm_set_enabled(k7_pio, k7_sm, false);
+    if (c == NULL) {
+        offset = k7_offset[pio_get_index(k7_pio)];
+        k7c = k7SmConfig(k7_pin, offset);
+        c = &k7c;
+    }
+    pio_sm_init(k7_pio, k7_sm, offset, c);
+    pio_sm_set_enabled(k7_pio, k7_sm, true);
+}
+
+// Feed the main output one bit at a time (bit 31 of each word in the
+// FIFO) or, if off, a byte at a time again; used by the regenerator
+void k7Bits (bool on) {
+    if (!on) {
+        k7Lend(0, NULL);
+        return;
+    }
+    uint offset = k7_offset[pio_get_index(k7_pio)];
+    pio_sm_config c = k7SmConfig(k7_pin, offset);
+    sm_config_set_out_shift(&c, false, true, 1);
+    k7Lend(offset, &c);
+}
+
+// Run the main output at scale times the normal rate
+// (the regenerator follows the speed of the tape deck)
+void k7Speed (float scale) {
+    float hz = PIO_FREQ * scale;
+    clockAddPio(k7_pio, k7_sm, hz);
+    pio_sm_set_clkdiv(k7_pio, k7_sm, clock_get_hz(clk_sys) / hz);
+}
+
+// Check if the FIFO of any output in the broadcast is full
+static bool outFull () {
+    for (int i = 0; i < nout; i++) {
+        if ((out_mask & (1u << i)) && pio_sm_is_tx_fifo_full (out[i].pio, out[i].sm)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Check if the FIFOs of all outputs in the broadcast are empty
+static bool outEmpty () {
+    for (int i = 0; i < nout; i++) {
+        if ((out_mask & (1u << i)) && !pio_sm_is_tx_fifo_empty (out[i].pio, out[i].sm)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Put a byte in the FIFO of all outputs in the broadcast
+static void outPut (uint8_t b) {
+    for (int i = 0; i < nout; i++) {
+        if (out_mask & (1u << i)) {
+            pio_sm_put (out[i].pio, out[i].sm, b << 24);
+        }
+    }
 }
 
-// Send program in file
+// Send program in file (in the format of its machine)
 // Returns false if invalid file
 bool k7Send (char *pfile) {
-  FIL fp;
-  FRESULT fr = f_open(&fp, pfile, FA_OPEN_EXISTING | FA_READ);
-
+  const K7_MACHINE *m = machineFind(pfile);
+  if (m == NULL) {
+      return false;
+  }
+  if (m->coding == K7_EDGES) {
+      prefetchCancel();
+      return tapSend(m, pfile);
+  }
   displayClear();
   displayStr("Sending", 0, 0, false);
   displayStr(pfile, 1, 0, false);
 
-  if (fr == FR_OK) {
-      UINT size = 0;
-      fr = f_read(&fp, code, 16*1024, &size);
-      f_close(&fp);
-      if (fr == FR_OK) {
-          size = check_code(size);
-          if (size) {
-              prtdbg ("Sending %u bytes\n", size);
-              return send_pgm(pgmname, code, size);
-          } else {
-              prtdbg ("Invalid file\n");
+  UINT size;
+  mach = m;
+  if ((pf.buf == code[0]) && (pf.state == PF_DONE) && (strcmp(pf.file, pfile) == 0)) {
+      size = pf.size;     // read while in the menu
+      pf.state = PF_IDLE;
+  } else {
+      prefetchCancel();
+      size = k7Load(m, pfile, code[0]);
+  }
+  if (size) {
+      const uint8_t *pgm = code[0];
+      if (packed && (m->id == MACH_ZX81)) {
+          clockSet(CLK_FAST_KHZ);
+          UINT psize = packImage(code[0], size, code[1], K7_MAX_SIZE);
+          clockSet(CLK_RUN_KHZ);
+          if (psize) {
+              char aux[17];
+              snprintf(aux, sizeof(aux), "Packed %d%%", (int) ((100*psize)/size));
+              displayStr(aux, 2, 0, false);
+              pgm = code[1];
+              size = psize;
           }
       }
-  } else {
-      prtdbg("f_open error: %s (%d)\n", FRESULT_str(fr), fr);
+      send_pgm(pgmname, pgm, size, K7_LEADER_MS);
+      return true;    // even if aborted
   }
   return false;
 }
 
-// Check code and fix size
+// Turn on or off the packed loaders
+void k7Pack (bool on) {
+  packed = on;
+}
+
+// Send a sequence of programs
+// The next part is read and checked while the current one is sent
+// Returns false if a part is invalid
+bool k7SendList (K7_PART *parts, int nparts) {
+  char aux[17];
+  int cur = 0;
+  prefetchCancel();
+  mach = &machines[MACH_ZX81];
+  UINT size = k7Load(mach, parts[0].file, code[cur]);
+
+  for (int i = 0; i < nparts; i++) {
+      displayClear();
+      displayStr("Sending", 0, 0, false);
+      displayStr(parts[i].file, 1, 0, false);
+      snprintf(aux, sizeof(aux), "Part %u/%u", (uint8_t) (i+1), (uint8_t) nparts);
+      displayStr(aux, 2, 0, false);
+      if (size == 0) {
+          pf.state = PF_IDLE;
+          return false;
+      }
+      if ((i+1) < nparts) {
+          prefetchStart(mach, parts[i+1].file, code[cur^1]);
+      }
+      if (!send_pgm(parts[i].name, code[cur], size, parts[i].gap)) {
+          prefetchWait();     // aborted, discard the next part
+          return true;
+      }
+      if ((i+1) < nparts) {
+          size = prefetchWait();
+          cur ^= 1;
+      }
+  }
+  return true;
+}
+
+// Read and check a file
+// It is read again if the checksum is not the one in the catalog
+// Returns the size to send or 0 if invalid file
+static UINT k7Load (const K7_MACHINE *m, char *pfile, uint8_t *buf) {
+  for (int i = 0; i < K7_READ_TRIES; i++) {
+      static K7_STREAM st;
+      FRESULT fr = streamOpen(&st, pfile, K7_TAPE_BPS);
+      if (fr != FR_OK) {
+          return 0;
+      }
+      UINT size = 0;
+      fr = streamRead(&st, buf, K7_MAX_SIZE, &size);
+      streamClose(&st);
+      if (fr != FR_OK) {
+          return 0;
+      }
+      size = check_code(m, buf, size);
+      if ((size == 0) || k7Verify(pfile, buf, size)) {
+          return size;
+      }
+  }
+  return 0;
+}
+
+// Check the CRC32 of a program against the catalog
+// If it is not known, it is recorded
+// Returns false if it is different
+static bool k7Verify (const char *pfile, const uint8_t *buf, UINT size) {
+    uint32_t crc = crcCalc(0, buf, size);
+    int i = catFind(pfile);
+    if (i < 0) {
+        return true;    // not in the catalog
+    }
+    if (catCrc(i) == 0) {
+        catSetCrc(i, crc);
+    } else if (catCrc(i) != crc) {
+        traceEvent(TR_ERROR, TRE_CRC, crc);
+        return false;
+    }
+    return true;
+}
+
+// Check the start of a .P file and get the size to send
+// hdr must have at least 13 bytes, size is the file size
 // files contains ZX81 memory starting from 4009
 // E_LINE (end of saved memory) is at 4014 -> offset 11 in code
-// Some P files have garbage added at the end
-static UINT check_code (UINT size) {
-    if ((size <= 120) || (code[0] != 0)) {
-        prtdbg ("Error size %u code[0]=%02X\n", size, code[0]);
-        return 0;   // too short or invalid version
-    }
-    UINT real_size = (code[11] + 256*code[12]) - 0x4009;
-    if (real_size > size) {
-        prtdbg ("Error real size %u\n", real_size);
-        return 0;   // something is missing in the file
+uint k7CheckHeader (const uint8_t *hdr, uint size) {
+    return machineSize(&machines[MACH_ZX81], hdr, size);
+}
+
+// Check code and fix size
+static UINT check_code (const K7_MACHINE *m, uint8_t *code, UINT size) {
+    UINT real_size = machineSize(m, code, size);
+    if (real_size == 0) {
+        return 0;
     }
     if (code[real_size-1] != 0x80) {
-        prtdbg ("Error code[real_size-1]=%02X\n", code[real_size-1]);
+        traceEvent(TR_ERROR, TRE_LAST_BYTE, code[real_size-1]);
         return 0;   // last byte should be 0x80
     }
     return real_size;
 }
 
+// Start reading a file in the background
+static void prefetchStart (const K7_MACHINE *m, char *pfile, uint8_t *buf) {
+    pf.mach = m;
+    pf.file = pfile;
+    pf.buf = buf;
+    pf.size = 0;
+    pf.tries = 0;
+    pf.state = PF_OPEN;
+}
+
+// Do one (short) step of the prefetch
+// Returns false if there is nothing to do
+static bool prefetchStep () {
+    FRESULT fr;
+    UINT n;
+
+    switch (pf.state) {
+        case PF_OPEN:
+            fr = streamOpen(&pf.st, pf.file, K7_TAPE_BPS);
+            pf.state = (fr == FR_OK) ? PF_READ : PF_ERROR;
+            return true;
+        case PF_READ:
+            n = K7_MAX_SIZE - pf.size;
+            if (n > PF_CHUNK) {
+                n = PF_CHUNK;
+            }
+            fr = streamRead(&pf.st, pf.buf + pf.size, n, &n);
+            if (fr != FR_OK) {
+                streamClose(&pf.st);
+                pf.state = PF_ERROR;
+                return true;
+            }
+            pf.size += n;
+            if ((n < PF_CHUNK) || (pf.size == K7_MAX_SIZE)) {
+                streamClose(&pf.st);
+                pf.size = check_code(pf.mach, pf.buf, pf.size);
+                if (pf.size && !k7Verify(pf.file, pf.buf, pf.size)) {
+                    // wrong checksum, read again
+                    pf.size = 0;
+                    pf.state = (++pf.tries < K7_READ_TRIES) ? PF_OPEN : PF_ERROR;
+                    return true;
+                }
+                pf.state = pf.size ? PF_DONE : PF_ERROR;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Finish the prefetch
+// Returns the size to send or 0 if invalid file
+static UINT prefetchWait () {
+    while (prefetchStep()) {
+    }
+    UINT size = (pf.state == PF_DONE) ? pf.size : 0;
+    pf.state = PF_IDLE;
+    return size;
+}
+
+// Stop the prefetch, discarding what was read
+static void prefetchCancel () {
+    if (pf.state == PF_READ) {
+        streamClose(&pf.st);
+    }
+    pf.state = PF_IDLE;
+}
+
+// Read and check a file in the background, while in the menu
+// Each call does a short step, for a new file the current prefetch is
+// discarded (NULL only discards it); k7Send uses the code if the file
+// is the same
+// Only memory images are prefetched (not TAP files)
+// Returns the size to send, 0 if invalid file or -1 if not done
+int k7Prefetch (const char *pfile) {
+    if (pfile == NULL) {
+        prefetchCancel();
+        return -1;
+    }
+    if ((pf.buf != code[0]) || (pf.state == PF_IDLE) || (strcmp(pf_name, pfile) != 0)) {
+        prefetchCancel();
+        strncpy(pf_name, pfile, CAT_MAX_NAME);
+        pf_name[CAT_MAX_NAME] = 0;
+        const K7_MACHINE *m = machineFind(pf_name);
+        if ((m == NULL) || (m->coding != K7_PULSES)) {
+            pf.buf = code[0];
+            pf.state = PF_SKIP;
+            return -1;
+        }
+        prefetchStart(m, pf_name, code[0]);
+    }
+    prefetchStep();
+    switch (pf.state) {
+        case PF_DONE:
+            return pf.size;
+        case PF_ERROR:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+// Send a byte to the PIO
+// Steps the prefetch while the FIFO is full
+static void k7Put (uint8_t b) {
+    while (outFull()) {
+        prefetchStep();
+        chPoll();
+    }
+    outPut(b);
+}
+
+// Silence (the state machine is waiting for data)
+// Steps the prefetch meanwhile
+static void k7Silence (int ms) {
+    absolute_time_t end = make_timeout_time_ms(ms);
+    while (absolute_time_diff_us(get_absolute_time(), end) > 0) {
+        chPoll();
+        if (!prefetchStep()) {
+            busy_wait_us(500);
+        }
+    }
+}
+
 // Send a program
-// 3 seconds silence
+// leader silence (ms)
 // program name (bit7 set in last char, uses ZX81 char codes)
 // code
 // silence
-bool send_pgm (uint8_t *name, const uint8_t *code, int size) {
+// The encoder controls the transport: Enter pauses; when paused
+// UP/DN choose where to resume (before 0:00 is abort) and Enter resumes
+// The ZX81 ROM gives up after a few ms without pulses and waits for a
+// new name, so the default is to resume from the start
+// Returns false if aborted
+static bool send_pgm (const uint8_t *name, const uint8_t *code, int size, int leader) {
+    K7_STATE st;
+    int target = 0;         // where to resume (ms), -1 to abort
+
+    k7Notify(showState);
+    k7Play(name, code, size, leader);
+    while (((st = k7Poll()) != K7_DONE) && (st != K7_ABORTED)) {
+        int key = getKey();
+        if (st == K7_PAUSED) {
+            switch (key) {
+                case KEY_ENTER:
+                    if (target < 0) {
+                        k7Abort();
+                        break;
+                    }
+                    k7Seek(target);
+                    showTarget(-2);
+                    k7Resume();
+                    break;
+                case KEY_UP:
+                    target = (target < 0) ? 0 : target + K7_SEEK_MS;
+                    if (target > (int) k7Length()) {
+                        target = k7Length();
+                    }
+                    showTarget(target);
+                    break;
+                case KEY_DN:
+                    target = (target > K7_SEEK_MS) ? target - K7_SEEK_MS : (target > 0) ? 0 : -1;
+                    showTarget(target);
+                    break;
+            }
+        } else if ((key == KEY_ENTER) && (st != K7_PAUSING)) {
+            target = 0;
+            showTarget(target);
+            k7Pause();
+        }
+        chPoll();
+        if (!prefetchStep()) {
+            busy_wait_us(500);
+        }
+    }
+    k7Notify(NULL);
+    return st == K7_DONE;
+}
+
+// Start sending a program in memory (non-blocking)
+// The sending is done by k7Poll
+void k7Play (const uint8_t *name, const uint8_t *code, int size, int leader) {
+    if (name == NULL) {
+        name = pgmname;
+    }
+    tp.name = name;
+    tp.code = code;
+    tp.nlen = 0;
+    if (mach->named) {
+        do {
+            tp.nlen++;
+        } while (((*name++ & 0x80) == 0) && (tp.nlen < K7_MAX_TNAME));
+    }
+    tp.len = tp.nlen + size;
+    tp.leader = leader;
+
+    // Time index
+    uint32_t t = 0;
+    for (int p = 0; p < tp.len; p++) {
+        if ((p % K7_INDEX_STEP) == 0) {
+            tp.index[p / K7_INDEX_STEP] = t;
+        }
+        t += byteCycles(tpByte(p));
+    }
+    tp.index[(tp.len + K7_INDEX_STEP - 1) / K7_INDEX_STEP] = t;
+
+    st_size = size;
+    st_sent = 0;
+    tp.pos = 0;
+    displayPercent(0);
+    traceEvent(TR_SEND, TRS_LEADER, size);
+    tp.leader_end = make_timeout_time_ms(leader);
+    tpState(K7_LEADER);
+}
+
+// Do the sending, returns the transport state
+K7_STATE k7Poll () {
+    switch (tp.state) {
+        case K7_LEADER:
+            if (absolute_time_diff_us(get_absolute_time(), tp.leader_end) > 0) {
+                break;
+            }
+            ws2812Pattern(LED_BREATHE, urgb_u32(0,0,120));
+            ws2812Track(k7_pio, k7_sm);
+            traceEvent(TR_SEND, tp.nlen ? TRS_NAME : TRS_DATA, 0);
+            tpState(K7_PLAYING);
+            // fall through
+        case K7_PLAYING:
+            while ((tp.pos < tp.len) && !outFull()) {
+                outPut(tpByte(tp.pos));
+                if (++tp.pos == tp.nlen) {
+                    traceEvent(TR_SEND, TRS_DATA, 0);
+                } else if (tp.pos > tp.nlen) {
+                    st_sent = tp.pos - tp.nlen;
+                    if ((st_sent & 0x7F) == 0) {
+                        traceEvent(TR_FIFO, pio_sm_get_tx_fifo_level (k7_pio, k7_sm), st_sent);
+                        displayPercent(100*st_sent/st_size);
+                    }
+                }
+            }
+            if ((tp.pos == tp.len) && outEmpty()) {
+                traceEvent(TR_SEND, TRS_END, st_sent);
+                ws2812Track(NULL, 0);
+                displayPercent(100);
+                tpState(K7_DONE);
+            }
+            break;
+        case K7_PAUSING:
+            // what is in the FIFO is sent, the PIO stops at the end of a byte
+            if (outEmpty()) {
+                tpState(K7_PAUSED);
+            }
+            break;
+        default:
+            break;
+    }
+    return tp.state;
+}
+
+// Pause at the end of the bytes already in the FIFO
+void k7Pause () {
+    if ((tp.state == K7_LEADER) || (tp.state == K7_PLAYING)) {
+        traceEvent(TR_SEND, TRS_PAUSE, st_sent);
+        tpState(tp.state == K7_LEADER ? K7_PAUSED : K7_PAUSING);
+    }
+}
+
+// Resume after a pause (from the start, the leader is sent again)
+void k7Resume () {
+    if (tp.state == K7_PAUSED) {
+        traceEvent(TR_SEND, TRS_RESUME, st_sent);
+        if (tp.pos == 0) {
+            tp.leader_end = make_timeout_time_ms(tp.leader);
+            tpState(K7_LEADER);
+        } else {
+            tpState(K7_PLAYING);
+        }
+    }
+}
+
+// Abort the sending
+void k7Abort () {
+    if ((tp.state != K7_IDLE) && (tp.state != K7_DONE) && (tp.state != K7_ABORTED)) {
+        traceEvent(TR_SEND, TRS_ABORT, st_sent);
+        k7Drain();      // what is in the FIFO (a few bytes)
+        ws2812Track(NULL, 0);
+        tpState(K7_ABORTED);
+    }
+}
+
+// Move to ms from the start of the name (only when paused)
+// The sending resumes at the start of the byte at that time
+void k7Seek (uint32_t ms) {
+    if (tp.state != K7_PAUSED) {
+        return;
+    }
+    uint32_t t = ms * K7_CYCLES_MS;
+    int lo = 0;
+    int hi = (tp.len + K7_INDEX_STEP - 1) / K7_INDEX_STEP;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (tp.index[mid] <= t) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    int p = lo * K7_INDEX_STEP;
+    uint32_t tb = tp.index[lo];
+    while ((p < tp.len) && ((tb + byteCycles(tpByte(p))) <= t)) {
+        tb += byteCycles(tpByte(p++));
+    }
+    tp.pos = p;
+    st_sent = (p > tp.nlen) ? p - tp.nlen : 0;
+    displayPercent(100*st_sent/st_size);
+    traceEvent(TR_SEND, TRS_SEEK, st_sent);
+}
+
+// Position (ms from the start of the name) of the next byte to send
+uint32_t k7Time () {
+    int p = tp.pos;
+    if ((tp.state == K7_PLAYING) || (tp.state == K7_PAUSING)) {
+        p -= pio_sm_get_tx_fifo_level (k7_pio, k7_sm);
+    }
+    uint32_t t = tp.index[p / K7_INDEX_STEP];
+    for (int i = p - (p % K7_INDEX_STEP); i < p; i++) {
+        t += byteCycles(tpByte(i));
+    }
+    return t / K7_CYCLES_MS;
+}
+
+// Time to send the name and code (ms)
+uint32_t k7Length () {
+    return tp.index[(tp.len + K7_INDEX_STEP - 1) / K7_INDEX_STEP] / K7_CYCLES_MS;
+}
+
+// Set the function called when the transport state changes
+void k7Notify (K7_NOTIFY fn) {
+    tp.notify = fn;
+}
+
+// Byte p of the stream
+static inline uint8_t tpByte (int p) {
+    return (p < tp.nlen) ? tp.name[p] : tp.code[p - tp.nlen];
+}
+
+// PIO cycles to send a byte
+static uint32_t byteCycles (uint8_t b) {
+    int ones = 0;
+    for ( ; b; b >>= 1) {
+        ones += b & 1;
+    }
+    return ones*K7_BIT1_CYCLES + (8-ones)*K7_BIT0_CYCLES;
+}
+
+// Change the transport state
+static void tpState (K7_STATE state) {
+    tp.state = state;
+    if (tp.notify != NULL) {
+        tp.notify(state);
+    }
+}
+
+// Show the transport state (notify function of send_pgm)
+static void showState (K7_STATE state) {
+    char aux[17];
+    uint32_t t;
+    switch (state) {
+        case K7_PAUSED:
+            t = k7Time() / 1000;
+            snprintf(aux, sizeof(aux), "Paused %2u:%02u   ", (uint8_t) (t/60), (uint8_t) (t%60));
+            displayStr(aux, 4, 0, false);
+            displayStr("Enter=resume    ", 7, 0, false);
+            break;
+        case K7_PAUSING:
+            displayStr("Pausing...      ", 4, 0, false);
+            break;
+        case K7_ABORTED:
+            displayStr("Aborted         ", 4, 0, false);
+            displayStr("                ", 5, 0, false);
+            displayStr("                ", 7, 0, false);
+            break;
+        case K7_DONE:
+            displayStr("                ", 7, 0, false);
+            break;
+        default:
+            displayStr("                ", 4, 0, false);
+            displayStr("Enter=pause     ", 7, 0, false);
+            break;
+    }
+}
+
+// Show where the transport will resume (-1 = abort, -2 = clear)
+static void showTarget (int ms) {
+    char aux[17];
+    if (ms == -2) {
+        strcpy(aux, "                ");
+    } else if (ms < 0) {
+        strcpy(aux, "Go to: abort    ");
+    } else {
+        snprintf(aux, sizeof(aux), "Go to: %2u:%02u   ", (uint8_t) (ms/60000), (uint8_t) ((ms/1000)%60));
+    }
+    displayStr(aux, 5, 0, false);
+}
+
+// Start sending a program whose code will be supplied later
+// by k7StreamPut (for data that is arriving from elsewhere)
+// Sends the leader silence and the name (default name if NULL)
+void k7StreamStart (const uint8_t *name, int size, int leader) {
+    if (name == NULL) {
+        name = pgmname;
+    }
+    st_size = size;
+    st_sent = 0;
     displayPercent(0);
-    busy_wait_ms(3000);
-    led_int = 0;
-    led_delta = 2;
+    traceEvent(TR_SEND, TRS_LEADER, size);
+    k7Silence(leader);
+    ws2812Pattern(LED_BREATHE, urgb_u32(0,0,120));
+    ws2812Track(k7_pio, k7_sm);
+    traceEvent(TR_SEND, TRS_NAME, 0);
     do {
-        pio_sm_put_blocking (K7_PIO, k7_sm, *name << 24);  // waits if FIFO is full
-        updateLED();
+        k7Put (*name);  // waits if FIFO is full
     } while ((*name++ & 0x80) == 0);
-    int tosend = size;
-    while (tosend--) {
-        pio_sm_put_blocking (K7_PIO, k7_sm, *code++ << 24);  // waits if FIFO is full
-        if ((tosend & 0x7F) == 0) {
-            displayPercent(100*(size-tosend)/size);
-        }
-        updateLED();
+    traceEvent(TR_SEND, TRS_DATA, 0);
+}
+
+// Send a byte of the program
+// Returns false (and does nothing) if the PIO FIFO is full
+bool k7StreamPut (uint8_t b) {
+    if (outFull()) {
+        return false;
     }
-    while (!pio_sm_is_tx_fifo_empty (k7_pio, k7_sm)) {
-        updateLED();
-        busy_wait_us(500);
+    if ((st_sent != 0) && pio_sm_is_tx_fifo_empty (k7_pio, k7_sm)) {
+        traceEvent(TR_UNDERRUN, 0, st_sent);    // PIO is on the last byte
+    }
+    outPut(b);
+    if ((++st_sent & 0x7F) == 0) {
+        traceEvent(TR_FIFO, pio_sm_get_tx_fifo_level (k7_pio, k7_sm), st_sent);
+        displayPercent(100*st_sent/st_size);
     }
-    displayPercent(100);
     return true;
 }
 
-static void updateLED() {
-    ws2812Update(urgb_u32(0,0,led_int));
-    if ((led_delta < 0) && (led_int < -led_delta)) {
-        led_delta = -led_delta;
-    }
-    if ((led_int > 120) && (led_delta > 0)) {
-        led_delta = -led_delta;
+// Finish sending a program (waits for the FIFO to empty)
+void k7StreamEnd () {
+    k7Drain();
+    traceEvent(TR_SEND, TRS_END, st_sent);
+    ws2812Track(NULL, 0);
+    displayPercent(100);
+}
+
+// Wait for the FIFO to empty
+static void k7Drain () {
+    while (!outEmpty()) {
+        chPoll();
+        if (!prefetchStep()) {
+            busy_wait_us(500);
+        }
     }
-    led_int += led_delta;
 }
 
 static void displayPercent(int perc) {
@@ -176,4 +908,4 @@ static void displayPercent(int perc) {
     aux[i++] = (perc % 10) + '0';
     aux [i++] = '%';
     displayStr(aux, 3, 0, false);
-}
\ No newline at end of file
+}
\ No newline at end of file
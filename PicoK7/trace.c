@@ -0,0 +1,103 @@
+/**
+ * @file trace.c
+ * @author Daniel Quadros
+ * @brief Binary trace - low overhead event recording
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * Each core has its own ring, so a core never waits for the other.
+ * Inside a core the interrupts are disabled only while the event is
+ * stored (the M0+ has no exclusive access instructions).
+ * When a ring is full new events are discarded and counted.
+ * traceDrain (called from the main loop, when idle) sends the events
+ * to the host in UP_TRACE frames; HostTools/k7trace shows them.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/pio.h"
+
+#include "picok7.h"
+#include "trace.h"
+
+#define TR_RING_SIZE  256   // events per core, must be a power of 2
+
+typedef struct {
+    TR_EVENT ev[TR_RING_SIZE];
+    volatile uint32_t head;     // written by the core
+    volatile uint32_t tail;     // written by traceDrain
+    volatile uint16_t lost;
+} TR_RING;
+
+static TR_RING ring[2];
+
+// Record an event (from any core, main loop or interrupt)
+void __not_in_flash_func(traceEvent) (uint8_t id, uint8_t a, uint32_t b) {
+    uint32_t t = time_us_32();
+    uint32_t status = save_and_disable_interrupts();
+    TR_RING *r = &ring[get_core_num()];
+    uint32_t head = r->head;
+    if ((head - r->tail) < TR_RING_SIZE) {
+        TR_EVENT *e = &r->ev[head & (TR_RING_SIZE-1)];
+        e->time = t;
+        e->id = id;
+        e->a = a;
+        e->b = b;
+        __dmb();    // event visible before the new head
+        r->head = head + 1;
+    } else if (r->lost != 0xFFFF) {
+        r->lost++;
+    }
+    restore_interrupts(status);
+}
+
+// Send the recorded events to the host
+// Must not be called while the USB is used for something else (upload)
+void traceDrain () {
+    #ifdef LIB_PICO_STDIO_USB
+    uint8_t payload[3+TR_MAX_EVENTS*TR_EVENT_SIZE];
+    uint8_t frame[UP_MAX_FRAME];
+
+    if (!stdio_usb_connected()) {
+        return;
+    }
+    for (int core = 0; core < 2; core++) {
+        while ((ring[core].head != ring[core].tail) || (ring[core].lost != 0)) {
+            uint32_t tail = ring[core].tail;
+            uint32_t n = ring[core].head - tail;
+            if (n > TR_MAX_EVENTS) {
+                n = TR_MAX_EVENTS;
+            }
+            __dmb();
+            uint32_t status = save_and_disable_interrupts();
+            uint16_t lost = ring[core].lost;
+            ring[core].lost = 0;
+            restore_interrupts(status);
+
+            payload[0] = core;
+            payload[1] = lost & 0xFF;
+            payload[2] = lost >> 8;
+            uint8_t *p = payload+3;
+            for (uint32_t i = 0; i < n; i++) {
+                TR_EVENT *e = &ring[core].ev[(tail+i) & (TR_RING_SIZE-1)];
+                upPut32(p, e->time);
+                p[4] = e->id;
+                p[5] = e->a;
+                upPut32(p+6, e->b);
+                p += TR_EVENT_SIZE;
+            }
+            ring[core].tail = tail + n;
+
+            int len = upFrame(frame, UP_TRACE, payload, p - payload);
+            for (int i = 0; i < len; i++) {
+                putchar_raw(frame[i]);
+            }
+        }
+    }
+    stdio_flush();
+    #endif
+}
@@ -0,0 +1,102 @@
+/**
+ * @file trace.h
+ * @author Daniel Quadros
+ * @brief Binary trace - definitions shared with the host tools
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * Events are recorded in RAM (one ring per core) and sent to the host
+ * in UP_TRACE frames (see upproto.h), when the firmware is idle.
+ *
+ * UP_TRACE payload:
+ *   core(1) lost(2) events
+ *   lost is the number of events discarded because the ring was full
+ *   each event is time(4) id(1) a(1) b(4), little endian
+ *   time is in microseconds since power on
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef __TRACE_H__
+
+#define __TRACE_H__
+
+#include <stdint.h>
+#include "upproto.h"
+
+#define UP_TRACE        0x84    // device to host
+#define TR_EVENT_SIZE   10
+#define TR_MAX_EVENTS   ((UP_MAX_PAYLOAD-3)/TR_EVENT_SIZE)
+
+// Event ids
+#define TR_SD_READ      0x01    // a: 512 byte blocks, b: time (us)
+#define TR_CLOCK        0x02    // b: new clock (kHz)
+#define TR_KEY          0x03    // a: key
+#define TR_LCD_FLUSH    0x04    // a: line, b: page
+#define TR_SEND         0x05    // a: phase, b: bytes sent (size for TRS_LEADER)
+#define TR_FIFO         0x06    // a: TX FIFO level, b: bytes sent
+#define TR_UNDERRUN     0x07    // b: bytes sent when the FIFO was found empty
+#define TR_ERROR        0x08    // a: error code, b: value
+#define TR_PIO_SM       0x09    // a: module, b: state machine
+#define TR_UPLOAD       0x0A    // a: status, b: bytes received
+#define TR_CHANNEL      0x0B    // a: output, b: new CH_STATE
+#define TR_STREAM       0x0C    // a: TRF_ flags, b: worst read/seek time (us)
+#define TR_RECORD       0x0D    // a: TRF_REC_ flags, b: worst write time (us)
+#define TR_CAPTURE      0x0E    // a: status, b: samples lost
+#define TR_REGEN        0x0F    // a: % of bits with the exact pulses, b: bits
+#define TR_MEMORY       0x10    // a: TRMEM_ region (| TRMEM_SIZE), b: peak bytes used (size)
+
+// TR_SEND phases
+#define TRS_LEADER      0
+#define TRS_NAME        1
+#define TRS_DATA        2
+#define TRS_END         3
+#define TRS_PAUSE       4
+#define TRS_RESUME      5
+#define TRS_SEEK        6
+#define TRS_ABORT       7
+
+// TR_ERROR codes
+#define TRE_HEADER      1       // b: file size | (code[0] << 24)
+#define TRE_SIZE        2       // b: real size
+#define TRE_LAST_BYTE   3       // b: last byte
+#define TRE_OPEN        4       // b: FRESULT
+#define TRE_READ        5       // b: FRESULT
+#define TRE_PIO_MEMORY  6       // b: module
+#define TRE_CRC         7       // b: CRC32 read (different from the catalog)
+#define TRE_FRAGMENTED  8       // b: CLMT words needed
+#define TRE_EXPAND      9       // b: FRESULT (no contiguous area)
+#define TRE_WRITE       10      // b: FRESULT
+
+// TR_STREAM flags
+#define TRF_FAST_SEEK   0x01    // the file used a CLMT
+#define TRF_LATE        0x02    // some read was slower than needed
+
+// TR_RECORD flags
+#define TRF_REC_ERROR       0x01    // the recording was not stored
+#define TRF_REC_CONTIGUOUS  0x02    // the file was contiguous
+
+// TR_PIO_SM modules
+#define TRM_TAPE        0
+#define TRM_ENCODER     1
+#define TRM_WS2812      2
+#define TRM_SCOPE       3
+#define TRM_CAPTURE     4
+
+// TR_MEMORY regions
+#define TRMEM_STACK0    0       // stack of core 0
+#define TRMEM_STACK1    1       // stack of core 1
+#define TRMEM_HEAP      2
+#define TRMEM_COUNT     3
+#define TRMEM_SIZE      0x80    // b is the size of the region
+
+// A decoded event
+typedef struct {
+    uint32_t time;
+    uint8_t id;
+    uint8_t a;
+    uint32_t b;
+} TR_EVENT;
+
+#endif
@@ -0,0 +1,318 @@
+/**
+ * @file upload.c
+ * @author Daniel Quadros
+ * @brief Receive a .P image over USB, sending it to the tape as it arrives
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * The protocol is described in upproto.h.
+ * Received data goes into a ring buffer that is emptied into the
+ * PIO FIFO; credits are given to the host as space is freed.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+#include "ff.h"
+#include "f_util.h"
+
+#include "picok7.h"
+#include "stream.h"
+#include "upproto.h"
+#include "trace.h"
+
+#ifdef LIB_PICO_STDIO_USB
+
+#define RING_SIZE    2048   // must be a power of 2
+#define MIN_CREDIT   256    // don't send small credits
+#define TIMEOUT_MS   5000   // max time without data from host
+
+static UP_PARSER parser;
+static uint8_t ring[RING_SIZE];
+static uint32_t r_in, r_out;    // bytes put in/taken from ring
+
+// Transfer state
+static enum { UPL_WAIT, UPL_DATA, UPL_END, UPL_DONE } state;
+static uint8_t flags;
+static uint32_t total;      // image size
+static uint32_t granted;    // credit given to host
+static uint32_t received;   // data received
+static uint32_t to_send;    // bytes to send to tape (0 until header checked)
+static uint32_t sent;       // bytes sent to tape
+static uint8_t last;        // last byte sent to tape
+static bool sending;
+static uint8_t status;
+static char fname[UP_MAX_NAME+1];
+static bool storing;
+static K7_REC rec;
+
+static void upSend (uint8_t type, const uint8_t *payload, int len);
+static void handleFrame (int type, uint8_t *payload, int len);
+static void startTransfer (uint8_t *payload, int len);
+static void pump (void);
+static void giveCredit (void);
+static void finish (uint8_t st);
+
+// USB upload mode
+// Returns true if a file was stored in the SD card
+bool usbUpload () {
+    displayClear();
+    displayStr("USB upload", 0, 0, true);
+    displayStr("Waiting...", 1, 0, false);
+    displayStr("Enter to cancel", 7, 0, false);
+    ws2812Pattern(LED_BLINK, urgb_u32(0,0,128));
+
+    upInit(&parser);
+    state = UPL_WAIT;
+    storing = false;
+    uint32_t last_rx = to_ms_since_boot(get_absolute_time());
+    bool stored = false;
+
+    while (state != UPL_DONE) {
+        // Process received bytes (a few at a time, to keep the tape going)
+        for (int i = 0; i < 64; i++) {
+            int c = getchar_timeout_us(0);
+            if (c < 0) {
+                break;
+            }
+            last_rx = to_ms_since_boot(get_absolute_time());
+            int type = upParse(&parser, (uint8_t) c);
+            if (type == UP_BAD) {
+                prtdbg("UPLOAD: bad frame\n");
+                if (state != UPL_WAIT) {
+                    finish(UPS_PROTOCOL);
+                }
+            } else if (type != UP_NONE) {
+                handleFrame(type, parser.payload, parser.len);
+            }
+            if (state == UPL_DONE) {
+                break;
+            }
+        }
+        if (state == UPL_WAIT) {
+            chPoll();
+            if (getKey() == KEY_ENTER) {
+                return false;
+            }
+            continue;
+        }
+        if (state == UPL_DONE) {
+            break;
+        }
+
+        pump();
+        giveCredit();
+        if (storing) {
+            recPoll(&rec);
+        }
+        chPoll();
+
+        if ((state == UPL_END) && (r_out == r_in) && !sending) {
+            // All data processed
+            if ((flags & UPF_SEND) && (last != 0x80)) {
+                finish(UPS_INVALID);
+            } else {
+                stored = storing;
+                finish(UPS_OK);
+            }
+        } else if ((state == UPL_DATA) && (r_out == r_in) &&
+                   ((to_ms_since_boot(get_absolute_time()) - last_rx) > TIMEOUT_MS)) {
+            finish(UPS_TIMEOUT);
+        }
+    }
+
+    displayStr(status == UPS_OK ? "Upload OK" : "Upload failed", 6, 0, false);
+    if (status != UPS_OK) {
+        ws2812Pattern(LED_FLASH, urgb_u32(128,0,0));
+    }
+    displayStr("Press Enter    ", 7, 0, false);
+    while (getKey() != KEY_ENTER) {
+        chPoll();
+        sleep_ms(10);
+    }
+    return stored;
+}
+
+// Send a frame to the host
+static void upSend (uint8_t type, const uint8_t *payload, int len) {
+    uint8_t frame[UP_MAX_FRAME];
+    int n = upFrame(frame, type, payload, len);
+    for (int i = 0; i < n; i++) {
+        putchar_raw(frame[i]);  // no CR/LF translation
+    }
+    stdio_flush();
+}
+
+// Treat a frame from the host
+static void handleFrame (int type, uint8_t *payload, int len) {
+    switch (type) {
+        case UP_START:
+            if (state == UPL_WAIT) {
+                startTransfer(payload, len);
+            } else {
+                finish(UPS_PROTOCOL);
+            }
+            break;
+        case UP_DATA:
+            if ((state != UPL_DATA) || ((received + len) > granted)) {
+                prtdbg("UPLOAD: data without credit\n");
+                finish(UPS_PROTOCOL);
+                break;
+            }
+            if (storing) {
+                FRESULT fr = recWrite(&rec, payload, len);
+                if (fr != FR_OK) {
+                    prtdbg("f_write error: %s (%d)\n", FRESULT_str(fr), fr);
+                    finish(UPS_SD_ERROR);
+                    break;
+                }
+            }
+            if (flags & UPF_SEND) {
+                for (int i = 0; i < len; i++) {
+                    ring[r_in++ & (RING_SIZE-1)] = payload[i];
+                }
+            }
+            received += len;
+            break;
+        case UP_END:
+            if ((state != UPL_DATA) || (received != total)) {
+                finish(UPS_PROTOCOL);
+            } else {
+                state = UPL_END;
+            }
+            break;
+        case UP_ABORT:
+            if (state != UPL_WAIT) {
+                finish(UPS_ABORTED);
+            }
+            break;
+    }
+}
+
+// Start a transfer
+static void startTransfer (uint8_t *payload, int len) {
+    if ((len < 6) || (len > (5+UP_MAX_NAME))) {
+        upSend(UP_STATUS, (uint8_t []) { UPS_PROTOCOL }, 1);
+        return;
+    }
+    flags = payload[0];
+    total = upGet32(payload+1);
+    memcpy(fname, payload+5, len-5);
+    fname[len-5] = 0;
+    prtdbg("UPLOAD: %s %lu bytes flags %02X\n", fname, (unsigned long) total, flags);
+
+    r_in = r_out = 0;
+    granted = received = 0;
+    to_send = sent = 0;
+    last = 0;
+    sending = false;
+    state = UPL_DATA;
+
+    displayStr("Receiving ", 1, 0, false);
+    displayStr(fname, 2, 0, false);
+
+    if (flags & UPF_STORE) {
+        if ((strchr(fname, '/') != NULL) || (strchr(fname, ':') != NULL)) {
+            finish(UPS_SD_ERROR);
+            return;
+        }
+        FRESULT fr = recOpen(&rec, fname, total);
+        if (fr != FR_OK) {
+            prtdbg("recOpen error: %s (%d)\n", FRESULT_str(fr), fr);
+            finish(UPS_SD_ERROR);
+            return;
+        }
+        storing = true;
+    }
+    giveCredit();
+}
+
+// Move data from the ring to the tape
+static void pump () {
+    if ((flags & UPF_SEND) == 0) {
+        return;
+    }
+    if (to_send == 0) {
+        // Wait for the header to check the file and start the tape
+        if ((r_in < 13) && (received < total)) {
+            return;
+        }
+        to_send = k7CheckHeader(ring, total);
+        if (to_send == 0) {
+            finish(UPS_INVALID);
+            return;
+        }
+        displayStr("Sending   ", 1, 0, false);
+        k7StreamStart(NULL, to_send, K7_LEADER_MS);
+        sending = true;
+    }
+    while (r_out != r_in) {
+        if (sent == to_send) {
+            r_out++;    // garbage after the program
+            continue;
+        }
+        uint8_t b = ring[r_out & (RING_SIZE-1)];
+        if (!k7StreamPut(b)) {
+            break;      // FIFO full
+        }
+        last = b;
+        r_out++;
+        if ((++sent & 0x7F) == 0) {
+            uint8_t aux[4];
+            upPut32(aux, sent);
+            upSend(UP_PROGRESS, aux, 4);
+        }
+    }
+    if (sending && (sent == to_send)) {
+        k7StreamEnd();
+        sending = false;
+        uint8_t aux[4];
+        upPut32(aux, sent);
+        upSend(UP_PROGRESS, aux, 4);
+    }
+}
+
+// Give credit to host, as space is available
+static void giveCredit () {
+    if (state != UPL_DATA) {
+        return;
+    }
+    uint32_t room = RING_SIZE - (r_in - r_out) - (granted - received);
+    if ((granted + room) > total) {
+        room = total - granted;
+    }
+    if ((room >= MIN_CREDIT) || ((room > 0) && ((granted + room) == total))) {
+        uint8_t aux[2] = { room & 0xFF, room >> 8 };
+        granted += room;
+        upSend(UP_CREDIT, aux, 2);
+    }
+}
+
+// End of transfer
+static void finish (uint8_t st) {
+    if (sending) {
+        k7StreamEnd();    // what is in the FIFO
+        sending = false;
+    }
+    if (storing) {
+        storing = false;
+        FRESULT fr = recClose(&rec, st == UPS_OK);
+        if (fr != FR_OK) {
+            prtdbg("recClose error: %s (%d)\n", FRESULT_str(fr), fr);
+            if (st == UPS_OK) {
+                st = UPS_SD_ERROR;
+            }
+        }
+    }
+    traceEvent(TR_UPLOAD, st, received);
+    status = st;
+    upSend(UP_STATUS, &status, 1);
+    state = UPL_DONE;
+}
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file upproto.c
+ * @author Daniel Quadros
+ * @brief USB upload protocol - framing (also used by the host tools)
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#include <string.h>
+
+#include "upproto.h"
+
+// Parser states
+enum { ST_SYNC1, ST_SYNC2, ST_TYPE, ST_LEN1, ST_LEN2, ST_PAYLOAD };
+
+// CRC-16/CCITT (poly 0x1021)
+uint16_t upCrc (uint16_t crc, const uint8_t *data, int len) {
+    while (len--) {
+        crc ^= (uint16_t) *data++ << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Init parser
+void upInit (UP_PARSER *p) {
+    p->state = ST_SYNC1;
+}
+
+// Process a received byte
+// Returns the frame type when a frame is complete,
+// UP_NONE if not complete or UP_BAD if invalid
+int upParse (UP_PARSER *p, uint8_t c) {
+    switch (p->state) {
+        case ST_SYNC1:
+            if (c == UP_SYNC1) {
+                p->state = ST_SYNC2;
+            }
+            break;
+        case ST_SYNC2:
+            p->state = (c == UP_SYNC2) ? ST_TYPE : (c == UP_SYNC1) ? ST_SYNC2 : ST_SYNC1;
+            break;
+        case ST_TYPE:
+            p->type = c;
+            p->crc = upCrc(0xFFFF, &c, 1);
+            p->state = ST_LEN1;
+            break;
+        case ST_LEN1:
+            p->len = c;
+            p->crc = upCrc(p->crc, &c, 1);
+            p->state = ST_LEN2;
+            break;
+        case ST_LEN2:
+            p->len |= c << 8;
+            p->crc = upCrc(p->crc, &c, 1);
+            if (p->len > UP_MAX_PAYLOAD) {
+                p->state = ST_SYNC1;
+                return UP_BAD;
+            }
+            p->n = 0;
+            p->state = ST_PAYLOAD;
+            break;
+        case ST_PAYLOAD:
+            p->payload[p->n++] = c;
+            if (p->n == (p->len + 2)) {
+                p->state = ST_SYNC1;
+                uint16_t crc = p->payload[p->len] | (p->payload[p->len+1] << 8);
+                if (crc != upCrc(p->crc, p->payload, p->len)) {
+                    return UP_BAD;
+                }
+                return p->type;
+            }
+            break;
+    }
+    return UP_NONE;
+}
+
+// Build a frame
+// frame must have UP_MAX_FRAME bytes
+// Returns the frame size
+int upFrame (uint8_t *frame, uint8_t type, const uint8_t *payload, int len) {
+    frame[0] = UP_SYNC1;
+    frame[1] = UP_SYNC2;
+    frame[2] = type;
+    frame[3] = len & 0xFF;
+    frame[4] = len >> 8;
+    if (len) {
+        memcpy(frame+5, payload, len);
+    }
+    uint16_t crc = upCrc(0xFFFF, frame+2, len+3);
+    frame[len+5] = crc & 0xFF;
+    frame[len+6] = crc >> 8;
+    return len+7;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file upproto.h
+ * @author Daniel Quadros
+ * @brief USB upload protocol - definitions shared with the host tools
+ * @version 1.0
+ * @date 2026-10-18
+ *
+ * Frames (both directions):
+ *   0xA5 0x5A type len(2) payload(len) crc(2)
+ *   multibyte fields are little endian
+ *   crc is the CRC-16/CCITT of type, len and payload
+ * Anything outside a frame is ignored (debug messages from the device).
+ *
+ * Flow control is credit based: the host can only send as many data
+ * bytes as the device has granted (UP_CREDIT). The device grants credits
+ * as its buffer is emptied into the PIO FIFO (or the SD card).
+ *
+ * A transfer is: START, DATA..., END. The device answers with a STATUS.
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#ifndef __UPPROTO_H__
+
+#define __UPPROTO_H__
+
+#include <stdint.h>
+
+#define UP_SYNC1        0xA5
+#define UP_SYNC2        0x5A
+#define UP_MAX_PAYLOAD  512
+#define UP_MAX_FRAME    (UP_MAX_PAYLOAD+7)
+#define UP_MAX_NAME     64
+
+// Host to device
+#define UP_START     0x01    // flags(1) size(4) file name
+#define UP_DATA      0x02    // image data
+#define UP_END       0x03    // no payload
+#define UP_ABORT     0x04    // no payload
+
+// Device to host
+#define UP_CREDIT    0x81    // credit(2): more bytes the host can send
+#define UP_PROGRESS  0x82    // sent(4): bytes sent to the tape
+#define UP_STATUS    0x83    // status(1): end of transfer
+
+// START flags
+#define UPF_SEND     0x01    // send to the tape as the data arrives
+#define UPF_STORE    0x02    // store in the ZX81 directory
+
+// Status codes
+#define UPS_OK        0
+#define UPS_PROTOCOL  1      // bad frame or protocol violation
+#define UPS_INVALID   2      // not a valid .P image
+#define UPS_SD_ERROR  3      // could not write the file
+#define UPS_ABORTED   4      // aborted by the host or the user
+#define UPS_TIMEOUT   5      // host stopped sending
+
+// upParse() return
+#define UP_NONE      0       // frame not complete
+#define UP_BAD       (-1)    // invalid frame
+
+// Frame parser
+typedef struct {
+    int state;
+    int n;
+    uint8_t type;
+    uint16_t len;
+    uint16_t crc;
+    uint8_t payload[UP_MAX_PAYLOAD+2];
+} UP_PARSER;
+
+uint16_t upCrc (uint16_t crc, const uint8_t *data, int len);
+void upInit (UP_PARSER *p);
+int upParse (UP_PARSER *p, uint8_t c);
+int upFrame (uint8_t *frame, uint8_t type, const uint8_t *payload, int len);
+
+static inline uint32_t upGet32 (const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void upPut32 (uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+#endif
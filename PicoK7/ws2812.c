@@ -16,25 +16,49 @@
 #include "hardware/gpio.h"
 #include "hardware/clocks.h"
 #include "hardware/pio.h"
+#include "hardware/dma.h"
 
 #include "ws2812.pio.h"
 
 #include "picok7.h"
+#include "trace.h"
 
 #define FREQ 800000.0
 
+// The animation is a table of colors, replayed by DMA:
+// a pacing channel waits for a DMA timer (or the bits sent by the tape
+// state machine) and then chains to the channel that sends the next
+// color to the state machine, which chains back to the pacing channel
+#define LED_STEPS       128     // colors in the table (power of 2)
+#define LED_RING_BITS   9       // log2 of table size in bytes
+#define LED_FPS         40      // steps per second
+#define LED_TRACK_BITS  8       // bits sent to tape per step
+
 static PIO WS2812_pio;
 static int WS2812_sm;
 
+static uint32_t led_table[LED_STEPS] __attribute__((aligned(LED_STEPS*4)));
+static uint32_t led_dummy;
+static int led_pace_ch;
+static int led_data_ch;
+static int led_timer;
+static uint led_pace_count;
+static bool led_tracking;
+
+static void ledPace (void);
+static void ledClock (void);
+static void ledStart (void);
+
 // Init PIO state machine for send commands to the WS2812 LED
+// and the DMA channels that animate it
 void ws282Init(PIO pio, uint pin) {
 
     WS2812_pio = pio;
     WS2812_sm = pio_claim_unused_sm(pio, true);
-    prtdbg("WS2812: sm %d\n", WS2812_sm);
+    traceEvent(TR_PIO_SM, TRM_WS2812, WS2812_sm);
     int offset = pio_add_program(pio, &ws2812_program);
     if (offset < 0) {
-      prtdbg("WS2812: PIO memory full\n");
+      traceEvent(TR_ERROR, TRE_PIO_MEMORY, TRM_WS2812);
     }
 
     pio_gpio_init(pio, pin);
@@ -51,10 +75,98 @@ void ws282Init(PIO pio, uint pin) {
 
     pio_sm_init(pio, WS2812_sm, offset, &c);
     pio_sm_set_enabled(pio, WS2812_sm, true);
+    clockAddPio(pio, WS2812_sm, FREQ * cycles_per_bit);
+
+    ws2812Pattern(LED_SOLID, 0);
+    ledStart();
 }
 
-// Update LED color
-void ws2812Update(uint32_t pixel) {
-    sleep_us(50);   // marks start
-    pio_sm_put_blocking(WS2812_pio, WS2812_sm, pixel);
+// Set the LED animation
+// Only the table is changed, the DMA keeps running
+void ws2812Pattern(LED_PATTERN pattern, uint32_t color) {
+    for (int i = 0; i < LED_STEPS; i++) {
+        uint v;     // intensity, 0 to 128
+        switch (pattern) {
+            case LED_BREATHE:
+                v = i < (LED_STEPS/2) ? 2*i : 2*(LED_STEPS-1-i);
+                break;
+            case LED_BLINK:
+                v = (i & 16) ? 0 : 128;
+                break;
+            case LED_FLASH:     // two short flashes
+                v = ((i & 0x1F) < 4) || (((i & 0x1F) >= 8) && ((i & 0x1F) < 12)) ? 128 : 0;
+                break;
+            default:
+                v = 128;
+                break;
+        }
+        uint32_t pixel = 0;
+        for (int shift = 8; shift < 32; shift += 8) {
+            pixel |= ((((color >> shift) & 0xFF) * v / 128) & 0xFF) << shift;
+        }
+        led_table[i] = pixel;
+    }
+}
+
+// Select what paces the animation: the bits sent by a tape
+// state machine or, if pio is NULL, the DMA timer
+// The tape state machine pushes a word in the RX FIFO for each bit
+void ws2812Track(PIO pio, uint sm) {
+    dma_channel_config c = dma_channel_get_default_config(led_pace_ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_chain_to(&c, led_data_ch);
+    channel_config_set_irq_quiet(&c, true);
+    led_tracking = pio != NULL;
+    if (pio == NULL) {
+        channel_config_set_dreq(&c, dma_get_timer_dreq(led_timer));
+        dma_channel_set_read_addr(led_pace_ch, &led_dummy, false);
+        dma_channel_set_trans_count(led_pace_ch, led_pace_count, false);
+    } else {
+        channel_config_set_dreq(&c, pio_get_dreq(pio, sm, false));
+        dma_channel_set_read_addr(led_pace_ch, &pio->rxf[sm], false);
+        dma_channel_set_trans_count(led_pace_ch, LED_TRACK_BITS, false);
+    }
+    dma_channel_set_write_addr(led_pace_ch, &led_dummy, false);
+    dma_channel_set_config(led_pace_ch, &c, false);
+}
+
+// Program the DMA timer for LED_FPS steps
+// The timer is too fast for this, so the pacing channel
+// counts led_pace_count timer ticks for each step
+static void ledPace() {
+    uint32_t clk = clock_get_hz(clk_sys);
+    led_pace_count = (clk + 65535UL*LED_FPS - 1) / (65535UL*LED_FPS);
+    dma_timer_set_fraction(led_timer, 1, clk / (LED_FPS * led_pace_count));
+}
+
+// Start the DMA channels that replay the color table
+static void ledStart() {
+    led_timer = dma_claim_unused_timer(true);
+    led_pace_ch = dma_claim_unused_channel(true);
+    led_data_ch = dma_claim_unused_channel(true);
+    ledPace();
+
+    dma_channel_config c = dma_channel_get_default_config(led_data_ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_ring(&c, false, LED_RING_BITS);
+    channel_config_set_dreq(&c, pio_get_dreq(WS2812_pio, WS2812_sm, true));
+    channel_config_set_chain_to(&c, led_pace_ch);
+    channel_config_set_irq_quiet(&c, true);
+    dma_channel_configure(led_data_ch, &c, &WS2812_pio->txf[WS2812_sm], led_table, 1, false);
+
+    ws2812Track(NULL, 0);
+    dma_channel_start(led_pace_ch);
+    clockAddCallback(ledClock);
+}
+
+// clk_sys changed, reprogram the DMA timer
+static void ledClock() {
+    ledPace();
+    if (!led_tracking) {
+        dma_channel_set_trans_count(led_pace_ch, led_pace_count, false);
+    }
 }
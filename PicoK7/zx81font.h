@@ -0,0 +1,69 @@
+// ZX81 character set (codes 0 to 63, as in the ROM)
+// 8 bytes per char, from top to bottom, bit 7 is the left pixel
+// Not used by the firmware: zxglyph.cmake makes the preview glyphs from it
+const static uint8_t zx81font[] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // space 0
+    0xF0, 0xF0, 0xF0, 0xF0, 0x00, 0x00, 0x00, 0x00, // graphic 1
+    0x0F, 0x0F, 0x0F, 0x0F, 0x00, 0x00, 0x00, 0x00, // graphic 2
+    0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, // graphic 3
+    0x00, 0x00, 0x00, 0x00, 0xF0, 0xF0, 0xF0, 0xF0, // graphic 4
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, // graphic 5
+    0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, // graphic 6
+    0xFF, 0xFF, 0xFF, 0xFF, 0xF0, 0xF0, 0xF0, 0xF0, // graphic 7
+    0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, // grey 8
+    0x00, 0x00, 0x00, 0x00, 0xAA, 0x55, 0xAA, 0x55, // grey 9
+    0xAA, 0x55, 0xAA, 0x55, 0x00, 0x00, 0x00, 0x00, // grey 10
+    0x00, 0x24, 0x24, 0x00, 0x00, 0x00, 0x00, 0x00, // " 11
+    0x00, 0x1C, 0x22, 0x78, 0x20, 0x20, 0x7E, 0x00, // pound 12
+    0x00, 0x08, 0x3E, 0x28, 0x3E, 0x0A, 0x3E, 0x08, // $ 13
+    0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x10, 0x00, // : 14
+    0x00, 0x3C, 0x42, 0x04, 0x08, 0x00, 0x08, 0x00, // ? 15
+    0x00, 0x04, 0x08, 0x08, 0x08, 0x08, 0x04, 0x00, // ( 16
+    0x00, 0x20, 0x10, 0x10, 0x10, 0x10, 0x20, 0x00, // ) 17
+    0x00, 0x00, 0x10, 0x08, 0x04, 0x08, 0x10, 0x00, // > 18
+    0x00, 0x00, 0x04, 0x08, 0x10, 0x08, 0x04, 0x00, // < 19
+    0x00, 0x00, 0x00, 0x3E, 0x00, 0x3E, 0x00, 0x00, // = 20
+    0x00, 0x00, 0x08, 0x08, 0x3E, 0x08, 0x08, 0x00, // + 21
+    0x00, 0x00, 0x00, 0x00, 0x3E, 0x00, 0x00, 0x00, // - 22
+    0x00, 0x00, 0x14, 0x08, 0x3E, 0x08, 0x14, 0x00, // * 23
+    0x00, 0x00, 0x02, 0x04, 0x08, 0x10, 0x20, 0x00, // / 24
+    0x00, 0x00, 0x10, 0x00, 0x00, 0x10, 0x10, 0x20, // ; 25
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0x10, // , 26
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, // . 27
+    0x00, 0x3C, 0x46, 0x4A, 0x52, 0x62, 0x3C, 0x00, // 0 28
+    0x00, 0x18, 0x28, 0x08, 0x08, 0x08, 0x3E, 0x00, // 1 29
+    0x00, 0x3C, 0x42, 0x02, 0x3C, 0x40, 0x7E, 0x00, // 2 30
+    0x00, 0x3C, 0x42, 0x0C, 0x02, 0x42, 0x3C, 0x00, // 3 31
+    0x00, 0x08, 0x18, 0x28, 0x48, 0x7E, 0x08, 0x00, // 4 32
+    0x00, 0x7E, 0x40, 0x7C, 0x02, 0x42, 0x3C, 0x00, // 5 33
+    0x00, 0x3C, 0x40, 0x7C, 0x42, 0x42, 0x3C, 0x00, // 6 34
+    0x00, 0x7E, 0x02, 0x04, 0x08, 0x10, 0x10, 0x00, // 7 35
+    0x00, 0x3C, 0x42, 0x3C, 0x42, 0x42, 0x3C, 0x00, // 8 36
+    0x00, 0x3C, 0x42, 0x42, 0x3E, 0x02, 0x3C, 0x00, // 9 37
+    0x00, 0x3C, 0x42, 0x42, 0x7E, 0x42, 0x42, 0x00, // A 38
+    0x00, 0x7C, 0x42, 0x7C, 0x42, 0x42, 0x7C, 0x00, // B 39
+    0x00, 0x3C, 0x42, 0x40, 0x40, 0x42, 0x3C, 0x00, // C 40
+    0x00, 0x78, 0x44, 0x42, 0x42, 0x44, 0x78, 0x00, // D 41
+    0x00, 0x7E, 0x40, 0x7C, 0x40, 0x40, 0x7E, 0x00, // E 42
+    0x00, 0x7E, 0x40, 0x7C, 0x40, 0x40, 0x40, 0x00, // F 43
+    0x00, 0x3C, 0x42, 0x40, 0x4E, 0x42, 0x3C, 0x00, // G 44
+    0x00, 0x42, 0x42, 0x7E, 0x42, 0x42, 0x42, 0x00, // H 45
+    0x00, 0x3E, 0x08, 0x08, 0x08, 0x08, 0x3E, 0x00, // I 46
+    0x00, 0x02, 0x02, 0x02, 0x42, 0x42, 0x3C, 0x00, // J 47
+    0x00, 0x44, 0x48, 0x70, 0x48, 0x44, 0x42, 0x00, // K 48
+    0x00, 0x40, 0x40, 0x40, 0x40, 0x40, 0x7E, 0x00, // L 49
+    0x00, 0x42, 0x66, 0x5A, 0x42, 0x42, 0x42, 0x00, // M 50
+    0x00, 0x42, 0x62, 0x52, 0x4A, 0x46, 0x42, 0x00, // N 51
+    0x00, 0x3C, 0x42, 0x42, 0x42, 0x42, 0x3C, 0x00, // O 52
+    0x00, 0x7C, 0x42, 0x42, 0x7C, 0x40, 0x40, 0x00, // P 53
+    0x00, 0x3C, 0x42, 0x42, 0x52, 0x4A, 0x3C, 0x00, // Q 54
+    0x00, 0x7C, 0x42, 0x42, 0x7C, 0x44, 0x42, 0x00, // R 55
+    0x00, 0x3C, 0x40, 0x3C, 0x02, 0x42, 0x3C, 0x00, // S 56
+    0x00, 0xFE, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, // T 57
+    0x00, 0x42, 0x42, 0x42, 0x42, 0x42, 0x3C, 0x00, // U 58
+    0x00, 0x42, 0x42, 0x42, 0x42, 0x24, 0x18, 0x00, // V 59
+    0x00, 0x42, 0x42, 0x42, 0x42, 0x5A, 0x24, 0x00, // W 60
+    0x00, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x00, // X 61
+    0x00, 0x82, 0x44, 0x28, 0x10, 0x10, 0x10, 0x00, // Y 62
+    0x00, 0x7E, 0x04, 0x08, 0x10, 0x20, 0x7E, 0x00, // Z 63
+};
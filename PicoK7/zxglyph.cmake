@@ -0,0 +1,61 @@
+# Make the glyphs of the ZX81 screen preview (zxglyph.h) from zx81font.h
+# Usage: cmake -DIN=zx81font.h -DOUT=zxglyph.h -P zxglyph.cmake
+#
+# Each 8x8 char is reduced to 4x2 pixels: a pixel is set if at least
+# THRESHOLD of the 2x4 pixels it replaces are set. The glyph is a byte,
+# two bits per column from left to right (bit 7 is the top left pixel)
+
+cmake_minimum_required(VERSION 3.13)
+
+if (NOT DEFINED THRESHOLD)
+    set(THRESHOLD 2)
+endif()
+
+file(READ ${IN} SRC)
+string(REGEX REPLACE "//[^\n]*" "" SRC "${SRC}")
+string(REGEX MATCHALL "0x[0-9A-Fa-f][0-9A-Fa-f]" BYTES "${SRC}")
+list(LENGTH BYTES NBYTES)
+if (NOT NBYTES EQUAL 512)
+    message(FATAL_ERROR "${IN}: expected 512 bytes, found ${NBYTES}")
+endif()
+
+set(OUTPUT "// Generated by zxglyph.cmake from zx81font.h - do not edit\n")
+string(APPEND OUTPUT "// ZX81 chars reduced to 4x2 pixels, 2 bits per column (bit 7 is the top left)\n")
+string(APPEND OUTPUT "const static uint8_t zxglyph[64] = {\n")
+foreach(CHR RANGE 63)
+    set(GLYPH 0)
+    foreach(COL RANGE 3)
+        foreach(HALF RANGE 1)
+            set(COUNT 0)
+            foreach(ROW RANGE 3)
+                math(EXPR I "${CHR}*8 + ${HALF}*4 + ${ROW}")
+                list(GET BYTES ${I} B)
+                math(EXPR COUNT "${COUNT} + ((${B} >> (7 - 2*${COL})) & 1) + ((${B} >> (6 - 2*${COL})) & 1)")
+            endforeach()
+            if (NOT COUNT LESS THRESHOLD)
+                math(EXPR GLYPH "${GLYPH} | (1 << (7 - 2*${COL} - ${HALF}))")
+            endif()
+        endforeach()
+    endforeach()
+    math(EXPR GLYPH "${GLYPH} + 256" OUTPUT_FORMAT HEXADECIMAL)
+    string(SUBSTRING ${GLYPH} 3 2 GLYPH)
+    string(TOUPPER ${GLYPH} GLYPH)
+    math(EXPR COLUMN "${CHR} % 8")
+    if (COLUMN EQUAL 0)
+        string(APPEND OUTPUT "   ")
+    endif()
+    string(APPEND OUTPUT " 0x${GLYPH},")
+    if (COLUMN EQUAL 7)
+        string(APPEND OUTPUT "\n")
+    endif()
+endforeach()
+string(APPEND OUTPUT "};\n")
+
+# Only rewrite if changed, so the sources are not recompiled for nothing
+if (EXISTS ${OUT})
+    file(READ ${OUT} OLD)
+    if (OLD STREQUAL OUTPUT)
+        return()
+    endif()
+endif()
+file(WRITE ${OUT} "${OUTPUT}")
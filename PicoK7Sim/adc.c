@@ -0,0 +1,163 @@
+/*
+    PicoK7Sim - ADC emulation
+
+    Input 0 (GPIO 26, the tape input) plays the WAV file given with -a,
+    from the first time the ADC is started; the file goes on playing
+    in virtual time even while the ADC is stopped, like a tape deck.
+    The other inputs, and input 0 after the end of the file, read
+    midscale. Conversions happen at the rate given by the divider and
+    are taken by the DMA (DREQ_ADC) or read from the FIFO register.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#define SIM_INTERNAL
+
+#include <stdlib.h>
+
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/gpio.h"
+
+#include "audio.h"
+#include "sim.h"
+
+#define ADC_CLK_HZ      48000000.0
+#define MIN_CYCLES      96          // a conversion takes 96 clk_adc cycles
+#define MIDSCALE        2048
+#define WAV_BLOCK       4096
+
+adc_hw_t sim_adc_hw;
+
+static AUDIO audio;
+static bool has_audio;
+static bool started;        // the tape started playing
+static uint64_t t_start;
+static float wav[WAV_BLOCK];
+static size_t wav_base;     // sample of the file in wav[0]
+static size_t wav_len;
+static float full_scale;
+
+static uint input;
+static double period = MIN_CYCLES * 1e9 / ADC_CLK_HZ;
+static bool running;
+static bool byte_shift;
+static double t_conv;       // time of the next conversion
+
+static uint16_t tapeSample (uint64_t t);
+
+// Open the WAV file played in input 0
+bool adcOpen (const char *file) {
+    if (!audioOpen(&audio, file)) {
+        return false;
+    }
+    full_scale = audio.bits == 8 ? 128.0f : 32768.0f;
+    has_audio = true;
+    return true;
+}
+
+// Is there a conversion not taken up to t_end?
+bool adcDreq (uint64_t t_end) {
+    return running && (t_conv <= t_end);
+}
+
+// Read the FIFO at addr
+bool adcFifoRead (const volatile void *addr, uint32_t *data) {
+    if (addr != &sim_adc_hw.fifo) {
+        return false;
+    }
+    uint64_t t = running ? (uint64_t) t_conv : sim_now;
+    uint16_t v = (input == 0) ? tapeSample(t) : MIDSCALE;
+    *data = byte_shift ? (v >> 4) : v;
+    if (running) {
+        t_conv += period;
+    }
+    return true;
+}
+
+// Value of input 0 at time t (12 bits)
+static uint16_t tapeSample (uint64_t t) {
+    if (!has_audio || !started || (t < t_start)) {
+        return MIDSCALE;
+    }
+    double pos = (t - t_start) * 1e-9 * audio.rate;
+    size_t i = (size_t) pos;
+    while (i + 1 >= wav_base + wav_len) {
+        // samples are taken in order, keep the last one
+        if (wav_len != 0) {
+            wav[0] = wav[wav_len-1];
+            wav_base += wav_len - 1;
+            wav_len = 1;
+        }
+        size_t n = audioRead(&audio, wav + wav_len, WAV_BLOCK - wav_len);
+        if (n == 0) {
+            return MIDSCALE;
+        }
+        wav_len += n;
+    }
+    if (i < wav_base) {
+        i = wav_base;
+    }
+    float f = (float) (pos - i);
+    float x = (wav[i - wav_base] * (1.0f - f) + wav[i + 1 - wav_base] * f) / full_scale;
+    int v = MIDSCALE + (int) (x * (MIDSCALE - 1));
+    if (v < 0) {
+        v = 0;
+    } else if (v > 4095) {
+        v = 4095;
+    }
+    return v;
+}
+
+
+// SDK API
+//---------------------------
+
+void adc_init () {
+    running = false;
+}
+
+void adc_gpio_init (uint gpio) {
+    gpio_set_function(gpio, GPIO_FUNC_NULL);
+    gpio_disable_pulls(gpio);
+}
+
+void adc_select_input (uint in) {
+    input = in;
+}
+
+void adc_set_clkdiv (float clkdiv) {
+    double cycles = 1.0 + clkdiv;
+    if (cycles < MIN_CYCLES) {
+        cycles = MIN_CYCLES;
+    }
+    period = cycles * 1e9 / ADC_CLK_HZ;
+}
+
+void adc_fifo_setup (bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool shift) {
+    (void) en;
+    (void) dreq_en;
+    (void) dreq_thresh;
+    (void) err_in_fifo;
+    byte_shift = shift;
+}
+
+void adc_run (bool run) {
+    if (run && !running) {
+        if (!started) {
+            started = true;
+            t_start = sim_now;
+        }
+        t_conv = sim_now + period;
+    }
+    running = run;
+}
+
+void adc_fifo_drain () {
+}
+
+uint16_t adc_read () {
+    simAdvance((uint64_t) period, PRF_POLL);
+    return (input == 0) ? tapeSample(sim_now) : MIDSCALE;
+}
@@ -0,0 +1,168 @@
+/*
+    PicoK7Sim - SD card as a FAT image file
+
+    FatFs (from the SDLib submodule) runs unchanged over these
+    disk functions. Each access costs the time of the SPI commands
+    and transfers.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#define SIM_INTERNAL
+
+#include <stdlib.h>
+
+#include "pico/stdlib.h"
+
+#include "ff.h"
+#include "diskio.h"
+#include "f_util.h"
+#include "sd_card.h"
+
+#include "sim.h"
+
+#define SECTOR_SIZE  512
+#define CMD_NS       100000ull  // command and wait for the card
+#define SECTOR_NS    (SECTOR_SIZE * 8 * 1000ull / 12)   // 12.5 MHz SPI
+
+static FILE *image;
+static LBA_t nsectors;
+static sd_card_t sd_card;
+
+bool diskOpen (const char *file) {
+    image = fopen(file, "r+b");
+    if (image == NULL) {
+        perror(file);
+        return false;
+    }
+    fseek(image, 0, SEEK_END);
+    nsectors = ftell(image) / SECTOR_SIZE;
+    return true;
+}
+
+DSTATUS disk_status (BYTE pdrv) {
+    return ((pdrv == 0) && (image != NULL)) ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_initialize (BYTE pdrv) {
+    simAdvance(10 * CMD_NS, PRF_SD);
+    return disk_status(pdrv);
+}
+
+DRESULT disk_read (BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    if (disk_status(pdrv)) {
+        return RES_NOTRDY;
+    }
+    if ((sector + count) > nsectors) {
+        return RES_PARERR;
+    }
+    simAdvance(CMD_NS + count * SECTOR_NS, PRF_SD);
+    sim_cnt.sd_read += count;
+    fseek(image, (long) sector * SECTOR_SIZE, SEEK_SET);
+    return fread(buff, SECTOR_SIZE, count, image) == count ? RES_OK : RES_ERROR;
+}
+
+DRESULT disk_write (BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
+    if (disk_status(pdrv)) {
+        return RES_NOTRDY;
+    }
+    if ((sector + count) > nsectors) {
+        return RES_PARERR;
+    }
+    simAdvance(CMD_NS + count * (SECTOR_NS + CMD_NS), PRF_SD);
+    sim_cnt.sd_write += count;
+    fseek(image, (long) sector * SECTOR_SIZE, SEEK_SET);
+    return fwrite(buff, SECTOR_SIZE, count, image) == count ? RES_OK : RES_ERROR;
+}
+
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void *buff) {
+    if (disk_status(pdrv)) {
+        return RES_NOTRDY;
+    }
+    switch (cmd) {
+        case CTRL_SYNC:
+            fflush(image);
+            return RES_OK;
+        case GET_SECTOR_COUNT:
+            *(LBA_t *) buff = nsectors;
+            return RES_OK;
+        case GET_SECTOR_SIZE:
+            *(WORD *) buff = SECTOR_SIZE;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *(DWORD *) buff = 1;
+            return RES_OK;
+        default:
+            return RES_OK;
+    }
+}
+
+// Fixed timestamp (2026-10-18 12:00)
+DWORD get_fattime () {
+    return ((DWORD) (2026 - 1980) << 25) | (10 << 21) | (18 << 16) | (12 << 11);
+}
+
+#if FF_USE_LFN == 3
+void *ff_memalloc (UINT msize) {
+    return malloc(msize);
+}
+
+void ff_memfree (void *mblock) {
+    free(mblock);
+}
+#endif
+
+#if FF_FS_REENTRANT
+int ff_mutex_create (int vol) {
+    (void) vol;
+    return 1;
+}
+
+void ff_mutex_delete (int vol) {
+    (void) vol;
+}
+
+int ff_mutex_take (int vol) {
+    (void) vol;
+    return 1;
+}
+
+void ff_mutex_give (int vol) {
+    (void) vol;
+}
+#endif
+
+size_t sd_get_num () {
+    return 1;
+}
+
+sd_card_t *sd_get_by_num (size_t num) {
+    return num == 0 ? &sd_card : NULL;
+}
+
+const char *FRESULT_str (FRESULT i) {
+    static const char *str[] = {
+        "Succeeded",
+        "A hard error occurred in the low level disk I/O layer",
+        "Assertion failed",
+        "The physical drive cannot work",
+        "Could not find the file",
+        "Could not find the path",
+        "The path name format is invalid",
+        "Access denied due to prohibited access or directory full",
+        "Access denied due to prohibited access",
+        "The file/directory object is invalid",
+        "The physical drive is write protected",
+        "The logical drive number is invalid",
+        "The volume has no work area",
+        "There is no valid FAT volume",
+        "The f_mkfs() aborted due to any problem",
+        "Could not get a grant to access the volume within defined period",
+        "The operation is rejected according to the file sharing policy",
+        "LFN working buffer could not be allocated",
+        "Number of open files > FF_FS_LOCK",
+        "Given parameter is invalid"
+    };
+    return (unsigned) i < count_of(str) ? str[i] : "Unknown error";
+}
@@ -0,0 +1,413 @@
+/*
+    PicoK7Sim - DMA emulation
+
+    Transfers happen as the virtual time advances: DREQ_FORCE channels
+    run at once, PIO paced channels while the FIFO has room (or data),
+    ADC paced channels as the conversions are done and timer paced
+    channels at the timer rate. The sniffer sees the
+    bytes of each item, least significant first.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#define SIM_INTERNAL
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+
+#include "sim.h"
+
+dma_hw_t sim_dma_hw;
+
+static struct {
+    bool claimed;
+    bool busy;
+    dma_channel_config cfg;
+    uintptr_t read_addr, write_addr;
+    uint32_t count;         // transfer count to load at trigger
+    uintptr_t ring_base;
+    double next;            // next transfer (timer paced)
+} ch[NUM_DMA_CHANNELS];
+
+static struct {
+    bool claimed;
+    uint16_t num, den;
+} timer[NUM_DMA_TIMERS];
+
+static struct {
+    bool enable;
+    uint channel;
+    uint mode;
+    bool out_rev, out_inv;
+    uint32_t data;
+} sniff;
+
+static void sniffByte (uint8_t b);
+static uint32_t reverse (uint32_t x, int bits);
+
+void dmaSimInit () {
+    for (uint c = 0; c < NUM_DMA_CHANNELS; c++) {
+        ch[c].cfg = dma_channel_get_default_config(c);
+    }
+}
+
+// Move one item
+static void transfer (uint c) {
+    uint size = 1u << ch[c].cfg.size;
+    dma_channel_hw_t *hw = &sim_dma_hw.ch[c];
+    uint32_t data = 0;
+
+    if (!pioFifoRead((const volatile void *) hw->read_addr, &data) &&
+        !adcFifoRead((const volatile void *) hw->read_addr, &data)) {
+        memcpy(&data, (const void *) hw->read_addr, size);
+    }
+    if (ch[c].cfg.bswap && (size > 1)) {
+        data = size == 2 ? (uint32_t) __builtin_bswap16((uint16_t) data) : __builtin_bswap32(data);
+    }
+    if (!pioFifoWrite((volatile void *) hw->write_addr, data)) {
+        memcpy((void *) hw->write_addr, &data, size);
+    }
+    if (sniff.enable && (sniff.channel == c) && ch[c].cfg.sniff) {
+        for (uint i = 0; i < size; i++) {
+            sniffByte(data >> (8*i));
+        }
+    }
+    sim_cnt.dma_transfers++;
+
+    uintptr_t ring = ch[c].cfg.ring_bits ? ((uintptr_t) 1 << ch[c].cfg.ring_bits) - 1 : 0;
+    if (ch[c].cfg.read_incr) {
+        uintptr_t a = hw->read_addr + size;
+        hw->read_addr = (ring && !ch[c].cfg.ring_write) ? (hw->read_addr & ~ring) | (a & ring) : a;
+    }
+    if (ch[c].cfg.write_incr) {
+        uintptr_t a = hw->write_addr + size;
+        hw->write_addr = (ring && ch[c].cfg.ring_write) ? (hw->write_addr & ~ring) | (a & ring) : a;
+    }
+    if (--hw->transfer_count == 0) {
+        ch[c].busy = false;
+        if (!ch[c].cfg.irq_quiet) {
+            sim_dma_hw.intr |= 1u << c;
+        }
+        if (ch[c].cfg.chain_to != c) {
+            dma_channel_start(ch[c].cfg.chain_to);
+        }
+    }
+}
+
+// Update the sniffer with a byte
+static void sniffByte (uint8_t b) {
+    switch (sniff.mode) {
+        case DMA_SNIFF_CTRL_CALC_VALUE_CRC32R:
+            b = reverse(b, 8);
+            // fall through
+        case DMA_SNIFF_CTRL_CALC_VALUE_CRC32:
+            sniff.data ^= (uint32_t) b << 24;
+            for (int i = 0; i < 8; i++) {
+                sniff.data = (sniff.data & 0x80000000) ? (sniff.data << 1) ^ 0x04C11DB7 : sniff.data << 1;
+            }
+            break;
+        case DMA_SNIFF_CTRL_CALC_VALUE_CRC16R:
+            b = reverse(b, 8);
+            // fall through
+        case DMA_SNIFF_CTRL_CALC_VALUE_CRC16:
+            sniff.data ^= (uint32_t) b << 8;
+            for (int i = 0; i < 8; i++) {
+                sniff.data = (sniff.data & 0x8000) ? (sniff.data << 1) ^ 0x1021 : sniff.data << 1;
+            }
+            sniff.data &= 0xFFFF;
+            break;
+        case DMA_SNIFF_CTRL_CALC_VALUE_EVEN:
+            sniff.data ^= __builtin_parity(b);
+            break;
+        case DMA_SNIFF_CTRL_CALC_VALUE_SUM:
+            sniff.data += b;
+            break;
+    }
+}
+
+static uint32_t reverse (uint32_t x, int bits) {
+    uint32_t r = 0;
+    for (int i = 0; i < bits; i++) {
+        r = (r << 1) | ((x >> i) & 1);
+    }
+    return r;
+}
+
+static double timerPeriod (uint t) {
+    if (timer[t].num == 0) {
+        return 0;
+    }
+    return 1e9 * timer[t].den / ((double) timer[t].num * clock_get_hz(clk_sys));
+}
+
+// Run the channels up to t_end
+void dmaRun (uint64_t t_end) {
+    bool again = true;
+    while (again) {     // a chained channel may have been started
+        again = false;
+        for (uint c = 0; c < NUM_DMA_CHANNELS; c++) {
+            if (!ch[c].busy || !ch[c].cfg.enable) {
+                continue;
+            }
+            uint dreq = ch[c].cfg.dreq;
+            if (dreq == DREQ_FORCE) {
+                while (ch[c].busy) {
+                    transfer(c);
+                }
+            } else if (dreq < DREQ_SPI0_TX) {
+                while (ch[c].busy && pioDreq(dreq)) {
+                    transfer(c);
+                }
+            } else if (dreq == DREQ_ADC) {
+                while (ch[c].busy && adcDreq(t_end)) {
+                    transfer(c);
+                }
+            } else if ((dreq >= DREQ_DMA_TIMER0) && (dreq <= DREQ_DMA_TIMER3)) {
+                double period = timerPeriod(dreq - DREQ_DMA_TIMER0);
+                if (period == 0) {
+                    continue;
+                }
+                if (ch[c].next < sim_now) {
+                    ch[c].next = sim_now;
+                }
+                while (ch[c].busy && (ch[c].next <= t_end)) {
+                    transfer(c);
+                    ch[c].next += period;
+                }
+            } else {
+                while (ch[c].busy) {    // DREQs not emulated
+                    transfer(c);
+                }
+            }
+            if (!ch[c].busy) {
+                again = true;
+            }
+        }
+    }
+}
+
+// Check for interrupts
+void dmaIrqCheck () {
+    sim_dma_hw.ints0 = sim_dma_hw.intr & sim_dma_hw.inte0;
+    sim_dma_hw.ints1 = sim_dma_hw.intr & sim_dma_hw.inte1;
+    if (sim_dma_hw.ints0) {
+        simIrq(DMA_IRQ_0);
+    }
+    if (sim_dma_hw.ints1) {
+        simIrq(DMA_IRQ_1);
+    }
+}
+
+
+// SDK API
+//---------------------------
+
+void dma_channel_claim (uint channel) {
+    ch[channel].claimed = true;
+}
+
+void dma_channel_unclaim (uint channel) {
+    ch[channel].claimed = false;
+}
+
+int dma_claim_unused_channel (bool required) {
+    for (uint c = 0; c < NUM_DMA_CHANNELS; c++) {
+        if (!ch[c].claimed) {
+            ch[c].claimed = true;
+            return c;
+        }
+    }
+    if (required) {
+        simError("no free DMA channel");
+    }
+    return -1;
+}
+
+bool dma_channel_is_claimed (uint channel) {
+    return ch[channel].claimed;
+}
+
+dma_channel_config dma_channel_get_default_config (uint channel) {
+    dma_channel_config c;
+    memset(&c, 0, sizeof(c));
+    c.read_incr = true;
+    c.size = DMA_SIZE_32;
+    c.dreq = DREQ_FORCE;
+    c.chain_to = channel;
+    c.enable = true;
+    return c;
+}
+
+void dma_channel_set_config (uint channel, const dma_channel_config *config, bool trigger) {
+    ch[channel].cfg = *config;
+    if (trigger) {
+        dma_channel_start(channel);
+    }
+}
+
+void dma_channel_set_read_addr (uint channel, const volatile void *read_addr, bool trigger) {
+    ch[channel].read_addr = (uintptr_t) read_addr;
+    sim_dma_hw.ch[channel].read_addr = (uintptr_t) read_addr;
+    if (trigger) {
+        dma_channel_start(channel);
+    }
+}
+
+void dma_channel_set_write_addr (uint channel, volatile void *write_addr, bool trigger) {
+    ch[channel].write_addr = (uintptr_t) write_addr;
+    sim_dma_hw.ch[channel].write_addr = (uintptr_t) write_addr;
+    if (trigger) {
+        dma_channel_start(channel);
+    }
+}
+
+void dma_channel_set_trans_count (uint channel, uint32_t trans_count, bool trigger) {
+    ch[channel].count = trans_count;
+    if (trigger) {
+        dma_channel_start(channel);
+    }
+}
+
+void dma_channel_configure (uint channel, const dma_channel_config *config, volatile void *write_addr,
+                            const volatile void *read_addr, uint transfer_count, bool trigger) {
+    dma_channel_set_read_addr(channel, read_addr, false);
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, false);
+    dma_channel_set_config(channel, config, trigger);
+}
+
+void dma_channel_transfer_from_buffer_now (uint channel, const volatile void *read_addr, uint32_t transfer_count) {
+    dma_channel_set_read_addr(channel, read_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, true);
+}
+
+void dma_channel_transfer_to_buffer_now (uint channel, volatile void *write_addr, uint32_t transfer_count) {
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, true);
+}
+
+void dma_channel_start (uint channel) {
+    // The read and write addresses continue from where they stopped
+    simActivity();
+    sim_dma_hw.ch[channel].transfer_count = ch[channel].count;
+    ch[channel].busy = ch[channel].count > 0;
+    ch[channel].next = sim_now;
+}
+
+void dma_start_channel_mask (uint32_t chan_mask) {
+    for (uint c = 0; c < NUM_DMA_CHANNELS; c++) {
+        if ((chan_mask >> c) & 1) {
+            dma_channel_start(c);
+        }
+    }
+}
+
+void dma_channel_abort (uint channel) {
+    ch[channel].busy = false;
+}
+
+bool dma_channel_is_busy (uint channel) {
+    simPoll();
+    return ch[channel].busy;
+}
+
+void dma_channel_wait_for_finish_blocking (uint channel) {
+    while (dma_channel_is_busy(channel)) {
+    }
+}
+
+void dma_channel_set_irq0_enabled (uint channel, bool enabled) {
+    if (enabled) {
+        sim_dma_hw.inte0 |= 1u << channel;
+    } else {
+        sim_dma_hw.inte0 &= ~(1u << channel);
+    }
+}
+
+void dma_channel_set_irq1_enabled (uint channel, bool enabled) {
+    if (enabled) {
+        sim_dma_hw.inte1 |= 1u << channel;
+    } else {
+        sim_dma_hw.inte1 &= ~(1u << channel);
+    }
+}
+
+bool dma_channel_get_irq0_status (uint channel) {
+    return (sim_dma_hw.intr & sim_dma_hw.inte0 & (1u << channel)) != 0;
+}
+
+bool dma_channel_get_irq1_status (uint channel) {
+    return (sim_dma_hw.intr & sim_dma_hw.inte1 & (1u << channel)) != 0;
+}
+
+void dma_channel_acknowledge_irq0 (uint channel) {
+    sim_dma_hw.intr &= ~(1u << channel);
+    sim_dma_hw.ints0 = sim_dma_hw.intr & sim_dma_hw.inte0;
+}
+
+void dma_channel_acknowledge_irq1 (uint channel) {
+    sim_dma_hw.intr &= ~(1u << channel);
+    sim_dma_hw.ints1 = sim_dma_hw.intr & sim_dma_hw.inte1;
+}
+
+void dma_timer_claim (uint t) {
+    timer[t].claimed = true;
+}
+
+void dma_timer_unclaim (uint t) {
+    timer[t].claimed = false;
+}
+
+int dma_claim_unused_timer (bool required) {
+    for (uint t = 0; t < NUM_DMA_TIMERS; t++) {
+        if (!timer[t].claimed) {
+            timer[t].claimed = true;
+            return t;
+        }
+    }
+    if (required) {
+        simError("no free DMA timer");
+    }
+    return -1;
+}
+
+void dma_timer_set_fraction (uint t, uint16_t numerator, uint16_t denominator) {
+    timer[t].num = numerator;
+    timer[t].den = denominator;
+}
+
+void dma_sniffer_enable (uint channel, uint mode, bool force_channel_enable) {
+    sniff.channel = channel;
+    sniff.mode = mode;
+    sniff.out_rev = false;
+    sniff.out_inv = false;
+    sniff.enable = true;
+    if (force_channel_enable) {
+        ch[channel].cfg.sniff = true;
+    }
+}
+
+void dma_sniffer_disable () {
+    sniff.enable = false;
+}
+
+void dma_sniffer_set_output_reverse_enabled (bool enable) {
+    sniff.out_rev = enable;
+}
+
+void dma_sniffer_set_output_invert_enabled (bool enable) {
+    sniff.out_inv = enable;
+}
+
+void dma_sniffer_set_data_accumulator (uint32_t seed_value) {
+    sniff.data = seed_value;
+}
+
+// The output transforms are applied when the accumulator is read
+uint32_t dma_sniffer_get_data_accumulator () {
+    uint32_t data = sniff.out_rev ? reverse(sniff.data, 32) : sniff.data;
+    return sniff.out_inv ? ~data : data;
+}
@@ -0,0 +1,319 @@
+/*
+    PicoK7Sim - GPIO and clocks
+
+    Pin levels come from the SIO, the PIOs or the "user" (script),
+    with the pulls as default. Level changes are passed to the
+    virtual display, the EAR waveform dump and the WS2812 decoder.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#define SIM_INTERNAL
+
+#include <stdlib.h>
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/pio.h"
+
+#include "picok7.h"
+#include "sim.h"
+
+#define WS2812_ONE_NS   600     // longer pulses are ones
+#define WS2812_RESET_NS 50000   // low time to restart
+#define PLL_LOCK_NS     100000  // time to reprogram a PLL
+
+static struct {
+    enum gpio_function fn;
+    bool sio_out, sio_oe;
+    bool pull_up, pull_down;
+    int ext;            // level driven from outside (-1 if none)
+    bool level;
+} pins[NUM_BANK0_GPIOS];
+
+static uint32_t pio_out[NUM_PIOS], pio_oe[NUM_PIOS];
+static uint32_t sys_khz = 125000;
+
+// EAR waveform
+static FILE *vcd;
+static uint ear_pin = PIN_EAR;
+static uint64_t vcd_last;
+
+// WS2812 decoder
+static uint64_t ws_rise, ws_fall;
+static uint32_t ws_bits;
+static int ws_nbits;
+static uint32_t ws_color;
+
+static void refresh (uint pin, uint64_t t);
+
+void gpioSimInit () {
+    for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++) {
+        pins[pin].fn = GPIO_FUNC_NULL;
+        pins[pin].pull_down = true;
+        pins[pin].ext = -1;
+    }
+}
+
+bool gpioLevel (uint pin) {
+    return (pin < NUM_BANK0_GPIOS) && pins[pin].level;
+}
+
+uint32_t gpioAll () {
+    uint32_t all = 0;
+    for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++) {
+        all |= (uint32_t) pins[pin].level << pin;
+    }
+    return all;
+}
+
+// Pin driven by the "user"
+void gpioExternal (uint pin, int level) {
+    pins[pin].ext = level;
+    refresh(pin, sim_now);
+}
+
+// Pin written by a PIO
+void gpioPioOut (uint pio, uint pin, bool value, uint64_t t) {
+    if (pin >= NUM_BANK0_GPIOS) {
+        return;
+    }
+    if (value) {
+        pio_out[pio] |= 1u << pin;
+    } else {
+        pio_out[pio] &= ~(1u << pin);
+    }
+    refresh(pin, t);
+}
+
+void gpioPioDir (uint pio, uint pin, bool out, uint64_t t) {
+    if (pin >= NUM_BANK0_GPIOS) {
+        return;
+    }
+    if (out) {
+        pio_oe[pio] |= 1u << pin;
+    } else {
+        pio_oe[pio] &= ~(1u << pin);
+    }
+    refresh(pin, t);
+}
+
+// Write the EAR level in the VCD file
+static void earChanged (bool level, uint64_t t) {
+    if (vcd != NULL) {
+        if (t < vcd_last) {
+            t = vcd_last;
+        }
+        fprintf(vcd, "#%llu\n%d!\n", (unsigned long long) t, level);
+        vcd_last = t;
+    }
+}
+
+// Decode the WS2812 pulses
+static void ws2812Changed (bool level, uint64_t t) {
+    if (level) {
+        if ((t - ws_fall) > WS2812_RESET_NS) {
+            ws_nbits = 0;
+        }
+        ws_rise = t;
+    } else {
+        ws_fall = t;
+        ws_bits = ((ws_bits << 1) | ((t - ws_rise) > WS2812_ONE_NS)) & 0xFFFFFF;
+        if (++ws_nbits == 24) {
+            if (sim_verbose && ((ws_bits << 8) != ws_color)) {
+                simLog("LED R=%u G=%u B=%u", (ws_bits >> 8) & 0xFF, ws_bits >> 16, ws_bits & 0xFF);
+            }
+            ws_color = ws_bits << 8;
+            ws_nbits = 0;
+        }
+    }
+}
+
+// Last color sent to the LED (in the urgb_u32 format)
+uint32_t ledColor () {
+    return ws_color;
+}
+
+// Recalculate the level of a pin
+static void refresh (uint pin, uint64_t t) {
+    bool level;
+    uint pio = pins[pin].fn == GPIO_FUNC_PIO1 ? 1 : 0;
+
+    if ((pins[pin].fn == GPIO_FUNC_SIO) && pins[pin].sio_oe) {
+        level = pins[pin].sio_out;
+    } else if (((pins[pin].fn == GPIO_FUNC_PIO0) || (pins[pin].fn == GPIO_FUNC_PIO1)) &&
+               ((pio_oe[pio] >> pin) & 1)) {
+        level = (pio_out[pio] >> pin) & 1;
+    } else if (pins[pin].ext >= 0) {
+        level = pins[pin].ext;
+    } else if (pins[pin].pull_up || pins[pin].pull_down) {
+        level = pins[pin].pull_up;
+    } else {
+        level = pins[pin].level;    // floating
+    }
+    if (level != pins[pin].level) {
+        pins[pin].level = level;
+        if (pin == ear_pin) {
+            earChanged(level, t);
+        } else if (pin == PIN_WS2812) {
+            ws2812Changed(level, t);
+        }
+        lcdPinChanged(pin, level);
+    }
+}
+
+// EAR waveform dump (pin is the output to record)
+void earOpen (const char *file, uint pin) {
+    ear_pin = pin;
+    vcd = fopen(file, "w");
+    if (vcd == NULL) {
+        perror(file);
+        exit(1);
+    }
+    fprintf(vcd, "$timescale 1ns $end\n");
+    fprintf(vcd, "$scope module picok7 $end\n$var wire 1 ! EAR $end\n$upscope $end\n");
+    fprintf(vcd, "$enddefinitions $end\n#0\n%d!\n", pins[ear_pin].level);
+}
+
+void earClose () {
+    if (vcd != NULL) {
+        fprintf(vcd, "#%llu\n", (unsigned long long) sim_now);
+        fclose(vcd);
+        vcd = NULL;
+    }
+}
+
+
+// SDK API
+//---------------------------
+
+void gpio_init (uint gpio) {
+    pins[gpio].sio_oe = false;
+    pins[gpio].sio_out = false;
+    gpio_set_function(gpio, GPIO_FUNC_SIO);
+}
+
+void gpio_set_function (uint gpio, enum gpio_function fn) {
+    pins[gpio].fn = fn;
+    refresh(gpio, sim_now);
+}
+
+void gpio_set_dir (uint gpio, bool out) {
+    pins[gpio].sio_oe = out;
+    refresh(gpio, sim_now);
+}
+
+void gpio_put (uint gpio, bool value) {
+    simActivity();
+    pins[gpio].sio_out = value;
+    refresh(gpio, sim_now);
+}
+
+bool gpio_get (uint gpio) {
+    simPoll();
+    return pins[gpio].level;
+}
+
+uint32_t gpio_get_all () {
+    simPoll();
+    return gpioAll();
+}
+
+void gpio_pull_up (uint gpio) {
+    pins[gpio].pull_up = true;
+    pins[gpio].pull_down = false;
+    refresh(gpio, sim_now);
+}
+
+void gpio_pull_down (uint gpio) {
+    pins[gpio].pull_up = false;
+    pins[gpio].pull_down = true;
+    refresh(gpio, sim_now);
+}
+
+void gpio_disable_pulls (uint gpio) {
+    pins[gpio].pull_up = false;
+    pins[gpio].pull_down = false;
+    refresh(gpio, sim_now);
+}
+
+uint32_t clock_get_hz (enum clock_index clk_index) {
+    switch (clk_index) {
+        case clk_sys:
+        case clk_peri:
+            return sys_khz * 1000;
+        case clk_ref:
+            return 12000000;
+        case clk_rtc:
+            return 46875;
+        default:
+            return 48000000;
+    }
+}
+
+// Same search as the SDK: VCO from 750 to 1600 MHz, post dividers 1 to 7
+bool check_sys_clock_khz (uint32_t freq_khz, uint *vco_freq_out, uint *post_div1_out, uint *post_div2_out) {
+    for (uint fbdiv = 320; fbdiv >= 16; fbdiv--) {
+        uint vco = fbdiv * 12000;
+        if ((vco < 750000) || (vco > 1600000)) {
+            continue;
+        }
+        for (uint pd1 = 7; pd1 >= 1; pd1--) {
+            for (uint pd2 = pd1; pd2 >= 1; pd2--) {
+                if ((vco / (pd1 * pd2)) == freq_khz && (vco % (pd1 * pd2)) == 0) {
+                    *vco_freq_out = vco * 1000;
+                    *post_div1_out = pd1;
+                    *post_div2_out = pd2;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Only clk_sys matters, clk_peri always follows it
+bool clock_configure (enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t freq) {
+    (void) src;
+    (void) auxsrc;
+    if ((freq == 0) || (freq > src_freq)) {
+        return false;
+    }
+    if (clk_index == clk_sys) {
+        sys_khz = freq / 1000;
+        pioClockChanged();
+    }
+    return true;
+}
+
+pll_hw_t sim_pll[2] = { { 0 }, { 1 } };
+
+// Reprogramming a PLL takes the lock time
+void pll_init (PLL pll, uint ref_div, uint vco_freq, uint post_div1, uint post_div2) {
+    (void) pll;
+    (void) ref_div;
+    (void) vco_freq;
+    (void) post_div1;
+    (void) post_div2;
+    simAdvance(PLL_LOCK_NS, PRF_SLEEP);
+}
+
+void pll_deinit (PLL pll) {
+    (void) pll;
+}
+
+bool set_sys_clock_khz (uint32_t freq_khz, bool required) {
+    uint vco, pd1, pd2;
+    if (!check_sys_clock_khz(freq_khz, &vco, &pd1, &pd2)) {
+        if (required) {
+            simError("cannot set clk_sys to %u kHz", freq_khz);
+        }
+        return false;
+    }
+    sys_khz = freq_khz;
+    pioClockChanged();
+    return true;
+}
@@ -0,0 +1,12 @@
+/*
+    SD card library shim for the simulation build
+*/
+
+#ifndef _SIM_F_UTIL_H
+#define _SIM_F_UTIL_H
+
+#include "ff.h"
+
+const char *FRESULT_str (FRESULT i);
+
+#endif
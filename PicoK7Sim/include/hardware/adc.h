@@ -0,0 +1,28 @@
+/*
+    Pico SDK shim for the simulation build - ADC
+    Input 0 plays the WAV file given with -a, the others read midscale
+*/
+
+#ifndef _SIM_HARDWARE_ADC_H
+#define _SIM_HARDWARE_ADC_H
+
+#include "pico.h"
+
+// Registers the firmware may read
+typedef struct {
+    volatile uint32_t fifo;
+} adc_hw_t;
+
+extern adc_hw_t sim_adc_hw;
+#define adc_hw (&sim_adc_hw)
+
+void adc_init (void);
+void adc_gpio_init (uint gpio);
+void adc_select_input (uint input);
+void adc_set_clkdiv (float clkdiv);
+void adc_fifo_setup (bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_run (bool run);
+void adc_fifo_drain (void);
+uint16_t adc_read (void);
+
+#endif
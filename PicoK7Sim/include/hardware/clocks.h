@@ -0,0 +1,38 @@
+/*
+    Pico SDK shim for the simulation build - clocks
+*/
+
+#ifndef _SIM_HARDWARE_CLOCKS_H
+#define _SIM_HARDWARE_CLOCKS_H
+
+#include "pico.h"
+
+enum clock_index {
+    clk_gpout0 = 0,
+    clk_gpout1,
+    clk_gpout2,
+    clk_gpout3,
+    clk_ref,
+    clk_sys,
+    clk_peri,
+    clk_usb,
+    clk_adc,
+    clk_rtc,
+    CLK_COUNT
+};
+
+#define USB_CLK_KHZ 48000
+
+// Clock sources (only the ones used with clk_sys and clk_peri)
+#define CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF            0x0
+#define CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX 0x1
+#define CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS  0x0
+#define CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB  0x1
+#define CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS        0x0
+
+uint32_t clock_get_hz (enum clock_index clk_index);
+bool clock_configure (enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t freq);
+bool set_sys_clock_khz (uint32_t freq_khz, bool required);
+bool check_sys_clock_khz (uint32_t freq_khz, uint *vco_freq_out, uint *post_div1_out, uint *post_div2_out);
+
+#endif
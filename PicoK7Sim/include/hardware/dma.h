@@ -0,0 +1,149 @@
+/*
+    Pico SDK shim for the simulation build - DMA
+    Transfers are paced by the DREQs of the PIO FIFOs and the DMA timers
+    The sniffer calculates the CRCs, parity and sum of the bytes moved
+*/
+
+#ifndef _SIM_HARDWARE_DMA_H
+#define _SIM_HARDWARE_DMA_H
+
+#include "pico.h"
+
+#define NUM_DMA_CHANNELS 12
+#define NUM_DMA_TIMERS 4
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+enum dreq_num_rp2040 {
+    DREQ_PIO0_TX0 = 0, DREQ_PIO0_TX1, DREQ_PIO0_TX2, DREQ_PIO0_TX3,
+    DREQ_PIO0_RX0, DREQ_PIO0_RX1, DREQ_PIO0_RX2, DREQ_PIO0_RX3,
+    DREQ_PIO1_TX0, DREQ_PIO1_TX1, DREQ_PIO1_TX2, DREQ_PIO1_TX3,
+    DREQ_PIO1_RX0, DREQ_PIO1_RX1, DREQ_PIO1_RX2, DREQ_PIO1_RX3,
+    DREQ_SPI0_TX, DREQ_SPI0_RX, DREQ_SPI1_TX, DREQ_SPI1_RX,
+    DREQ_ADC = 36,
+    DREQ_DMA_TIMER0 = 0x3b, DREQ_DMA_TIMER1, DREQ_DMA_TIMER2, DREQ_DMA_TIMER3,
+    DREQ_FORCE = 0x3f
+};
+
+#define DMA_SNIFF_CTRL_CALC_VALUE_CRC32   0x0
+#define DMA_SNIFF_CTRL_CALC_VALUE_CRC32R  0x1
+#define DMA_SNIFF_CTRL_CALC_VALUE_CRC16   0x2
+#define DMA_SNIFF_CTRL_CALC_VALUE_CRC16R  0x3
+#define DMA_SNIFF_CTRL_CALC_VALUE_EVEN    0xe
+#define DMA_SNIFF_CTRL_CALC_VALUE_SUM     0xf
+
+typedef struct {
+    bool read_incr, write_incr;
+    enum dma_channel_transfer_size size;
+    uint dreq;
+    uint chain_to;
+    bool ring_write;
+    uint ring_bits;
+    bool irq_quiet;
+    bool enable;
+    bool sniff;
+    bool bswap;
+} dma_channel_config;
+
+// Registers the firmware may read
+typedef struct {
+    volatile uintptr_t read_addr;
+    volatile uintptr_t write_addr;
+    volatile uint32_t transfer_count;
+} dma_channel_hw_t;
+
+typedef struct {
+    dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+    volatile uint32_t intr;
+    volatile uint32_t inte0;
+    volatile uint32_t ints0;
+    volatile uint32_t inte1;
+    volatile uint32_t ints1;
+} dma_hw_t;
+
+extern dma_hw_t sim_dma_hw;
+#define dma_hw (&sim_dma_hw)
+
+static inline dma_channel_hw_t *dma_channel_hw_addr (uint channel) {
+    return &sim_dma_hw.ch[channel];
+}
+
+void dma_channel_claim (uint channel);
+void dma_channel_unclaim (uint channel);
+int dma_claim_unused_channel (bool required);
+bool dma_channel_is_claimed (uint channel);
+
+dma_channel_config dma_channel_get_default_config (uint channel);
+static inline void channel_config_set_read_increment (dma_channel_config *c, bool incr) {
+    c->read_incr = incr;
+}
+static inline void channel_config_set_write_increment (dma_channel_config *c, bool incr) {
+    c->write_incr = incr;
+}
+static inline void channel_config_set_dreq (dma_channel_config *c, uint dreq) {
+    c->dreq = dreq;
+}
+static inline void channel_config_set_chain_to (dma_channel_config *c, uint chain_to) {
+    c->chain_to = chain_to;
+}
+static inline void channel_config_set_transfer_data_size (dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->size = size;
+}
+static inline void channel_config_set_ring (dma_channel_config *c, bool write, uint size_bits) {
+    c->ring_write = write;
+    c->ring_bits = size_bits;
+}
+static inline void channel_config_set_bswap (dma_channel_config *c, bool bswap) {
+    c->bswap = bswap;
+}
+static inline void channel_config_set_irq_quiet (dma_channel_config *c, bool irq_quiet) {
+    c->irq_quiet = irq_quiet;
+}
+static inline void channel_config_set_enable (dma_channel_config *c, bool enable) {
+    c->enable = enable;
+}
+static inline void channel_config_set_sniff_enable (dma_channel_config *c, bool sniff_enable) {
+    c->sniff = sniff_enable;
+}
+
+void dma_channel_set_config (uint channel, const dma_channel_config *config, bool trigger);
+void dma_channel_set_read_addr (uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_set_write_addr (uint channel, volatile void *write_addr, bool trigger);
+void dma_channel_set_trans_count (uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_configure (uint channel, const dma_channel_config *config, volatile void *write_addr,
+                            const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_transfer_from_buffer_now (uint channel, const volatile void *read_addr, uint32_t transfer_count);
+void dma_channel_transfer_to_buffer_now (uint channel, volatile void *write_addr, uint32_t transfer_count);
+void dma_channel_start (uint channel);
+void dma_start_channel_mask (uint32_t chan_mask);
+void dma_channel_abort (uint channel);
+bool dma_channel_is_busy (uint channel);
+void dma_channel_wait_for_finish_blocking (uint channel);
+
+void dma_channel_set_irq0_enabled (uint channel, bool enabled);
+void dma_channel_set_irq1_enabled (uint channel, bool enabled);
+bool dma_channel_get_irq0_status (uint channel);
+bool dma_channel_get_irq1_status (uint channel);
+void dma_channel_acknowledge_irq0 (uint channel);
+void dma_channel_acknowledge_irq1 (uint channel);
+
+void dma_timer_claim (uint timer);
+void dma_timer_unclaim (uint timer);
+int dma_claim_unused_timer (bool required);
+void dma_timer_set_fraction (uint timer, uint16_t numerator, uint16_t denominator);
+static inline uint dma_get_timer_dreq (uint timer_num) {
+    return DREQ_DMA_TIMER0 + timer_num;
+}
+
+void dma_sniffer_enable (uint channel, uint mode, bool force_channel_enable);
+void dma_sniffer_disable (void);
+void dma_sniffer_set_output_reverse_enabled (bool enable);
+void dma_sniffer_set_output_invert_enabled (bool enable);
+void dma_sniffer_set_data_accumulator (uint32_t seed_value);
+uint32_t dma_sniffer_get_data_accumulator (void);
+
+#endif
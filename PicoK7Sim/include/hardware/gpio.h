@@ -0,0 +1,39 @@
+/*
+    Pico SDK shim for the simulation build - GPIO
+*/
+
+#ifndef _SIM_HARDWARE_GPIO_H
+#define _SIM_HARDWARE_GPIO_H
+
+#include "pico.h"
+
+#define NUM_BANK0_GPIOS 30
+
+#define GPIO_OUT 1
+#define GPIO_IN  0
+
+enum gpio_function {
+    GPIO_FUNC_XIP = 0,
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_UART = 2,
+    GPIO_FUNC_I2C = 3,
+    GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_PIO0 = 6,
+    GPIO_FUNC_PIO1 = 7,
+    GPIO_FUNC_GPCK = 8,
+    GPIO_FUNC_USB = 9,
+    GPIO_FUNC_NULL = 0x1f,
+};
+
+void gpio_init (uint gpio);
+void gpio_set_function (uint gpio, enum gpio_function fn);
+void gpio_set_dir (uint gpio, bool out);
+void gpio_put (uint gpio, bool value);
+bool gpio_get (uint gpio);
+uint32_t gpio_get_all (void);
+void gpio_pull_up (uint gpio);
+void gpio_pull_down (uint gpio);
+void gpio_disable_pulls (uint gpio);
+
+#endif
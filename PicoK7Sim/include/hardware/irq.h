@@ -0,0 +1,34 @@
+/*
+    Pico SDK shim for the simulation build - interrupts
+*/
+
+#ifndef _SIM_HARDWARE_IRQ_H
+#define _SIM_HARDWARE_IRQ_H
+
+#include "pico.h"
+
+typedef void (*irq_handler_t) (void);
+
+enum irq_num {
+    TIMER_IRQ_0 = 0, TIMER_IRQ_1, TIMER_IRQ_2, TIMER_IRQ_3,
+    PWM_IRQ_WRAP, USBCTRL_IRQ, XIP_IRQ,
+    PIO0_IRQ_0, PIO0_IRQ_1, PIO1_IRQ_0, PIO1_IRQ_1,
+    DMA_IRQ_0, DMA_IRQ_1,
+    IO_IRQ_BANK0, IO_IRQ_QSPI,
+    SIO_IRQ_PROC0, SIO_IRQ_PROC1,
+    CLOCKS_IRQ, SPI0_IRQ, SPI1_IRQ, UART0_IRQ, UART1_IRQ,
+    ADC_IRQ_FIFO, I2C0_IRQ, I2C1_IRQ, RTC_IRQ,
+    NUM_IRQS = 32
+};
+
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+#define PICO_DEFAULT_IRQ_PRIORITY 0x80
+
+void irq_set_enabled (uint num, bool enabled);
+bool irq_is_enabled (uint num);
+void irq_set_exclusive_handler (uint num, irq_handler_t handler);
+void irq_add_shared_handler (uint num, irq_handler_t handler, uint8_t order_priority);
+void irq_remove_handler (uint num, irq_handler_t handler);
+void irq_set_priority (uint num, uint8_t hardware_priority);
+
+#endif
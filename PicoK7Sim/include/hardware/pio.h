@@ -0,0 +1,246 @@
+/*
+    Pico SDK shim for the simulation build - PIO
+    The state machines are emulated instruction by instruction
+    (see pio.c), the generated .pio.h headers come from pioasm.c
+*/
+
+#ifndef _SIM_HARDWARE_PIO_H
+#define _SIM_HARDWARE_PIO_H
+
+#include "pico.h"
+#include "hardware/gpio.h"
+
+#define NUM_PIOS 2
+#define NUM_PIO_STATE_MACHINES 4
+#define PIO_INSTRUCTION_COUNT 32
+
+// The registers the firmware accesses directly
+typedef struct {
+    volatile uint32_t txf[NUM_PIO_STATE_MACHINES];
+    volatile uint32_t rxf[NUM_PIO_STATE_MACHINES];
+    volatile uint32_t intr;
+    volatile uint32_t inte0;
+    volatile uint32_t intf0;
+    volatile uint32_t ints0;
+    volatile uint32_t inte1;
+    volatile uint32_t intf1;
+    volatile uint32_t ints1;
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t sim_pio_hw[NUM_PIOS];
+#define pio0 (&sim_pio_hw[0])
+#define pio1 (&sim_pio_hw[1])
+
+#define PIO_INTR_SM0_RXNEMPTY_LSB 0
+#define PIO_INTR_SM0_TXNFULL_LSB  4
+#define PIO_INTR_SM0_LSB          8
+#define PIO_IRQ0_INTE_SM0_RXNEMPTY_BITS 0x001u
+#define PIO_IRQ0_INTE_SM0_TXNFULL_BITS  0x010u
+#define PIO_IRQ0_INTE_SM0_BITS          0x100u
+#define PIO_IRQ0_INTS_SM0_RXNEMPTY_BITS 0x001u
+#define PIO_IRQ0_INTS_SM0_TXNFULL_BITS  0x010u
+#define PIO_IRQ0_INTS_SM0_BITS          0x100u
+#define PIO_IRQ1_INTE_SM0_RXNEMPTY_BITS 0x001u
+#define PIO_IRQ1_INTE_SM0_TXNFULL_BITS  0x010u
+#define PIO_IRQ1_INTE_SM0_BITS          0x100u
+#define PIO_IRQ1_INTS_SM0_RXNEMPTY_BITS 0x001u
+#define PIO_IRQ1_INTS_SM0_TXNFULL_BITS  0x010u
+#define PIO_IRQ1_INTS_SM0_BITS          0x100u
+
+typedef struct pio_program {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+enum pio_fifo_join {
+    PIO_FIFO_JOIN_NONE = 0,
+    PIO_FIFO_JOIN_TX = 1,
+    PIO_FIFO_JOIN_RX = 2,
+};
+
+enum pio_mov_status_type {
+    STATUS_TX_LESSTHAN = 0,
+    STATUS_RX_LESSTHAN = 1
+};
+
+// State machine configuration (fields instead of register bits)
+typedef struct {
+    float clkdiv;
+    uint wrap_target, wrap;
+    uint sideset_bits;
+    bool sideset_opt, sideset_pindirs;
+    uint sideset_base;
+    uint out_base, out_count;
+    uint set_base, set_count;
+    uint in_base;
+    uint jmp_pin;
+    bool out_right, autopull;
+    uint pull_thresh;
+    bool in_right, autopush;
+    uint push_thresh;
+    enum pio_fifo_join join;
+    bool out_sticky;
+    enum pio_mov_status_type status_sel;
+    uint status_n;
+} pio_sm_config;
+
+pio_sm_config pio_get_default_sm_config (void);
+static inline void sm_config_set_wrap (pio_sm_config *c, uint wrap_target, uint wrap) {
+    c->wrap_target = wrap_target;
+    c->wrap = wrap;
+}
+static inline void sm_config_set_sideset (pio_sm_config *c, uint bit_count, bool optional, bool pindirs) {
+    c->sideset_bits = bit_count;
+    c->sideset_opt = optional;
+    c->sideset_pindirs = pindirs;
+}
+static inline void sm_config_set_sideset_pins (pio_sm_config *c, uint sideset_base) {
+    c->sideset_base = sideset_base;
+}
+static inline void sm_config_set_out_pins (pio_sm_config *c, uint out_base, uint out_count) {
+    c->out_base = out_base;
+    c->out_count = out_count;
+}
+static inline void sm_config_set_set_pins (pio_sm_config *c, uint set_base, uint set_count) {
+    c->set_base = set_base;
+    c->set_count = set_count;
+}
+static inline void sm_config_set_in_pins (pio_sm_config *c, uint in_base) {
+    c->in_base = in_base;
+}
+static inline void sm_config_set_jmp_pin (pio_sm_config *c, uint pin) {
+    c->jmp_pin = pin;
+}
+static inline void sm_config_set_out_shift (pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold) {
+    c->out_right = shift_right;
+    c->autopull = autopull;
+    c->pull_thresh = pull_threshold ? pull_threshold : 32;
+}
+static inline void sm_config_set_in_shift (pio_sm_config *c, bool shift_right, bool autopush, uint push_threshold) {
+    c->in_right = shift_right;
+    c->autopush = autopush;
+    c->push_thresh = push_threshold ? push_threshold : 32;
+}
+static inline void sm_config_set_fifo_join (pio_sm_config *c, enum pio_fifo_join join) {
+    c->join = join;
+}
+static inline void sm_config_set_clkdiv (pio_sm_config *c, float div) {
+    c->clkdiv = div;
+}
+static inline void sm_config_set_clkdiv_int_frac (pio_sm_config *c, uint16_t div_int, uint8_t div_frac) {
+    c->clkdiv = div_int + div_frac / 256.0f;
+}
+static inline void sm_config_set_out_special (pio_sm_config *c, bool sticky, bool has_enable_pin, uint enable_pin_index) {
+    (void) has_enable_pin;
+    (void) enable_pin_index;
+    c->out_sticky = sticky;
+}
+static inline void sm_config_set_mov_status (pio_sm_config *c, enum pio_mov_status_type status_sel, uint status_n) {
+    c->status_sel = status_sel;
+    c->status_n = status_n;
+}
+
+static inline uint pio_get_index (PIO pio) {
+    return pio == pio1 ? 1 : 0;
+}
+static inline PIO pio_get_instance (uint instance) {
+    return instance ? pio1 : pio0;
+}
+uint pio_get_dreq (PIO pio, uint sm, bool is_tx);
+
+bool pio_can_add_program (PIO pio, const pio_program_t *program);
+int pio_add_program (PIO pio, const pio_program_t *program);
+void pio_remove_program (PIO pio, const pio_program_t *program, uint loaded_offset);
+void pio_clear_instruction_memory (PIO pio);
+
+void pio_sm_claim (PIO pio, uint sm);
+void pio_sm_unclaim (PIO pio, uint sm);
+int pio_claim_unused_sm (PIO pio, bool required);
+bool pio_sm_is_claimed (PIO pio, uint sm);
+
+void pio_gpio_init (PIO pio, uint pin);
+int pio_sm_set_consecutive_pindirs (PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+void pio_sm_set_pins (PIO pio, uint sm, uint32_t pin_values);
+void pio_sm_set_pins_with_mask (PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask);
+void pio_sm_set_pindirs_with_mask (PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask);
+
+int pio_sm_init (PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+void pio_sm_set_config (PIO pio, uint sm, const pio_sm_config *config);
+void pio_sm_set_enabled (PIO pio, uint sm, bool enabled);
+void pio_set_sm_mask_enabled (PIO pio, uint32_t mask, bool enabled);
+void pio_enable_sm_mask_in_sync (PIO pio, uint32_t mask);
+void pio_sm_restart (PIO pio, uint sm);
+void pio_sm_clkdiv_restart (PIO pio, uint sm);
+void pio_clkdiv_restart_sm_mask (PIO pio, uint32_t mask);
+void pio_sm_set_clkdiv (PIO pio, uint sm, float div);
+void pio_sm_set_clkdiv_int_frac (PIO pio, uint sm, uint16_t div_int, uint8_t div_frac);
+void pio_sm_exec (PIO pio, uint sm, uint instr);
+void pio_sm_exec_wait_blocking (PIO pio, uint sm, uint instr);
+uint8_t pio_sm_get_pc (PIO pio, uint sm);
+
+void pio_sm_put (PIO pio, uint sm, uint32_t data);
+void pio_sm_put_blocking (PIO pio, uint sm, uint32_t data);
+uint32_t pio_sm_get (PIO pio, uint sm);
+uint32_t pio_sm_get_blocking (PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_full (PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_empty (PIO pio, uint sm);
+uint pio_sm_get_tx_fifo_level (PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_full (PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_empty (PIO pio, uint sm);
+uint pio_sm_get_rx_fifo_level (PIO pio, uint sm);
+void pio_sm_clear_fifos (PIO pio, uint sm);
+void pio_sm_drain_tx_fifo (PIO pio, uint sm);
+
+bool pio_interrupt_get (PIO pio, uint irq_num);
+void pio_interrupt_clear (PIO pio, uint irq_num);
+
+// Instruction encoding
+enum pio_src_dest {
+    pio_pins = 0u,
+    pio_x = 1u,
+    pio_y = 2u,
+    pio_null = 3u,
+    pio_pindirs = 4u,
+    pio_exec_mov = 4u | 0x10u,
+    pio_status = 5u,
+    pio_pc = 5u | 0x10u,
+    pio_isr = 6u,
+    pio_osr = 7u,
+    pio_exec_out = 7u | 0x10u,
+};
+
+static inline uint pio_encode_delay (uint cycles) { return cycles << 8; }
+static inline uint pio_encode_sideset (uint sideset_bit_count, uint value) {
+    return value << (13 - sideset_bit_count);
+}
+static inline uint pio_encode_sideset_opt (uint sideset_bit_count, uint value) {
+    return 0x1000u | (value << (12 - sideset_bit_count));
+}
+static inline uint pio_encode_jmp (uint addr) { return 0x0000u | addr; }
+static inline uint pio_encode_set (enum pio_src_dest dest, uint value) {
+    return 0xE000u | ((dest & 7u) << 5) | value;
+}
+static inline uint pio_encode_mov (enum pio_src_dest dest, enum pio_src_dest src) {
+    return 0xA000u | ((dest & 7u) << 5) | (src & 7u);
+}
+static inline uint pio_encode_out (enum pio_src_dest dest, uint count) {
+    return 0x6000u | ((dest & 7u) << 5) | (count & 0x1Fu);
+}
+static inline uint pio_encode_in (enum pio_src_dest src, uint count) {
+    return 0x4000u | ((src & 7u) << 5) | (count & 0x1Fu);
+}
+static inline uint pio_encode_pull (bool if_empty, bool block) {
+    return 0x8080u | (if_empty ? 0x40u : 0) | (block ? 0x20u : 0);
+}
+static inline uint pio_encode_push (bool if_full, bool block) {
+    return 0x8000u | (if_full ? 0x40u : 0) | (block ? 0x20u : 0);
+}
+static inline uint pio_encode_nop (void) { return 0xA042u; }
+
+static inline void hw_set_bits (volatile uint32_t *addr, uint32_t mask) { *addr |= mask; }
+static inline void hw_clear_bits (volatile uint32_t *addr, uint32_t mask) { *addr &= ~mask; }
+
+#endif
@@ -0,0 +1,23 @@
+/*
+    Pico SDK shim for the simulation build - PLLs
+*/
+
+#ifndef _SIM_HARDWARE_PLL_H
+#define _SIM_HARDWARE_PLL_H
+
+#include "pico.h"
+
+typedef struct {
+    int index;
+} pll_hw_t;
+
+typedef pll_hw_t *PLL;
+
+extern pll_hw_t sim_pll[2];
+#define pll_sys (&sim_pll[0])
+#define pll_usb (&sim_pll[1])
+
+void pll_init (PLL pll, uint ref_div, uint vco_freq, uint post_div1, uint post_div2);
+void pll_deinit (PLL pll);
+
+#endif
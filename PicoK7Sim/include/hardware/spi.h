@@ -0,0 +1,31 @@
+/*
+    Pico SDK shim for the simulation build - SPI
+    spi1 is connected to the virtual ST7565R display
+*/
+
+#ifndef _SIM_HARDWARE_SPI_H
+#define _SIM_HARDWARE_SPI_H
+
+#include "pico.h"
+
+typedef struct spi_inst {
+    int index;
+    uint32_t div;       // clk_peri / baud rate
+} spi_inst_t;
+
+extern spi_inst_t sim_spi[2];
+#define spi0 (&sim_spi[0])
+#define spi1 (&sim_spi[1])
+
+typedef enum { SPI_CPHA_0 = 0, SPI_CPHA_1 = 1 } spi_cpha_t;
+typedef enum { SPI_CPOL_0 = 0, SPI_CPOL_1 = 1 } spi_cpol_t;
+typedef enum { SPI_LSB_FIRST = 0, SPI_MSB_FIRST = 1 } spi_order_t;
+
+uint spi_init (spi_inst_t *spi, uint baudrate);
+void spi_deinit (spi_inst_t *spi);
+uint spi_set_baudrate (spi_inst_t *spi, uint baudrate);
+uint spi_get_baudrate (const spi_inst_t *spi);
+void spi_set_format (spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order);
+int spi_write_blocking (spi_inst_t *spi, const uint8_t *src, size_t len);
+
+#endif
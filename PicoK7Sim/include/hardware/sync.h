@@ -0,0 +1,17 @@
+/*
+    Pico SDK shim for the simulation build - interrupt masking
+*/
+
+#ifndef _SIM_HARDWARE_SYNC_H
+#define _SIM_HARDWARE_SYNC_H
+
+#include "pico.h"
+
+uint32_t save_and_disable_interrupts (void);
+void restore_interrupts (uint32_t status);
+
+static inline void __dmb (void) {
+    __sync_synchronize();
+}
+
+#endif
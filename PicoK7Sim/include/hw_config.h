@@ -0,0 +1,10 @@
+/*
+    SD card library shim for the simulation build
+*/
+
+#ifndef _SIM_HW_CONFIG_H
+#define _SIM_HW_CONFIG_H
+
+#include "sd_card.h"
+
+#endif
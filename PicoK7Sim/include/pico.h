@@ -0,0 +1,38 @@
+/*
+    Pico SDK shim for the simulation build - basic types
+*/
+
+#ifndef _SIM_PICO_H
+#define _SIM_PICO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef unsigned int uint;
+
+#define __not_in_flash_func(f) f
+#define __time_critical_func(f) f
+#define __no_inline_not_in_flash_func(f) f
+#define __scratch_x(s)
+#define __scratch_y(s)
+#define __uninitialized_ram(v) v
+#define count_of(a) (sizeof(a)/sizeof((a)[0]))
+#define hard_assert(x) ((void)(x))
+#define valid_params_if(x, test) ((void)0)
+
+#define PICO_ERROR_NONE     0
+#define PICO_ERROR_TIMEOUT  (-1)
+#define PICO_ERROR_GENERIC  (-2)
+
+#define PICO_DEFAULT_LED_PIN 25
+
+static inline void tight_loop_contents (void) {}
+
+// The simulation has a single core
+static inline uint get_core_num (void) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,24 @@
+/*
+    Pico SDK shim for the simulation build - stdio over "USB"
+    Output goes to the terminal or to the pseudo terminal (-p option)
+*/
+
+#ifndef _SIM_PICO_STDIO_H
+#define _SIM_PICO_STDIO_H
+
+#include <stdio.h>
+#include "pico.h"
+
+bool stdio_init_all (void);
+bool stdio_usb_connected (void);
+void stdio_flush (void);
+int getchar_timeout_us (uint32_t timeout_us);
+int putchar_raw (int c);
+int puts_raw (const char *s);
+int sim_printf (const char *fmt, ...);
+
+#ifndef SIM_INTERNAL
+#define printf sim_printf
+#endif
+
+#endif
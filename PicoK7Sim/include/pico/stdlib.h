@@ -0,0 +1,13 @@
+/*
+    Pico SDK shim for the simulation build
+*/
+
+#ifndef _SIM_PICO_STDLIB_H
+#define _SIM_PICO_STDLIB_H
+
+#include "pico.h"
+#include "pico/time.h"
+#include "pico/stdio.h"
+#include "hardware/gpio.h"
+
+#endif
@@ -0,0 +1,70 @@
+/*
+    Pico SDK shim for the simulation build - time, timers and alarms
+    Time is virtual: it only advances when the firmware calls the shim
+*/
+
+#ifndef _SIM_PICO_TIME_H
+#define _SIM_PICO_TIME_H
+
+#include "pico.h"
+
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+typedef struct alarm_pool alarm_pool_t;
+
+struct repeating_timer;
+typedef bool (*repeating_timer_callback_t) (struct repeating_timer *rt);
+typedef int64_t (*alarm_callback_t) (alarm_id_t id, void *user_data);
+
+struct repeating_timer {
+    int64_t delay_us;
+    alarm_pool_t *pool;
+    alarm_id_t alarm_id;
+    repeating_timer_callback_t callback;
+    void *user_data;
+};
+
+uint64_t time_us_64 (void);
+uint32_t time_us_32 (void);
+
+static inline absolute_time_t get_absolute_time (void) { return time_us_64(); }
+static inline uint64_t to_us_since_boot (absolute_time_t t) { return t; }
+static inline uint32_t to_ms_since_boot (absolute_time_t t) { return (uint32_t) (t / 1000); }
+static inline absolute_time_t delayed_by_us (absolute_time_t t, uint64_t us) { return t + us; }
+static inline absolute_time_t delayed_by_ms (absolute_time_t t, uint32_t ms) { return t + ms * 1000ull; }
+static inline absolute_time_t make_timeout_time_us (uint64_t us) { return time_us_64() + us; }
+static inline absolute_time_t make_timeout_time_ms (uint32_t ms) { return time_us_64() + ms * 1000ull; }
+static inline int64_t absolute_time_diff_us (absolute_time_t from, absolute_time_t to) {
+    return (int64_t) (to - from);
+}
+static inline bool time_reached (absolute_time_t t) { return time_us_64() >= t; }
+
+void sleep_us (uint64_t us);
+void sleep_ms (uint32_t ms);
+void sleep_until (absolute_time_t t);
+void busy_wait_us_32 (uint32_t us);
+void busy_wait_us (uint64_t us);
+void busy_wait_ms (uint32_t ms);
+void busy_wait_until (absolute_time_t t);
+
+bool add_repeating_timer_us (int64_t delay_us, repeating_timer_callback_t callback,
+                             void *user_data, struct repeating_timer *out);
+static inline bool add_repeating_timer_ms (int32_t delay_ms, repeating_timer_callback_t callback,
+                                           void *user_data, struct repeating_timer *out) {
+    return add_repeating_timer_us(delay_ms * 1000ll, callback, user_data, out);
+}
+bool cancel_repeating_timer (struct repeating_timer *timer);
+
+alarm_id_t add_alarm_at (absolute_time_t time, alarm_callback_t callback, void *user_data,
+                         bool fire_if_past);
+static inline alarm_id_t add_alarm_in_us (uint64_t us, alarm_callback_t callback,
+                                          void *user_data, bool fire_if_past) {
+    return add_alarm_at(time_us_64() + us, callback, user_data, fire_if_past);
+}
+static inline alarm_id_t add_alarm_in_ms (uint32_t ms, alarm_callback_t callback,
+                                          void *user_data, bool fire_if_past) {
+    return add_alarm_at(time_us_64() + ms * 1000ull, callback, user_data, fire_if_past);
+}
+bool cancel_alarm (alarm_id_t id);
+
+#endif
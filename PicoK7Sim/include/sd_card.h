@@ -0,0 +1,22 @@
+/*
+    SD card library shim for the simulation build
+    The card is a FAT image file (see diskio.c)
+*/
+
+#ifndef _SIM_SD_CARD_H
+#define _SIM_SD_CARD_H
+
+#include "pico.h"
+#include "ff.h"
+
+typedef struct {
+    struct {
+        FATFS fatfs;
+        bool mounted;
+    } state;
+} sd_card_t;
+
+size_t sd_get_num (void);
+sd_card_t *sd_get_by_num (size_t num);
+
+#endif
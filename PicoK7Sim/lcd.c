@@ -0,0 +1,248 @@
+/*
+    PicoK7Sim - SPI and the ST7565R display
+
+    spi1 feeds a model of the controller (display RAM, page, column,
+    start line). The text on the screen is recovered by comparing
+    the 8x8 cells with the firmware font.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#define SIM_INTERNAL
+
+#include <ctype.h>
+
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
+
+#include "picok7.h"
+#include "font.h"
+#include "sim.h"
+
+#define SPI_CALL_NS  2000   // overhead of a spi_write_blocking
+#define COLUMNS      132
+#define WIDTH        128
+#define HEIGHT       64
+
+spi_inst_t sim_spi[2] = { { 0, 2 }, { 1, 2 } };
+
+static uint8_t ram[9][COLUMNS];
+static uint page, column, start_line;
+static bool display_on;
+static uint8_t pending;     // first byte of a two byte command
+static bool cs = true, rs, res;
+
+static bool dirty = true;
+static char text[8][WIDTH/8+1];
+static bool inverse[8];     // line has inverse characters
+
+static void lcdReset (void);
+
+void lcdSimInit () {
+    memset(ram, 0x55, sizeof(ram));     // garbage at power up
+    lcdReset();
+}
+
+static void lcdReset () {
+    page = column = start_line = 0;
+    display_on = false;
+    pending = 0;
+    dirty = true;
+}
+
+void lcdPinChanged (uint pin, bool level) {
+    if (pin == LCD_pinCS) {
+        cs = level;
+        pending = 0;
+    } else if (pin == LCD_pinRS) {
+        rs = level;
+    } else if (pin == LCD_pinRES) {
+        if (!level && res) {
+            lcdReset();
+        }
+        res = level;
+    }
+}
+
+static void lcdCmd (uint8_t cmd) {
+    if (pending) {
+        pending = 0;    // the second byte is a value we don't model
+        return;
+    }
+    if ((cmd == 0xAE) || (cmd == 0xAF)) {
+        display_on = cmd & 1;
+    } else if ((cmd & 0xC0) == 0x40) {
+        start_line = cmd & 0x3F;
+    } else if ((cmd & 0xF0) == 0xB0) {
+        page = cmd & 0x0F;
+    } else if ((cmd & 0xF0) == 0x10) {
+        column = ((cmd & 0x0F) << 4) | (column & 0x0F);
+    } else if ((cmd & 0xF0) == 0x00) {
+        column = (column & 0xF0) | (cmd & 0x0F);
+    } else if ((cmd == 0x81) || (cmd == 0xF8) || (cmd == 0xAC) || (cmd == 0xAD)) {
+        pending = cmd;
+    } else if (cmd == 0xE2) {
+        lcdReset();
+    }
+    dirty = true;
+}
+
+static void lcdData (uint8_t data) {
+    if ((page < 9) && (column < COLUMNS)) {
+        ram[page][column++] = data;
+    }
+    dirty = true;
+}
+
+void lcdSpiWrite (const uint8_t *data, size_t len) {
+    if (cs || !res) {
+        return;
+    }
+    while (len--) {
+        if (rs) {
+            lcdData(*data++);
+        } else {
+            lcdCmd(*data++);
+        }
+    }
+}
+
+// Pixel at x,y (0,0 is top left)
+// Pages are numbered from bottom to top, bit 7 is the top of a page
+static bool pixel (int x, int y) {
+    if (!display_on) {
+        return false;
+    }
+    uint r = (start_line + HEIGHT - 1 - y) & (HEIGHT - 1);
+    return (ram[r >> 3][x] >> (r & 7)) & 1;
+}
+
+// Recognize the text on screen
+static void ocr () {
+    for (int l = 0; l < 8; l++) {
+        inverse[l] = false;
+        for (int c = 0; c < WIDTH/8; c++) {
+            uint8_t cell[8];
+            for (int i = 0; i < 8; i++) {
+                cell[i] = 0;
+                for (int j = 0; j < 8; j++) {
+                    cell[i] = (cell[i] << 1) | pixel(c*8 + i, l*8 + j);
+                }
+            }
+            char chr = '?';
+            for (uint g = 0; g < sizeof(font)/8; g++) {
+                bool normal = true, inv = true;
+                for (int i = 0; i < 8; i++) {
+                    normal = normal && (cell[i] == font[g*8+i]);
+                    inv = inv && (cell[i] == (font[g*8+i] ^ 0xFF));
+                }
+                if (normal || inv) {
+                    chr = 0x20 + g;
+                    inverse[l] = inverse[l] || inv;
+                    break;
+                }
+            }
+            text[l][c] = chr;
+        }
+        text[l][WIDTH/8] = 0;
+    }
+    dirty = false;
+}
+
+// Check if text is on the screen
+bool lcdFind (const char *str) {
+    if (dirty) {
+        ocr();
+    }
+    for (int l = 0; l < 8; l++) {
+        if (strstr(text[l], str) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Print the text on the screen
+// Lines with inverse characters are marked with a '>'
+void lcdPrint (FILE *f) {
+    if (dirty) {
+        ocr();
+    }
+    fprintf(f, "+----------------+\n");
+    for (int l = 0; l < 8; l++) {
+        fprintf(f, "%c%s|\n", inverse[l] ? '>' : '|', text[l]);
+    }
+    fprintf(f, "+----------------+\n");
+}
+
+// Save the screen as a PBM image
+bool lcdShot (const char *file) {
+    FILE *f = fopen(file, "w");
+    if (f == NULL) {
+        return false;
+    }
+    fprintf(f, "P1\n%d %d\n", WIDTH, HEIGHT);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            fputc(pixel(x, y) ? '1' : '0', f);
+        }
+        fputc('\n', f);
+    }
+    fclose(f);
+    return true;
+}
+
+
+// SDK API
+//---------------------------
+
+// Same dividers as the SDK: even prescale (2-254) and postdiv (1-256)
+uint spi_set_baudrate (spi_inst_t *spi, uint baudrate) {
+    uint freq_in = clock_get_hz(clk_peri);
+    uint prescale, postdiv;
+    for (prescale = 2; prescale <= 254; prescale += 2) {
+        if (freq_in < (prescale + 2) * 256 * (uint64_t) baudrate) {
+            break;
+        }
+    }
+    for (postdiv = 256; postdiv > 1; --postdiv) {
+        if (freq_in / (prescale * (postdiv - 1)) > baudrate) {
+            break;
+        }
+    }
+    spi->div = prescale * postdiv;
+    return freq_in / spi->div;
+}
+
+uint spi_get_baudrate (const spi_inst_t *spi) {
+    return clock_get_hz(clk_peri) / spi->div;
+}
+
+uint spi_init (spi_inst_t *spi, uint baudrate) {
+    return spi_set_baudrate(spi, baudrate);
+}
+
+void spi_deinit (spi_inst_t *spi) {
+    (void) spi;
+}
+
+void spi_set_format (spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order) {
+    (void) spi;
+    (void) data_bits;
+    (void) cpol;
+    (void) cpha;
+    (void) order;
+}
+
+int spi_write_blocking (spi_inst_t *spi, const uint8_t *src, size_t len) {
+    simActivity();
+    if (spi == spi1) {
+        lcdSpiWrite(src, len);
+    }
+    sim_cnt.spi_bytes += len;
+    simAdvance(SPI_CALL_NS + len * 8 * 1000000000ull / spi_get_baudrate(spi), PRF_SPI);
+    return len;
+}
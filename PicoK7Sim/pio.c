@@ -0,0 +1,766 @@
+/*
+    PicoK7Sim - PIO emulation
+
+    The state machines are interpreted one clock cycle at a time,
+    with their own clock divider. A stalled state machine (waiting
+    for its FIFO or a pin) is skipped until the end of the time slice.
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#define SIM_INTERNAL
+
+#include <math.h>
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+
+#include "sim.h"
+
+#define FIFO_MAX 8
+
+pio_hw_t sim_pio_hw[NUM_PIOS];
+
+typedef struct {
+    uint32_t data[FIFO_MAX];
+    uint first, n;
+} FIFO;
+
+typedef struct {
+    bool claimed, enabled;
+    pio_sm_config cfg;
+    uint8_t pc;
+    uint32_t x, y, osr, isr;
+    uint osr_count, isr_count;
+    FIFO tx, rx;
+    uint delay;
+    int exec;           // instruction to execute next (-1 if none)
+    bool irq_wait;      // IRQ WAIT instruction waiting for clear
+    double period;      // ns per cycle
+    double next;        // time of the next cycle
+} SM;
+
+static struct {
+    uint16_t mem[PIO_INSTRUCTION_COUNT];
+    uint32_t used;
+    SM sm[NUM_PIO_STATE_MACHINES];
+    uint8_t irq;
+} pio_sim[NUM_PIOS];
+
+static inline uint txDepth (SM *sm) {
+    return sm->cfg.join == PIO_FIFO_JOIN_TX ? 8 : sm->cfg.join == PIO_FIFO_JOIN_RX ? 0 : 4;
+}
+
+static inline uint rxDepth (SM *sm) {
+    return sm->cfg.join == PIO_FIFO_JOIN_RX ? 8 : sm->cfg.join == PIO_FIFO_JOIN_TX ? 0 : 4;
+}
+
+static inline void fifoPush (FIFO *f, uint32_t v) {
+    f->data[(f->first + f->n++) % FIFO_MAX] = v;
+}
+
+static inline uint32_t fifoPop (FIFO *f) {
+    uint32_t v = f->data[f->first];
+    f->first = (f->first + 1) % FIFO_MAX;
+    f->n--;
+    return v;
+}
+
+static void update (uint p);
+static void setPeriod (SM *sm);
+
+void pioSimInit () {
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        for (uint s = 0; s < NUM_PIO_STATE_MACHINES; s++) {
+            pio_sim[p].sm[s].cfg = pio_get_default_sm_config();
+            pio_sim[p].sm[s].exec = -1;
+            setPeriod(&pio_sim[p].sm[s]);
+        }
+        update(p);
+    }
+}
+
+
+// Interpreter
+//---------------------------
+
+static void writePins (uint p, uint base, uint count, uint32_t value, uint64_t t) {
+    for (uint i = 0; i < count; i++) {
+        gpioPioOut(p, (base + i) & 31, (value >> i) & 1, t);
+    }
+}
+
+static void writeDirs (uint p, uint base, uint count, uint32_t value, uint64_t t) {
+    for (uint i = 0; i < count; i++) {
+        gpioPioDir(p, (base + i) & 31, (value >> i) & 1, t);
+    }
+}
+
+static uint32_t readPins (SM *sm) {
+    uint32_t all = gpioAll();
+    uint b = sm->cfg.in_base & 31;
+    return b ? (all >> b) | (all << (32 - b)) : all;
+}
+
+static uint32_t reverse (uint32_t v) {
+    uint32_t r = 0;
+    for (int i = 0; i < 32; i++) {
+        r = (r << 1) | ((v >> i) & 1);
+    }
+    return r;
+}
+
+static inline uint32_t mask (uint count) {
+    return count >= 32 ? 0xFFFFFFFFu : (1u << count) - 1;
+}
+
+// Execute one cycle of a state machine
+// Returns true if the state machine is stalled
+static bool smStep (uint p, uint s, uint64_t t) {
+    SM *sm = &pio_sim[p].sm[s];
+
+    if (sm->delay) {
+        sm->delay--;
+        return false;
+    }
+
+    bool from_exec = sm->exec >= 0;
+    uint16_t ins = from_exec ? sm->exec : pio_sim[p].mem[sm->pc];
+    uint op = ins >> 13;
+    uint a = (ins >> 5) & 7;
+    uint idx = ins & 0x1F;
+    uint count = idx ? idx : 32;
+
+    // Side set happens even when stalled
+    uint ssb = sm->cfg.sideset_bits;
+    uint dfield = (ins >> 8) & 0x1F;
+    uint delay = dfield & mask(5 - ssb);
+    if (ssb) {
+        bool apply = true;
+        uint value;
+        if (sm->cfg.sideset_opt) {
+            apply = (dfield & 0x10) != 0;
+            value = (dfield >> (5 - ssb)) & mask(ssb - 1);
+            ssb--;
+        } else {
+            value = dfield >> (5 - ssb);
+        }
+        if (apply) {
+            if (sm->cfg.sideset_pindirs) {
+                writeDirs(p, sm->cfg.sideset_base, ssb, value, t);
+            } else {
+                writePins(p, sm->cfg.sideset_base, ssb, value, t);
+            }
+        }
+    }
+
+    bool jump = false;
+    bool stall = false;
+    int new_exec = -1;
+    uint32_t data = 0;
+
+    switch (op) {
+        case 0: {   // JMP
+            bool cond = false;
+            switch (a) {
+                case 0: cond = true; break;
+                case 1: cond = sm->x == 0; break;
+                case 2: cond = sm->x != 0; sm->x--; break;
+                case 3: cond = sm->y == 0; break;
+                case 4: cond = sm->y != 0; sm->y--; break;
+                case 5: cond = sm->x != sm->y; break;
+                case 6: cond = gpioLevel(sm->cfg.jmp_pin); break;
+                case 7: cond = sm->osr_count < sm->cfg.pull_thresh; break;
+            }
+            if (cond) {
+                sm->pc = idx;
+                jump = true;
+            }
+            break;
+        }
+        case 1: {   // WAIT
+            bool pol = (ins >> 7) & 1;
+            bool level = false;
+            uint irq = 0;
+            switch ((ins >> 5) & 3) {
+                case 0: level = gpioLevel(idx); break;
+                case 1: level = gpioLevel((sm->cfg.in_base + idx) & 31); break;
+                case 2:
+                    irq = (idx & 0x10) ? ((idx & 4) | ((idx + s) & 3)) : (idx & 7);
+                    level = (pio_sim[p].irq >> irq) & 1;
+                    break;
+            }
+            if (level != pol) {
+                stall = true;
+            } else if ((((ins >> 5) & 3) == 2) && pol) {
+                pio_sim[p].irq &= ~(1u << irq);
+            }
+            break;
+        }
+        case 2:     // IN
+            if (sm->cfg.autopush && ((sm->isr_count + count) >= sm->cfg.push_thresh) &&
+                (sm->rx.n >= rxDepth(sm))) {
+                stall = true;
+                break;
+            }
+            switch (a) {
+                case 0: data = readPins(sm); break;
+                case 1: data = sm->x; break;
+                case 2: data = sm->y; break;
+                case 6: data = sm->isr; break;
+                case 7: data = sm->osr; break;
+            }
+            data &= mask(count);
+            if (sm->cfg.in_right) {
+                sm->isr = count == 32 ? data : (sm->isr >> count) | (data << (32 - count));
+            } else {
+                sm->isr = count == 32 ? data : (sm->isr << count) | data;
+            }
+            sm->isr_count += count;
+            if (sm->isr_count > 32) {
+                sm->isr_count = 32;
+            }
+            if (sm->cfg.autopush && (sm->isr_count >= sm->cfg.push_thresh)) {
+                fifoPush(&sm->rx, sm->isr);
+                sm->isr = 0;
+                sm->isr_count = 0;
+            }
+            break;
+        case 3:     // OUT
+            if (sm->cfg.autopull && (sm->osr_count >= sm->cfg.pull_thresh)) {
+                if (sm->tx.n == 0) {
+                    stall = true;
+                    break;
+                }
+                sm->osr = fifoPop(&sm->tx);
+                sm->osr_count = 0;
+            }
+            if (sm->cfg.out_right) {
+                data = sm->osr & mask(count);
+                sm->osr = count == 32 ? 0 : sm->osr >> count;
+            } else {
+                data = count == 32 ? sm->osr : sm->osr >> (32 - count);
+                sm->osr = count == 32 ? 0 : sm->osr << count;
+            }
+            sm->osr_count += count;
+            if (sm->osr_count > 32) {
+                sm->osr_count = 32;
+            }
+            switch (a) {
+                case 0: writePins(p, sm->cfg.out_base, sm->cfg.out_count, data, t); break;
+                case 1: sm->x = data; break;
+                case 2: sm->y = data; break;
+                case 4: writeDirs(p, sm->cfg.out_base, sm->cfg.out_count, data, t); break;
+                case 5: sm->pc = data & 31; jump = true; break;
+                case 6: sm->isr = data; sm->isr_count = count; break;
+                case 7: new_exec = data & 0xFFFF; break;
+            }
+            break;
+        case 4:
+            if (ins & 0x80) {   // PULL
+                bool if_empty = (ins >> 6) & 1;
+                bool block = (ins >> 5) & 1;
+                if (if_empty && (sm->osr_count < sm->cfg.pull_thresh)) {
+                    break;
+                }
+                if (sm->tx.n == 0) {
+                    if (block) {
+                        stall = true;
+                    } else {
+                        sm->osr = sm->x;
+                        sm->osr_count = 0;
+                    }
+                } else {
+                    sm->osr = fifoPop(&sm->tx);
+                    sm->osr_count = 0;
+                }
+            } else {            // PUSH
+                bool if_full = (ins >> 6) & 1;
+                bool block = (ins >> 5) & 1;
+                if (if_full && (sm->isr_count < sm->cfg.push_thresh)) {
+                    break;
+                }
+                if (sm->rx.n >= rxDepth(sm)) {
+                    if (block) {
+                        stall = true;
+                        break;
+                    }
+                } else {
+                    fifoPush(&sm->rx, sm->isr);
+                }
+                sm->isr = 0;
+                sm->isr_count = 0;
+            }
+            break;
+        case 5:     // MOV
+            switch (ins & 7) {
+                case 0: data = readPins(sm); break;
+                case 1: data = sm->x; break;
+                case 2: data = sm->y; break;
+                case 3: data = 0; break;
+                case 5:
+                    if (sm->cfg.status_sel == STATUS_TX_LESSTHAN) {
+                        data = sm->tx.n < sm->cfg.status_n ? 0xFFFFFFFF : 0;
+                    } else {
+                        data = sm->rx.n < sm->cfg.status_n ? 0xFFFFFFFF : 0;
+                    }
+                    break;
+                case 6: data = sm->isr; break;
+                case 7: data = sm->osr; break;
+            }
+            switch ((ins >> 3) & 3) {
+                case 1: data = ~data; break;
+                case 2: data = reverse(data); break;
+            }
+            switch (a) {
+                case 0: writePins(p, sm->cfg.out_base, sm->cfg.out_count, data, t); break;
+                case 1: sm->x = data; break;
+                case 2: sm->y = data; break;
+                case 4: new_exec = data & 0xFFFF; break;
+                case 5: sm->pc = data & 31; jump = true; break;
+                case 6: sm->isr = data; sm->isr_count = 0; break;
+                case 7: sm->osr = data; sm->osr_count = 0; break;
+            }
+            break;
+        case 6: {   // IRQ
+            uint irq = (idx & 0x10) ? ((idx & 4) | ((idx + s) & 3)) : (idx & 7);
+            if ((ins >> 6) & 1) {
+                pio_sim[p].irq &= ~(1u << irq);
+            } else if (!sm->irq_wait) {
+                pio_sim[p].irq |= 1u << irq;
+                if ((ins >> 5) & 1) {
+                    sm->irq_wait = true;
+                    stall = true;
+                }
+            } else if ((pio_sim[p].irq >> irq) & 1) {
+                stall = true;
+            } else {
+                sm->irq_wait = false;
+            }
+            break;
+        }
+        case 7:     // SET
+            switch (a) {
+                case 0: writePins(p, sm->cfg.set_base, sm->cfg.set_count, idx, t); break;
+                case 1: sm->x = idx; break;
+                case 2: sm->y = idx; break;
+                case 4: writeDirs(p, sm->cfg.set_base, sm->cfg.set_count, idx, t); break;
+            }
+            break;
+    }
+
+    if (stall) {
+        return true;
+    }
+    sm->exec = new_exec;
+    if (!jump && !from_exec) {
+        sm->pc = (sm->pc == sm->cfg.wrap) ? sm->cfg.wrap_target : (sm->pc + 1) & 31;
+    }
+    sm->delay = delay;
+    return false;
+}
+
+// Run the state machines up to t_end
+void pioRun (uint64_t t_end) {
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        for (uint s = 0; s < NUM_PIO_STATE_MACHINES; s++) {
+            SM *sm = &pio_sim[p].sm[s];
+            if (!sm->enabled) {
+                continue;
+            }
+            while (sm->next <= t_end) {
+                bool stalled = smStep(p, s, (uint64_t) sm->next);
+                sim_cnt.pio_instr[p][s]++;
+                sm->next += sm->period;
+                if (stalled && (sm->next <= t_end)) {
+                    // Nothing changes until the CPU or the script acts
+                    sm->next += (floor((t_end - sm->next) / sm->period) + 1) * sm->period;
+                }
+            }
+        }
+    }
+}
+
+// Update the interrupt registers
+static void update (uint p) {
+    uint32_t intr = 0;
+    for (uint s = 0; s < NUM_PIO_STATE_MACHINES; s++) {
+        SM *sm = &pio_sim[p].sm[s];
+        if (sm->rx.n) {
+            intr |= 1u << (PIO_INTR_SM0_RXNEMPTY_LSB + s);
+        }
+        if (sm->tx.n < txDepth(sm)) {
+            intr |= 1u << (PIO_INTR_SM0_TXNFULL_LSB + s);
+        }
+    }
+    intr |= (pio_sim[p].irq & 0xF) << PIO_INTR_SM0_LSB;
+    sim_pio_hw[p].intr = intr;
+    sim_pio_hw[p].ints0 = (intr | sim_pio_hw[p].intf0) & sim_pio_hw[p].inte0;
+    sim_pio_hw[p].ints1 = (intr | sim_pio_hw[p].intf1) & sim_pio_hw[p].inte1;
+}
+
+// Check for interrupts
+void pioIrqCheck () {
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        update(p);
+        if (sim_pio_hw[p].ints0) {
+            simIrq(p ? PIO1_IRQ_0 : PIO0_IRQ_0);
+        }
+        if (sim_pio_hw[p].ints1) {
+            simIrq(p ? PIO1_IRQ_1 : PIO0_IRQ_1);
+        }
+    }
+}
+
+// Access to the FIFOs by DMA
+bool pioFifoWrite (volatile void *addr, uint32_t data) {
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        for (uint s = 0; s < NUM_PIO_STATE_MACHINES; s++) {
+            if (addr == &sim_pio_hw[p].txf[s]) {
+                pio_sm_put(pio_get_instance(p), s, data);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool pioFifoRead (const volatile void *addr, uint32_t *data) {
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        for (uint s = 0; s < NUM_PIO_STATE_MACHINES; s++) {
+            if (addr == &sim_pio_hw[p].rxf[s]) {
+                *data = pio_sm_get(pio_get_instance(p), s);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// DREQ_PIOx_TXn / DREQ_PIOx_RXn are active?
+bool pioDreq (uint dreq) {
+    uint p = dreq >> 3;
+    uint s = dreq & 3;
+    SM *sm = &pio_sim[p].sm[s];
+    if (dreq & 4) {
+        return sm->rx.n > 0;
+    }
+    return sm->tx.n < txDepth(sm);
+}
+
+
+// SDK API
+//---------------------------
+
+static inline SM *getSM (PIO pio, uint sm) {
+    return &pio_sim[pio_get_index(pio)].sm[sm];
+}
+
+static void setPeriod (SM *sm) {
+    sm->period = sm->cfg.clkdiv * 1e9 / clock_get_hz(clk_sys);
+}
+
+// Called when clk_sys changes
+void pioClockChanged () {
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        for (uint s = 0; s < NUM_PIO_STATE_MACHINES; s++) {
+            setPeriod(&pio_sim[p].sm[s]);
+        }
+    }
+}
+
+pio_sm_config pio_get_default_sm_config () {
+    pio_sm_config c;
+    memset(&c, 0, sizeof(c));
+    c.clkdiv = 1.0f;
+    c.wrap_target = 0;
+    c.wrap = 31;
+    c.out_right = true;
+    c.in_right = true;
+    c.pull_thresh = 32;
+    c.push_thresh = 32;
+    return c;
+}
+
+uint pio_get_dreq (PIO pio, uint sm, bool is_tx) {
+    return (pio_get_index(pio) << 3) | (is_tx ? 0 : 4) | sm;
+}
+
+static int findSpace (uint p, const pio_program_t *program) {
+    uint32_t m = mask(program->length);
+    if (program->origin >= 0) {
+        return (pio_sim[p].used & (m << program->origin)) ? -1 : program->origin;
+    }
+    for (int off = PIO_INSTRUCTION_COUNT - program->length; off >= 0; off--) {
+        if ((pio_sim[p].used & (m << off)) == 0) {
+            return off;
+        }
+    }
+    return -1;
+}
+
+bool pio_can_add_program (PIO pio, const pio_program_t *program) {
+    return findSpace(pio_get_index(pio), program) >= 0;
+}
+
+int pio_add_program (PIO pio, const pio_program_t *program) {
+    uint p = pio_get_index(pio);
+    int off = findSpace(p, program);
+    if (off < 0) {
+        simLog("pio%u: no space for program", p);
+        return -1;
+    }
+    for (uint i = 0; i < program->length; i++) {
+        uint16_t ins = program->instructions[i];
+        if ((ins & 0xE000) == 0) {
+            ins += off;     // relocate JMP
+        }
+        pio_sim[p].mem[off + i] = ins;
+    }
+    pio_sim[p].used |= mask(program->length) << off;
+    return off;
+}
+
+void pio_remove_program (PIO pio, const pio_program_t *program, uint loaded_offset) {
+    pio_sim[pio_get_index(pio)].used &= ~(mask(program->length) << loaded_offset);
+}
+
+void pio_clear_instruction_memory (PIO pio) {
+    pio_sim[pio_get_index(pio)].used = 0;
+}
+
+void pio_sm_claim (PIO pio, uint sm) {
+    getSM(pio, sm)->claimed = true;
+}
+
+void pio_sm_unclaim (PIO pio, uint sm) {
+    getSM(pio, sm)->claimed = false;
+}
+
+int pio_claim_unused_sm (PIO pio, bool required) {
+    for (uint s = 0; s < NUM_PIO_STATE_MACHINES; s++) {
+        if (!getSM(pio, s)->claimed) {
+            getSM(pio, s)->claimed = true;
+            return s;
+        }
+    }
+    if (required) {
+        simError("pio%u: no free state machine", pio_get_index(pio));
+    }
+    return -1;
+}
+
+bool pio_sm_is_claimed (PIO pio, uint sm) {
+    return getSM(pio, sm)->claimed;
+}
+
+void pio_gpio_init (PIO pio, uint pin) {
+    gpio_set_function(pin, pio_get_index(pio) ? GPIO_FUNC_PIO1 : GPIO_FUNC_PIO0);
+}
+
+int pio_sm_set_consecutive_pindirs (PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out) {
+    (void) sm;
+    writeDirs(pio_get_index(pio), pin_base, pin_count, is_out ? 0xFFFFFFFF : 0, sim_now);
+    return PICO_ERROR_NONE;
+}
+
+void pio_sm_set_pins (PIO pio, uint sm, uint32_t pin_values) {
+    pio_sm_set_pins_with_mask(pio, sm, pin_values, 0xFFFFFFFF);
+}
+
+void pio_sm_set_pins_with_mask (PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask) {
+    (void) sm;
+    for (uint pin = 0; pin < 32; pin++) {
+        if ((pin_mask >> pin) & 1) {
+            gpioPioOut(pio_get_index(pio), pin, (pin_values >> pin) & 1, sim_now);
+        }
+    }
+}
+
+void pio_sm_set_pindirs_with_mask (PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask) {
+    (void) sm;
+    for (uint pin = 0; pin < 32; pin++) {
+        if ((pin_mask >> pin) & 1) {
+            gpioPioDir(pio_get_index(pio), pin, (pin_dirs >> pin) & 1, sim_now);
+        }
+    }
+}
+
+int pio_sm_init (PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+    SM *s = getSM(pio, sm);
+    s->enabled = false;
+    s->cfg = *config;
+    setPeriod(s);
+    s->tx.n = s->rx.n = 0;
+    pio_sm_restart(pio, sm);
+    s->pc = initial_pc;
+    update(pio_get_index(pio));
+    return PICO_ERROR_NONE;
+}
+
+void pio_sm_set_config (PIO pio, uint sm, const pio_sm_config *config) {
+    SM *s = getSM(pio, sm);
+    s->cfg = *config;
+    setPeriod(s);
+}
+
+void pio_sm_set_enabled (PIO pio, uint sm, bool enabled) {
+    SM *s = getSM(pio, sm);
+    if (enabled && !s->enabled) {
+        s->next = sim_now;
+    }
+    s->enabled = enabled;
+}
+
+void pio_set_sm_mask_enabled (PIO pio, uint32_t mask, bool enabled) {
+    for (uint s = 0; s < NUM_PIO_STATE_MACHINES; s++) {
+        if ((mask >> s) & 1) {
+            pio_sm_set_enabled(pio, s, enabled);
+        }
+    }
+}
+
+void pio_enable_sm_mask_in_sync (PIO pio, uint32_t mask) {
+    pio_set_sm_mask_enabled(pio, mask, true);
+}
+
+void pio_sm_restart (PIO pio, uint sm) {
+    SM *s = getSM(pio, sm);
+    s->x = s->y = s->osr = s->isr = 0;
+    s->osr_count = 32;      // empty
+    s->isr_count = 0;
+    s->delay = 0;
+    s->exec = -1;
+    s->irq_wait = false;
+}
+
+void pio_sm_clkdiv_restart (PIO pio, uint sm) {
+    getSM(pio, sm)->next = sim_now;
+}
+
+void pio_clkdiv_restart_sm_mask (PIO pio, uint32_t mask) {
+    for (uint s = 0; s < NUM_PIO_STATE_MACHINES; s++) {
+        if ((mask >> s) & 1) {
+            pio_sm_clkdiv_restart(pio, s);
+        }
+    }
+}
+
+void pio_sm_set_clkdiv (PIO pio, uint sm, float div) {
+    SM *s = getSM(pio, sm);
+    s->cfg.clkdiv = div;
+    setPeriod(s);
+}
+
+void pio_sm_set_clkdiv_int_frac (PIO pio, uint sm, uint16_t div_int, uint8_t div_frac) {
+    pio_sm_set_clkdiv(pio, sm, div_int + div_frac / 256.0f);
+}
+
+void pio_sm_exec (PIO pio, uint sm, uint instr) {
+    SM *s = getSM(pio, sm);
+    s->exec = instr;
+    s->delay = 0;
+    smStep(pio_get_index(pio), sm, sim_now);
+}
+
+void pio_sm_exec_wait_blocking (PIO pio, uint sm, uint instr) {
+    pio_sm_exec(pio, sm, instr);
+    while (getSM(pio, sm)->exec >= 0) {
+        simPoll();
+    }
+}
+
+uint8_t pio_sm_get_pc (PIO pio, uint sm) {
+    simPoll();
+    return getSM(pio, sm)->pc;
+}
+
+void pio_sm_put (PIO pio, uint sm, uint32_t data) {
+    SM *s = getSM(pio, sm);
+    simActivity();
+    if (s->tx.n < txDepth(s)) {
+        fifoPush(&s->tx, data);
+        sim_cnt.pio_put[pio_get_index(pio)][sm]++;
+    }
+    update(pio_get_index(pio));
+}
+
+void pio_sm_put_blocking (PIO pio, uint sm, uint32_t data) {
+    while (pio_sm_is_tx_fifo_full(pio, sm)) {
+    }
+    pio_sm_put(pio, sm, data);
+}
+
+uint32_t pio_sm_get (PIO pio, uint sm) {
+    SM *s = getSM(pio, sm);
+    uint32_t v = 0;
+    simActivity();
+    if (s->rx.n) {
+        v = fifoPop(&s->rx);
+    }
+    update(pio_get_index(pio));
+    return v;
+}
+
+uint32_t pio_sm_get_blocking (PIO pio, uint sm) {
+    while (pio_sm_is_rx_fifo_empty(pio, sm)) {
+    }
+    return pio_sm_get(pio, sm);
+}
+
+bool pio_sm_is_tx_fifo_full (PIO pio, uint sm) {
+    simPoll();
+    SM *s = getSM(pio, sm);
+    return s->tx.n >= txDepth(s);
+}
+
+bool pio_sm_is_tx_fifo_empty (PIO pio, uint sm) {
+    simPoll();
+    return getSM(pio, sm)->tx.n == 0;
+}
+
+uint pio_sm_get_tx_fifo_level (PIO pio, uint sm) {
+    simPoll();
+    return getSM(pio, sm)->tx.n;
+}
+
+bool pio_sm_is_rx_fifo_full (PIO pio, uint sm) {
+    simPoll();
+    SM *s = getSM(pio, sm);
+    return s->rx.n >= rxDepth(s);
+}
+
+bool pio_sm_is_rx_fifo_empty (PIO pio, uint sm) {
+    simPoll();
+    return getSM(pio, sm)->rx.n == 0;
+}
+
+uint pio_sm_get_rx_fifo_level (PIO pio, uint sm) {
+    simPoll();
+    return getSM(pio, sm)->rx.n;
+}
+
+void pio_sm_clear_fifos (PIO pio, uint sm) {
+    SM *s = getSM(pio, sm);
+    s->tx.n = s->rx.n = 0;
+    update(pio_get_index(pio));
+}
+
+void pio_sm_drain_tx_fifo (PIO pio, uint sm) {
+    SM *s = getSM(pio, sm);
+    s->tx.n = 0;
+    s->osr_count = 32;
+    update(pio_get_index(pio));
+}
+
+bool pio_interrupt_get (PIO pio, uint irq_num) {
+    return (pio_sim[pio_get_index(pio)].irq >> irq_num) & 1;
+}
+
+void pio_interrupt_clear (PIO pio, uint irq_num) {
+    pio_sim[pio_get_index(pio)].irq &= ~(1u << irq_num);
+    update(pio_get_index(pio));
+}
@@ -0,0 +1,570 @@
+/*
+    pioasm - a small PIO assembler for the simulation build
+
+    Generates the same C header as the SDK's pioasm (c-sdk format)
+    for the subset of the PIO language used by PicoK7:
+    .program .side_set [opt] [pindirs] .wrap_target .wrap .origin
+    .define [public], [public] labels, % c-sdk {} blocks and all
+    the PIO instructions with side-set and delay
+
+    Usage: pioasm input.pio output.h
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#define MAX_LINES   1024
+#define MAX_SYMS    256
+#define MAX_TOKENS  32
+#define MAX_PROGS   8
+#define MAX_INSTR   32
+
+typedef struct {
+    char name[64];
+    long value;
+    int prog;       // -1 for global
+    bool pub;
+    bool label;
+} SYM;
+
+typedef struct {
+    char name[64];
+    int first_sym;
+    int length;
+    int wrap_target, wrap;
+    int origin;
+    int sideset;        // bits, including opt
+    bool sideset_opt;
+    bool sideset_pindirs;
+    unsigned short code[MAX_INSTR];
+    char *csdk;
+} PROG;
+
+static SYM syms[MAX_SYMS];
+static int nsyms;
+static PROG progs[MAX_PROGS];
+static int nprogs;
+static char *glob_csdk;
+
+static const char *fname;
+static int lineno;
+
+// Tokens of the current line
+static char tok[MAX_TOKENS][64];
+static int ntok, ptok;
+
+static void error (const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "%s:%d: ", fname, lineno);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+    exit(1);
+}
+
+// Split a line into tokens
+static void tokenize (char *s) {
+    ntok = ptok = 0;
+    while (*s) {
+        if (isspace((unsigned char) *s) || (*s == ',')) {
+            s++;
+            continue;
+        }
+        if (ntok == MAX_TOKENS) {
+            error("line too long");
+        }
+        char *t = tok[ntok++];
+        if (isalnum((unsigned char) *s) || (*s == '_') || (*s == '.')) {
+            int n = 0;
+            while ((isalnum((unsigned char) *s) || (*s == '_') || (*s == '.')) && (n < 63)) {
+                t[n++] = *s++;
+            }
+            t[n] = 0;
+            // x-- y--
+            if ((s[0] == '-') && (s[1] == '-') && (n == 1)) {
+                t[n++] = *s++;
+                t[n++] = *s++;
+                t[n] = 0;
+            }
+            // x!=y
+            if ((s[0] == '!') && (s[1] == '=')) {
+                t[n++] = *s++;
+                t[n++] = *s++;
+                while (isalnum((unsigned char) *s) && (n < 63)) {
+                    t[n++] = *s++;
+                }
+                t[n] = 0;
+            }
+        } else if ((s[0] == ':') && (s[1] == ':')) {
+            strcpy(t, "::");
+            s += 2;
+        } else {
+            t[0] = *s++;
+            t[1] = 0;
+        }
+    }
+}
+
+static bool is (const char *t) {
+    return (ptok < ntok) && (strcasecmp(tok[ptok], t) == 0);
+}
+
+static bool accept (const char *t) {
+    if (is(t)) {
+        ptok++;
+        return true;
+    }
+    return false;
+}
+
+static SYM *findSym (const char *name, int prog) {
+    for (int i = 0; i < nsyms; i++) {
+        if ((strcmp(syms[i].name, name) == 0) && ((syms[i].prog == prog) || (syms[i].prog == -1))) {
+            // program symbols hide the globals
+            if (syms[i].prog == -1) {
+                for (int j = i+1; j < nsyms; j++) {
+                    if ((strcmp(syms[j].name, name) == 0) && (syms[j].prog == prog)) {
+                        return &syms[j];
+                    }
+                }
+            }
+            return &syms[i];
+        }
+    }
+    return NULL;
+}
+
+static void addSym (const char *name, long value, int prog, bool pub, bool label) {
+    if (nsyms == MAX_SYMS) {
+        error("too many symbols");
+    }
+    for (int i = 0; i < nsyms; i++) {
+        if ((strcmp(syms[i].name, name) == 0) && (syms[i].prog == prog)) {
+            if (syms[i].label && label) {
+                syms[i].value = value;  // second pass
+                return;
+            }
+            error("duplicate symbol %s", name);
+        }
+    }
+    SYM *s = &syms[nsyms++];
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->value = value;
+    s->prog = prog;
+    s->pub = pub;
+    s->label = label;
+}
+
+// Expressions: + - * / ( ) unary -, numbers and symbols
+static long expr (int prog);
+
+static long primary (int prog) {
+    if (ptok >= ntok) {
+        error("expression expected");
+    }
+    if (accept("(")) {
+        long v = expr(prog);
+        if (!accept(")")) {
+            error(") expected");
+        }
+        return v;
+    }
+    if (accept("-")) {
+        return -primary(prog);
+    }
+    char *t = tok[ptok++];
+    if (isdigit((unsigned char) t[0])) {
+        if ((t[0] == '0') && ((t[1] == 'b') || (t[1] == 'B'))) {
+            return strtol(t+2, NULL, 2);
+        }
+        return strtol(t, NULL, 0);
+    }
+    SYM *s = findSym(t, prog);
+    if (s == NULL) {
+        error("undefined symbol %s", t);
+    }
+    return s->value;
+}
+
+static long term (int prog) {
+    long v = primary(prog);
+    while (true) {
+        if (accept("*")) {
+            v *= primary(prog);
+        } else if (accept("/")) {
+            v /= primary(prog);
+        } else {
+            return v;
+        }
+    }
+}
+
+static long expr (int prog) {
+    long v = term(prog);
+    while (true) {
+        if (accept("+")) {
+            v += term(prog);
+        } else if (accept("-")) {
+            v -= term(prog);
+        } else {
+            return v;
+        }
+    }
+}
+
+// Find a name in a table of operands
+static int operand (const char *const *names, const char *what) {
+    for (int i = 0; names[i] != NULL; i++) {
+        if (names[i][0] && is(names[i])) {
+            ptok++;
+            return i;
+        }
+    }
+    error("invalid %s %s", what, ptok < ntok ? tok[ptok] : "");
+    return 0;
+}
+
+static const char *const in_src[] = { "pins", "x", "y", "null", "", "", "isr", "osr", NULL };
+static const char *const out_dst[] = { "pins", "x", "y", "null", "pindirs", "pc", "isr", "exec", NULL };
+static const char *const mov_dst[] = { "pins", "x", "y", "", "exec", "pc", "isr", "osr", NULL };
+static const char *const mov_src[] = { "pins", "x", "y", "null", "", "status", "isr", "osr", NULL };
+static const char *const set_dst[] = { "pins", "x", "y", "", "pindirs", NULL };
+static const char *const jmp_cond[] = { "", "!x", "x--", "!y", "y--", "x!=y", "pin", "!osre", NULL };
+
+// Encode an instruction
+static unsigned short encode (PROG *p, int prog, bool final) {
+    unsigned short ins = 0;
+    char *op = tok[ptok++];
+    long v;
+
+    if (strcasecmp(op, "nop") == 0) {
+        ins = 0xA042;   // mov y, y
+    } else if (strcasecmp(op, "jmp") == 0) {
+        int cond = 0;
+        if (accept("!")) {
+            // "! x" written with a space
+            char aux[8];
+            snprintf(aux, sizeof(aux), "!%.5s", ptok < ntok ? tok[ptok] : "");
+            strcpy(tok[ptok], aux);
+        }
+        for (int i = 1; jmp_cond[i] != NULL; i++) {
+            if (is(jmp_cond[i])) {
+                cond = i;
+                ptok++;
+                break;
+            }
+        }
+        v = 0;
+        if (final) {
+            v = expr(prog);
+        } else {
+            ptok++;
+        }
+        ins = 0x0000 | (cond << 5) | (v & 0x1F);
+    } else if (strcasecmp(op, "wait") == 0) {
+        int pol = expr(prog) & 1;
+        int src = accept("gpio") ? 0 : accept("pin") ? 1 : accept("irq") ? 2 : -1;
+        if (src < 0) {
+            error("invalid wait source");
+        }
+        int idx = expr(prog) & 0x1F;
+        if (accept("rel")) {
+            idx |= 0x10;
+        }
+        ins = 0x2000 | (pol << 7) | (src << 5) | idx;
+    } else if (strcasecmp(op, "in") == 0) {
+        int src = operand(in_src, "source");
+        v = expr(prog);
+        ins = 0x4000 | (src << 5) | (v & 0x1F);
+    } else if (strcasecmp(op, "out") == 0) {
+        int dst = operand(out_dst, "destination");
+        v = expr(prog);
+        ins = 0x6000 | (dst << 5) | (v & 0x1F);
+    } else if ((strcasecmp(op, "push") == 0) || (strcasecmp(op, "pull") == 0)) {
+        bool pull = strcasecmp(op, "pull") == 0;
+        int cond = accept(pull ? "ifempty" : "iffull") ? 1 : 0;
+        int block = accept("noblock") ? 0 : 1;
+        accept("block");
+        ins = 0x8000 | (pull << 7) | (cond << 6) | (block << 5);
+    } else if (strcasecmp(op, "mov") == 0) {
+        int dst = operand(mov_dst, "destination");
+        int mop = 0;
+        if (accept("!") || accept("~")) {
+            mop = 1;
+        } else if (accept("::")) {
+            mop = 2;
+        }
+        int src = operand(mov_src, "source");
+        ins = 0xA000 | (dst << 5) | (mop << 3) | src;
+    } else if (strcasecmp(op, "irq") == 0) {
+        int clr = 0, wait = 0;
+        if (accept("clear")) {
+            clr = 1;
+        } else if (accept("wait")) {
+            wait = 1;
+        } else if (!accept("set")) {
+            accept("nowait");
+        }
+        int idx = expr(prog) & 0x1F;
+        if (accept("rel")) {
+            idx |= 0x10;
+        }
+        ins = 0xC000 | (clr << 6) | (wait << 5) | idx;
+    } else if (strcasecmp(op, "set") == 0) {
+        int dst = operand(set_dst, "destination");
+        v = expr(prog);
+        ins = 0xE000 | (dst << 5) | (v & 0x1F);
+    } else {
+        error("unknown instruction %s", op);
+    }
+
+    // side-set and delay
+    int side = -1, delay = 0;
+    while (ptok < ntok) {
+        if (accept("side") || accept("sideset")) {
+            side = expr(prog);
+        } else if (accept("[")) {
+            delay = expr(prog);
+            if (!accept("]")) {
+                error("] expected");
+            }
+        } else {
+            error("unexpected %s", tok[ptok]);
+        }
+    }
+    int delay_bits = 5 - p->sideset;
+    if ((delay < 0) || (delay >= (1 << delay_bits))) {
+        error("delay out of range");
+    }
+    int field = delay;
+    if (side >= 0) {
+        if (p->sideset == 0) {
+            error("side-set not enabled");
+        }
+        int side_bits = p->sideset_opt ? p->sideset - 1 : p->sideset;
+        if (side >= (1 << side_bits)) {
+            error("side-set value out of range");
+        }
+        field |= side << delay_bits;
+        if (p->sideset_opt) {
+            field |= 1 << 4;
+        }
+    } else if ((p->sideset > 0) && !p->sideset_opt) {
+        error("side-set required");
+    }
+    return ins | (field << 8);
+}
+
+// Read a % c-sdk { ... %} block
+static char *readBlock (FILE *f, const char *lang) {
+    char line[512];
+    size_t size = 0;
+    char *text = calloc(1, 1);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        if (strncmp(line, "%}", 2) == 0) {
+            break;
+        }
+        if (strcmp(lang, "c-sdk") == 0) {
+            text = realloc(text, size + strlen(line) + 1);
+            strcpy(text + size, line);
+            size += strlen(line);
+        }
+    }
+    return text;
+}
+
+// Assemble the file, pass 1 finds the labels
+static void assemble (FILE *f, bool final) {
+    char line[512];
+    int prog = -1;
+    PROG *p = NULL;
+
+    lineno = 0;
+    nprogs = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        if (line[0] == '%') {
+            char lang[32] = "";
+            sscanf(line+1, " %31[^ {\r\n]", lang);
+            char *text = readBlock(f, lang);
+            if (!final) {
+                free(text);
+            } else if (p != NULL) {
+                p->csdk = text;
+            } else {
+                glob_csdk = text;
+            }
+            continue;
+        }
+        char *c = strchr(line, ';');
+        if (c != NULL) {
+            *c = 0;
+        }
+        c = strstr(line, "//");
+        if (c != NULL) {
+            *c = 0;
+        }
+        tokenize(line);
+        if (ntok == 0) {
+            continue;
+        }
+
+        // labels
+        bool pub = false;
+        if (is("public") && (ntok > 2) && (strcmp(tok[2], ":") == 0)) {
+            pub = true;
+            ptok++;
+        }
+        if (((ptok + 1) < ntok) && (strcmp(tok[ptok+1], ":") == 0)) {
+            if (p == NULL) {
+                error("label outside program");
+            }
+            addSym(tok[ptok], p->length, prog, pub, true);
+            ptok += 2;
+            if (ptok == ntok) {
+                continue;
+            }
+        }
+
+        if (accept(".program")) {
+            if (nprogs == MAX_PROGS) {
+                error("too many programs");
+            }
+            prog = nprogs++;
+            p = &progs[prog];
+            memset(p, 0, sizeof(*p));
+            snprintf(p->name, sizeof(p->name), "%s", tok[ptok]);
+            p->wrap_target = 0;
+            p->wrap = -1;
+            p->origin = -1;
+        } else if (accept(".define")) {
+            bool dpub = accept("public");
+            char *name = tok[ptok++];
+            long v = expr(prog);
+            if (!final) {
+                addSym(name, v, prog, dpub, false);
+            }
+        } else if (p == NULL) {
+            error("directive or instruction outside program");
+        } else if (accept(".side_set")) {
+            p->sideset = expr(prog);
+            while (ptok < ntok) {
+                if (accept("opt")) {
+                    p->sideset_opt = true;
+                } else if (accept("pindirs")) {
+                    p->sideset_pindirs = true;
+                } else {
+                    error("invalid .side_set");
+                }
+            }
+            if (p->sideset_opt) {
+                p->sideset++;
+            }
+            if (p->sideset > 5) {
+                error("too many side-set bits");
+            }
+        } else if (accept(".wrap_target")) {
+            p->wrap_target = p->length;
+        } else if (accept(".wrap")) {
+            p->wrap = p->length - 1;
+        } else if (accept(".origin")) {
+            p->origin = expr(prog);
+        } else if (accept(".lang_opt") || accept(".pio_version") || accept(".clock_div") ||
+                   accept(".fifo") || accept(".in") || accept(".out") || accept(".set") ||
+                   accept(".mov_status")) {
+            // not used by the simulation
+        } else if (tok[ptok][0] == '.') {
+            error("unknown directive %s", tok[ptok]);
+        } else {
+            if (p->length == MAX_INSTR) {
+                error("program too long");
+            }
+            p->code[p->length++] = encode(p, prog, final);
+        }
+    }
+    for (int i = 0; i < nprogs; i++) {
+        if (progs[i].wrap < 0) {
+            progs[i].wrap = progs[i].length - 1;
+        }
+    }
+}
+
+int main (int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s input.pio output.h\n", argv[0]);
+        return 1;
+    }
+    fname = argv[1];
+    FILE *f = fopen(fname, "r");
+    if (f == NULL) {
+        perror(fname);
+        return 1;
+    }
+    assemble(f, false);
+    rewind(f);
+    assemble(f, true);
+    fclose(f);
+
+    FILE *out = fopen(argv[2], "w");
+    if (out == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+    fprintf(out, "// -------------------------------------------------- //\n");
+    fprintf(out, "// This file is autogenerated by pioasm; do not edit! //\n");
+    fprintf(out, "// -------------------------------------------------- //\n\n");
+    fprintf(out, "#pragma once\n\n#if !PICO_NO_HARDWARE\n#include \"hardware/pio.h\"\n#endif\n\n");
+    for (int i = 0; i < nsyms; i++) {
+        if ((syms[i].prog == -1) && syms[i].pub) {
+            fprintf(out, "#define %s %ld\n", syms[i].name, syms[i].value);
+        }
+    }
+    for (int i = 0; i < nprogs; i++) {
+        PROG *p = &progs[i];
+        fprintf(out, "\n// %s //\n\n", p->name);
+        fprintf(out, "#define %s_wrap_target %d\n", p->name, p->wrap_target);
+        fprintf(out, "#define %s_wrap %d\n\n", p->name, p->wrap);
+        for (int j = 0; j < nsyms; j++) {
+            if ((syms[j].prog == i) && syms[j].pub) {
+                fprintf(out, "#define %s_%s%s %ld\n", p->name,
+                        syms[j].label ? "offset_" : "", syms[j].name, syms[j].value);
+            }
+        }
+        fprintf(out, "\nstatic const uint16_t %s_program_instructions[] = {\n", p->name);
+        for (int j = 0; j < p->length; j++) {
+            fprintf(out, "    0x%04x,\n", p->code[j]);
+        }
+        fprintf(out, "};\n\n#if !PICO_NO_HARDWARE\n");
+        fprintf(out, "static const struct pio_program %s_program = {\n", p->name);
+        fprintf(out, "    .instructions = %s_program_instructions,\n", p->name);
+        fprintf(out, "    .length = %d,\n    .origin = %d,\n};\n\n", p->length, p->origin);
+        fprintf(out, "static inline pio_sm_config %s_program_get_default_config(uint offset) {\n", p->name);
+        fprintf(out, "    pio_sm_config c = pio_get_default_sm_config();\n");
+        fprintf(out, "    sm_config_set_wrap(&c, offset + %s_wrap_target, offset + %s_wrap);\n",
+                p->name, p->name);
+        if (p->sideset) {
+            fprintf(out, "    sm_config_set_sideset(&c, %d, %s, %s);\n", p->sideset,
+                    p->sideset_opt ? "true" : "false", p->sideset_pindirs ? "true" : "false");
+        }
+        fprintf(out, "    return c;\n}\n");
+        if (p->csdk != NULL) {
+            fprintf(out, "%s", p->csdk);
+        }
+        fprintf(out, "#endif\n");
+    }
+    if (glob_csdk != NULL) {
+        fprintf(out, "\n#if !PICO_NO_HARDWARE\n%s#endif\n", glob_csdk);
+    }
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,26 @@
+/*
+    PicoK7Sim - memory monitor
+
+    PicoK7/memory.c measures the stacks and the heap of the Pico from
+    the symbols of its linker script. In the simulation the firmware
+    runs on the stack and the heap of the host, that say nothing about
+    the Pico, so it is replaced by these functions that measure nothing
+    (use the map report of the firmware build, see the README).
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+#include "picok7.h"
+
+void memInit () {
+}
+
+void memCheck () {
+}
+
+void memReport () {
+}
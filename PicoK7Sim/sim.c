@@ -0,0 +1,658 @@
+/*
+    PicoK7Sim - host simulation of the PicoK7 firmware
+
+    Runs the real firmware sources over a shim of the Pico SDK.
+    Time is virtual: it advances when the firmware calls the shim
+    (sleeps, SPI transfers, SD access, polling the hardware). The
+    PIO state machines, DMA, timers and interrupts run as time advances.
+
+    Usage: picok7sim [options]
+        -i image   FAT image file with the SD card contents
+        -s script  script with the encoder/switch actions and checks
+        -e file    dump the EAR waveform (VCD)
+        -o gpio    output dumped by -e (default PIN_EAR)
+        -a file    WAV file played in the tape input (ADC, regenerator)
+        -p         stdio over a pseudo terminal (for k7upload)
+        -r         don't let the virtual time run ahead of the real time
+        -t secs    stop after secs of virtual time
+        -v         verbose
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#define SIM_INTERNAL
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/pio.h"
+
+#include "picok7.h"
+#include "sim.h"
+
+#define SLICE_NS        10000ull    // max time advanced in one step
+#define POLL_MIN_NS     1000ull     // cost of polling the hardware
+#define POLL_MAX_NS     50000ull    // max cost after many polls
+#define MAX_TIMERS      16
+#define MAX_HANDLERS    4
+#define MAX_PIN_EVENTS  64
+#define STEP_NS         3000000ull  // time between encoder transitions
+#define EXPECT_MS       5000        // default expect timeout
+#define NEVER           UINT64_MAX
+
+extern int picok7_main (void);
+
+uint64_t sim_now;
+SIM_COUNTERS sim_cnt;
+bool sim_verbose;
+
+static bool in_irq;
+static bool irq_masked;     // save_and_disable_interrupts
+static uint64_t poll_ns = POLL_MIN_NS;
+static uint64_t prf_time[PRF_COUNT];
+static const char *prf_name[PRF_COUNT] = { "sleep/busy wait", "polling", "SPI (display)", "SD card", "USB stdio" };
+static uint64_t max_time = NEVER;
+static bool real_time;
+static struct timespec wall_start;
+
+// Timers and alarms
+static struct {
+    bool used;
+    uint64_t at;
+    struct repeating_timer *rt;
+    alarm_callback_t callback;
+    void *user_data;
+    alarm_id_t id;
+} timers[MAX_TIMERS];
+static alarm_id_t last_id;
+
+// Interrupts
+static irq_handler_t handlers[NUM_IRQS][MAX_HANDLERS];
+static bool irq_enabled[NUM_IRQS];
+
+// Script
+static FILE *script;
+static int script_line;
+static uint64_t script_next = NEVER;     // time to run the next command
+static char expect_text[80];
+static uint64_t expect_deadline;
+static struct {
+    uint64_t at;
+    uint pin;
+    int level;
+} pin_events[MAX_PIN_EVENTS];
+static int n_pin_events;
+
+static void timersFire (void);
+static uint64_t timersNext (void);
+static void irqRaise (uint num);
+static void scriptRun (void);
+static void pace (void);
+static void profile (void);
+static double wallTime (void);
+
+int main (int argc, char *argv[]) {
+    const char *image = NULL;
+    const char *ear = NULL;
+    const char *pty = NULL;
+    uint ear_pin = PIN_EAR;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:s:e:o:a:prt:v")) != -1) {
+        switch (opt) {
+            case 'i':
+                image = optarg;
+                break;
+            case 's':
+                script = fopen(optarg, "r");
+                if (script == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                script_next = 0;
+                break;
+            case 'e':
+                ear = optarg;
+                break;
+            case 'o':
+                ear_pin = atoi(optarg);
+                break;
+            case 'a':
+                if (!adcOpen(optarg)) {
+                    return 1;
+                }
+                break;
+            case 'p':
+                pty = "";
+                real_time = true;
+                break;
+            case 'r':
+                real_time = true;
+                break;
+            case 't':
+                max_time = (uint64_t) (atof(optarg) * 1e9);
+                break;
+            case 'v':
+                sim_verbose = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-i image] [-s script] [-e ear.vcd] [-o gpio] [-a tape.wav] [-p] [-r] [-t secs] [-v]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if ((image != NULL) && !diskOpen(image)) {
+        return 1;
+    }
+    gpioSimInit();
+    pioSimInit();
+    dmaSimInit();
+    lcdSimInit();
+    stdioSimInit(pty);
+    if (ear != NULL) {
+        earOpen(ear, ear_pin);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    atexit(profile);
+
+    picok7_main();
+    return 0;
+}
+
+// Advance the virtual time
+void simAdvance (uint64_t ns, SIM_PROFILE prf) {
+    uint64_t end = sim_now + ns;
+    prf_time[prf] += ns;
+    while (sim_now < end) {
+        uint64_t t = end;
+        if ((t - sim_now) > SLICE_NS) {
+            t = sim_now + SLICE_NS;
+        }
+        uint64_t next = timersNext();
+        if ((next > sim_now) && (next < t)) {
+            t = next;
+        }
+        if ((script_next > sim_now) && (script_next < t)) {
+            t = script_next;
+        }
+        if ((n_pin_events > 0) && (pin_events[0].at > sim_now) && (pin_events[0].at < t)) {
+            t = pin_events[0].at;
+        }
+        dmaRun(t);
+        pioRun(t);
+        sim_now = t;
+        if (!in_irq && !irq_masked) {
+            timersFire();
+            pioIrqCheck();
+            dmaIrqCheck();
+            scriptRun();
+        }
+        if (sim_now >= max_time) {
+            simLog("time limit reached");
+            exit(0);
+        }
+        if (real_time) {
+            pace();
+        }
+    }
+}
+
+// The firmware is polling the hardware
+// Consecutive polls without activity cost more, so busy loops run fast
+void simPoll () {
+    if (in_irq) {
+        return;
+    }
+    simAdvance(poll_ns, PRF_POLL);
+    if (poll_ns < POLL_MAX_NS) {
+        poll_ns += poll_ns/4;
+    }
+}
+
+// The firmware did something (the next poll is cheap again)
+void simActivity () {
+    poll_ns = POLL_MIN_NS;
+}
+
+bool simInIrq () {
+    return in_irq;
+}
+
+// Log with the virtual time
+void simLog (const char *fmt, ...) {
+    va_list va;
+    fprintf(stderr, "[%12.6f] ", sim_now / 1e9);
+    va_start(va, fmt);
+    vfprintf(stderr, fmt, va);
+    va_end(va);
+    fputc('\n', stderr);
+}
+
+// Fatal error (script check failed)
+void simError (const char *fmt, ...) {
+    va_list va;
+    fprintf(stderr, "[%12.6f] ERROR: ", sim_now / 1e9);
+    va_start(va, fmt);
+    vfprintf(stderr, fmt, va);
+    va_end(va);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+// Don't let the virtual time run ahead of the real time
+static void pace () {
+    double ahead = sim_now / 1e9 - wallTime();
+    if (ahead > 0.001) {
+        struct timespec ts = { 0, (long) (ahead * 1e9) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static double wallTime () {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - wall_start.tv_sec) + (ts.tv_nsec - wall_start.tv_nsec) / 1e9;
+}
+
+// Print where the time was spent
+static void profile () {
+    earClose();
+    double wall = wallTime();
+    fprintf(stderr, "\n--- Profile ---\n");
+    fprintf(stderr, "Virtual time %.3f s, real time %.3f s (%.1fx)\n",
+            sim_now / 1e9, wall, wall > 0 ? sim_now / 1e9 / wall : 0.0);
+    uint64_t total = 0;
+    for (int i = 0; i < PRF_COUNT; i++) {
+        total += prf_time[i];
+    }
+    for (int i = 0; i < PRF_COUNT; i++) {
+        fprintf(stderr, "  %-16s %10.3f ms %5.1f%%\n", prf_name[i], prf_time[i] / 1e6,
+                total ? 100.0 * prf_time[i] / total : 0.0);
+    }
+    for (int p = 0; p < 2; p++) {
+        for (int sm = 0; sm < 4; sm++) {
+            if (sim_cnt.pio_instr[p][sm]) {
+                fprintf(stderr, "  pio%d sm%d: %llu cycles, %llu words put\n", p, sm,
+                        (unsigned long long) sim_cnt.pio_instr[p][sm],
+                        (unsigned long long) sim_cnt.pio_put[p][sm]);
+            }
+        }
+    }
+    fprintf(stderr, "  SPI %llu bytes, SD %llu sectors read %llu written, DMA %llu transfers\n",
+            (unsigned long long) sim_cnt.spi_bytes, (unsigned long long) sim_cnt.sd_read,
+            (unsigned long long) sim_cnt.sd_write, (unsigned long long) sim_cnt.dma_transfers);
+    fprintf(stderr, "  %llu timer callbacks, %llu interrupts\n",
+            (unsigned long long) sim_cnt.timer_calls, (unsigned long long) sim_cnt.irq_calls);
+}
+
+
+// Time
+//---------------------------
+
+uint64_t time_us_64 () {
+    simPoll();
+    return sim_now / 1000;
+}
+
+uint32_t time_us_32 () {
+    return (uint32_t) time_us_64();
+}
+
+void sleep_us (uint64_t us) {
+    simActivity();
+    simAdvance(us * 1000, PRF_SLEEP);
+}
+
+void sleep_ms (uint32_t ms) {
+    sleep_us(ms * 1000ull);
+}
+
+void sleep_until (absolute_time_t t) {
+    if ((t * 1000) > sim_now) {
+        simAdvance(t * 1000 - sim_now, PRF_SLEEP);
+    }
+}
+
+void busy_wait_us_32 (uint32_t us) {
+    sleep_us(us);
+}
+
+void busy_wait_us (uint64_t us) {
+    sleep_us(us);
+}
+
+void busy_wait_ms (uint32_t ms) {
+    sleep_us(ms * 1000ull);
+}
+
+void busy_wait_until (absolute_time_t t) {
+    sleep_until(t);
+}
+
+
+// Timers and alarms
+//---------------------------
+
+static int timerAlloc (uint64_t at) {
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        if (!timers[i].used) {
+            memset(&timers[i], 0, sizeof(timers[i]));
+            timers[i].used = true;
+            timers[i].at = at;
+            timers[i].id = ++last_id;
+            return i;
+        }
+    }
+    simLog("too many timers");
+    return -1;
+}
+
+bool add_repeating_timer_us (int64_t delay_us, repeating_timer_callback_t callback,
+                             void *user_data, struct repeating_timer *out) {
+    uint64_t delay = (delay_us < 0 ? -delay_us : delay_us) * 1000;
+    int i = timerAlloc(sim_now + delay);
+    if (i < 0) {
+        return false;
+    }
+    out->delay_us = delay_us;
+    out->callback = callback;
+    out->user_data = user_data;
+    out->alarm_id = timers[i].id;
+    out->pool = NULL;
+    timers[i].rt = out;
+    return true;
+}
+
+bool cancel_repeating_timer (struct repeating_timer *timer) {
+    return cancel_alarm(timer->alarm_id);
+}
+
+alarm_id_t add_alarm_at (absolute_time_t time, alarm_callback_t callback, void *user_data,
+                         bool fire_if_past) {
+    uint64_t at = time * 1000;
+    if (at <= sim_now) {
+        if (!fire_if_past) {
+            return 0;
+        }
+        at = sim_now;
+    }
+    int i = timerAlloc(at);
+    if (i < 0) {
+        return -1;
+    }
+    timers[i].callback = callback;
+    timers[i].user_data = user_data;
+    return timers[i].id;
+}
+
+bool cancel_alarm (alarm_id_t id) {
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        if (timers[i].used && (timers[i].id == id)) {
+            timers[i].used = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t timersNext () {
+    uint64_t next = NEVER;
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        if (timers[i].used && (timers[i].at < next)) {
+            next = timers[i].at;
+        }
+    }
+    return next;
+}
+
+// Call the expired timers (in interrupt context)
+static void timersFire () {
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        if (!timers[i].used || (timers[i].at > sim_now)) {
+            continue;
+        }
+        sim_cnt.timer_calls++;
+        in_irq = true;
+        if (timers[i].rt != NULL) {
+            struct repeating_timer *rt = timers[i].rt;
+            int64_t delay = rt->delay_us < 0 ? -rt->delay_us : rt->delay_us;
+            if (rt->callback(rt) && timers[i].used) {
+                timers[i].at += delay * 1000;
+            } else {
+                timers[i].used = false;
+            }
+        } else {
+            timers[i].used = false;
+            int64_t r = timers[i].callback(timers[i].id, timers[i].user_data);
+            if (r != 0) {
+                // reschedule the same alarm
+                timers[i].used = true;
+                timers[i].at = r > 0 ? timers[i].at + r * 1000 : sim_now - r * 1000;
+            }
+        }
+        in_irq = false;
+    }
+}
+
+
+// Interrupts
+//---------------------------
+
+void irq_set_enabled (uint num, bool enabled) {
+    irq_enabled[num] = enabled;
+}
+
+bool irq_is_enabled (uint num) {
+    return irq_enabled[num];
+}
+
+void irq_set_exclusive_handler (uint num, irq_handler_t handler) {
+    memset(handlers[num], 0, sizeof(handlers[num]));
+    handlers[num][0] = handler;
+}
+
+void irq_add_shared_handler (uint num, irq_handler_t handler, uint8_t order_priority) {
+    (void) order_priority;
+    for (int i = 0; i < MAX_HANDLERS; i++) {
+        if (handlers[num][i] == NULL) {
+            handlers[num][i] = handler;
+            return;
+        }
+    }
+    simLog("too many handlers for irq %u", num);
+}
+
+void irq_remove_handler (uint num, irq_handler_t handler) {
+    for (int i = 0; i < MAX_HANDLERS; i++) {
+        if (handlers[num][i] == handler) {
+            handlers[num][i] = NULL;
+        }
+    }
+}
+
+void irq_set_priority (uint num, uint8_t hardware_priority) {
+    (void) num;
+    (void) hardware_priority;
+}
+
+uint32_t save_and_disable_interrupts () {
+    uint32_t status = irq_masked;
+    irq_masked = true;
+    return status;
+}
+
+void restore_interrupts (uint32_t status) {
+    irq_masked = status != 0;
+}
+
+// An interrupt line is active
+void simIrq (uint num) {
+    if (in_irq || irq_masked || !irq_enabled[num]) {
+        return;
+    }
+    irqRaise(num);
+}
+
+static void irqRaise (uint num) {
+    in_irq = true;
+    for (int i = 0; i < MAX_HANDLERS; i++) {
+        if (handlers[num][i] != NULL) {
+            sim_cnt.irq_calls++;
+            handlers[num][i]();
+        }
+    }
+    in_irq = false;
+}
+
+
+// Script
+//---------------------------
+
+// Schedule a change in a pin driven by the "user"
+static void pinEvent (uint64_t at, uint pin, int level) {
+    if (n_pin_events == MAX_PIN_EVENTS) {
+        simError("script: too many pending pin changes");
+    }
+    int i = n_pin_events++;
+    while ((i > 0) && (pin_events[i-1].at > at)) {
+        pin_events[i] = pin_events[i-1];
+        i--;
+    }
+    pin_events[i].at = at;
+    pin_events[i].pin = pin;
+    pin_events[i].level = level;
+}
+
+// Rotate the encoder, returns when it ends
+// Pins rest high; up is A low first, down is B low first
+static uint64_t rotate (uint64_t t, int n, bool up) {
+    uint first = up ? PIN_ENC_CLK : PIN_ENC_DT;
+    uint second = up ? PIN_ENC_DT : PIN_ENC_CLK;
+    while (n--) {
+        pinEvent(t += STEP_NS, first, 0);
+        pinEvent(t += STEP_NS, second, 0);
+        pinEvent(t += STEP_NS, first, 1);
+        pinEvent(t += STEP_NS, second, 1);
+    }
+    return t + STEP_NS;
+}
+
+// Execute a script command
+// Returns false if must wait before the next one
+static bool scriptCmd (char *line) {
+    char *cmd = strtok(line, " \t\r\n");
+    char *arg = strtok(NULL, "\r\n");
+    int n;
+
+    if ((cmd == NULL) || (cmd[0] == '#')) {
+        return true;
+    }
+    n = (arg != NULL) ? atoi(arg) : 0;
+    if (strcmp(cmd, "wait") == 0) {
+        script_next = sim_now + n * 1000000ull;
+        return false;
+    } else if ((strcmp(cmd, "up") == 0) || (strcmp(cmd, "dn") == 0)) {
+        script_next = rotate(sim_now, n > 0 ? n : 1, cmd[0] == 'u');
+        return false;
+    } else if (strcmp(cmd, "enter") == 0) {
+        pinEvent(sim_now, PIN_ENC_SW, 0);
+        pinEvent(sim_now + 200000000ull, PIN_ENC_SW, 1);
+        script_next = sim_now + 300000000ull;
+        return false;
+    } else if (strcmp(cmd, "pin") == 0) {
+        uint pin;
+        char level;
+        if ((arg == NULL) || (sscanf(arg, "%u %c", &pin, &level) != 2) || (pin >= NUM_BANK0_GPIOS)) {
+            simError("script line %d: pin number level", script_line);
+        }
+        gpioExternal(pin, level == 'z' ? -1 : level - '0');
+        return true;
+    } else if (strcmp(cmd, "expect") == 0) {
+        int timeout = EXPECT_MS;
+        if (arg == NULL) {
+            simError("script line %d: expect text", script_line);
+        }
+        if (arg[0] == '"') {
+            char *end = strchr(arg+1, '"');
+            if (end == NULL) {
+                simError("script line %d: missing quote", script_line);
+            }
+            *end = 0;
+            if (atoi(end+1) > 0) {
+                timeout = atoi(end+1);
+            }
+            arg++;
+        }
+        snprintf(expect_text, sizeof(expect_text), "%s", arg);
+        expect_deadline = sim_now + timeout * 1000000ull;
+        script_next = sim_now;
+        return false;
+    } else if (strcmp(cmd, "screen") == 0) {
+        simLog("screen:");
+        lcdPrint(stderr);
+        return true;
+    } else if (strcmp(cmd, "led") == 0) {
+        uint32_t grb = ledColor();
+        simLog("LED R=%u G=%u B=%u", (grb >> 16) & 0xFF, grb >> 24, (grb >> 8) & 0xFF);
+        return true;
+    } else if (strcmp(cmd, "shot") == 0) {
+        if ((arg == NULL) || !lcdShot(arg)) {
+            simError("script line %d: cannot write screen shot", script_line);
+        }
+        return true;
+    } else if (strcmp(cmd, "echo") == 0) {
+        simLog("%s", arg != NULL ? arg : "");
+        return true;
+    } else if (strcmp(cmd, "quit") == 0) {
+        simLog("end of script");
+        exit(0);
+    }
+    simError("script line %d: unknown command %s", script_line, cmd);
+    return false;
+}
+
+// Run the script (called as time advances)
+static void scriptRun () {
+    char line[256];
+
+    while ((n_pin_events > 0) && (pin_events[0].at <= sim_now)) {
+        gpioExternal(pin_events[0].pin, pin_events[0].level);
+        n_pin_events--;
+        memmove(pin_events, pin_events+1, n_pin_events * sizeof(pin_events[0]));
+    }
+    if (sim_now < script_next) {
+        return;
+    }
+    if (expect_text[0]) {
+        if (lcdFind(expect_text)) {
+            if (sim_verbose) {
+                simLog("found \"%s\"", expect_text);
+            }
+            expect_text[0] = 0;
+        } else if (sim_now >= expect_deadline) {
+            lcdPrint(stderr);
+            simError("script line %d: \"%s\" not found", script_line, expect_text);
+        } else {
+            script_next = sim_now + 1000000ull;     // check again in 1 ms
+            return;
+        }
+    }
+    while (fgets(line, sizeof(line), script) != NULL) {
+        script_line++;
+        if (sim_verbose && !isspace((unsigned char) line[0]) && (line[0] != '#')) {
+            simLog("> %.*s", (int) strcspn(line, "\r\n"), line);
+        }
+        if (!scriptCmd(line)) {
+            return;
+        }
+    }
+    script_next = NEVER;
+}
@@ -0,0 +1,100 @@
+/*
+    PicoK7Sim - host simulation of the PicoK7 firmware
+    Internal definitions shared by the simulator modules
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico.h"
+
+// Virtual time, in ns
+extern uint64_t sim_now;
+
+// Where the virtual time was spent (for the profile)
+typedef enum {
+    PRF_SLEEP,      // sleep_xx and busy_wait_xx
+    PRF_POLL,       // polling hardware (FIFO status, time, stdio)
+    PRF_SPI,        // SPI transfers (display)
+    PRF_SD,         // SD card access
+    PRF_USB,        // stdio over USB
+    PRF_COUNT
+} SIM_PROFILE;
+
+// Counters shown in the profile
+typedef struct {
+    uint64_t pio_instr[2][4];
+    uint64_t pio_put[2][4];
+    uint64_t spi_bytes;
+    uint64_t sd_read, sd_write;
+    uint64_t dma_transfers;
+    uint64_t timer_calls;
+    uint64_t irq_calls;
+} SIM_COUNTERS;
+
+extern SIM_COUNTERS sim_cnt;
+
+// Options
+extern bool sim_verbose;
+
+// sim.c
+void simAdvance (uint64_t ns, SIM_PROFILE prf);
+void simPoll (void);
+void simActivity (void);
+bool simInIrq (void);
+void simIrq (uint num);
+void simLog (const char *fmt, ...);
+void simError (const char *fmt, ...);
+
+// gpio.c
+void gpioSimInit (void);
+bool gpioLevel (uint pin);
+void gpioExternal (uint pin, int level);
+void gpioPioOut (uint pio, uint pin, bool value, uint64_t t);
+void gpioPioDir (uint pio, uint pin, bool out, uint64_t t);
+uint32_t gpioAll (void);
+void earOpen (const char *file, uint pin);
+void earClose (void);
+uint32_t ledColor (void);
+
+// pio.c
+void pioSimInit (void);
+void pioRun (uint64_t t_end);
+void pioIrqCheck (void);
+bool pioFifoWrite (volatile void *addr, uint32_t data);
+bool pioFifoRead (const volatile void *addr, uint32_t *data);
+bool pioDreq (uint dreq);
+void pioClockChanged (void);
+
+// dma.c
+void dmaSimInit (void);
+void dmaRun (uint64_t t_end);
+void dmaIrqCheck (void);
+
+// adc.c
+bool adcOpen (const char *file);
+bool adcDreq (uint64_t t_end);
+bool adcFifoRead (const volatile void *addr, uint32_t *data);
+
+// lcd.c
+void lcdSimInit (void);
+void lcdSpiWrite (const uint8_t *data, size_t len);
+void lcdPinChanged (uint pin, bool level);
+bool lcdFind (const char *text);
+void lcdPrint (FILE *f);
+bool lcdShot (const char *file);
+
+// stdio.c
+void stdioSimInit (const char *pty);
+bool stdioRealTime (void);
+
+// diskio.c
+bool diskOpen (const char *image);
+
+#endif
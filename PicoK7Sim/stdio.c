@@ -0,0 +1,141 @@
+/*
+    PicoK7Sim - stdio over "USB"
+
+    Without -p the output goes to stdout and there is no input.
+    With -p a pseudo terminal is created and used as the USB CDC port
+    (the host tools, like k7upload, can open it).
+
+    (C) 2026, Daniel Quadros
+    MIT License
+*/
+
+#define SIM_INTERNAL
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+
+#include "pico/stdlib.h"
+
+#include "sim.h"
+
+#define BYTE_NS 1000    // USB full speed CDC, about 1 MB/s
+
+static int master = -1;
+static int slave = -1;
+static uint8_t rxbuf[256];
+static int rx_n, rx_pos;
+
+void stdioSimInit (const char *pty) {
+    if (pty == NULL) {
+        return;
+    }
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((master < 0) || (grantpt(master) < 0) || (unlockpt(master) < 0)) {
+        perror("pty");
+        exit(1);
+    }
+    const char *name = ptsname(master);
+    // Keep the slave open, so the master doesn't see EOF between connections
+    slave = open(name, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if ((slave >= 0) && (tcgetattr(slave, &tio) == 0)) {
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+    }
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    fprintf(stderr, "USB stdio on %s\n", name);
+}
+
+static void output (const char *buf, int n) {
+    if (n <= 0) {
+        return;
+    }
+    if (master >= 0) {
+        while (n > 0) {
+            ssize_t w = write(master, buf, n);
+            if (w > 0) {
+                buf += w;
+                n -= w;
+            } else {
+                usleep(1000);   // the other side is not reading
+            }
+        }
+    } else {
+        fwrite(buf, 1, n, stdout);
+        fflush(stdout);
+    }
+}
+
+bool stdio_init_all () {
+    return true;
+}
+
+bool stdio_usb_connected () {
+    return true;
+}
+
+void stdio_flush () {
+}
+
+int putchar_raw (int c) {
+    char ch = c;
+    output(&ch, 1);
+    simAdvance(BYTE_NS, PRF_USB);
+    return c;
+}
+
+int puts_raw (const char *s) {
+    int n = strlen(s);
+    output(s, n);
+    output("\n", 1);
+    simAdvance((n + 1) * BYTE_NS, PRF_USB);
+    return n;
+}
+
+// printf from the firmware (\n becomes \r\n, like the SDK)
+int sim_printf (const char *fmt, ...) {
+    char buf[1024];
+    char out[2048];
+    va_list va;
+    va_start(va, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, va);
+    va_end(va);
+    if (n >= (int) sizeof(buf)) {
+        n = sizeof(buf) - 1;
+    }
+    int j = 0;
+    for (int i = 0; i < n; i++) {
+        if ((buf[i] == '\n') && (master >= 0)) {
+            out[j++] = '\r';
+        }
+        out[j++] = buf[i];
+    }
+    output(out, j);
+    simAdvance(j * BYTE_NS, PRF_USB);
+    return n;
+}
+
+int getchar_timeout_us (uint32_t timeout_us) {
+    if ((rx_pos == rx_n) && (master >= 0)) {
+        ssize_t n = read(master, rxbuf, sizeof(rxbuf));
+        if (n > 0) {
+            rx_n = n;
+            rx_pos = 0;
+        }
+    }
+    if (rx_pos < rx_n) {
+        simActivity();
+        simAdvance(BYTE_NS, PRF_USB);
+        return rxbuf[rx_pos++];
+    }
+    if (timeout_us) {
+        simAdvance(timeout_us * 1000ull, PRF_SLEEP);
+    } else {
+        simPoll();
+    }
+    return PICO_ERROR_TIMEOUT;
+}